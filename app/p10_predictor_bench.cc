@@ -0,0 +1,95 @@
+// EPOS SmartData Predictor Benchmark
+
+#include <utility/ostream.h>
+#include <utility/math.h>
+#include <utility/predictor.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+typedef unsigned long long Time_Stamp;
+typedef float Value;
+
+const unsigned int SAMPLES = 5000;
+const Time_Stamp PERIOD = 1000000; // us
+const unsigned int WINDOW = 20;
+const unsigned int BOUNDS = 3;
+const Value BOUND[BOUNDS] = {0.25f, 0.5f, 1.0f}; // absolute error acceptable at the sink
+
+// Deterministic noise in [-0.2, 0.2), so every run sees the same traces
+unsigned int seed;
+Value noise() { seed = seed * 1103515245 + 12345; return ((seed >> 16) % 400) / 1000.0f - 0.2f; }
+
+// Synthetic traces, after the sensors SmartData usually covers
+Value trend(unsigned int i) { return 20 + i * 0.002f + noise(); }                                    // slow warm-up of a temperature sensor
+Value drift(unsigned int i) { unsigned int p = i % 1000; return 50 + ((p < 500) ? p : 1000 - p) * 0.02f + noise(); } // a daily cycle, linearized
+Value steps(unsigned int i) { return 100 + 5 * ((i / 250) % 4) + noise(); }                         // a setpoint switched from time to time
+
+struct Result
+{
+    unsigned int sent;
+    Value max_error;
+    Value mean_error;
+};
+
+// The source trickles every sample and, whenever its predictor cannot suppress one, ships the model to the sink, as SmartData
+// does in its Responses. The sink's predictions are then the values the application at the sink sees.
+template<typename Predictor>
+Result run(const typename Predictor::Configuration & config, Value (* trace)(unsigned int))
+{
+    Predictor source(config);
+    Predictor sink(config, true);
+    Result result = {0, 0, 0};
+    float total = 0;
+
+    seed = 1;
+    for(unsigned int i = 0; i < SAMPLES; i++) {
+        Time_Stamp t = (i + 1) * PERIOD;
+        Value v = trace(i);
+
+        if(!source.trickle(t, v)) {
+            sink.update(source.model(), true);
+            result.sent++;
+        }
+
+        Value error = abs(v - sink.predict(t));
+        if(error > result.max_error)
+            result.max_error = error;
+        total += error;
+    }
+    result.mean_error = total / SAMPLES;
+
+    return result;
+}
+
+void print(const char * predictor, const char * trace, Value bound, const Result & r)
+{
+    cout << predictor << "\t" << trace << "\t" << bound << "\t" << r.sent << "\t" << (SAMPLES - r.sent) * 100 / SAMPLES << "%\t"
+         << r.max_error << "\t" << r.mean_error << endl;
+}
+
+void bench(const char * name, Value (* trace)(unsigned int))
+{
+    for(unsigned int b = 0; b < BOUNDS; b++) {
+        print("LVP", name, BOUND[b], run<LVP<Time_Stamp, Value>>(LVP<Time_Stamp, Value>::Configuration(0, BOUND[b], 0), trace));
+        print("DBP", name, BOUND[b], run<DBP<Time_Stamp, Value>>(DBP<Time_Stamp, Value>::Configuration(0, BOUND[b], 0, WINDOW, WINDOW / 4), trace));
+        print("LSP", name, BOUND[b], run<LSP<Time_Stamp, Value>>(LSP<Time_Stamp, Value>::Configuration(0, BOUND[b], 0, WINDOW), trace));
+        print("KFP", name, BOUND[b], run<KFP<Time_Stamp, Value>>(KFP<Time_Stamp, Value>::Configuration(0, BOUND[b], 0, 0.001f, 0.015f), trace));
+    }
+}
+
+int main()
+{
+    cout << "P10 SmartData Predictor Benchmark" << endl;
+    cout << SAMPLES << " samples per trace, " << PERIOD / 1000 << " ms apart" << endl;
+    cout << "pred\ttrace\tbound\tsent\tsuppr\tmax err\tmean err" << endl;
+
+    bench("trend", &trend);
+    bench("drift", &drift);
+    bench("steps", &steps);
+
+    cout << "Done!" << endl;
+
+    return 0;
+}
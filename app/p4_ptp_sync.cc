@@ -0,0 +1,34 @@
+// EPOS DIRP PTP-like Clock Synchronization Test Program
+
+#include <time.h>
+
+#include <machine/nic.h>
+#include <communicator.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+const int ROUNDS = 30;
+const int PERIOD = 1000000; // us
+
+int main()
+{
+    cout << "P4 PTP Synchronization Test" << endl;
+    DIRP::init(0);
+
+    DIRP::Address self = DIRP::get_by_nic(0)->address();
+    cout << "  MAC: " << self << endl;
+
+    if(self[5] == 9)
+        cout << "  Master: sending SYNC every " << DIRP::PTP_SYNC_PERIOD << " us" << endl;
+    else
+        cout << "  Slave: reporting residual offset to the master (us)" << endl;
+
+    for(int i = 0; i < ROUNDS; i++) {
+        Alarm::delay(PERIOD);
+        cout << "  t=" << DIRP::PTP::now() << " sync=" << DIRP::PTP::synchronized() << " stats=" << DIRP::PTP::statistics() << endl;
+    }
+
+    return 0;
+}
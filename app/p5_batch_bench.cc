@@ -0,0 +1,99 @@
+// EPOS Batched Send/Receive Benchmark
+
+#include <time.h>
+
+#include <machine/nic.h>
+#include <communicator.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+typedef Communicator_Common<UDP, true> Communicator;
+
+const unsigned int PACKETS = 4096;
+const unsigned int BATCH = Network_Common::MAX_BATCH;
+const unsigned int DATA_SIZE = 64;
+const UDP::Port PORT = 5555;
+const Communicator::Microsecond IDLE = 2000000; // us without traffic ends a round
+
+char data[DATA_SIZE];
+
+void sender(const IP::Address & peer);
+void receiver();
+
+int main()
+{
+    cout << "P5 Batched Send/Receive Benchmark" << endl;
+
+    IP * ip = IP::get_by_nic(0);
+    IP::Address self = ip->address();
+    cout << "  IP: " << self << endl;
+
+    if(self[3] % 2) {  // sender
+        IP::Address peer = self;
+        peer[3]--;
+        Alarm::delay(2000000);
+        sender(peer);
+    } else  // receiver
+        receiver();
+
+    return 0;
+}
+
+void sender(const IP::Address & peer)
+{
+    Communicator comm(PORT);
+    UDP::Address to(peer, PORT);
+    Chronometer chrono;
+
+    // One frame and one doorbell per send()
+    chrono.start();
+    for(unsigned int i = 0; i < PACKETS; i++)
+        comm.send(to, data, DATA_SIZE);
+    chrono.stop();
+    cout << "  single: " << PACKETS << " packets in " << chrono.read() << " us => " << PACKETS * 1000000ULL / chrono.read() << " packets/s" << endl;
+
+    Alarm::delay(IDLE * 2);
+
+    // BATCH frames and one doorbell per send_batch()
+    Communicator::Message_Desc msgs[BATCH];
+    for(unsigned int i = 0; i < BATCH; i++) {
+        msgs[i].to = to;
+        msgs[i].data = data;
+        msgs[i].size = DATA_SIZE;
+    }
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < PACKETS; i += BATCH)
+        comm.send_batch(msgs, BATCH);
+    chrono.stop();
+    cout << "  batch(" << BATCH << "): " << PACKETS << " packets in " << chrono.read() << " us => " << PACKETS * 1000000ULL / chrono.read() << " packets/s" << endl;
+}
+
+void receiver()
+{
+    Communicator comm(PORT);
+    Communicator::Buffer * bufs[BATCH];
+
+    for(unsigned int round = 0; round < 2; round++) {
+        Chronometer chrono;
+        unsigned int received = 0;
+        unsigned int wakeups = 0;
+
+        // Block for the first packet, then drain until the sender goes quiet
+        unsigned int n = comm.receive_batch(bufs, BATCH);
+        chrono.start();
+        while(n) {
+            for(unsigned int i = 0; i < n; i++)
+                comm.receive(bufs[i], data, DATA_SIZE);
+            received += n;
+            wakeups++;
+            chrono.lap();
+            n = comm.receive_batch(bufs, BATCH, IDLE);
+        }
+
+        cout << "  round " << round << ": " << received << " packets in " << wakeups << " wakeups, " << chrono.read() << " us => " << (chrono.read() ? received * 1000000ULL / chrono.read() : 0) << " packets/s" << endl;
+    }
+}
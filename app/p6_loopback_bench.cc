@@ -0,0 +1,130 @@
+// EPOS Loopback NIC Network Benchmark
+// Runs over the Loopback NIC selected by Traits<Build>::LOOPBACK in its traits
+// Link latency, loss and bandwidth can be emulated through Traits<Loopback>
+
+#include <time.h>
+#include <process.h>
+#include <synchronizer.h>
+
+#include <machine/nic.h>
+#include <communicator.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+typedef Communicator_Common<UDP, true> Communicator;
+
+const unsigned int PACKETS = 4096;
+const unsigned int WINDOW = 32;   // packets in flight during the throughput test
+const unsigned int ROUNDS = 256;  // ping-pongs during the latency test
+const unsigned int DATA_SIZE = 1024;
+
+const UDP::Port SINK = 5555;
+const UDP::Port ECHO = 7;
+const UDP::Port CLIENT = 7777;
+
+char data[DATA_SIZE];
+IP::Address self;
+Semaphore credits(WINDOW);
+
+int sink()
+{
+    Communicator comm(SINK);
+    Communicator::Buffer * bufs[WINDOW];
+    char tmp[DATA_SIZE];
+
+    for(unsigned int received = 0; received < PACKETS; ) {
+        unsigned int n = comm.receive_batch(bufs, WINDOW);
+        for(unsigned int i = 0; i < n; i++) {
+            comm.receive(bufs[i], tmp, DATA_SIZE);
+            credits.v();
+        }
+        received += n;
+    }
+
+    return 0;
+}
+
+int echo()
+{
+    Communicator comm(ECHO);
+    char tmp[DATA_SIZE];
+
+    for(unsigned int i = 0; i < ROUNDS; i++) {
+        int size = comm.receive(tmp, DATA_SIZE);
+        comm.send(UDP::Address(self, CLIENT), tmp, size);
+    }
+
+    return 0;
+}
+
+void throughput()
+{
+    Thread * receiver = new Thread(&sink);
+    Communicator comm(CLIENT);
+    UDP::Address to(self, SINK);
+    Chronometer chrono;
+
+    chrono.start();
+    for(unsigned int i = 0; i < PACKETS; i++) {
+        credits.p();
+        comm.send(to, data, DATA_SIZE);
+    }
+    receiver->join();
+    chrono.stop();
+
+    Chronometer::Microsecond t = chrono.read();
+    cout << "  throughput: " << PACKETS << " x " << DATA_SIZE << " bytes in " << t << " us => "
+         << PACKETS * 1000000ULL / t << " packets/s, " << PACKETS * DATA_SIZE * 8ULL / t << " Mbit/s" << endl;
+
+    delete receiver;
+}
+
+void latency()
+{
+    Thread * server = new Thread(&echo);
+    Communicator comm(CLIENT);
+    UDP::Address to(self, ECHO);
+    Chronometer chrono;
+    Chronometer::Microsecond min = -1UL, max = 0, total = 0;
+
+    for(unsigned int i = 0; i < ROUNDS; i++) {
+        chrono.reset();
+        chrono.start();
+        comm.send(to, data, DATA_SIZE);
+        comm.receive(data, DATA_SIZE);
+        chrono.stop();
+
+        Chronometer::Microsecond rtt = chrono.read();
+        total += rtt;
+        if(rtt < min)
+            min = rtt;
+        if(rtt > max)
+            max = rtt;
+    }
+    server->join();
+
+    cout << "  latency: " << ROUNDS << " round trips of " << DATA_SIZE << " bytes => rtt min=" << min << " avg=" << total / ROUNDS << " max=" << max << " us" << endl;
+
+    delete server;
+}
+
+int main()
+{
+    cout << "P6 Loopback Network Benchmark" << endl;
+
+    NIC<Ethernet> * nic = Loopback::get(0);
+    self = IP::get_by_nic(0)->address();
+    cout << "  MAC: " << nic->address() << ", IP: " << self << endl;
+
+    memset(data, 'x', DATA_SIZE);
+
+    throughput();
+    latency();
+
+    const Ethernet::Statistics & stats = nic->statistics();
+    cout << "  NIC: tx=" << stats.tx_packets << " rx=" << stats.rx_packets << " lost=" << stats.carrier_errors << " overruns=" << stats.rx_overruns << endl;
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+// EPOS TCP Congestion Control Benchmark
+// Requires Traits<Ethernet>::DEVICES = LIST<Loopback> in the machine traits
+// Set Traits<Loopback>::LOSS (and optionally LATENCY and BANDWIDTH) to exercise fast retransmit, fast recovery and RTO back-off
+
+#include <time.h>
+#include <process.h>
+
+#include <machine/nic.h>
+#include <communicator.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+typedef Link<TCP> Communicator;
+
+const unsigned int MESSAGES = 256;
+const unsigned int MESSAGE_SIZE = 8192;
+
+const TCP::Port SERVER = 8000;
+const TCP::Port CLIENT = 8001;
+
+char data[MESSAGE_SIZE];
+IP::Address self;
+
+int sink()
+{
+    Communicator comm(SERVER); // listen
+    char tmp[MESSAGE_SIZE];
+    unsigned int errors = 0;
+
+    for(unsigned int i = 0; i < MESSAGES; i++) {
+        int received = comm.read(tmp, MESSAGE_SIZE);
+        if((received != int(MESSAGE_SIZE)) || (tmp[0] != char(i)) || (tmp[MESSAGE_SIZE - 1] != char(i)))
+            errors++;
+    }
+
+    cout << "  sink: " << MESSAGES << " messages received, " << errors << " corrupted or short" << endl;
+
+    return errors;
+}
+
+int main()
+{
+    cout << "P7 TCP Congestion Control Benchmark" << endl;
+
+    NIC<Ethernet> * nic = Loopback::get(0);
+    self = IP::get_by_nic(0)->address();
+    cout << "  MAC: " << nic->address() << ", IP: " << self << endl;
+    cout << "  link: latency=" << Traits<Loopback>::LATENCY << " us, loss=" << Traits<Loopback>::LOSS << "%, bandwidth=" << Traits<Loopback>::BANDWIDTH << " kbps" << endl;
+
+    Thread * receiver = new Thread(&sink);
+    Thread::yield();
+
+    Communicator comm(CLIENT, Communicator::Address(self, SERVER)); // connect
+    Chronometer chrono;
+
+    unsigned int failures = 0;
+    chrono.start();
+    for(unsigned int i = 0; i < MESSAGES; i++) {
+        memset(data, i, MESSAGE_SIZE);
+        if(comm.write(data, MESSAGE_SIZE) != int(MESSAGE_SIZE))
+            failures++;
+    }
+    receiver->join();
+    chrono.stop();
+
+    Chronometer::Microsecond t = chrono.read();
+    cout << "  transfer: " << MESSAGES << " x " << MESSAGE_SIZE << " bytes in " << t << " us => "
+         << MESSAGES * MESSAGE_SIZE * 8ULL / t << " Mbit/s, " << failures << " failed writes" << endl;
+    cout << "  TCP: " << comm.connection()->statistics() << endl;
+
+    const Ethernet::Statistics & stats = nic->statistics();
+    cout << "  NIC: tx=" << stats.tx_packets << " rx=" << stats.rx_packets << " lost=" << stats.carrier_errors << " overruns=" << stats.rx_overruns << endl;
+
+    delete receiver;
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+// EPOS NIC Receive Flood Benchmark
+// Run on two nodes: the one with an odd MAC floods the other with minimum-size frames, and the other reports frames/s and CPU load
+// Toggle Traits<PCNet32>::polling (or Traits<E100>::polling), RX_BUDGET and MODERATION to compare interrupt-driven and polled reception
+
+#include <machine/nic.h>
+#include <process.h>
+#include <time.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+typedef Traits<Ethernet>::DEVICES::Get<0>::Result Device;
+
+const unsigned int PERIOD = 1000000; // us
+const unsigned int ROUNDS = 5;
+const unsigned int PAYLOAD = 46; // minimum Ethernet payload
+const NIC<Ethernet>::Protocol PROTOCOL = 0x8888;
+
+NIC<Ethernet> * nic;
+
+// CPU load is inferred from how much a LOW priority thread gets done while frames are being received
+volatile unsigned long long spins;
+volatile bool done;
+
+int spinner()
+{
+    while(!done)
+        spins++;
+
+    return 0;
+}
+
+void measure(unsigned long long * work, unsigned int * frames)
+{
+    unsigned long long s = spins;
+    unsigned int f = nic->statistics().rx_packets;
+
+    Alarm::delay(PERIOD);
+
+    *work = spins - s;
+    *frames = nic->statistics().rx_packets - f;
+}
+
+int main()
+{
+    cout << "P8 NIC Receive Flood Benchmark" << endl;
+
+    nic = Device::get(0);
+    NIC<Ethernet>::Address self = nic->address();
+    cout << "  MAC: " << self << endl;
+    cout << "  polling=" << Traits<Device>::polling << ", budget=" << Traits<Device>::RX_BUDGET << ", moderation=" << Traits<Device>::MODERATION << " us" << endl;
+
+    char data[PAYLOAD];
+    memset(data, 0x5a, PAYLOAD);
+
+    if(self[5] % 2) { // flooder
+        Delay(3000000); // let the receiver calibrate
+
+        TSC_Chronometer chrono;
+        unsigned int sent = 0;
+        chrono.start();
+        while(chrono.read() < (ROUNDS + 2) * PERIOD) {
+            nic->send(nic->broadcast(), PROTOCOL, data, PAYLOAD);
+            sent++;
+        }
+        chrono.stop();
+
+        cout << "  sent " << sent << " frames in " << chrono.read() << " us" << endl;
+    } else { // receiver
+        Thread * thread = new Thread(Thread::Configuration(Thread::READY, Thread::LOW), &spinner);
+
+        unsigned long long idle;
+        unsigned int frames;
+        measure(&idle, &frames);
+        cout << "  idle: " << idle << " spins/period, " << frames << " frames" << endl;
+
+        // Wait for the flood to begin
+        unsigned long long work;
+        for(frames = 0; frames < 100; measure(&work, &frames));
+
+        unsigned long long total = 0;
+        for(unsigned int i = 0; i < ROUNDS; i++) {
+            measure(&work, &frames);
+            total += frames;
+
+            unsigned int load = (work < idle) ? 100 - work * 100 / idle : 0;
+            cout << "  round " << i << ": " << static_cast<unsigned long long>(frames) * 1000000 / PERIOD << " frames/s, CPU load " << load << "%" << endl;
+        }
+
+        cout << "  average: " << total * 1000000 / (ROUNDS * PERIOD) << " frames/s" << endl;
+
+        done = true;
+        thread->join();
+        delete thread;
+    }
+
+    const Ethernet::Statistics & stats = nic->statistics();
+    cout << "  NIC: tx=" << stats.tx_packets << " rx=" << stats.rx_packets << " overruns=" << stats.rx_overruns << endl;
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+// EPOS TSTP over Emulated IEEE 802.15.4 Benchmark
+// Run on two (or more) nodes: the sink, at the origin, asks the sensor at (10,10,0) (see img/makefile) for time-triggered
+// SmartData and reports the end-to-end latency and delivery ratio of the responses it gets through the emulated radio
+// Set Traits<Radio_Emulator>::LOSS and RANGE to degrade the links; more QEMU instances can share the air through a multicast netdev
+// Set BATCH above 1 to have the sensor pack that many samples in each response, trading latency for airtime
+
+#include <machine/nic.h>
+#include <time.h>
+#include <network.h>
+#include <transducer.h>
+
+using namespace EPOS;
+
+OStream cout;
+
+const unsigned int PERIOD = 500000; // us
+const unsigned int EXPIRY = 2 * PERIOD;
+const unsigned int ROUNDS = 60;
+const unsigned char BATCH = 1; // samples per response
+const unsigned int LATENCY = (BATCH - 1) * PERIOD; // the oldest sample in a batch waits for the others
+
+// Every response carries the Dummy_Transducer's sample count, so gaps in it are responses lost on the way
+class Probe: public Observer
+{
+public:
+    Probe(Antigravity_Proxy * proxy): _proxy(proxy), _received(0), _first(0), _last(0), _latency(0), _max(0) { _proxy->attach(this); }
+    ~Probe() { _proxy->detach(this); }
+
+    void update(Observed * obs) {
+        SmartData::Time latency = TSTP::now() - _proxy->time();
+        long sample = static_cast<long>(static_cast<Antigravity_Proxy::Value &>(*_proxy));
+
+        if(!_received)
+            _first = sample;
+        _last = sample;
+        _received++;
+        _latency += latency;
+        if(latency > _max)
+            _max = latency;
+    }
+
+    void report() {
+        unsigned int sent = _received ? _last - _first + 1 : 0;
+        cout << "  responses: " << _received << " of " << sent << " (" << (sent ? _received * 100 / sent : 0) << "% delivered)" << endl;
+        if(_received)
+            cout << "  latency: " << _latency / _received << " us average, " << _max << " us max" << endl;
+    }
+
+private:
+    Antigravity_Proxy * _proxy;
+    unsigned int _received;
+    long _first;
+    long _last;
+    SmartData::Time _latency;
+    SmartData::Time _max;
+};
+
+int main()
+{
+    cout << "P9 TSTP over Emulated IEEE 802.15.4 Benchmark" << endl;
+
+    Radio_Emulator * nic = Radio_Emulator::get();
+    cout << "  address: " << nic->address() << ", position: " << nic->position() << endl;
+    cout << "  air: range=" << Traits<Radio_Emulator>::RANGE << " cm, loss=" << Traits<Radio_Emulator>::LOSS << "%, channel=" << nic->channel() << endl;
+    cout << "  TSTP: here=" << TSTP::here() << ", now=" << TSTP::now() << endl;
+
+    if(TSTP::here() == TSTP::sink()) {
+        SmartData::Space sensor(10, 10, 0);
+        SmartData::Region region(sensor, 0, TSTP::now(), -1);
+        cout << "  sink: asking for Antigravity in " << region << " every " << PERIOD << " us, in batches of " << BATCH << endl;
+
+        Antigravity_Proxy proxy(region, EXPIRY + LATENCY, PERIOD, SmartData::SINGLE, 0, SmartData::UNIQUE, BATCH, LATENCY);
+        Probe probe(&proxy);
+
+        Alarm::delay(ROUNDS * PERIOD);
+
+        probe.report();
+    } else {
+        cout << "  sensor: advertising Antigravity" << endl;
+
+        Antigravity antigravity(0, EXPIRY, Antigravity::ADVERTISED);
+
+        Alarm::delay((ROUNDS + 10) * PERIOD);
+    }
+
+    const IEEE802_15_4::Statistics & stats = nic->statistics();
+    cout << "  NIC: tx=" << stats.tx_packets << " rx=" << stats.rx_packets << " lost=" << stats.carrier_errors
+         << " collisions=" << stats.collisions << " overruns=" << stats.rx_overruns << endl;
+
+    return 0;
+}
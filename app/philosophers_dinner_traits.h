@@ -31,7 +31,7 @@ struct Traits
     enum {STATIC, MAC, INFO, RARP, DHCP};
 
     // SmartData predictors
-    enum :unsigned char {NONE, LVP, DBP};
+    enum :unsigned char {NONE, LVP, DBP, LSP, KFP};
 
     // Default traits
     static const bool enabled = true;
@@ -51,6 +51,7 @@ template<> struct Traits<Build>: public Traits<void>
     static const unsigned int MODEL = Legacy_PC;
     static const unsigned int CPUS = 1;
     static const unsigned int NODES = 1; // > 1 => NETWORKING
+    static const bool LOOPBACK = false;  // (true => NETWORKING over a Loopback NIC, even on a single node)
 };
 
 
@@ -31,6 +31,7 @@ template<> struct Traits<Build>
 
     static const unsigned int CPUS = 1;
     static const unsigned int NODES = 2; // > 1 => NETWORKING
+    static const bool LOOPBACK = false;  // (true => NETWORKING over a Loopback NIC, even on a single node)
 };
 
 
@@ -233,6 +234,12 @@ template<> struct Traits<UDP>: public Traits<Network>
     static const bool checksum = true;
 };
 
+template<> struct Traits<DIRP>: public Traits<Network>
+{
+    enum {NTP, PTP};
+    static const unsigned int SYNC_MODE = NTP; // NTP: master time stamps piggybacked on data, PTP: two-step SYNC/DELAY exchanges
+};
+
 template<> struct Traits<TCP>: public Traits<Network>
 {
     static const unsigned int WINDOW = 4096;
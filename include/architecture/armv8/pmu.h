@@ -106,12 +106,13 @@ public:
 public:
     ARMv8_A_PMU() {}
 
-    static void config(const Channel & channel, const Event & event, const Flags & flags = NONE) {
+    static bool config(const Channel & channel, const Event & event, const Flags & flags = NONE) {
         assert((static_cast<unsigned int>(channel) < CHANNELS) && (static_cast<unsigned int>(event) < EVENTS));
         db<PMU>(TRC) << "PMU::config(c=" << channel << ",e=" << event << ",f=" << flags << ")" << endl;
         pmselr(channel);
         pmxevtyper(_events[event]);
         start(channel);
+        return true;
     }
 
     static Count read(const Channel & channel) {
@@ -179,6 +180,7 @@ private:
 
 public:
     using Engine::CHANNELS;
+    using Engine::FIXED;
 
     using Engine::Event;
     using Engine::Count;
@@ -187,6 +189,7 @@ public:
 public:
     PMU() {}
 
+    using Engine::fits;
     using Engine::config;
     using Engine::read;
     using Engine::write;
@@ -94,10 +94,11 @@ public:
 public:
     Intel_PMU_V1() {}
 
-    static void config(const Channel & channel, const Event & event, const Flags & flags = NONE) {
+    static bool config(const Channel & channel, const Event & event, const Flags & flags = NONE) {
         assert((channel < CHANNELS) && (event < EVENTS));
         db<PMU>(TRC) << "PMU::config(c=" << channel << ",e=" << event << ",f=" << flags << ")" << endl;
         wrmsr(EVTSEL0 + channel, _events[event] | USR | OS | ENABLE | flags); // implicitly start counting due to flag ENABLE
+        return true;
     }
 
     static Count read(const Channel & channel) {
@@ -600,11 +601,15 @@ public:
 public:
     Intel_Sandy_Bridge_PMU() {}
 
+    static bool fits(const Channel & channel, const Event & event) {
+        return !(((channel == 0) && (event != INSTRUCTION)) || ((channel == 1) && (event != DVS_CLOCK)) || ((channel == 2) && (event != CLOCK)));
+    }
+
     static bool config(const Channel & channel, const Event & event, const Flags & flags = NONE) {
         assert((channel < CHANNELS) && (event < EVENTS));
         db<PMU>(TRC) << "PMU::config(c=" << channel << ",e=" << event << ",f=" << flags << ")" << endl;
 
-        if(((channel == 0) && (event != INSTRUCTION)) || ((channel == 1) && (event != DVS_CLOCK)) || ((channel == 2) && (event != CLOCK))) {
+        if(!fits(channel, event)) {
             db<PMU>(WRN) << "PMU::config: channel " << channel << " is fixed in this architecture and cannot be reconfigured!" << endl;
             return false;
         }
@@ -701,6 +706,7 @@ class PMU: public PMU_Select_Version<Traits<PMU>::VERSION>
 
 public:
     using Engine::CHANNELS;
+    using Engine::FIXED;
 
 public:
     PMU() {}
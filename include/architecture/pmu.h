@@ -92,7 +92,13 @@ public:
         INT
     };
 
+public:
+    // Whether a channel can count an event (the first FIXED channels, if any, are hardwired to a single event each)
+    static bool fits(const Channel & channel, const Event & event) { return true; }
+
 protected:
+    static const unsigned int FIXED = 0;
+
     PMU_Common() {}
 };
 
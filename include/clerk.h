@@ -9,6 +9,7 @@
 #include <time.h>
 #include <transducer.h>
 #include <process.h>
+#include <utility/statistics.h>
 
 extern "C" { void __pre_main(); }
 
@@ -35,6 +36,7 @@ public:
     virtual ~Monitor() {}
 
     virtual void capture() = 0;
+    virtual void report() = 0;
     virtual OStream & operator<<(OStream & os) = 0;
 
     static void run();
@@ -48,7 +50,7 @@ public:
             db<Monitor>(WRN) << "CPU" << n << endl;
             for(List::Iterator it = _monitors[n].begin(); it != _monitors[n].end(); it++) {
                 db<Monitor>(WRN) << "TS," << i << endl;
-                db<Monitor>(WRN) << it->object();
+                it->object()->report();
                 i++;
             }
         }
@@ -76,6 +78,7 @@ class Clerk_Monitor: public Monitor
 
 private:
 //    static const unsigned int PERIOD = (FREQUENCY > 0) ? 1000000 / FREQUENCY : -1UL;
+    static const bool STREAMING = Traits<Monitor>::STREAMING;
 
 public:
     typedef typename Clerk::Data Data;
@@ -87,9 +90,10 @@ public:
     };
 
 public:
-    Clerk_Monitor(Clerk * clerk, const Hertz & frequency): _clerk(clerk), _frequency(frequency), _period((frequency > 0) ? 1000000 / frequency : -1UL), _last_capture(0), _average(0), _link(this) {
+    Clerk_Monitor(Clerk * clerk, const Hertz & frequency): _clerk(clerk), _frequency(frequency), _period((frequency > 0) ? 1000000 / frequency : -1UL), _last_capture(0), _link(this) {
         db<Clerk>(TRC) << "Clerk_Monitor(clerk=" << clerk << ") => " << this << ")" << endl;
-        _snapshots = Traits<Build>::EXPECTED_SIMULATION_TIME * frequency;
+        // Streaming monitors keep the last snapshots in a ring, others all of them
+        _snapshots = STREAMING ? Traits<Monitor>::RECENT_SNAPSHOTS : Traits<Build>::EXPECTED_SIMULATION_TIME * frequency;
         // if((_snapshots * sizeof(Snapshot)) > Traits<Monitor>::MAX_BUFFER_SIZE)
         //     _snapshots = Traits<Monitor>::MAX_BUFFER_SIZE * sizeof(Snapshot);
         _buffer = new (SYSTEM) Snapshot[_snapshots];
@@ -98,25 +102,32 @@ public:
     }
     ~Clerk_Monitor() {
         _monitors[CPU::id()].remove(&_link);
-        delete _buffer;
+        delete [] _buffer;
     }
 
-    Snapshot & operator[](unsigned int i) const { return (i < _captures) ? _buffer[i] : _buffer[_captures]; }
+    // Snapshots still in the buffer, from the oldest one
+    Snapshot & operator[](unsigned int i) const { return (i < buffered()) ? _buffer[(_captures - buffered() + i) % _snapshots] : _buffer[(_captures - 1) % _snapshots]; }
 
     unsigned int captures() { return _captures; }
+    unsigned int buffered() const { return (_captures < _snapshots) ? _captures : _snapshots; }
+
+    const Statistics<Data> & statistics() const { return _statistics; }
+    const Histogram<Data> & histogram() const { return _histogram; }
 
     void capture() {
         Time_Stamp ts = time_stamp();
-        if(_captures < _snapshots && ((ts - _last_capture) > _period)) {
-            _buffer[_captures].ts = ts;
-            _buffer[_captures].data = _clerk->read();
-            _average = (_average * _captures + _buffer[_captures].data) / (_captures + 1);
+        if((STREAMING || (_captures < _snapshots)) && ((ts - _last_capture) > _period)) {
+            Snapshot & s = _buffer[_captures % _snapshots];
+            s.ts = ts;
+            s.data = _clerk->read();
+            _statistics.insert(s.data);
+            _histogram.insert(s.data);
             _captures++;
             _last_capture = ts;
         }
     }
 
-    // Validate a snapshot against the collected time series
+    // Validate a snapshot against the running statistics of the time series, in constant time
     bool validate(const Snapshot & s) {
         if(_captures > MINIMUN_SNAPSHOTS_TO_VALIDATE) {
             // Statistic validation
@@ -142,15 +153,7 @@ public:
             // at current event begin, if previous event not succeed, there is an anomaly
             // this detector is used on processtrace.c
             // not implemented (on gateway scenarios, would be great)
-            // using dynamic std_dev calc.
-            // Welford's algorithm computes the sample variance incrementally.
-            // https://stackoverflow.com/questions/5543651/computing-standard-deviation-in-a-stream
-            // for each of the captures:
-            // delta = cur_value - mean;
-            // mean += delta / SNAPSHOTS;
-            // M2 += delta * (cur_value - mean);
-            // var = M2 / SNAPSHOTS;
-            // std = squareRoot(var);
+            // using Welford's running mean and variance (see Statistics)
             // with a pre-defined hard-limit and soft limit
             // if curr_value out of (mean +/- std * (hard-limit or limit)): anomaly
             // this detector is used on spike.c
@@ -159,39 +162,39 @@ public:
             // Voter.c analysis the amount of anomalies on a channel (here Clerk_Monitor)
             // if this is greater than number of detectors / 5 (here, detectors are Clerks)
 
-            unsigned int drift;
-            unsigned int time_deviation;
-            unsigned int delta;
-            Data std;
+            double average = _statistics.mean();
+            double deviation = _statistics.deviation();
 
             // first verification
-            drift = (s.data - _average);
-            drift *= drift;
-            if(drift > AVERAGE_ACCEPTED_DRIFT * _average)
+            double drift = s.data - average;
+            if(drift * drift > AVERAGE_ACCEPTED_DRIFT * average)
                 return false;
 
-            // second verification
-            if((s.ts - _frequency) < 0)
-                time_deviation = -1 * (s.ts - _frequency);
-            else
-                time_deviation = s.ts - _frequency;
-            if(time_deviation > TIME_ACCEPTED_DRIFT * _frequency)
+            // second verification: the snapshot must follow the last capture by about a period
+            Time_Stamp interval = s.ts - _last_capture;
+            Time_Stamp time_deviation = (interval > _period) ? interval - _period : _period - interval;
+            if(time_deviation > TIME_ACCEPTED_DRIFT * _period)
                 return false;
 
             // third verification
-            delta = s.data - _average;
-            std = delta*(_average-(delta/_captures));
-            std /= _captures;
-            std = squareRoot(std);
-            if((s.data > (_average + std * STD_DEV_ACCEPTED_DRIFT)) || (s.data < (_average - std * STD_DEV_ACCEPTED_DRIFT)))
+            if((s.data > (average + deviation * STD_DEV_ACCEPTED_DRIFT)) || (s.data < (average - deviation * STD_DEV_ACCEPTED_DRIFT)))
                 return false;
         }
         return true;
     }
 
+    void report() {
+        db<Monitor>(WRN) << "n=" << _statistics.count() << ",min=" << _statistics.min() << ",max=" << _statistics.max() << ",avg=" << _statistics.mean()
+                         << ",std=" << _statistics.deviation() << ",p50=" << _histogram.percentile(50) << ",p90=" << _histogram.percentile(90)
+                         << ",p99=" << _histogram.percentile(99) << endl;
+        if(!STREAMING)
+            for(unsigned int i = 0; i < buffered(); i++)
+                db<Monitor>(WRN) << (*this)[i].ts << "," << (*this)[i].data << endl;
+    }
+
     OStream & operator<<(OStream & os) {
-        for(unsigned int i = 0; i < _captures; i++)
-            os << _buffer[i].ts << "," << _buffer[i].data << endl;
+        for(unsigned int i = 0; i < buffered(); i++)
+            os << (*this)[i].ts << "," << (*this)[i].data << endl;
         return os;
     }
 
@@ -200,7 +203,8 @@ private:
     Hertz _frequency;
     Time_Stamp _period;
     Time_Stamp _last_capture;
-    Data _average;
+    Statistics<Data> _statistics;
+    Histogram<Data> _histogram;
     unsigned int _snapshots;
     Snapshot * _buffer;
     List::Element _link;
@@ -353,41 +357,193 @@ enum PMU_Clerk_Event {
     EVENTS                              = PMU_Common::EVENTS
 };
 
+// Clerks are virtual counters: while there are enough PMU channels on a CPU that can count their events, each keeps a channel
+// of its own; beyond that, they take turns on the channels at every scheduler tick (see rotate()), as Linux perf does, and
+// read() scales what each counted while on the hardware by the time it was enabled over the time it actually ran there.
+// Fixed channels are only handed to clerks of the event they are hardwired to and, since they cannot be written on some
+// PMUs, counts are always taken as the difference from the value a channel had when the clerk last accounted for it.
 template<>
 class Clerk<PMU>: private PMU
 {
+private:
+    typedef TSC::Time_Stamp Time_Stamp;
+    typedef Simple_List<Clerk> List;
+
 public:
     using PMU::CHANNELS;
     typedef PMU::Count Data;
     typedef TSC::Hertz Hertz;
 
 public:
-    Clerk(const PMU_Clerk_Event & event, const Hertz frequency = 0, bool monitored = false) {
-        for(_channel = 0; _in_use[CPU::id()][_channel]; _channel++);
-        if(_channel != CHANNELS) {
-            _in_use[CPU::id()][_channel] = true;
-            PMU::config(_channel, reinterpret_cast<const Event &>(event));
-
-            if(monitored)
-                new (SYSTEM) Clerk_Monitor<Clerk>(this, frequency);
-        }
+    Clerk(const PMU_Clerk_Event & event, const Hertz frequency = 0, bool monitored = false)
+    : _event(event), _channel(CHANNELS), _cpu(CPU::id()), _started(true), _count(0), _base(0), _enabled(0), _running(0), _since(TSC::time_stamp()), _link(this) {
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        _clerks[_cpu].insert(&_link);
+        schedule();
+        if(e)
+            CPU::int_enable();
+
+        if(_channel == CHANNELS)
+            db<Clerk>(INF) << "Clerk<PMU>(e=" << event << "): all channels are busy, multiplexing" << endl;
+
+        if(monitored)
+            new (SYSTEM) Clerk_Monitor<Clerk>(this, frequency);
     }
     ~Clerk() {
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        unschedule();
+        _clerks[_cpu].remove(&_link);
+        if(e)
+            CPU::int_enable();
+    }
+
+    // Estimate of the events counted (clerks count from their creation), scaled up if the counter was multiplexed
+    Data read() {
+        Data count = raw();
+        Time_Stamp running = this->running();
+        Time_Stamp enabled = this->enabled();
+        if(!running)
+            return 0;
+        if(running >= enabled)
+            return count;
+        return static_cast<double>(count) * enabled / running;
+    }
+
+    // Events actually counted, during running()
+    Data raw() const { return _count + (((_channel < CHANNELS) && _started) ? PMU::read(_channel) - _base : 0); }
+
+    // Time the counter has been started, and the part of it that it spent on the hardware
+    Time_Stamp enabled() const { return _enabled + (_started ? TSC::time_stamp() - _since : 0); }
+    Time_Stamp running() const { return _running + (((_channel < CHANNELS) && _started) ? TSC::time_stamp() - _since : 0); }
+
+    bool multiplexed() const { return (_channel == CHANNELS) || (_running != _enabled); }
+
+    void start() {
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        if(!_started) {
+            _started = true;
+            _since = TSC::time_stamp();
+            if(_channel < CHANNELS) {
+                _base = PMU::read(_channel);
+                PMU::start(_channel);
+            }
+        }
+        if(e)
+            CPU::int_enable();
+    }
+
+    void stop() {
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        if(_started) {
+            account();
+            if(_channel < CHANNELS)
+                PMU::stop(_channel);
+            _started = false;
+        }
+        if(e)
+            CPU::int_enable();
+    }
+
+    void reset() {
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        _count = 0;
+        _enabled = _running = 0;
+        _since = TSC::time_stamp();
+        if(_channel < CHANNELS)
+            _base = PMU::read(_channel);
+        if(e)
+            CPU::int_enable();
+    }
+
+    // Hands the channels of the current CPU over to the next clerks in line, if any clerk is waiting for one
+    // Called with interrupts disabled at every scheduler tick
+    static void rotate() {
+        List * clerks = &_clerks[CPU::id()];
+        List::Iterator it;
+        for(it = clerks->begin(); (it != clerks->end()) && (it->object()->_channel < CHANNELS); it++);
+        if(it == clerks->end())
+            return;
+
+        for(it = clerks->begin(); it != clerks->end(); it++)
+            it->object()->unschedule();
+
+        // The clerks that just ran go to the end of the line
+        for(unsigned int i = 0; (i < CHANNELS) && (i < clerks->size()); i++)
+            clerks->insert_tail(clerks->remove_head());
+
+        for(it = clerks->begin(); it != clerks->end(); it++)
+            it->object()->schedule();
+    }
+
+private:
+    // Brings the time (and the events counted, if on the hardware) since the last change of state into the totals
+    void account() {
+        Time_Stamp now = TSC::time_stamp();
+        if(_started) {
+            _enabled += now - _since;
+            if(_channel < CHANNELS) {
+                Data count = PMU::read(_channel);
+                _running += now - _since;
+                _count += count - _base;
+                _base = count;
+            }
+        }
+        _since = now;
+    }
+
+    // Puts the clerk on a free channel that can count its event, if any (fixed channels come first, sparing the others)
+    bool schedule() {
+        const Event & event = reinterpret_cast<const Event &>(_event);
+        for(Channel channel = 0; channel < CHANNELS; channel++) {
+            if(_in_use[_cpu][channel] || !PMU::fits(channel, event))
+                continue;
+
+            if(!PMU::config(channel, event)) { // implicitly starts counting
+                db<Clerk>(WRN) << "Clerk<PMU>::schedule: channel " << channel << " refused event " << _event << "!" << endl;
+                continue;
+            }
+
+            account();
+            _channel = channel;
+            _in_use[_cpu][_channel] = true;
+            _base = PMU::read(_channel);
+            if(!_started)
+                PMU::stop(_channel);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Takes the clerk off the hardware, keeping what it counted there
+    void unschedule() {
         if(_channel < CHANNELS) {
+            account();
             PMU::stop(_channel);
-            _in_use[CPU::id()][_channel] = false;
+            _in_use[_cpu][_channel] = false;
+            _channel = CHANNELS;
         }
     }
 
-    Data read() { return (_channel < CHANNELS) ? PMU::read(_channel) : 0; }
-    void start() { if(_channel < CHANNELS) PMU::start(_channel); }
-    void stop() { if(_channel < CHANNELS) PMU::stop(_channel); }
-    void reset() { if(_channel < CHANNELS) PMU::reset(_channel); }
-
 private:
+    PMU_Clerk_Event _event;
     Channel _channel;
+    unsigned int _cpu;
+    bool _started;
+    Data _count;
+    Data _base; // channel's value when last accounted for
+    Time_Stamp _enabled;
+    Time_Stamp _running;
+    Time_Stamp _since;
+    List::Element _link;
 
     static bool _in_use[Traits<Build>::CPUS][CHANNELS];
+    static List _clerks[Traits<Build>::CPUS];
 };
 
 #endif
@@ -6,6 +6,7 @@
 #include <network.h>
 #include <machine/nic.h>
 #include <synchronizer.h>
+#include <time.h>
 #include <utility/list.h>
 
 __BEGIN_SYS
@@ -30,6 +31,16 @@ public:
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
 
+    // Vectored sends
+    typedef Network_Common::Message_Desc<Address> Message_Desc;
+
+    // Scatter-gather sends and zero-copy receives
+    typedef Network_Common::Chunk Chunk;
+    typedef Network_Common::View<Buffer> View;
+
+    typedef Alarm::Microsecond Microsecond;
+    enum { INFINITE = Alarm::INFINITE };
+
 //protected:
     Communicator_Common(const Local_Address & local): _local(local) {
         Channel::attach(this, local);
@@ -51,6 +62,16 @@ public:
         return Channel::send(from, to, data, size);
     }
 
+    // Sends a message whose payload is gathered from n chunks
+    int send(const Address & to, const Chunk * chunks, unsigned int n) {
+        return Channel::send(_local, to, chunks, n);
+    }
+
+    // Sends n messages, letting the channel hand them over to the NIC in as few batches as possible
+    int send_batch(const Message_Desc * msgs, unsigned int n) {
+        return Channel::send_batch(_local, msgs, n);
+    }
+
     template<typename Message>
     int receive(const Message & message) {
         Buffer * buf = updated();
@@ -65,6 +86,30 @@ public:
         return Channel::receive(buf, from, data, size);
     }
 
+    // Takes up to max received buffers at once, waiting at most timeout for the first one (0 just polls)
+    // Each returned buffer must be consumed with receive(buf, data, size), which also releases it
+    unsigned int receive_batch(Buffer * bufs[], unsigned int max, const Microsecond & timeout = INFINITE) {
+        Batch_Wait wait = {this, (timeout == 0)};
+        if(wait.expired || (timeout == INFINITE))
+            return drop_wakeups(bufs, Observer::updated(bufs, max, &wait.expired));
+
+        Functor_Handler<Batch_Wait> handler(&expire, &wait);
+        Alarm alarm(timeout, &handler);
+        return drop_wakeups(bufs, Observer::updated(bufs, max, &wait.expired));
+    }
+    int receive(Buffer * buf, void * data, unsigned int size) {
+        return Channel::receive(buf, data, size);
+    }
+
+    // Maps the next message instead of copying it (see Network_Common::View), which must then be handed back with release()
+    int receive(View * view) {
+        Buffer * buf = updated();
+        return Channel::receive(buf, view);
+    }
+    void release(View * view) {
+        Channel::release(view);
+    }
+
     int receive_all(void * data, unsigned int size) {
         int r = 0;
         for(unsigned int received = 0, coppied = 0; received < size; received += coppied) {
@@ -88,8 +133,34 @@ public:
     }
 
 private:
-    void update(typename Channel::Observed * obs, const Observing_Condition & c, Buffer * buf) { Observer::update(c, buf); }
+    void update(typename Channel::Observed * obs, const Observing_Condition & c, Buffer * buf) {
+        // A null buffer is a wakeup (e.g. DIRP's time outs), which goes through the ring like data so it reaches the receiver
+        if(!Observer::update(c, buf) && buf && buf->nic())
+            buf->nic()->free(buf);
+    }
     Buffer * updated() { return Observer::updated(); }
+    unsigned int updated(Buffer * bufs[], unsigned int max) { return Observer::updated(bufs, max); }
+
+    // Removes the null buffers (wakeups, see update()) from a batch
+    static unsigned int drop_wakeups(Buffer * bufs[], unsigned int n) {
+        unsigned int m = 0;
+        for(unsigned int i = 0; i < n; i++)
+            if(bufs[i])
+                bufs[m++] = bufs[i];
+        return m;
+    }
+
+    // Time out of receive_batch()
+    struct Batch_Wait
+    {
+        Communicator_Common * communicator;
+        volatile bool expired;
+    };
+
+    static void expire(Batch_Wait * wait) {
+        wait->expired = true;
+        wait->communicator->Observer::wakeup();
+    }
 
 private:
     Local_Address _local;
@@ -173,6 +244,10 @@ public:
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
 
+    // Scatter-gather sends and zero-copy receives
+    typedef Network_Common::Chunk Chunk;
+    typedef Network_Common::View<Buffer> View;
+
 protected:
     Communicator_Common(const Local_Address & local, const Address & peer): _local(local) {
         _connection = Channel::attach(this, local, peer);
@@ -186,12 +261,24 @@ public:
     int send(const void * data, unsigned int size) {
         return _connection->send(data, size);
     }
+    int send(const Chunk * chunks, unsigned int n) {
+        return _connection->send(chunks, n);
+    }
 
     int receive_some(void * data, unsigned int size) {
         Buffer * buf = updated();
         return _connection->receive(buf, data, size);
     }
 
+    // Maps the next segment instead of copying it (see Network_Common::View), which must then be handed back with release()
+    int receive(View * view) {
+        Buffer * buf = updated();
+        return _connection->receive(buf, view);
+    }
+    void release(View * view) {
+        _connection->release(view);
+    }
+
     int receive(void * d, unsigned int size) {
         char * data = reinterpret_cast<char *>(d);
         unsigned int received = 0;
@@ -214,9 +301,15 @@ public:
         return r;
     }
 
+    typename Channel::Connection * connection() const { return _connection; }
+
 private:
-    void update(typename Channel::Observed * obs, const Observing_Condition & c, Buffer * buf) { Observer::update(c, buf); }
+    void update(typename Channel::Observed * obs, const Observing_Condition & c, Buffer * buf) {
+        if(!Observer::update(c, buf) && buf)
+            _connection->discard(buf); // releases the buffer and reopens the receive window it was holding
+    }
     Buffer * updated() { return Observer::updated(); }
+    unsigned int updated(Buffer * bufs[], unsigned int max) { return Observer::updated(bufs, max); }
 
 protected:
     Local_Address _local;
@@ -237,12 +330,18 @@ public:
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
 
+public:
+    typedef typename Base::Chunk Chunk;
+    typedef typename Base::View View;
+
 public:
     Link(const Local_Address & local, const Address & peer = Address::NULL): Base(local), _peer(peer) {}
     ~Link() {}
 
     int send(const void * data, unsigned int size) { return Base::send(_peer, data, size); }
+    int send(const Chunk * chunks, unsigned int n) { return Base::send(_peer, chunks, n); }
     int receive(void * data, unsigned int size) { return Base::receive(data, size); }
+    int receive(View * view) { return Base::receive(view); }
     int receive_all(void * data, unsigned int size) { return Base::receive_all(data, size); }
 
     int read(void * data, unsigned int size) { return receive_all(data, size); }
@@ -266,12 +365,18 @@ public:
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
 
+public:
+    typedef typename Base::Chunk Chunk;
+    typedef typename Base::View View;
+
 public:
     Link(const Local_Address & local, const Address & peer = Address::NULL): Base(local, peer), _peer(peer) {}
     ~Link() {}
 
     int send(const void * data, unsigned int size) { return Base::send(data, size); }
+    int send(const Chunk * chunks, unsigned int n) { return Base::send(chunks, n); }
     int receive(void * data, unsigned int size) { return Base::receive(data, size); }
+    int receive(View * view) { return Base::receive(view); }
     int receive_all(void * data, unsigned int size) { return Base::receive_all(data, size); }
 
     int read(void * data, unsigned int size) { return receive_all(data, size); }
@@ -296,6 +401,9 @@ public:
     typedef typename Channel::Address Address;
     typedef typename Channel::Address::Local Local_Address;
 
+public:
+    typedef typename Base::Chunk Chunk;
+
 public:
     Port(const Local_Address & local): Base(local) {}
     ~Port() {}
@@ -303,6 +411,7 @@ public:
     template<typename Message>
     int send(const Message & message) { return Base::send(message); }
     int send(const Address & to, const void * data, unsigned int size) { return Base::send(to, data, size); }
+    int send(const Address & to, const Chunk * chunks, unsigned int n) { return Base::send(to, chunks, n); }
 
     template<typename Message>
     int receive(const Message & message) { return Base::receive(message); }
@@ -207,6 +207,7 @@ public:
     	unsigned int microframe_count;        // Number of Microframes left until data
     	int hint;                             // Inserted in the Hint Microframe field
         unsigned int times_txed;              // Number of times the MAC transmited this buffer
+        volatile unsigned int references;     // Holders of a received buffer (the receive path and, if it is relayed in place, the MAC)
     };
 
     private:
@@ -236,6 +237,14 @@ public:
     virtual Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload) = 0;
     virtual int send(Buffer * buf) = 0;
     virtual void free(Buffer * buf) = 0;
+
+    // Vectored send of several allocated pools (in allocation order); devices override it to notify the hardware only once
+    virtual int send(Buffer * pools[], unsigned int n) {
+        int size = 0;
+        for(unsigned int i = 0; i < n; i++)
+            size += send(pools[i]);
+        return size;
+    }
     virtual bool drop(unsigned int id) { return true; };
 
     virtual const Address & address() = 0;
@@ -398,7 +398,6 @@ protected:
     volatile unsigned int _tx_cuc_suspended;
     Ethernet::Address _address;
     Ethernet::Statistics _statistics;
-    Ethernet::Buffer * _tx_buffer_prev; // Previously transmitted buffer
 };
 
 class i82559ER: public i8255x // Works with QEMU
@@ -539,6 +538,12 @@ private:
     static const unsigned int UNITS = Traits<E100>::UNITS;
     static const unsigned int TX_BUFS = Traits<E100>::SEND_BUFFERS;
     static const unsigned int RX_BUFS = Traits<E100>::RECEIVE_BUFFERS;
+
+    // Polled reception (see poll())
+    static const bool polling = Traits<E100>::polling;
+    static const unsigned int RX_BUDGET = Traits<E100>::RX_BUDGET;
+    static const unsigned int MODERATION = Traits<E100>::MODERATION;
+
     static const unsigned int DMA_BUFFER_SIZE =
         ((sizeof(ConfigureCB) + 15) & ~15U) +
         ((sizeof(MACaddrCB) + 15) & ~15U) +
@@ -566,6 +571,7 @@ public:
     Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
     void free(Buffer * buf);
     int send(Buffer * buf);
+    int send(Buffer * pools[], unsigned int n);
 
     const Address & address() { return _address; }
     void address(const Address & address) { _address = address; }
@@ -576,8 +582,20 @@ public:
 
     static E100 * get(unsigned int unit = 0) { return get_by_unit(unit); }
 
+    // Creates the receive poller thread, once threads are available (received frames are handled in the ISR until then)
+    void init_poller();
+
 private:
     void handle_int();
+    unsigned int drain(unsigned int budget, const Timer::Time_Stamp & ts);
+    void rx_unmask();
+
+    unsigned int reserve(unsigned int n);
+    void reclaim();
+    unsigned int publish(Buffer * buf);
+    void doorbell();
+
+    static int poll(E100 * dev);
 
     static void int_handler(const IC::Interrupt_Id & interrupt);
 
@@ -710,7 +728,10 @@ private:
     Rx_Desc * _rx_ring;
     Phy_Addr _rx_ring_phy;
 
-    int _tx_cur, _tx_prev;
+    int _tx_cur, _tx_prev; // next TxCB to be reserved and last one handed over to the CU (which suspends on it)
+    unsigned int _tx_clean; // oldest TxCB not yet reclaimed
+    unsigned int _tx_free;
+    volatile bool _tx_ready[TX_BUFS]; // published, but waiting for older reservations to be published too before going to the CU
     Tx_Desc * _tx_ring;
     Phy_Addr _tx_ring_phy;
 
@@ -721,6 +742,11 @@ private:
 
     DMA_Buffer * _dma_buffer;
 
+    volatile bool _polling; // device interrupts masked while _poller drains the ring
+    Timer::Time_Stamp _rx_ts;
+    Thread * _poller;
+    Semaphore * _rx_sem;
+
     static Device _devices[UNITS];
 
 private:
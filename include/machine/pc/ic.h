@@ -533,9 +533,39 @@ public:
     using Engine::ipi;
     using Engine::irq2int;
 
+    // Deferred handling (top/bottom halves): instead of running in interrupt context, the handler of interrupt "i" runs
+    // in a kernel thread with the given priority, while the interrupt stays masked
+    // Limitation: unicore only. On multicore PCs, the APIC engine can only mask a whole controller, not a single source,
+    // so defer() refuses every interrupt there (returning false) and handlers keep running in interrupt context.
+    static bool defer(const Interrupt_Id & i, int priority);
+
+    // Creates the bottom halves of interrupts deferred before threads existed (called by Thread::init)
+    static void init_workers();
+
+private:
+    // Bottom halves with distinct priorities (deferral is refused on multicore, so they are not per CPU)
+    static const unsigned int WORKERS = 4;
+
+    // Each worker's queue is written by ISRs (top halves) and read by the worker's thread, so it needs no locks on a single CPU.
+    // A deferred interrupt is queued at most once (_pending), even if its handler unmasks it before returning (as PCNet32's
+    // does), so the queue never overflows.
+    struct Worker
+    {
+        bool used;
+        int priority;
+        Thread * thread;
+        Semaphore * semaphore;
+        volatile unsigned int head;
+        volatile unsigned int tail;
+        Interrupt_Id queue[INTS];
+    };
+
 private:
     static void dispatch(unsigned int i);
 
+    static void init_worker(Worker * worker);
+    static int bottom_half(Worker * worker);
+
     // Logical handlers
     static void int_not(const Interrupt_Id & i);
 
@@ -550,6 +580,10 @@ private:
 
 private:
     static Interrupt_Handler _int_vector[INTS];
+    static unsigned int _deferred[INTS]; // worker + 1 for deferred interrupts, 0 otherwise
+    static volatile bool _pending[INTS]; // deferred interrupts queued for their bottom halves
+    static Worker _workers[WORKERS];
+    static volatile bool _workers_ready;
 };
 
 __END_SYS
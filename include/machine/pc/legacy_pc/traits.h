@@ -142,10 +142,11 @@ template<> struct Traits<Scratchpad>: public Traits<Machine_Common>
 
 template<> struct Traits<Ethernet>: public Traits<Machine_Common>
 {
-    typedef LIST<PCNet32> DEVICES;
+    // Applications select Loopback through Traits<Build>::LOOPBACK, to exercise the network on a single node
+    typedef IF<Traits<Build>::LOOPBACK, LIST<Loopback>, LIST<PCNet32>>::Result DEVICES;
     static const unsigned int UNITS = DEVICES::Length;
 
-    static const bool enabled = (Traits<Build>::NODES > 1) && (UNITS > 0);
+    static const bool enabled = ((Traits<Build>::NODES > 1) || DEVICES::Count<Loopback>::Result) && (UNITS > 0);
 };
 
 template<> struct Traits<PCNet32>: public Traits<Machine_Common>
@@ -157,6 +158,13 @@ template<> struct Traits<PCNet32>: public Traits<Machine_Common>
     static const bool enabled = (Traits<Build>::NODES > 1) && (UNITS > 0);
 
     static const bool promiscuous = false;
+
+    // NAPI-like reception: the first receive interrupt masks the device's and wakes a HIGH priority thread that hands at most
+    // RX_BUDGET frames per pass up the stack, unmasking interrupts once the ring is empty. The device has no interrupt
+    // moderation timer, so MODERATION (us, 0 disables it) makes the thread wait that long for more frames before unmasking.
+    static const bool polling = false;
+    static const unsigned int RX_BUDGET = 32;
+    static const unsigned int MODERATION = 0;
 };
 
 template<> struct Traits<E100>: public Traits<Machine_Common>
@@ -169,6 +177,13 @@ template<> struct Traits<E100>: public Traits<Machine_Common>
 
     static const bool promiscuous = false;
     static const bool qemu = true;
+
+    // NAPI-like reception: the first receive interrupt masks the device's and wakes a HIGH priority thread that hands at most
+    // RX_BUDGET frames per pass up the stack, unmasking interrupts once the ring is empty. The device has no interrupt
+    // moderation timer, so MODERATION (us, 0 disables it) makes the thread wait that long for more frames before unmasking.
+    static const bool polling = false;
+    static const unsigned int RX_BUDGET = 32;
+    static const unsigned int MODERATION = 0;
 };
 
 template<> struct Traits<C905>: public Traits<Machine_Common>
@@ -182,6 +197,45 @@ template<> struct Traits<C905>: public Traits<Machine_Common>
     static const bool promiscuous = false;
 };
 
+template<> struct Traits<Loopback>: public Traits<Machine_Common>
+{
+    static const unsigned int UNITS = Traits<Ethernet>::DEVICES::Count<Loopback>::Result;
+    static const unsigned int SEND_BUFFERS = 64; // per unit
+    static const unsigned int RECEIVE_BUFFERS = 64; // per unit
+
+    static const bool enabled = (UNITS > 0);
+
+    // Emulated link (0 disables each of them)
+    static const unsigned int LATENCY = 0;   // us (resolution of 1 ms)
+    static const unsigned int LOSS = 0;      // % of frames lost
+    static const unsigned int BANDWIDTH = 0; // Kbit/s
+};
+
+template<> struct Traits<IEEE802_15_4>: public Traits<Machine_Common>
+{
+    // There are no 802.15.4 radios on PCs, so one is emulated on top of the first Ethernet NIC
+    typedef LIST<Radio_Emulator> DEVICES;
+    static const unsigned int UNITS = DEVICES::Length;
+
+    // Brought up only when TSTP runs on it (see Machine::init())
+    static const bool enabled = (Traits<Build>::NODES > 1) && (UNITS > 0);
+};
+
+template<> struct Traits<Radio_Emulator>: public Traits<Machine_Common>
+{
+    static const unsigned int UNITS = Traits<IEEE802_15_4>::DEVICES::Count<Radio_Emulator>::Result; // at most one, since radio and MAC are static
+    static const unsigned int RECEIVE_BUFFERS = 20; // per unit
+
+    static const bool enabled = (UNITS > 0);
+
+    static const bool promiscuous = false;
+    static const unsigned int DEFAULT_CHANNEL = 26; // [11,26]
+
+    // Emulated medium (positions come from the boot image, i.e. eposmkbi's -x, -y and -z; 0 disables each of them)
+    static const unsigned int RANGE = 8000; // cm
+    static const unsigned int LOSS = 0;     // % of frames lost on each link
+};
+
 template<> struct Traits<FPGA>: public Traits<Machine_Common>
 {
     static const bool enabled = false;
@@ -0,0 +1,99 @@
+// EPOS PC Loopback Ethernet NIC Mediator Declarations
+
+#ifndef __loopback_h
+#define __loopback_h
+
+#include <architecture.h>
+#include <utility/handler.h>
+#include <network/ethernet.h>
+
+__BEGIN_SYS
+
+// Software Ethernet NIC that hands every transmitted frame back to its own receive path
+// Frames are "DMAed" from transmit to receive buffers, so the network stack sees the same ownership rules of a real NIC
+// Latency, loss and bandwidth of the emulated link are configured through Traits<Loopback>
+class Loopback: public NIC<Ethernet>
+{
+    friend class Machine_Common;
+
+private:
+    typedef Timer::Time_Stamp Time_Stamp;
+
+    // Transmit and Receive pool sizes
+    static const unsigned int UNITS = Traits<Loopback>::UNITS;
+    static const unsigned int TX_BUFS = Traits<Loopback>::SEND_BUFFERS;
+    static const unsigned int RX_BUFS = Traits<Loopback>::RECEIVE_BUFFERS;
+
+    // Link emulation
+    static const unsigned int LATENCY = Traits<Loopback>::LATENCY;
+    static const unsigned int LOSS = Traits<Loopback>::LOSS;
+    static const unsigned int BANDWIDTH = Traits<Loopback>::BANDWIDTH;
+    static const bool shaped = LATENCY || BANDWIDTH;
+
+    // Period of the Alarm that delivers frames in flight on shaped links (i.e. latency resolution)
+    static const unsigned int TICK = 1000; // us
+
+protected:
+    Loopback(unsigned int unit);
+
+public:
+    ~Loopback();
+
+    int send(const Address & dst, const Protocol & prot, const void * data, unsigned int size);
+    int receive(Address * src, Protocol * prot, void * data, unsigned int size);
+
+    Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
+    void free(Buffer * buf);
+    int send(Buffer * buf);
+
+    const Address & address() { return _address; }
+    void address(const Address & address) { _address = address; }
+
+    const Statistics & statistics() { return _statistics; }
+
+    void reset();
+
+    static Loopback * get(unsigned int unit = 0) { return get_by_unit(unit); }
+
+private:
+    void transmit(Buffer * buf);
+    void deliver(Buffer * buf);
+
+    static void tick();
+
+    // Time the emulated link takes to serialize a frame
+    static Time_Stamp serialization(unsigned int bytes) {
+        static const unsigned int KBPS = BANDWIDTH ? BANDWIDTH : -1U; // Kbit/s
+        return BANDWIDTH ? Timer::us2count(bytes * 8 * 1000ULL / KBPS) : 0;
+    }
+
+    static Loopback * get_by_unit(unsigned int unit) {
+        assert(unit < UNITS);
+        return _devices[unit];
+    }
+
+    static void init(unsigned int unit);
+
+private:
+    unsigned int _unit;
+
+    Address _address;
+    Statistics _statistics;
+
+    unsigned int _tx_cur;
+    unsigned int _rx_cur;
+    Buffer * _tx_buffer[TX_BUFS];
+    Buffer * _rx_buffer[RX_BUFS];
+
+    Time_Stamp _link_free;       // when the emulated link finishes serializing the last frame
+    Buffer::List _wire;          // frames in flight on shaped links, in arrival order
+    Buffer::List _received;      // frames no one observed, kept for receive()
+
+    static Loopback * _devices[UNITS];
+    static Alarm * _alarm;
+    static Function_Handler _handler;
+};
+
+__END_SYS
+
+#endif
@@ -8,5 +8,7 @@
 #include "pcnet32.h"
 #include "e100.h"
 #include "c905.h"
+#include "loopback.h"
+#include <network/ieee802_15_4.h> // for the Radio_Emulator, which comes with TSTP (see network/tstp/mac.h)
 
 #endif
@@ -307,6 +307,14 @@ public:
 
     // Transmit Descriptor
     struct Tx_Desc: public Desc {
+        enum { // misc (TMD2)
+            RTRY = 0x04000000,
+            LCAR = 0x08000000,
+            LCOL = 0x10000000,
+            UFLO = 0x40000000,
+            BUFF = 0x80000000
+        };
+
         friend Debug & operator<<(Debug & db, const Tx_Desc & d) {
             db << "{" << hex << d.phy_addr << dec
                 << "," << 65536 - d.size
@@ -407,6 +415,11 @@ private:
     static const unsigned int TX_BUFS = Traits<PCNet32>::SEND_BUFFERS;
     static const unsigned int RX_BUFS =Traits<PCNet32>::RECEIVE_BUFFERS;
 
+    // Polled reception (see poll())
+    static const bool polling = Traits<PCNet32>::polling;
+    static const unsigned int RX_BUDGET = Traits<PCNet32>::RX_BUDGET;
+    static const unsigned int MODERATION = Traits<PCNet32>::MODERATION;
+
     // Size of the DMA Buffer that will host the ring buffers and the init block
     static const unsigned int DMA_BUFFER_SIZE = ((sizeof(Init_Block) + 15) & ~15U) +
         RX_BUFS * ((sizeof(Rx_Desc) + 15) & ~15U) + TX_BUFS * ((sizeof(Tx_Desc) + 15) & ~15U) +
@@ -430,6 +443,7 @@ public:
     Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
     void free(Buffer * buf);
     int send(Buffer * buf);
+    int send(Buffer * pools[], unsigned int n);
 
     const Address & address() { return _address; }
     void address(const Address & address) { _address = address; }
@@ -440,8 +454,20 @@ public:
 
     static PCNet32 * get(unsigned int unit = 0) { return get_by_unit(unit); }
 
+    // Creates the receive poller thread, once threads are available (received frames are handled in the ISR until then)
+    void init_poller();
+
 private:
     void handle_int();
+    unsigned int drain(unsigned int budget, const Timer::Time_Stamp & ts);
+    void rx_unmask();
+
+    unsigned int reserve(unsigned int n);
+    void reclaim();
+    unsigned int publish(Buffer * buf);
+    void doorbell();
+
+    static int poll(PCNet32 * dev);
 
     static void int_handler(const IC::Interrupt_Id & interrupt);
 
@@ -476,13 +502,20 @@ private:
     Rx_Desc * _rx_ring;
     Phy_Addr _rx_ring_phy;
 
-    int _tx_cur;
+    int _tx_cur; // next descriptor to be reserved
+    unsigned int _tx_clean; // oldest descriptor not yet reclaimed
+    unsigned int _tx_free;
     Tx_Desc * _tx_ring;
     Phy_Addr _tx_ring_phy;
 
     Buffer * _rx_buffer[RX_BUFS];
     Buffer * _tx_buffer[TX_BUFS];
 
+    volatile bool _polling; // receive interrupts masked while _poller drains the ring
+    Timer::Time_Stamp _rx_ts;
+    Thread * _poller;
+    Semaphore * _rx_sem;
+
     static Device _devices[UNITS];
 };
 
@@ -0,0 +1,322 @@
+// EPOS PC IEEE 802.15.4 Radio Emulator NIC Mediator Declarations
+
+#ifndef __radio_emulator_h
+#define __radio_emulator_h
+
+#include <architecture.h>
+#include <utility/convert.h>
+#include <utility/geometry.h>
+#include <machine/ic.h>
+#include <machine/timer.h>
+#include <network/ethernet.h>
+#include <network/ieee802_15_4.h>
+#include <network/ieee802_15_4_mac.h>
+#define __tstp_h
+#include <network/tstp/mac.h>
+#undef __tstp_h
+
+__BEGIN_SYS
+
+// Emulated IEEE 802.15.4 RF Transceiver
+// The "air" is the Ethernet segment of the first Ethernet NIC: every transmission is broadcast on it tagged with the
+// sender's position and channel, and each node decides on its own whether it hears it, according to range, loss, the
+// state of its receiver and whatever else is on the air at the time. Airtime follows the 802.15.4 PHY (BYTE_RATE plus
+// PHY_HEADER_SIZE) and state transitions take as long as on the CC2538, so the MACs' CCA, contention and microframe
+// schedules see the timing they were designed for, albeit with the 1 ms resolution of the system timer.
+class Radio_Emulator_RF
+{
+    friend class Radio_Emulator;
+
+protected:
+    typedef RTC::Microsecond Microsecond;
+    typedef Point<long, 3> Position;
+
+    static const bool promiscuous = Traits<Radio_Emulator>::promiscuous;
+
+    static const unsigned int TX_TO_RX_DELAY = 2; // as the CC2538, which the MACs were tuned for
+    static const unsigned int RX_TO_TX_DELAY = 0;
+
+    static const unsigned int SLEEP_TO_TX_DELAY = 194;
+    static const unsigned int SLEEP_TO_RX_DELAY = 194;
+    static const unsigned int TX_TO_SLEEP_DELAY = 50;
+
+    // Emulated medium
+    static const unsigned int RANGE = Traits<Radio_Emulator>::RANGE;
+    static const unsigned int LOSS = Traits<Radio_Emulator>::LOSS;
+
+    // Whether the receiver comes back on after a transmission (duty-cycled TSTP turns it on explicitly)
+    static const bool rx_after_tx = !(Traits<TSTP>::enabled && EQUAL<Traits<TSTP>::NIC_Family, IEEE802_15_4>::Result) || (Traits<System>::DUTY_CYCLE == 1000000);
+
+    // IEEE 802 Local Experimental EtherType, which carries the emulated air
+    static const unsigned short PROTO_AIR = 0x88b5;
+
+    // What goes on the Ethernet in front of each PSDU
+    struct Air_Header
+    {
+        Position position;
+        unsigned char channel;
+        unsigned char size; // PSDU length, including the FCS
+    } __attribute__((packed));
+
+    // State of the frame being received (i.e. the RX FIFO)
+    enum RX_State {
+        RX_IDLE,
+        RX_RECEIVING,
+        RX_CORRUPTED,
+        RX_DONE
+    };
+
+public:
+    // MAC timer, counting microseconds out of the TSC
+    // Interrupts are checked on every tick of the system timer, which bounds their resolution
+    class Timer: private NIC_Common::Timer
+    {
+        friend class Radio_Emulator_RF;
+        friend class Radio_Emulator;
+
+    private:
+        const static Hertz CLOCK = 1000000; // 1 MHz
+        const static PPB ACCURACY = 40000; // 40 PPM, as the CC2538, so TSTP's Timekeeper keeps its resynchronization period
+
+    public:
+        using NIC_Common::Timer::Time_Stamp;
+        using NIC_Common::Timer::Offset;
+
+    public:
+        Timer() {}
+
+        static Time_Stamp read() { return TSC::time_stamp() / (TSC::frequency() / CLOCK) + _offset; }
+        static Time_Stamp sfd() { return _sfd; }
+
+        static void adjust(const Offset & o) { _offset += o; }
+
+        static Hertz frequency() { return CLOCK; }
+        static PPB accuracy() { return ACCURACY; }
+
+        static void interrupt(const Time_Stamp & when, const IC::Interrupt_Handler & h) {
+            bool was_disabled = CPU::int_disabled();
+            CPU::int_disable();
+            _int_request_time = when;
+            _handler = h;
+            if(!was_disabled)
+                CPU::int_enable();
+        }
+
+        static void int_disable() { _handler = 0; }
+
+        static Time_Stamp us2count(const Microsecond & us) { return Convert::us2count<Time_Stamp, Microsecond>(CLOCK, us); }
+        static Microsecond count2us(const Time_Stamp & ts) { return Convert::count2us<Hertz, Time_Stamp, Microsecond>(CLOCK, ts); }
+
+    private:
+        static void int_handler(const IC::Interrupt_Id & interrupt);
+
+    private:
+        static volatile Offset _offset;
+        static volatile Time_Stamp _sfd;
+        static volatile Time_Stamp _int_request_time;
+        static volatile IC::Interrupt_Handler _handler;
+    };
+
+public:
+    typedef Radio_Emulator Device; // for the MAC bindings in radio_emulator.cc
+
+public:
+    Radio_Emulator_RF() {}
+
+    void address(const IEEE802_15_4::Address & address) {}
+
+    // FIXME: methods static because of TSTP_MAC, as in CC2538RF
+    static void backoff(const Microsecond & time) {
+        Timer::Time_Stamp end = Timer::read() + Timer::us2count(time);
+        while(Timer::read() <= end);
+    }
+
+    static bool cca(const Microsecond & time) {
+        Timer::Time_Stamp end = Timer::read() + Timer::us2count(time);
+        bool channel_free = !busy();
+        while((Timer::read() <= end) && (channel_free = channel_free && !busy()));
+        return channel_free;
+    }
+
+    static void transmit_no_cca();
+
+    static bool transmit() {
+        if(busy())
+            return false;
+        transmit_no_cca();
+        return true;
+    }
+
+    // Acknowledgments are not emulated, so every frame counts as acknowledged once it leaves the air
+    bool wait_for_ack(const Microsecond & timeout, unsigned char sequence_number) {
+        while(!tx_done());
+        return true;
+    }
+
+    static void listen() { _listening = true; }
+
+    static bool tx_done() { return Timer::read() >= _tx_end; }
+
+    static bool rx_done() { return _rx_state == RX_DONE; }
+
+    static void channel(unsigned int c) {
+        assert((c > 10) && (c < 27));
+        _channel = c;
+    }
+
+    static void copy_to_nic(const void * frame, unsigned int size) {
+        assert(size <= IEEE802_15_4::MTU);
+        _tx_size = size;
+        memcpy(_tx_frame, frame, size - sizeof(IEEE802_15_4::CRC));
+    }
+
+    static unsigned int copy_from_nic(void * frame) {
+        unsigned int size = _rx_size;
+        memcpy(frame, _rx_frame, size);
+        drop();
+        return size;
+    }
+
+    static void drop() { _rx_state = RX_IDLE; }
+
+    static void power(const Power_Mode & mode);
+
+    // Emulated position, initially the one given to the boot image
+    static const Position & position() { return _position; }
+    static void position(const Position & p) { _position = p; }
+
+protected:
+    // Energy is sensed on the channel while any frame heard is on the air, our own included
+    static bool busy() { return (Timer::read() < _air_busy) || !tx_done(); }
+
+    // Half-duplex: nothing is received while transmitting and until the radio turns around
+    static bool receiving() {
+        Timer::Time_Stamp now = Timer::read();
+        return (_mode == FULL) && _listening && (now >= _rx_ready) && (now >= _tx_end + Timer::us2count(TX_TO_RX_DELAY));
+    }
+
+    // Ends the reception in progress once its frame has left the air
+    static void settle(const Timer::Time_Stamp & now) {
+        if((_rx_state == RX_RECEIVING) && (now >= _rx_end))
+            _rx_state = RX_DONE;
+        else if((_rx_state == RX_CORRUPTED) && (now >= _rx_end))
+            _rx_state = RX_IDLE;
+    }
+
+    // Time a PSDU of size bytes takes on the air
+    static Timer::Time_Stamp airtime(unsigned int size) {
+        return Timer::us2count((IEEE802_15_4::PHY_HEADER_SIZE + size) * 1000000ULL / IEEE802_15_4::BYTE_RATE);
+    }
+
+protected:
+    static NIC<Ethernet> * _air;
+
+    static Position _position;
+    static unsigned int _channel;
+    static Power_Mode _mode;
+    static bool _listening;
+
+    static Timer::Time_Stamp _rx_ready; // when the receiver is done waking up or turning around
+    static Timer::Time_Stamp _tx_end;   // when our last transmission leaves the air
+    static Timer::Time_Stamp _air_busy; // when the last frame heard leaves the air
+
+    static unsigned int _tx_size;
+    static unsigned char _tx_frame[IEEE802_15_4::MTU];
+
+    static volatile RX_State _rx_state;
+    static Timer::Time_Stamp _rx_end;
+    static int _rx_rssi;
+    static unsigned int _rx_size;
+    static unsigned char _rx_frame[IEEE802_15_4::MTU];
+};
+
+
+// Emulated IEEE 802.15.4 NIC, so TSTP (or the plain 802.15.4 MAC) can run on PCs and QEMU instances
+// Radio and MAC are static, so there can be only one unit per node
+class Radio_Emulator: public NIC<IEEE802_15_4>, private NIC<Ethernet>::Observer, private IF<Traits<TSTP>::enabled && EQUAL<Traits<TSTP>::NIC_Family, IEEE802_15_4>::Result, TSTP::MAC<Radio_Emulator_RF, Traits<System>::DUTY_CYCLE != 1000000>, IEEE802_15_4_MAC<Radio_Emulator_RF>>::Result
+{
+    friend class Machine_Common;
+
+private:
+    typedef IEEE802_15_4::Buffer Buffer;
+    typedef IEEE802_15_4::Statistics Statistics;
+    typedef IEEE802_15_4::Address Address;
+    typedef IEEE802_15_4::Protocol Protocol;
+    typedef IF<Traits<TSTP>::enabled && EQUAL<Traits<TSTP>::NIC_Family, IEEE802_15_4>::Result, TSTP::MAC<Radio_Emulator_RF, Traits<System>::DUTY_CYCLE != 1000000>, IEEE802_15_4_MAC<Radio_Emulator_RF>>::Result MAC;
+
+    typedef Radio_Emulator_RF::Position Position;
+    typedef Radio_Emulator_RF::Air_Header Air_Header;
+
+    // Receive Ring size
+    static const unsigned int UNITS = Traits<Radio_Emulator>::UNITS;
+    static const unsigned int RX_BUFS = Traits<Radio_Emulator>::RECEIVE_BUFFERS;
+
+public:
+    typedef Radio_Emulator_RF::Timer Timer;
+
+protected:
+    Radio_Emulator(unsigned int unit);
+
+public:
+    ~Radio_Emulator();
+
+    int send(const Address & dst, const Protocol & prot, const void * data, unsigned int size);
+    int receive(Address * src, Protocol * prot, void * data, unsigned int size);
+    bool drop(unsigned int id) { return MAC::drop(id); }
+
+    Buffer * alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload);
+    void free(Buffer * buf);
+    int send(Buffer * buf);
+
+    const Address & address() { return _address; }
+    void address(const Address & address) { _address = address; }
+
+    unsigned int channel() { return _channel; }
+    void channel(unsigned int channel) {
+        if((channel > 10) && (channel < 27)) {
+            _channel = channel;
+            Radio_Emulator_RF::channel(_channel);
+        }
+    }
+
+    using Radio_Emulator_RF::position;
+
+    const Statistics & statistics() { return _statistics; }
+
+    void reset();
+
+    static Radio_Emulator * get(unsigned int unit = 0) { return get_by_unit(unit); }
+
+private:
+    void update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & prot, NIC<Ethernet>::Buffer * buf);
+
+    void handle_int();
+
+    static void int_handler(const IC::Interrupt_Id & interrupt);
+
+    static Radio_Emulator * get_by_unit(unsigned int unit) {
+        assert(unit < UNITS);
+        return _devices[unit];
+    }
+
+    static void init(unsigned int unit);
+
+private:
+    unsigned int _unit;
+
+    Address _address;
+    unsigned int _channel;
+    Statistics _statistics;
+
+    Buffer * _rx_bufs[RX_BUFS];
+    unsigned int _rx_cur_consume;
+    unsigned int _rx_cur_produce;
+
+    static Radio_Emulator * _devices[UNITS];
+    static User_Timer * _timer;
+    static volatile bool _handling;
+};
+
+__END_SYS
+
+#endif
@@ -0,0 +1,23 @@
+// EPOS PC Watchdog Mediator Declarations
+
+#ifndef __pc_watchdog_h
+#define __pc_watchdog_h
+
+#include <machine/watchdog.h>
+
+__BEGIN_SYS
+
+// PCs have no watchdog, but code written for motes (e.g. TSTP's MAC) kicks one
+class Watchdog: private Watchdog_Common
+{
+public:
+    Watchdog() {}
+
+    static void enable() {}
+    static void disable() {}
+    static void kick() {}
+};
+
+__END_SYS
+
+#endif
@@ -209,8 +209,8 @@ public:
 
     typedef Frame PDU;
 
-    // Buffers used to hold frames across a zero-copy network stack
-    typedef _UTIL::Buffer<NIC<IEEE802_15_4>, IF<Traits<TSTP>::enabled, Phy_Frame, Frame>::Result, void, Metadata> Buffer;
+    // Buffers used to hold frames across a zero-copy network stack (TSTP's MAC has its own frame format)
+    typedef _UTIL::Buffer<NIC<IEEE802_15_4>, IF<Traits<TSTP>::enabled && EQUAL<Traits<TSTP>::NIC_Family, IEEE802_15_4>::Result, Phy_Frame, Frame>::Result, void, Metadata> Buffer;
 
     // Observers of a protocol get a also a pointer to the received buffer
     typedef Data_Observer<Buffer, Type> Observer;
@@ -15,6 +15,60 @@ class Network_Common
      friend void ::__pre_main();
 
 public:
+    // Frames handed to a NIC at once by vectored sends (must not exceed any NIC's transmit ring)
+    static const unsigned int MAX_BATCH = 16;
+
+    // Descriptor of one message in a vectored send
+    template<typename Address>
+    struct Message_Desc
+    {
+        Address to;
+        const void * data;
+        unsigned int size;
+    };
+
+    // Scatter-gather element: one contiguous piece of a message that lives in the application's memory
+    struct Chunk
+    {
+        const void * data;
+        unsigned int size;
+    };
+
+    // Read-only, zero-copy view over a received message, whose payload stays in the NIC buffers it arrived in until the
+    // channel's release() hands them back. The first buffer of the chain carries "head" bytes of headers, the others "tail" bytes
+    template<typename Buffer>
+    class View
+    {
+    public:
+        View(): _pool(0), _head(0), _tail(0) {}
+        View(Buffer * pool, unsigned int head, unsigned int tail): _pool(pool), _head(head), _tail(tail) {}
+
+        Buffer * pool() const { return _pool; }
+
+        unsigned int size() const {
+            unsigned int s = 0;
+            for(typename Buffer::Element * el = _pool ? _pool->link() : 0; el; el = el->next())
+                s += el->object()->size() - ((el == _pool->link()) ? _head : _tail);
+            return s;
+        }
+
+        // Fills a scatter list with the payload, one chunk per buffer, and returns the number of chunks filled (at most max)
+        unsigned int chunks(Chunk * chunks, unsigned int max) const {
+            unsigned int n = 0;
+            for(typename Buffer::Element * el = _pool ? _pool->link() : 0; el && (n < max); el = el->next(), n++) {
+                unsigned int skip = (el == _pool->link()) ? _head : _tail;
+                chunks[n].data = el->object()->frame()->template data<unsigned char>() + skip;
+                chunks[n].size = el->object()->size() - skip;
+            }
+            return n;
+        }
+
+    private:
+        Buffer * _pool;
+        unsigned int _head;
+        unsigned int _tail;
+    };
+
     template<int unit = 0>
     struct Initializer
     {
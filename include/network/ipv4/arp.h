@@ -22,8 +22,16 @@ public:
     typedef typename Network::Address PA;
     typedef typename NIC::Address HA;
 
+    typedef typename NIC::Buffer Buffer;
+
+    static const unsigned int TICK = 1000000;   // us between aging rounds (and request retries)
+    static const unsigned int TTL = 300;        // ticks a resolved mapping lasts without being refreshed
+    static const unsigned int RETRIES = Traits<Network>::RETRIES;
+    static const unsigned int PENDING = 4;      // datagrams held per unresolved address
+
 private:
     static const unsigned int ENTRIES = Traits<Build>::NODES;
+    static const unsigned int PERMANENT = -1U;
 
     class Mapping;
     typedef Simple_Hash<Mapping, ENTRIES, PA> Table;
@@ -87,36 +95,41 @@ public:
 private:
     class Mapping
     {
+        friend class ARP;
+
     public:
-        Mapping(const PA & pa, const HA & ha): _ha(ha), _sem(0), _link(this, pa) {}
-        Mapping(const PA & pa, Semaphore * sem): _ha(HA::NULL), _sem(sem), _link(this, pa) {}
+        Mapping(const PA & pa, const HA & ha, unsigned int ttl): _ha(ha), _ttl(ttl), _tries(0), _sem(0), _link(this, pa) {}
 
         const HA & ha() const { return _ha; }
-        Semaphore * semaphore() { return _sem; }
+        bool resolved() const { return _ha; }
         Element * link() { return &_link; }
 
-        void update(const HA & ha) {
+        // Reinitializes a mapping that is not in the table (i.e. the spare, see claim())
+        void reuse(const PA & pa, const HA & ha, unsigned int ttl) {
             _ha = ha;
-            if(_sem) {
-                _sem->v();
-                _sem = 0;
-            }
+            _ttl = ttl;
+            _tries = 0;
+            _sem = 0;
+            _link.rank(pa);
+            _link.next(0);
         }
 
         friend Debug & operator<<(Debug & db, const Mapping & m) {
-            db  << "{pa=" << m._link.key() << ",ha=" << m._ha << ",sem=" << m._sem << "}";
+            db  << "{pa=" << m._link.key() << ",ha=" << m._ha << ",ttl=" << m._ttl << ",tries=" << m._tries << ",sem=" << m._sem << ",pending=" << m._pending.size() << "}";
             return db;
         }
 
     private:
         HA _ha;
-        Semaphore * _sem;
-        Element _link; // PA is the key
+        unsigned int _ttl;              // ticks left for a resolved mapping (PERMANENT for static ones)
+        unsigned int _tries;            // requests sent so far for an unresolved mapping
+        Semaphore * _sem;               // thread blocked on resolve(), if any
+        typename Buffer::List _pending; // datagrams held until the mapping is resolved (linked through Buffer::lext())
+        Element _link;                  // PA is the key
     };
 
-
 public:
-    ARP(NIC * nic, Network * net): _nic(nic), _net(net) {
+    ARP(NIC * nic, Network * net): _nic(nic), _net(net), _spare(new (SYSTEM) Mapping(PA(PA::NULL), HA(HA::NULL), 0)), _handler(&age, this), _alarm(TICK, &_handler, Alarm::INFINITE) {
         db<ARP>(TRC) << "ARP::ARP(nic=" << nic << ",net=" << net << ") => " << this << endl;
 
         _nic->attach(this, NIC::PROTO_ARP);
@@ -128,21 +141,21 @@ public:
         _nic->detach(this, NIC::PROTO_ARP);
 
         lock();
-        for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++) {
-            if(it) {
-                db<ARP>(INF) << "ARP::~ARP: removing and deleting " << *it->object() << endl;
-
-                _table.remove(it);
-                delete it->object();
-            }
+        while(Mapping * map = first()) {
+            db<ARP>(INF) << "ARP::~ARP: removing and deleting " << *map << endl;
+            discard(map);
         }
         unlock();
+
+        if(_spare)
+            delete _spare;
     }
 
+    // Static mappings never age
     void insert(const PA & pa, const HA & ha) {
         db<ARP>(TRC) << "ARP::insert(pa=" << pa << ",ha=" << ha << ")" << endl;
 
-        Mapping * map = new (SYSTEM) Mapping(pa, ha);
+        Mapping * map = new (SYSTEM) Mapping(pa, ha, PERMANENT);
 
         lock();
         _table.insert(map->link());
@@ -152,62 +165,74 @@ public:
     void remove(const PA & pa) {
         db<ARP>(TRC) << "ARP::remove(pa=" << pa << ")" << endl;
 
-        Element * el = _table.remove_key(pa);
+        lock();
+        Element * el = _table.search_key(pa);
         if(el) {
             db<ARP>(INF) << "ARP::remove: removing and deleting " << *el->object() << endl;
-            delete el->object();
+            discard(el->object());
         }
+        unlock();
     }
 
-    HA resolve(const PA & pa) {
-        db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => ";
+    // Returns the hardware address mapped to "pa" or, if it is still unknown, starts resolving it and returns HA::NULL without blocking
+    HA lookup(const PA & pa) {
+        db<ARP>(TRC) << "ARP::lookup(pa=" << pa << ")" << endl;
 
-        volatile HA ha = HA(HA::NULL);
+        HA ha = HA(HA::NULL);
+        Mapping * map = 0;
 
         lock();
         Element * el = _table.search_key(pa);
-        unlock();
-
         if(el)
             ha = el->object()->ha();
-        else {
-            db<ARP>(TRC) << "sending requests" << endl;
+        else if((map = claim(pa, ha, 0)))
+            request(map);
+        unlock();
 
-            Semaphore sem(0);
-            Mapping * map = new (SYSTEM) Mapping(pa, &sem);
-            lock();
-            _table.insert(map->link());
-            unlock();
+        if(map)
+            replenish();
+
+        return ha;
+    }
+
+    // Blocking variant of lookup(), for the rare callers that cannot proceed without the address (e.g. network initialization)
+    HA resolve(const PA & pa) {
+        db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ")" << endl;
 
-            for(unsigned int i = 0; (i < Traits<Network>::RETRIES) && !ha; i++) {
-                Packet request(REQUEST, _nic->address(), _net->address(), HA::BROADCAST, pa);
-                db<ARP>(INF) << "ARP::resolve:request=" << request << endl;
-                _nic->send(HA::BROADCAST, NIC::PROTO_ARP, &request, sizeof(Packet));
+        HA ha = lookup(pa);
+        if(ha)
+            return ha;
 
-                Semaphore_Handler handler(&sem);
-                Alarm alarm(Traits<Network>::TIMEOUT * 1000000, &handler, 1);
-                sem.p();
+        Semaphore sem(0);
+        bool waiting = false;
 
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el) {
+            Mapping * map = el->object();
+            if(map->resolved())
                 ha = map->ha();
+            else if(!map->_sem) {
+                map->_sem = &sem;
+                waiting = true;
             }
+        }
+        unlock();
 
-            lock();
-            if(!ha) {
-                _table.remove(map->link());
-                delete map;
+        if(waiting)
+            sem.p(); // signaled by update() or, when the mapping is given up, by age()
+        else // another thread is already blocked on this mapping, so poll it until it is resolved or given up
+            for(unsigned int i = 0; !ha && (i <= RETRIES) && search(pa); i++) {
+                Alarm::delay(TICK);
+                ha = find(pa);
             }
-            unlock();
-
-            db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => ";
-        }
 
-        // Even being declared volatile, "ha" gets messed up and a PF occurs without the memcpy
-        HA ha2;
-        memcpy(&ha2, const_cast<HA *>(&ha), sizeof(HA));
+        if(!ha)
+            ha = find(pa);
 
-        db<ARP>(TRC) << ha2 << endl;
+        db<ARP>(TRC) << "ARP::resolve(pa=" << pa << ") => " << ha << endl;
 
-        return ha2;
+        return ha;
     }
 
 //    PA resolve(const HA & ha) {
@@ -231,6 +256,85 @@ public:
 //        return ha;
 //    }
 
+    // Allocates a pool for a datagram whose next hop is still being resolved (i.e. whose frames have no destination yet).
+    // It comes from the heap instead of the NIC, since NIC buffers must be sent in allocation order and this one will be held by enqueue().
+    Buffer * alloc(const typename NIC::Protocol & prot, unsigned int once, unsigned int always, unsigned int payload) {
+        db<ARP>(TRC) << "ARP::alloc(p=" << hex << prot << dec << ",on=" << once << ",al=" << always << ",pl=" << payload << ")" << endl;
+
+        int max_data = NIC::MTU - always;
+
+        typename Buffer::List pool;
+        for(int size = once + payload; size > 0; size -= max_data) {
+            Buffer * buf = new (SYSTEM) Buffer(_nic, (size > max_data) ? NIC::MTU : size + always, _nic->address(), HA(HA::NULL), prot);
+            pool.insert(buf->link());
+        }
+
+        return pool.head()->object();
+    }
+
+    // Takes over a pool obtained from alloc() and sends it as soon as "pa" gets resolved, or frees it if that never happens.
+    // Only the most recent PENDING datagrams are held for each address. Returns the number of bytes in the datagram.
+    int enqueue(const PA & pa, Buffer * pool) {
+        db<ARP>(TRC) << "ARP::enqueue(pa=" << pa << ",pool=" << pool << ")" << endl;
+
+        int size = 0;
+        for(typename Buffer::Element * el = pool->link(); el; el = el->next())
+            size += el->object()->size();
+
+        bool claimed = false;
+        Mapping * map;
+
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el)
+            map = el->object();
+        else if((map = claim(pa, HA(HA::NULL), 0))) { // the mapping has been given up since the pool was allocated, so start over
+            request(map);
+            claimed = true;
+        } else {
+            unlock();
+            db<ARP>(WRN) << "ARP::enqueue: no mapping left for " << pa << ", dropping " << pool << endl;
+            release(pool);
+            return 0;
+        }
+
+        if(map->resolved()) { // the reply arrived while the datagram was being assembled
+            unlock();
+            flush(pool, map->ha());
+            return size;
+        }
+
+        map->_pending.insert(pool->lext());
+        if(map->_pending.size() > PENDING) {
+            Buffer * oldest = map->_pending.remove()->object();
+            db<ARP>(INF) << "ARP::enqueue: too many datagrams waiting for " << pa << ", dropping " << oldest << endl;
+            release(oldest);
+        }
+        unlock();
+
+        if(claimed)
+            replenish();
+
+        return size;
+    }
+
+    // Restarts the aging of a resolved mapping, since traffic from "pa" has just been received
+    void refresh(const PA & pa) {
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el && el->object()->resolved() && (el->object()->_ttl != PERMANENT))
+            el->object()->_ttl = TTL;
+        unlock();
+    }
+
+    // Gratuitous ARP: broadcasts our own mapping so neighbors update their tables (e.g. after the address or the NIC changed)
+    void announce() {
+        db<ARP>(TRC) << "ARP::announce(pa=" << _net->address() << ",ha=" << _nic->address() << ")" << endl;
+
+        Packet announcement(REQUEST, _nic->address(), _net->address(), HA::NULL, _net->address());
+        _nic->send(HA::BROADCAST, NIC::PROTO_ARP, &announcement, sizeof(Packet));
+    }
+
     void update(typename NIC::Observed * obs, const typename NIC::Protocol & prot, typename NIC::Buffer * buf)
     {
         db<ARP>(TRC) << "ARP::update(obs=" << obs << ",prot=" << prot << ",buf=" << buf << ")" << endl;
@@ -238,23 +342,39 @@ public:
         Packet * packet = buf->frame()->template data<Packet>();
         db<ARP>(INF) << "ARP::update:pkt=" << packet << " => " << *packet << endl;
 
-        if((packet->op() == REQUEST) && (packet->tpa() == _net->address())) {
+        bool for_me = (packet->tpa() == _net->address());
 
-            Packet reply(REPLY, _nic->address(), _net->address(), packet->sha(), packet->spa());
-            db<ARP>(TRC) << "ARP::update: replying query for " << packet->tpa() << " with " << reply << endl;
-            _nic->send(packet->sha(), NIC::PROTO_ARP, &reply, sizeof(Packet));
+        // Merge the sender's mapping (RFC 826), which also covers replies, gratuitous ARP and requests from peers we are resolving
+        lock();
+        Element * el = _table.search_key(packet->spa());
+        if(el) {
+            Mapping * map = el->object();
+            db<ARP>(TRC) << "ARP::update: " << packet->spa() << " is at " << packet->sha() << endl;
 
-        } else if((packet->op() == REPLY) && (packet->tha() == _nic->address())) {
+            map->_ha = packet->sha();
+            if(map->_ttl != PERMANENT)
+                map->_ttl = TTL;
+            map->_tries = 0;
 
-            lock();
-            Element * el = _table.search_key(packet->spa());
-            if(el) {
-                db<ARP>(TRC) << "ARP::update: got reply for query on " << packet->spa() << ": " << packet->sha() << endl;
-                el->object()->update(packet->sha());
-            } else
-                db<ARP>(WRN) << "ARP::update: got reply for query on " << packet->spa() << ", which is not in table!" << endl;
-            unlock();
+            if(map->_sem) {
+                map->_sem->v();
+                map->_sem = 0;
+            }
 
+            while(!map->_pending.empty())
+                flush(map->_pending.remove()->object(), map->_ha);
+        } else if((packet->op() == REPLY) && for_me)
+            db<ARP>(WRN) << "ARP::update: got reply for query on " << packet->spa() << ", which is not in table!" << endl;
+        unlock();
+
+        // A peer resolving us will most likely talk to us soon
+        if(!el && (packet->op() == REQUEST) && for_me && packet->spa())
+            insert(packet->spa(), packet->sha(), TTL);
+
+        if((packet->op() == REQUEST) && for_me && (packet->spa() != packet->tpa())) {
+            Packet reply(REPLY, _nic->address(), _net->address(), packet->sha(), packet->spa());
+            db<ARP>(TRC) << "ARP::update: replying query for " << packet->tpa() << " with " << reply << endl;
+            _nic->send(packet->sha(), NIC::PROTO_ARP, &reply, sizeof(Packet));
         }
 
         _nic->free(buf);
@@ -264,7 +384,7 @@ public:
         db<ARP>(INF) << "ARP::Table => {" << endl;
         for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++) {
             if(it)
-                db<ARP>(INF) << hex << it << " => {" << it->key() << "," << it->object()->ha() << "}" << endl;
+                db<ARP>(INF) << hex << it << " => " << *it->object() << endl;
             else
                 db<ARP>(INF) << hex << it << " => EMPTY" << endl;
         }
@@ -273,23 +393,178 @@ public:
     }
 
 private:
+    void insert(const PA & pa, const HA & ha, unsigned int ttl) {
+        lock();
+        bool claimed = !_table.search_key(pa) && claim(pa, ha, ttl);
+        unlock();
+
+        if(claimed)
+            replenish();
+    }
+
+    // Must be called with the table locked: inserts the spare mapping as the one for "pa", so misses never use the heap with the
+    // table locked (nor allocate a mapping just to find out it was not needed). Returns 0 if the spare has not been replenished yet.
+    Mapping * claim(const PA & pa, const HA & ha, unsigned int ttl) {
+        Mapping * map = _spare;
+        if(map) {
+            _spare = 0;
+            map->reuse(pa, ha, ttl);
+            _table.insert(map->link());
+        }
+        return map;
+    }
+
+    // Replaces a claimed spare (a mapping that is being discarded might have done it already)
+    void replenish() {
+        if(_spare)
+            return;
+
+        Mapping * map = new (SYSTEM) Mapping(PA(PA::NULL), HA(HA::NULL), 0);
+
+        lock();
+        if(!_spare) {
+            _spare = map;
+            map = 0;
+        }
+        unlock();
+
+        if(map)
+            delete map;
+    }
+
+    bool search(const PA & pa) {
+        lock();
+        bool found = _table.search_key(pa);
+        unlock();
+
+        return found;
+    }
+
+    HA find(const PA & pa) {
+        HA ha = HA(HA::NULL);
+
+        lock();
+        Element * el = _table.search_key(pa);
+        if(el)
+            ha = el->object()->ha();
+        unlock();
+
+        return ha;
+    }
+
+    // Must be called with the table locked
+    void request(Mapping * map) {
+        map->_tries++;
+
+        Packet request(REQUEST, _nic->address(), _net->address(), HA::BROADCAST, map->link()->key());
+        db<ARP>(INF) << "ARP::request:request=" << request << endl;
+        _nic->send(HA::BROADCAST, NIC::PROTO_ARP, &request, sizeof(Packet));
+    }
+
+    // Sends a pool obtained from alloc() to "ha" by copying its frames into the NIC and then frees it
+    void flush(Buffer * pool, const HA & ha) {
+        db<ARP>(TRC) << "ARP::flush(pool=" << pool << ",ha=" << ha << ")" << endl;
+
+        for(typename Buffer::Element * el = pool->link(); el; el = el->next()) {
+            Buffer * buf = el->object();
+            _nic->send(ha, buf->frame()->header()->prot(), buf->frame()->template data<void>(), buf->size());
+        }
+        release(pool);
+    }
+
+    void release(Buffer * pool) {
+        for(typename Buffer::Element * el = pool->link(); el; ) {
+            Buffer * buf = el->object();
+            el = el->next();
+            delete buf;
+        }
+    }
+
+    // Must be called with the table locked
+    Mapping * first() {
+        for(typename Table::Iterator it = _table.begin(); it != _table.end(); it++)
+            if(it)
+                return it->object();
+        return 0;
+    }
+
+    // Must be called with the table locked
+    void discard(Mapping * map) {
+        _table.remove(map->link());
+        while(!map->_pending.empty())
+            release(map->_pending.remove()->object());
+        if(map->_sem)
+            map->_sem->v();
+        if(_spare)
+            delete map;
+        else
+            _spare = map;
+    }
+
+    // Runs every TICK: ages resolved mappings, retries requests for unresolved ones and gives up on those that have run out of tries
+    static void age(ARP * arp) {
+        arp->lock();
+
+        bool expired = false;
+        for(typename Table::Iterator it = arp->_table.begin(); it != arp->_table.end(); it++) {
+            if(!it)
+                continue;
+
+            Mapping * map = it->object();
+            if(map->resolved()) {
+                if((map->_ttl != PERMANENT) && !--map->_ttl)
+                    expired = true;
+            } else if(map->_tries <= RETRIES)
+                arp->request(map);
+            else
+                expired = true;
+        }
+
+        // Removing elements invalidates iterators, so the table is rescanned after each removal
+        while(expired) {
+            expired = false;
+            for(typename Table::Iterator it = arp->_table.begin(); it != arp->_table.end(); it++) {
+                if(!it)
+                    continue;
+
+                Mapping * map = it->object();
+                if(map->resolved() ? !map->_ttl : (map->_tries > RETRIES)) {
+                    db<ARP>(INF) << "ARP::age: removing " << *map << endl;
+                    arp->discard(map);
+                    expired = true;
+                    break;
+                }
+            }
+        }
+
+        arp->unlock();
+    }
+
     void lock() {
+        bool disabled = CPU::int_disabled();
         CPU::int_disable();
         if(Traits<System>::multicore)
             _lock.acquire();
+        _disabled = disabled;
     }
 
     void unlock() {
+        bool disabled = _disabled;
         if(Traits<System>::multicore)
             _lock.release();
-        CPU::int_enable();
+        if(!disabled)
+            CPU::int_enable();
     }
 
 private:
     Table _table;
     Spin _lock;
+    volatile bool _disabled;
     NIC * _nic;
     Network * _net;
+    Mapping * _spare;
+    Functor_Handler<ARP> _handler;
+    Alarm _alarm;
 };
 
 __END_SYS
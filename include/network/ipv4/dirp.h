@@ -6,6 +6,7 @@
 #ifdef __ipv4__
 
 #include <machine/nic.h>
+#include <network/initializer.h>
 #include <synchronizer.h>
 #include <time.h>
 
@@ -33,6 +34,18 @@ public:
 
     typedef RTC::Second Second;
 
+    static const unsigned int MAX_BATCH = Network_Common::MAX_BATCH;
+
+    // Time synchronization strategies (selected by Traits<DIRP>::SYNC_MODE)
+    enum Sync_Mode {
+        SYNC_NTP = Traits<DIRP>::NTP,   // two master timestamps (in seconds) piggybacked on data packets
+        SYNC_PTP = Traits<DIRP>::PTP    // IEEE 1588-like two-step SYNC/FOLLOW_UP and DELAY_REQ/DELAY_RESP exchanges
+    };
+
+    static const Sync_Mode SYNC_MODE = static_cast<Sync_Mode>(Traits<DIRP>::SYNC_MODE);
+    static const Port PTP_PORT = 319;                   // PTP event port
+    static const unsigned int PTP_SYNC_PERIOD = 1000000; // us
+
     class Address
     {
     public:
@@ -71,9 +84,15 @@ public:
         Port _port;
     }__attribute__((packed));
 
+    typedef Network_Common::Message_Desc<Address> Message_Desc;
+
     enum Code {
         NOTHING = 0,
-        ACK = 1
+        ACK = 1,
+        SYNC = 2,
+        FOLLOW_UP = 3,
+        DELAY_REQ = 4,
+        DELAY_RESP = 5
     };
 
     class Header
@@ -88,6 +107,7 @@ public:
         Address to() const { return _to; }
         unsigned short length() const { return _length; }
         Second timestamp() const { return _timestamp; }
+        Code code() const { return _code; }
 
     protected:
         Address _from;
@@ -120,6 +140,87 @@ public:
         Data _data = {0};
     }__attribute__((packed));
 
+    // PTP-like synchronization: a TSC-based clock disciplined in offset and frequency to the master's
+    class PTP
+    {
+        friend class DIRP;
+
+    public:
+        typedef NIC_Common::Timer Timer;
+        typedef Timer::Time_Stamp Time_Stamp; // us
+        typedef Timer::Offset Offset;         // us
+        typedef long long PPB;
+
+        // Payload of SYNC, FOLLOW_UP, DELAY_REQ and DELAY_RESP packets
+        class Message
+        {
+        public:
+            Message() {}
+            Message(unsigned short sequence, const Time_Stamp & time_stamp): _sequence(sequence), _time_stamp(time_stamp) {}
+
+            unsigned short sequence() const { return _sequence; }
+            Time_Stamp time_stamp() const { return _time_stamp; }
+
+        private:
+            unsigned short _sequence;
+            Time_Stamp _time_stamp;
+        }__attribute__((packed));
+
+        struct Statistics
+        {
+            Statistics(): syncs(0), offset(0), max_offset(0), delay(0), drift(0) {}
+
+            friend OStream & operator<<(OStream & db, const Statistics & s) {
+                db << "{syncs=" << s.syncs << ",off=" << s.offset << ",max=" << s.max_offset
+                   << ",delay=" << s.delay << ",drift=" << s.drift << "}";
+                return db;
+            }
+
+            unsigned int syncs;     // completed SYNC/DELAY_REQ rounds
+            Offset offset;          // residual offset measured in the last round (us)
+            Offset max_offset;      // largest residual offset since the first correction (us)
+            Offset delay;           // last estimated one-way path delay (us)
+            PPB drift;              // estimated local frequency error (ppb, positive = local runs fast)
+        };
+
+    public:
+        // Disciplined time, in us since the master's TSC was started; no RTC access involved
+        static Time_Stamp now() { return disciplined(local()); }
+
+        static bool synchronized() { return _statistics.syncs > 1; }
+        static Offset offset() { return _statistics.offset; }
+        static const Statistics & statistics() { return _statistics; }
+
+    private:
+        static Time_Stamp local() { return count2us(Timer::read()); }
+
+        static Time_Stamp count2us(const Time_Stamp & count) {
+            Time_Stamp f = Timer::frequency();
+            return (count / f) * 1000000 + (count % f) * 1000000 / f;
+        }
+
+        static Time_Stamp disciplined(const Time_Stamp & raw) {
+            Offset elapsed = raw - _raw_base;
+            return _base + elapsed - elapsed * _statistics.drift / 1000000000LL;
+        }
+
+        // Restart the disciplined time line at raw, keeping it continuous but for the given step
+        static void rebase(const Time_Stamp & raw, const Offset & step = 0) {
+            _base = disciplined(raw) - step;
+            _raw_base = raw;
+        }
+
+    private:
+        static Time_Stamp _base;
+        static Time_Stamp _raw_base;
+        static Statistics _statistics;
+
+        // Current round (t1, t4 in master's time; t2, t3 in local raw time)
+        static unsigned short _sequence;
+        static Time_Stamp _t1, _t2, _t3;
+        static Time_Stamp _last_t1, _last_t2;
+    };
+
     static void init(unsigned int unit) {
         _networks[unit] = new (SYSTEM) DIRP(unit);
     }
@@ -162,6 +263,9 @@ public:
         _networks[unit] = this;
         _clock = new Clock();
         _clock_start_time = _clock->now();
+
+        if((SYNC_MODE == SYNC_PTP) && is_master(_address))
+            _ptp_alarm = new (SYSTEM) Alarm(PTP_SYNC_PERIOD, &_ptp_handler, Alarm::INFINITE);
     }
 
     static DIRP * get_by_nic(unsigned int unit) {
@@ -175,6 +279,8 @@ public:
     ~DIRP() {
         db<DIRP>(TRC) << "DIRP::~DIRP()" << endl;
         _nic->detach(this, PROTOCOL);
+        if(_ptp_alarm)
+            delete _ptp_alarm;
         delete _clock;
     }
 
@@ -183,6 +289,7 @@ public:
     NIC<Ethernet>* nic() const { return _nic;      }
 
     static int send(const Address::Local & from, const Address & to, const void * data, unsigned int size);
+    static int send_batch(const Address::Local & from, const Message_Desc * msgs, unsigned int n);
     static int receive(Buffer * buf, void * data, unsigned int size);
 
     void update(Observed* obs, const Protocol& prot, Buffer* buf);
@@ -208,6 +315,18 @@ protected:
 
     static void acknowledged(Packet * pkt);
 
+    // Single time out guarding all the ACKs of a batch
+    struct Batch_Timer
+    {
+        Port port;
+        bool timed_out;
+    };
+
+    static void batch_timeout(Batch_Timer * timer) {
+        timer->timed_out = true;
+        notify(timer->port, nullptr);
+    }
+
     bool is_master(const Address& addr) {
         return addr.mac()[5] == 9;
     }
@@ -218,8 +337,10 @@ protected:
     Alarm* _alarm;
     long unsigned int _clock_start_time;
     Clock* _clock;
+    Alarm* _ptp_alarm = 0;
 
-    static Observed _observed;
+    static Hashed_Data_Observed<Buffer, Port> _observed;
+    static Function_Handler _ptp_handler;
     static DIRP* _networks[Traits<Ethernet>::UNITS];
 
     /*
@@ -231,6 +352,10 @@ protected:
     } NTP;
 
     void synchronize_time(Second timestamp);
+
+    PTP::Time_Stamp ptp_send(const Address & to, const Code & code, unsigned short sequence, const PTP::Time_Stamp & time_stamp);
+    void ptp_update(Packet * packet, const PTP::Time_Stamp & rx);
+    static void ptp_sync();
 };
 
 __END_SYS
@@ -10,6 +10,7 @@
 #include <utility/bitmap.h>
 #include <machine/nic.h>
 #include <network/ipv4/arp.h>
+#include <network/initializer.h>
 
 __BEGIN_SYS
 
@@ -28,6 +29,10 @@ public:
     typedef Ethernet::Address MAC_Address;
     typedef NIC_Common::Address<4> Address;
 
+    // Internet checksum (RFC 1071) partial sums: 32-bit words are accumulated in 64 bits, so carries are only folded at the end
+    // Partial sums keep the host's byte order (RFC 1071, 2.B), so folded checksums are stored in headers as they are
+    typedef unsigned long long Checksum;
+
     // RFC 1700 Protocols
     typedef unsigned char Protocol;
     enum {
@@ -41,6 +46,10 @@ public:
     // Buffers received by the NIC, eventually linked into a list
     typedef Ethernet::Buffer Buffer;
 
+    // Scatter-gather lists and zero-copy views over received datagrams
+    typedef Network_Common::Chunk Chunk;
+    typedef Network_Common::View<Buffer> View;
+
     // IP and NIC observer/d
     typedef Data_Observer<Buffer, Protocol> Observer;
     typedef Data_Observed<Buffer, Protocol> Observed;
@@ -60,6 +69,9 @@ public:
             DF = 2  // Don't Fragment
         };
 
+        // Position of _checksum in the header, in 16-bit words
+        static const unsigned int CHECKSUM_WORD = 5;
+
     public:
         Header() {}
         Header(const Address & from, const Address & to, const Protocol & prot, unsigned int size) :
@@ -92,7 +104,19 @@ public:
 
         unsigned short checksum() const { return ntohs(_checksum); }
 
-        void sum() { _checksum = 0; _checksum = htons(IP::checksum(reinterpret_cast<unsigned char *>(this), _ihl * 4)); }
+        void sum() { _checksum = 0; _checksum = ~IP::checksum_fold(IP::checksum_add(0, this, _ihl * 4)); }
+
+        // Incremental (RFC 1624) checksum of a header derived from an already summed one by changing some of its fields
+        void sum(const Header & base) {
+            const unsigned short * from = reinterpret_cast<const unsigned short *>(&base);
+            const unsigned short * to = reinterpret_cast<const unsigned short *>(this);
+            unsigned short chk = base._checksum;
+            for(unsigned int i = 0; i < _ihl * 2U; i++)
+                if((i != CHECKSUM_WORD) && (from[i] != to[i]))
+                    chk = IP::checksum_update(chk, from[i], to[i]);
+            _checksum = chk;
+        }
+
         bool check() { return (IP::checksum(reinterpret_cast<unsigned char *>(this), _ihl * 4) != 0xffff); }
 
         const Address & from() const { return _from; }
@@ -178,74 +202,87 @@ public:
 
     typedef Packet PDU;
 
+    // Reassembly counters
+    struct Statistics
+    {
+        Statistics(): reassembled(0), timeouts(0), dropped(0), evicted(0) {}
+
+        unsigned int reassembled;   // datagrams rebuilt from their fragments
+        unsigned int timeouts;      // datagrams given up for missing fragments
+        unsigned int dropped;       // duplicated, misaligned or out of range fragments
+        unsigned int evicted;       // datagrams given up to keep within the per source bound
+
+        friend OStream & operator<<(OStream & os, const Statistics & s) {
+            os << "{reassembled=" << s.reassembled << ",timeouts=" << s.timeouts << ",dropped=" << s.dropped << ",evicted=" << s.evicted << "}";
+            return os;
+        }
+    };
+
 private:
     // Fragment key = f(from, id) = (from & ~_netmask) << 16 | id (fragmentation can only happen on localnet)
     typedef unsigned long Key;
 
-    // List to hold received Buffers containing datagram fragments
+    // Datagrams being reassembled
     class Fragmented;
     typedef Simple_Hash<Fragmented, Traits<Build>::NODES, Key> Reassembling;
 
+    // Fragments are kept in a slot array indexed by offset, so duplicate detection, completion and ordering don't depend on arrival order
     class Fragmented
     {
         friend class IP;
 
     private:
         static const unsigned int MAX_FRAGMENTS = (MTU + MFS - 1) / MFS; // 45 for Ethernet
+        static const unsigned int SOURCE_DATAGRAMS = 2; // datagrams reassembled at once from each source, so a lossy or hostile peer can't hold up all receive buffers
         typedef Reassembling::Element Element;
 
     public:
-        Fragmented(const Key & key): _frags(MAX_FRAGMENTS), _handler(&timeout, this), _alarm(TIMEOUT, &_handler), _link(this, key) {}
-
-        void insert(Buffer * buf) {
-            Packet * packet = buf->frame()->data<Packet>();
-
-            if(_bitmap.set(packet->offset() / MFS)) // if not a dup, then insert
-                _list.insert(buf->link());
-
-            if(!(packet->flags() & Header::MF))
-                _frags = (packet->offset() + MFS) / MFS;
-
-            db<IP>(TRC) << "IP::Fragmented::insert(frags=" << _frags << ",buf=" << buf << ") => " << *packet << endl;
+        Fragmented(const Key & key, const Address & from): _from(from), _serial(_next_serial++), _frags(MAX_FRAGMENTS), _received(0), _top(0),
+            _handler(&timeout, this), _alarm(TIMEOUT, &_handler), _link(this, key) {
+            memset(_slots, 0, sizeof(_slots));
         }
 
-        bool reassembled() const { return _bitmap.full(_frags); }
+        bool insert(Buffer * buf);
 
-        void reorder();
+        bool reassembled() const { return _received == _frags; }
 
-        Buffer * pool() { return _list.head()->object(); }
+        Buffer * pool(); // chains the fragments in offset order
 
+        const Address & from() const { return _from; }
         Element * link() { return &_link; }
 
     private:
-        static void timeout(Fragmented * frag) {
-            frag->pool()->nic()->free(frag->pool());
-            delete frag;
-        }
+        void free();
+
+        static void timeout(Fragmented * frag);
 
     private:
+        Address _from;
+        unsigned int _serial;
         unsigned int _frags;
+        unsigned int _received;
+        unsigned int _top; // one past the highest fragment received
         Bitmap<MAX_FRAGMENTS> _bitmap;
-        Buffer::List _list;
+        Buffer * _slots[MAX_FRAGMENTS];
         Functor_Handler<Fragmented> _handler;
         Alarm _alarm;
         Element _link;
+
+        static unsigned int _next_serial;
     };
 
 
+public:
+    // Routing (public, since router() and route() hand them out)
     class Router;
 
     class Route
     {
         friend class Router;
 
-    private:
-        typedef Simple_List<Route> Table;
-        typedef Table::Element Element;
-
     public:
         Route(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0):
-            _destination(d), _gateway(g), _genmask(m), _flags(t), _metric(w), _nic(nic), _ip(ip), _arp(arp), _link(this) {}
+            _destination(d), _gateway(g), _genmask(m), _flags(t), _metric(w), _nic(nic), _ip(ip), _arp(arp), _next(0) {}
 
         const Address & gateway() const { return _gateway; }
         NIC<Ethernet> * nic() { return _nic; }
@@ -274,53 +311,62 @@ private:
         IP * _ip;
         ARP<NIC<Ethernet>, IP> * _arp;
 
-        Element _link;
+        Route * _next; // next route with the same prefix (in increasing metric order)
     };
 
 
+    // Routing table: a path-compressed binary trie on destination prefixes (longest prefix match, with the metric breaking ties)
+    // fronted by a small direct-mapped cache of recent destinations that is flushed whenever the table changes
     class Router
     {
     private:
-        typedef Route::Table::Element Element;
+        static const unsigned int CACHE_SIZE = 16; // must be a power of 2
 
-    public:
-        void insert(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0) {
-            Route * route = new (SYSTEM) Route(nic, ip, arp, d, g, m, t, w);
+        typedef unsigned int Key; // IPv4 address in host order
 
-            db<IP>(TRC) << "IP::Router::insert() => " << *route << endl;
+        class Node
+        {
+        public:
+            Node(const Key & prefix, unsigned int length): _prefix(prefix), _length(length), _routes(0) { _child[0] = _child[1] = 0; }
 
-            _table.insert(&route->_link);
-        }
+            Key _prefix;
+            unsigned int _length; // in bits
+            Node * _child[2];
+            Route * _routes;
+        };
 
-        void remove(const Address & to) {
-            db<IP>(TRC) << "IP::Router::remove(to=" << to << ")" << endl;
+        struct Cached
+        {
+            Key to;
+            Route * route;
+        };
 
-            Element * e = _table.head();
-            for(; e && ((to & e->object()->_genmask) != e->object()->_destination); e = e->next());
-            if(e) {
-                db<IP>(INF) << "IP::Router::remove: removing and deleting " << *e->object() << endl;
+    public:
+        Router(): _root(0), _routes(0) { flush(); }
 
-                _table.remove(e);
-                delete e->object();
-            }
-        }
+        void insert(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t = 0, unsigned int w = 0);
+        void remove(const Address & to); // removes the route search(to) would return
+        Route * search(const Address & to);
 
-        Route * search(Address to) {
-            // Assume default (0.0.0.0) to have genmask 0.0.0.0 and be the last route in table
-            // Assume all routes to be network routes (i.g. flags "G")
-            db<IP>(TRC) << "IP::Route::search(to=" << to << ")" << endl;
-
-            Element * e = _table.head();
-            for(; e && ((to & e->object()->_genmask) != e->object()->_destination); e = e->next());
-            if(e) {
-                db<IP>(INF) << "IP::Route::search: found route to " << to << " => " << *e->object() << endl;
-                return e->object();
-            } else
-                return 0;
+        unsigned int routes() const { return _routes; }
+
+    private:
+        static Key key(const Address & a) { return (Key(a[0]) << 24) | (a[1] << 16) | (a[2] << 8) | a[3]; }
+        static unsigned int length(const Address & mask);
+        static Key mask(unsigned int length) { return length ? ~0U << (32 - length) : 0; }
+        static unsigned int bit(const Key & k, unsigned int i) { return (k >> (31 - i)) & 1; }
+        static bool matches(const Key & k, const Node * n) { return ((k ^ n->_prefix) & mask(n->_length)) == 0; }
+
+        Route * lookup(const Key & to);
+        void flush() {
+            for(unsigned int i = 0; i < CACHE_SIZE; i++)
+                _cache[i].route = 0;
         }
 
     private:
-        Route::Table _table;
+        Node * _root;
+        unsigned int _routes;
+        Cached _cache[CACHE_SIZE];
     };
 
 
@@ -359,11 +405,46 @@ public:
 
     static Buffer * alloc(const Address & to, const Protocol & prot, unsigned int once, unsigned int payload);
     static int send(Buffer * buf);
+    static int send(Buffer * pools[], unsigned int n);
 
     static const unsigned int mtu() { return MTU; }
 
     static unsigned short checksum(const void * data, unsigned int size);
 
+    // Checksum building blocks (all but the last block summed into a partial sum must have an even size)
+    static Checksum checksum_add(Checksum sum, const void * data, unsigned int size);
+    static Checksum checksum_copy(Checksum sum, void * to, const void * from, unsigned int size); // memcpy() and checksum_add() in a single pass
+
+    // Cursor over a scatter-gather list, so datagrams can be filled straight from the application's chunks
+    class Gather
+    {
+    public:
+        Gather(const Chunk * chunks, unsigned int n): _chunk(chunks), _end(chunks + n), _offset(0) {}
+
+        unsigned int size() const;
+        void skip(unsigned int size);
+        void copy(void * to, unsigned int size);
+        Checksum copy(Checksum sum, void * to, unsigned int size); // copied bytes are summed as a single block
+
+    private:
+        const unsigned char * next(unsigned int * piece, unsigned int max);
+
+    private:
+        const Chunk * _chunk;
+        const Chunk * _end;
+        unsigned int _offset;
+    };
+    static unsigned short checksum_fold(Checksum sum) {
+        while(sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
+        return sum;
+    }
+    static unsigned short checksum_update(unsigned short checksum, unsigned short from, unsigned short to) { // RFC 1624, eqn. 3
+        return ~checksum_fold(Checksum(static_cast<unsigned short>(~checksum)) + static_cast<unsigned short>(~from) + to);
+    }
+
+    static const Statistics & statistics() { return _statistics; }
+
     static void attach(Observer * obs, const Protocol & prot) { _observed.attach(obs, prot); }
     static void detach(Observer * obs, const Protocol & prot) { _observed.detach(obs, prot); }
 
@@ -387,8 +468,13 @@ private:
 
     static bool notify(const Protocol & prot, Buffer * buf) { return _observed.notify(prot, buf); }
 
+    static Address next_hop(Route * through, const Address & to) { return (through->gateway() == through->ip()->address()) ? to : through->gateway(); }
+    static int hold(Buffer * pool);
+
     static void init(unsigned int unit);
 
+    static Fragmented * reassembly(const Key & key, const Address & from);
+
 protected:
     NIC<Ethernet> * _nic;
     ARP<NIC<Ethernet>, IP> _arp;
@@ -401,6 +487,7 @@ protected:
     static IP * _networks[Traits<Ethernet>::UNITS];
     static Router _router;
     static Reassembling _reassembling;
+    static Statistics _statistics;
     static Observed _observed; // shared by all IP instances, so the default for binding on a port is for all IPs
 };
 
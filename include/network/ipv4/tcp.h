@@ -28,7 +28,17 @@ public:
     static const unsigned int TIMEOUT = Traits<TCP>::TIMEOUT * 1000000;
     static const unsigned int WINDOW = Traits<TCP>::WINDOW;
 
+    // Congestion control (RFC 5681 and RFC 6582) and retransmission timer (RFC 6298)
+    static const unsigned int DUPLICATES = 3;  // duplicate ACKs that trigger a fast retransmit
+    static const unsigned int MIN_RTO = 200000; // us (RFC 6298 asks for 1 s, but EPOS links are mostly local)
+
+    // Receiver side
+    static const unsigned int REORDER = 8;      // out-of-order segments held per connection (each one pins a NIC receive buffer)
+    static const unsigned int DELAYED_ACK = 40000; // us (RFC 1122 allows up to 500 ms)
+
     typedef IP::Buffer Buffer;
+    typedef IP::Chunk Chunk;
+    typedef IP::View View;
 
     typedef UDP::Port Port;
 
@@ -108,6 +118,10 @@ public:
         T * data() { return reinterpret_cast<T *>(&_data); }
 
         void sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int length);
+
+        // Fused version of sum(): the payload is accumulated while being copied (see IP::checksum_copy())
+        IP::Checksum sum_header(const IP::Address & from, const IP::Address & to, unsigned int length);
+        void sum_trailer(IP::Checksum sum) { _checksum = ~IP::checksum_fold(sum); }
         bool check(unsigned int length) { return IP::checksum(this, length) != 0xffff; } // FIXME
 
         friend Debug & operator<<(Debug & db, const Segment & m) {
@@ -141,21 +155,62 @@ public:
 
         typedef void (Connection:: * State_Handler)();
 
+        // Congestion control state and counters
+        struct Statistics
+        {
+            Statistics(): cwnd(0), ssthresh(0), srtt(0), rto(0), segments(0), retransmits(0), fast_retransmits(0), timeouts(0) {}
+
+            unsigned int cwnd;                  // congestion window (bytes)
+            unsigned int ssthresh;              // slow start threshold (bytes)
+            Alarm::Microsecond srtt;            // smoothed round-trip time
+            Alarm::Microsecond rto;             // retransmission timeout
+            unsigned int segments;              // data segments sent
+            unsigned int retransmits;           // data segments retransmitted
+            unsigned int fast_retransmits;      // retransmissions triggered by duplicate ACKs
+            unsigned int timeouts;              // retransmission timer expirations
+
+            friend OStream & operator<<(OStream & os, const Statistics & s) {
+                os << "{cwnd=" << s.cwnd << ",ssthresh=" << s.ssthresh << ",srtt=" << s.srtt << ",rto=" << s.rto
+                   << ",seg=" << s.segments << ",rtx=" << s.retransmits << ",frtx=" << s.fast_retransmits << ",tout=" << s.timeouts << "}";
+                return os;
+            }
+        };
+
     public:
         Connection(const Port & from, const Address & to)
         : Header(from, to.port(), Random::random() & 0x00ffffff, WINDOW), _peer(to.ip()), _peer_window(0), _next(ntohl(_sequence)),
           _unacknowledged(_next), _initial(_next), _state(CLOSED), _handler(&Connection::closed), _current(0), _length(0), _valid(false),
-          _streaming(false), _retransmiting(false), _timeout_handler(&timeout,this), _alarm(0), _tries(0), _observer(0) {}
-        ~Connection() { if(_alarm) delete _alarm; close(); }
+          _streaming(false), _retransmiting(false), _cwnd(INITIAL_WINDOW), _ssthresh(-1U), _recover(_next), _duplicates(0), _recovering(false),
+          _fast_retransmit(false), _rto_expired(false), _timing(false), _timed(0), _srtt(0), _rttvar(0), _rto(TIMEOUT),
+          _reordered(0), _delayed(0), _unread(0), _advertised(0), _ack_handler(&delayed_ack, this), _ack_alarm(DELAYED_ACK, &_ack_handler), _ack_armed(false),
+          _timeout_handler(&timeout,this), _alarm(0), _tries(0), _observer(0) {}
+        ~Connection() {
+            if(_alarm) delete _alarm;
+            close();
+            for(unsigned int i = 0; i < _reordered; i++)
+                _reorder[i]->nic()->free(_reorder[i]);
+        }
 
         const volatile State & state() const { return _state; }
         const Header * header() const { return this; }
 
         int send(const void * data, unsigned int size);
+        int send(const Chunk * chunks, unsigned int n); // gathers the stream from the chunks
         int receive(Buffer * buf, void * data, unsigned int size);
+        int receive(Buffer * buf, View * view); // zero-copy: the payload stays in buf until release()
+        void release(View * view);
+        void discard(Buffer * buf);
 
         const IP::Address & peer() const { return _peer; }
 
+        const Statistics & statistics() {
+            _statistics.cwnd = _cwnd;
+            _statistics.ssthresh = _ssthresh;
+            _statistics.srtt = _srtt;
+            _statistics.rto = _rto;
+            return _statistics;
+        }
+
         unsigned long long id() const {
             unsigned long long tmp = _peer[0] << 24 | _peer[1] << 16 | _peer[2] << 8 | _peer[3];
             tmp = (tmp << 32) | ((to() << 16) | from());
@@ -213,7 +268,7 @@ public:
         void closed();
 
         void fsend(const Flags & flags);
-        int dsend(const void * data, unsigned int size);
+        int dsend(const Chunk * chunks, unsigned int n, unsigned int offset, unsigned int size);
 
         bool check_sequence();
         void process_fin();
@@ -221,6 +276,25 @@ public:
         static void timeout(Connection * c);
         void set_timeout(const Alarm::Microsecond & time = TIMEOUT);
 
+        // Congestion control
+        unsigned int usable();
+        void acknowledged(unsigned int ack);
+        bool duplicated();
+        void measured(const Alarm::Microsecond & rtt);
+        static void retransmission_timeout(Connection * c);
+
+        // Receiver side
+        static Segment * segment(Buffer * pool) { return pool->frame()->data<Packet>()->data<Segment>(); }
+        static unsigned int length(Buffer * pool) { return pool->size() - sizeof(IP::Header) - sizeof(Header); }
+        bool reorder(Buffer * pool);
+        bool reassemble(const unsigned long long & socket);
+        void deliver(const unsigned long long & socket, Buffer * pool, unsigned int length);
+        void consumed(unsigned int length);
+        void acknowledge(bool now = false);
+        void advertise();
+        unsigned int receive_window() const { return (_unread < WINDOW) ? WINDOW - _unread : 0; }
+        static void delayed_ack(Connection * c);
+
     private:
         IP::Address _peer;
         unsigned short  _peer_window;   // (host endianness)
@@ -243,6 +317,36 @@ public:
         volatile bool _retransmiting;
         Condition _stream;
 
+        // Congestion control
+        static const unsigned int INITIAL_WINDOW = (4 * MSS < 4380) ? 4 * MSS : (2 * MSS > 4380) ? 2 * MSS : 4380; // RFC 5681
+        unsigned int _cwnd;
+        unsigned int _ssthresh;
+        unsigned int _recover;                  // SND.NXT when fast recovery started (RFC 6582)
+        volatile unsigned int _duplicates;      // consecutive duplicate ACKs
+        volatile bool _recovering;
+        volatile bool _fast_retransmit;         // set by update() for send() to retransmit the first unacknowledged segment
+        volatile bool _rto_expired;
+
+        // RTT estimation (a single segment is timed at a time and retransmitted ones never are, as per Karn's algorithm)
+        Chronometer _rtt;
+        bool _timing;
+        unsigned int _timed;                    // sequence number whose acknowledgment ends the measurement
+        Alarm::Microsecond _srtt;
+        Alarm::Microsecond _rttvar;
+        Alarm::Microsecond _rto;
+
+        Statistics _statistics;
+
+        // Receiver side (out-of-order reassembly, delayed ACKs and window updates)
+        Buffer * _reorder[REORDER];             // segments beyond RCV.NXT, sorted by sequence number
+        unsigned int _reordered;
+        volatile unsigned int _delayed;         // in-order segments received but not acknowledged yet
+        volatile unsigned int _unread;          // bytes handed to the application but not consumed yet
+        unsigned int _advertised;               // right edge of the last window advertised (RCV.NXT + RCV.WND)
+        Functor_Handler<Connection> _ack_handler;
+        Alarm _ack_alarm;                       // one-shot, rearmed with reset() (it goes off once, idly, after construction)
+        volatile bool _ack_armed;
+
         // Timeout stuff
         Functor_Handler<Connection> _timeout_handler;
         Alarm * _alarm;
@@ -298,7 +402,7 @@ private:
     }
 
 private:
-    static Observed _observed; // Channel protocols are singletons
+    static Hashed_Data_Observed<Buffer, unsigned long long> _observed; // Channel protocols are singletons
 };
 
 __END_SYS
@@ -62,6 +62,11 @@ public:
         Port _port;
     };
 
+    typedef Network_Common::Message_Desc<Address> Message_Desc;
+
+    typedef IP::Chunk Chunk;
+    typedef IP::View View;
+
     typedef Data_Observer<Buffer, Port> Observer;
     typedef Data_Observed<Buffer, Port> Observed;
 
@@ -71,7 +76,7 @@ public:
     public:
         Header() {}
         Header(const Port & from, const Port & to, unsigned int size):
-            _from(htons(from)), _to(htons(to)), _length(htons((size > sizeof(Data) ? sizeof(Data) : size) + sizeof(Header))) {}
+            _from(htons(from)), _to(htons(to)), _length(htons((size > sizeof(Data) ? sizeof(Data) : size) + sizeof(Header))), _checksum(0) {}
 
         Port from() const { return ntohs(_from); }
         Port to() const { return ntohs(_to); }
@@ -98,6 +103,8 @@ public:
 
     typedef unsigned char Data[MTU];
 
+    static const unsigned int MAX_BATCH = Network_Common::MAX_BATCH;
+
     class Message: public Header
     {
     public:
@@ -108,10 +115,12 @@ public:
         template<typename T>
         T * data() { return reinterpret_cast<T *>(&_data); }
 
-        void sum_header(const IP::Address & from, const IP::Address & to);
-        void sum_data(const void * data, unsigned int size);
-        void sum_trailer();
-        bool check() { return Traits<UDP>::checksum ? (IP::checksum(this, length()) != 0xffff) : true; }
+        // The checksum is accumulated while data is copied in or out of the message, so each byte is touched only once
+        IP::Checksum sum_header(const IP::Address & from, const IP::Address & to);
+        IP::Checksum sum_data(IP::Checksum sum, void * to, const void * from, unsigned int size);
+        IP::Checksum sum_data(IP::Checksum sum, void * to, IP::Gather & from, unsigned int size);
+        void sum_trailer(IP::Checksum sum);
+        bool check(IP::Checksum sum) { return !Traits<UDP>::checksum || !_checksum || (IP::checksum_fold(sum) == 0xffff); } // a null checksum was not computed by the sender (RFC 768)
 
         friend Debug & operator<<(Debug & db, const Message & m) {
             db << "{head=" << reinterpret_cast<const Header &>(m) << ",data=" << m._data << "}";
@@ -135,7 +144,11 @@ public:
     }
 
     static int send(const Port & from, const Address & to, const void * data, unsigned int size);
+    static int send(const Port & from, const Address & to, const Chunk * chunks, unsigned int n); // gathers the payload from the chunks
+    static int send_batch(const Port & from, const Message_Desc * msgs, unsigned int n);
     static int receive(Buffer * buf, void * data, unsigned int size);
+    static int receive(Buffer * buf, View * view); // zero-copy: the payload stays in buf until release()
+    static void release(View * view);
 
     static void attach(Observer * obs, const Port & port) { _observed.attach(obs, port); }
     static void detach(Observer * obs, const Port & port) { _observed.detach(obs, port); }
@@ -144,7 +157,9 @@ public:
 private:
     void update(IP::Observed * obs, const IP::Protocol & prot, Buffer * buf);
 
-    static Observed _observed; // Channel protocols are singletons
+    static Buffer * marshal(const Port & from, const Address & to, const Chunk * chunks, unsigned int n, unsigned int * headers);
+
+    static Hashed_Data_Observed<Buffer, Port> _observed; // Channel protocols are singletons
 };
 
 __END_SYS
@@ -8,9 +8,10 @@
 #include <machine/ic.h>
 #include <machine/rtc.h>
 #include <machine/watchdog.h>
+#include <network/ieee802_15_4.h>
 #include <network/tstp/tstp.h>
 
-#if defined(__tstp__) && defined (__mach_cortex_m__)
+#if defined(__tstp__) && (defined(__mach_cortex_m__) || defined(__mach_pc__))
 
 __BEGIN_SYS
 
@@ -106,7 +107,7 @@ public:
     typedef typename Radio::Timer Timer;
     typedef typename Radio::Timer::Time_Stamp Time_Stamp;
 
-    static const unsigned int MTU = Frame::MTU;
+    static const unsigned int MTU = IEEE802_15_4::Frame::MTU;
 
     static unsigned int period() { return PERIOD; }
 
@@ -166,7 +167,7 @@ protected:
             Buffer * b = el->object();
             _tx_schedule.remove(el);
             if(b)
-                free(b);
+                release(b);
         }
     }
 
@@ -290,7 +291,7 @@ protected:
                     if(!queued_buf->destined_to_me) {
                         db<TSTP>(TRC) << "TSTP::MAC::pre_notify: ACK received, ID=" << queued_buf->id << endl;
                         _tx_schedule.remove(el);
-                        delete queued_buf;
+                        release(queued_buf);
                     }
                 }
             }
@@ -374,7 +375,7 @@ public:
                 if(_tx_pending == buf)
                     _tx_pending = 0;
                 ret = true;
-                delete buf;
+                release(buf);
                 break;
             }
         }
@@ -385,7 +386,7 @@ public:
 
     int send(Buffer * buf) {
         if(sniffer) {
-            delete buf;
+            release(buf);
             return 0;
         }
 
@@ -410,7 +411,7 @@ public:
                 if(_tx_pending && (_tx_pending == queued_buf))
                     _tx_pending = buf;
                 _tx_schedule.remove(queued_buf->link());
-                delete queued_buf;
+                release(queued_buf);
             }
         }
         _tx_schedule.insert(buf->link());
@@ -453,12 +454,12 @@ private:
                 /*// Message was created in the future. This might happen when Timekeeper adjusts the timer.
                 if(b->frame()->data<Header>()->time() > now_us) {
                     _tx_schedule.remove(el);
-                    delete b;
+                    release(b);
                 } else */
                 // Drop expired messages
                 if(drop_expired && (b->deadline <= now_us)) {
                     _tx_schedule.remove(el);
-                    delete b;
+                    release(b);
                 } else if(!_tx_pending) {
                     _tx_pending = b;
                     // Prioritize ACKs
@@ -685,7 +686,7 @@ private:
             // Keep Alive messages are never ACK'ed or forwarded
             if(is_keep_alive || _tx_pending->destined_to_me) {
                 _tx_schedule.remove(_tx_pending->link());
-                delete _tx_pending;
+                release(_tx_pending);
                 _tx_pending = 0;
             }
         } else {
@@ -707,9 +708,17 @@ private:
         return (b->id % 14) + 11;
     }
 
-    void free(Buffer * b);
+    static void free(Buffer * b);
     bool equals(Buffer *, Buffer *);
 
+    // Scheduled buffers either come from alloc() or were received and are being relayed in place, in which case they go back to the Radio
+    static void release(Buffer * b) {
+        if(b->references)
+            free(b);
+        else
+            delete b;
+    }
+
     static Microframe _mf;
     static Time_Stamp _mf_time;
     static Hint _receiving_data_hint;
@@ -776,7 +785,7 @@ public:
     typedef typename Radio::Timer Timer;
     typedef typename Radio::Timer::Time_Stamp Time_Stamp;
 
-    static const unsigned int MTU = Frame::MTU;
+    static const unsigned int MTU = IEEE802_15_4::Frame::MTU;
 
 protected:
     static const bool sniffer = Traits<Traits<IEEE802_15_4>::DEVICES::Get<0>::Result>::promiscuous;
@@ -837,7 +846,7 @@ public:
                 if(_tx_pending == buf)
                     _tx_pending = 0;
                 ret = true;
-                delete buf;
+                release(buf);
                 break;
             }
         }
@@ -848,7 +857,7 @@ public:
 
     int send(Buffer * buf) {
         if(sniffer) {
-            delete buf;
+            release(buf);
             return 0;
         }
 
@@ -875,7 +884,7 @@ public:
                 if(_tx_pending && (_tx_pending == queued_buf))
                     _tx_pending = buf;
                 _tx_schedule.remove(queued_buf->link());
-                delete queued_buf;
+                release(queued_buf);
                 db<TSTP>(TRC) << "TSTP_MAC_NOMF::send(b=" << buf << ") => deleted buffer with equivalent message" << endl;
             }
         }
@@ -921,7 +930,7 @@ protected:
                         _tx_pending = 0;
                     }
                     _tx_schedule.remove(el);
-                    delete queued_buf;
+                    release(queued_buf);
                 }
             }
         }
@@ -970,7 +979,7 @@ private:
             _tx_pending = 0;
             }
             _tx_schedule.remove(el);
-            delete b;
+            release(b);
             } else */
             if(drop_expired && (b->deadline <= now_us)) {
                 if(b == _tx_pending) {
@@ -978,7 +987,7 @@ private:
                     _tx_pending = 0;
                 }
                 _tx_schedule.remove(el);
-                delete b;
+                release(b);
             } else if(!_tx_pending) {
                 _tx_pending = b;
             } else if(_tx_pending->destined_to_me) {
@@ -1009,7 +1018,7 @@ private:
                 // based on number of transmission attempts.
                 // This prevents permanent inteference by a given pair of nodes, and
                 // makes unresponded messages have the lowest priorities
-                unsigned int lim = Timer::us2count(CCA_TX_GAP) << _tx_pending->random_backoff_exponent;
+                unsigned int lim = Timer::us2count(IEEE802_15_4::CCA_TX_GAP) << _tx_pending->random_backoff_exponent;
                 if(!lim)
                     lim = Timer::us2count(OFFSET_UPPER_BOUND);
                 if(_tx_pending->destined_to_me) {
@@ -1060,7 +1069,7 @@ private:
 
                 if(_tx_pending->destined_to_me || ((_tx_pending->frame()->data<Header>()->type() == CONTROL) && (_tx_pending->frame()->data<Control>()->subtype() == KEEP_ALIVE))) {
                     _tx_schedule.remove(_tx_pending->link());
-                    delete _tx_pending;
+                    release(_tx_pending);
                 } else
                     _tx_pending->random_backoff_exponent++;
                 _tx_pending = 0;
@@ -1082,12 +1091,20 @@ private:
     }
 
 private:
-    void free(Buffer * b);
+    static void free(Buffer * b);
+
+    // Scheduled buffers either come from alloc() or were received and are being relayed in place, in which case they go back to the Radio
+    static void release(Buffer * b) {
+        if(b->references)
+            free(b);
+        else
+            delete b;
+    }
 
 private:
     static Buffer::List _tx_schedule;
     static Buffer * _tx_pending;
-    static Statistics _stats;
+    static IEEE802_15_4::Statistics _stats;
     static bool _notifying;
 };
 
@@ -1098,13 +1115,18 @@ template<typename Radio>
 TSTP::Buffer * TSTP::MAC<Radio, false>::_tx_pending;
 
 template<typename Radio>
-TSTP::Statistics TSTP::MAC<Radio, false>::_stats;
+IEEE802_15_4::Statistics TSTP::MAC<Radio, false>::_stats;
 
 template<typename Radio>
 bool TSTP::MAC<Radio, false>::_notifying;
 
 __END_SYS
 
+// Emulated radios derive from the MAC, so they can only be declared after it (and must be before the Timekeeper uses their Timer)
+#ifdef __mach_pc__
+#include <machine/pc/radio_emulator.h>
+#endif
+
 #endif
 
 #endif
@@ -36,13 +36,31 @@ public:
     typedef _DH::Public_Key Public_Key;
     typedef _DH::Shared_Key Master_Secret;
 
+private:
+    static const unsigned int MI_SIZE = sizeof(Node_Id) > sizeof(Master_Secret) ? sizeof(Node_Id) : sizeof(Master_Secret);
+
+public:
     class Peer;
     typedef Simple_List<Peer> Peers;
+    typedef Spatial_Grid<Peer, Region::_Sphere, Traits<TSTP>::RADIO_RANGE> Peer_Grid;
     class Peer
     {
+    private:
+        static const unsigned int OTP_WINDOWS = 3; // the current POLY_TIME_WINDOW and its neighbors, to tolerate clock skew
+
+        // One-time password of a POLY_TIME_WINDOW and its expanded key
+        struct OTP_Window
+        {
+            Time window;
+            OTP otp;
+            _AES::Key_Schedule key;
+        };
+
     public:
-        Peer(const Node_Id & id, const Region & v): _id(id), _valid(v), _el(this), _auth_time(0) {
+        Peer(const Node_Id & id, const Region & v): _id(id), _valid(v), _el(this), _spot(this), _auth_time(0) {
             _aes.encrypt(_id, _id, _auth);
+            _poly.k(_id);
+            invalidate();
         }
 
         void valid(const Region & r) { _valid = r; }
@@ -59,13 +77,23 @@ public:
         const Time & authentication_time() { return _auth_time; }
 
         Peers::Element * link() { return &_el; }
+        Peer_Grid::Element * spot() { return &_spot; }
 
         const Master_Secret & master_secret() const { return _master_secret; }
         void master_secret(const Master_Secret & ms) {
             _master_secret = ms;
             _auth_time = TSTP::now();
+            _poly.r(reinterpret_cast<const unsigned char *>(&_master_secret));
+            invalidate();
         }
 
+        // Poly1305-AES keyed with the peer's id (k, whose AES key schedule is thus expanded only once) and master secret (r)
+        _Poly1305 & poly() { return _poly; }
+
+        // OTPs are derived once per window instead of once per message
+        const OTP & otp(const Time & window) { return _otps[slot(window)].otp; }
+        const _AES::Key_Schedule & otp_key(const Time & window) { return _otps[slot(window)].key; }
+
         const Auth & auth() const { return _auth; }
         const Node_Id & id() const { return _id; }
 
@@ -74,13 +102,33 @@ public:
             return db;
         }
 
+    private:
+        unsigned int slot(const Time & window) {
+            unsigned int i = window % OTP_WINDOWS;
+            if(_otps[i].window != window) {
+                _otps[i].window = window;
+                Security::otp(_otps[i].otp, _poly, _master_secret, _id, window);
+                if(use_encryption)
+                    _otps[i].key.key(_otps[i].otp);
+            }
+            return i;
+        }
+
+        void invalidate() {
+            for(unsigned int i = 0; i < OTP_WINDOWS; i++)
+                _otps[i].window = i + 1; // never maps to slot i
+        }
+
     private:
         Node_Id _id;
         Auth _auth;
         Region _valid;
         Master_Secret _master_secret;
         Peers::Element _el;
+        Peer_Grid::Element _spot;
         Time _auth_time;
+        _Poly1305 _poly;
+        OTP_Window _otps[OTP_WINDOWS];
     };
 
     class  Pending_Key;
@@ -224,7 +272,7 @@ public:
     static void add_peer(const unsigned char * peer_id, unsigned int id_len, const Region & valid_region) {
         Node_Id id(peer_id, id_len);
         Peer * peer = new (SYSTEM) Peer(id, valid_region);
-        _pending_peers.insert(peer->link());
+        insert(_pending_peers, _pending_grid, peer);
         if(!_key_manager)
             _key_manager = new (SYSTEM) Thread(&key_manager);
     }
@@ -236,131 +284,121 @@ public:
 private:
     void update(Data_Observed<Buffer> * obs, Buffer * buf);
 
+    static Buffer * open(Buffer * buf);
     static void marshal(Buffer * buf);
 
-    static void pack(unsigned char * msg, const Peer * peer) {
-        Time t = TSTP::now() / POLY_TIME_WINDOW;
+    // Peers are listed for the key manager's round robin and indexed by location for the lookups done on every message
+    static void insert(Peers & peers, Peer_Grid & grid, Peer * peer) {
+        peers.insert(peer->link());
+        grid.insert(peer->spot(), peer->valid());
+    }
 
-        const unsigned char * ms = reinterpret_cast<const unsigned char *>(&peer->master_secret());
-        const unsigned char * id = reinterpret_cast<const unsigned char *>(&peer->id());
+    static void remove(Peers & peers, Peer_Grid & grid, Peer * peer) {
+        peers.remove(peer->link());
+        grid.remove(peer->spot());
+    }
 
-        unsigned char nonce[16];
-        memset(nonce, 0, 16);
-        memcpy(nonce, &t, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-
-        _Poly1305 poly(id, ms);
-
-        poly.stamp(&msg[sizeof(Master_Secret)], nonce, reinterpret_cast<const unsigned char *>(msg), sizeof(Master_Secret));
-
-        if(use_encryption) {
-            // mi = ms ^ _id
-            static const unsigned int MI_SIZE = sizeof(Node_Id) > sizeof(Master_Secret) ? sizeof(Node_Id) : sizeof(Master_Secret);
-            unsigned char mi[MI_SIZE];
-            unsigned int i;
-            for(i = 0; (i < sizeof(Node_Id)) && (i < sizeof(Master_Secret)); i++)
-                mi[i] = id[i] ^ ms[i];
-            for(; i < sizeof(Node_Id); i++)
-                mi[i] = id[i];
-            for(; i < sizeof(Master_Secret); i++)
-                mi[i] = ms[i];
-
-            OTP key;
-            poly.stamp(key, nonce, mi, MI_SIZE);
-            _aes.encrypt(msg, key, msg);
-        }
+    static void trust(Peer * peer) {
+        remove(_pending_peers, _pending_grid, peer);
+        insert(_trusted_peers, _trusted_grid, peer);
     }
 
-    static bool unpack(const Peer * peer, unsigned char * msg, const unsigned char * mac, Time reception_time) {
-        unsigned char original_msg[sizeof(Master_Secret)];
-        memcpy(original_msg, msg, sizeof(Master_Secret));
+    static void distrust(Peer * peer) {
+        remove(_trusted_peers, _trusted_grid, peer);
+        insert(_pending_peers, _pending_grid, peer);
+    }
 
-        const unsigned char * ms = reinterpret_cast<const unsigned char *>(&peer->master_secret());
-        const unsigned char * id = reinterpret_cast<const unsigned char *>(&peer->id());
+    static Peer * search(Peer_Grid & grid, const Space & where, const Time & when) {
+        Peer_Grid::Query query(&grid, where);
+        for(Peer * peer = query.next(); peer; peer = query.next())
+            if(peer->valid_deploy(where, when))
+                return peer;
+        return 0;
+    }
 
-        // mi = ms ^ _id
-        static const unsigned int MI_SIZE = sizeof(Node_Id) > sizeof(Master_Secret) ? sizeof(Node_Id) : sizeof(Master_Secret);
-        unsigned char mi[MI_SIZE];
-        unsigned int i;
-        for(i = 0; (i < sizeof(Node_Id)) && (i < sizeof(Master_Secret)); i++)
-            mi[i] = id[i] ^ ms[i];
-        for(; i < sizeof(Node_Id); i++)
-            mi[i] = id[i];
-        for(; i < sizeof(Master_Secret); i++)
-            mi[i] = ms[i];
+    static void pack(unsigned char * msg, Peer * peer) {
+        Time t = TSTP::now() / POLY_TIME_WINDOW;
 
-        reception_time /= POLY_TIME_WINDOW;
+        unsigned char n[16];
+        nonce(n, t);
 
-        OTP key;
-        unsigned char nonce[16];
-        _Poly1305 poly(id, ms);
+        peer->poly().stamp(&msg[sizeof(Master_Secret)], n, reinterpret_cast<const unsigned char *>(msg), sizeof(Master_Secret));
 
-        memset(nonce, 0, 16);
-        memcpy(nonce, &reception_time, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-        poly.stamp(key, nonce, mi, MI_SIZE);
         if(use_encryption)
-            _aes.decrypt(original_msg, key, msg);
-        if(poly.verify(mac, nonce, msg, sizeof(Master_Secret)))
-            return true;
+            _aes.encrypt(msg, peer->otp_key(t), msg);
+    }
 
-        reception_time--;
-        memset(nonce, 0, 16);
-        memcpy(nonce, &reception_time, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-        poly.stamp(key, nonce, mi, MI_SIZE);
-        if(use_encryption)
-            _aes.decrypt(original_msg, key, msg);
-        if(poly.verify(mac, nonce, msg, sizeof(Master_Secret)))
-            return true;
+    static bool unpack(Peer * peer, unsigned char * msg, const unsigned char * mac, Time reception_time) {
+        unsigned char original_msg[sizeof(Master_Secret)];
+        memcpy(original_msg, msg, sizeof(Master_Secret));
 
-        reception_time += 2;
-        memset(nonce, 0, 16);
-        memcpy(nonce, &reception_time, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-        poly.stamp(key, nonce, mi, MI_SIZE);
-        if(use_encryption)
-            _aes.decrypt(original_msg, key, msg);
-        if(poly.verify(mac, nonce, msg, sizeof(Master_Secret)))
-            return true;
+        reception_time /= POLY_TIME_WINDOW;
+        const Time windows[] = { reception_time, reception_time - 1, reception_time + 1 };
+
+        for(unsigned int i = 0; i < sizeof(windows) / sizeof(Time); i++) {
+            unsigned char n[16];
+            nonce(n, windows[i]);
+            if(use_encryption)
+                _aes.decrypt(original_msg, peer->otp_key(windows[i]), msg);
+            if(peer->poly().verify(mac, n, msg, sizeof(Master_Secret)))
+                return true;
+        }
 
         memcpy(msg, original_msg, sizeof(Master_Secret));
         return false;
     }
 
     // TODO: remove?
-    static void encrypt(const unsigned char * msg, const Peer * peer, unsigned char * out) {
-        OTP key = otp(peer->master_secret(), peer->id());
-        _aes.encrypt(msg, key, out);
+    static void encrypt(const unsigned char * msg, Peer * peer, unsigned char * out) {
+        _aes.encrypt(msg, peer->otp_key(TSTP::now() / POLY_TIME_WINDOW), out);
     }
 
     static OTP otp(const Master_Secret & master_secret, const Node_Id & id) {
-        const unsigned char * ms = reinterpret_cast<const unsigned char *>(&master_secret);
+        OTP out;
+        _Poly1305 poly(id, reinterpret_cast<const unsigned char *>(&master_secret));
+        otp(out, poly, master_secret, id, TSTP::now() / POLY_TIME_WINDOW);
+        return out;
+    }
 
-        // mi = ms ^ _id
-        static const unsigned int MI_SIZE = sizeof(Node_Id) > sizeof(Master_Secret) ? sizeof(Node_Id) : sizeof(Master_Secret);
-        unsigned char mi[MI_SIZE];
-        unsigned int i;
-        for(i = 0; (i < sizeof(Node_Id)) && (i < sizeof(Master_Secret)); i++)
-            mi[i] = id[i] ^ ms[i];
-        for(; i < sizeof(Node_Id); i++)
-            mi[i] = id[i];
-        for(; i < sizeof(Master_Secret); i++)
-            mi[i] = ms[i];
+    // Same as above, but reusing the expanded key of peer's id
+    static OTP otp(const Master_Secret & master_secret, Peer * peer) {
+        OTP out;
+        _Poly1305 poly(peer->poly());
+        poly.r(reinterpret_cast<const unsigned char *>(&master_secret));
+        otp(out, poly, master_secret, peer->id(), TSTP::now() / POLY_TIME_WINDOW);
+        return out;
+    }
+
+    static void otp(OTP & out, _Poly1305 & poly, const Master_Secret & master_secret, const Node_Id & id, const Time & window) {
+        unsigned char m[MI_SIZE];
+        mi(m, master_secret, id);
+
+        unsigned char n[16];
+        nonce(n, window);
+
+        poly.stamp(out, n, m, MI_SIZE);
+    }
+
+    static bool verify_auth_request(const Master_Secret & master_secret, Peer * peer, const OTP & otp) {
+        _Poly1305 poly(peer->poly());
+        poly.r(reinterpret_cast<const unsigned char *>(&master_secret));
 
         Time t = TSTP::now() / POLY_TIME_WINDOW;
+        const Time windows[] = { t, t - 1, t + 1 };
 
-        unsigned char nonce[16];
-        memset(nonce, 0, 16);
-        memcpy(nonce, &t, sizeof(Time) < 16u ? sizeof(Time) : 16u);
+        for(unsigned int i = 0; i < sizeof(windows) / sizeof(Time); i++) {
+            OTP expected;
+            Security::otp(expected, poly, master_secret, peer->id(), windows[i]);
+            if(expected == otp)
+                return true;
+        }
 
-        OTP out;
-        _Poly1305(id, ms).stamp(out, nonce, mi, MI_SIZE);
-        return out;
+        return false;
     }
 
-    static bool verify_auth_request(const Master_Secret & master_secret, const Node_Id & id, const OTP & otp) {
+    // mi = ms ^ _id
+    static void mi(unsigned char * mi, const Master_Secret & master_secret, const Node_Id & id) {
         const unsigned char * ms = reinterpret_cast<const unsigned char *>(&master_secret);
-
-        // mi = ms ^ _id
-        static const unsigned int MI_SIZE = sizeof(Node_Id) > sizeof(Master_Secret) ? sizeof(Node_Id) : sizeof(Master_Secret);
-        unsigned char mi[MI_SIZE];
         unsigned int i;
         for(i = 0; (i < sizeof(Node_Id)) && (i < sizeof(Master_Secret)); i++)
             mi[i] = id[i] ^ ms[i];
@@ -368,30 +406,11 @@ private:
             mi[i] = id[i];
         for(; i < sizeof(Master_Secret); i++)
             mi[i] = ms[i];
+    }
 
-        unsigned char nonce[16];
-        Time t = TSTP::now() / POLY_TIME_WINDOW;
-
-        _Poly1305 poly(id, ms);
-
-        memset(nonce, 0, 16);
-        memcpy(nonce, &t, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-        if(poly.verify(otp, nonce, mi, MI_SIZE))
-            return true;
-
-        t--;
-        memset(nonce, 0, 16);
-        memcpy(nonce, &t, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-        if(poly.verify(otp, nonce, mi, MI_SIZE))
-            return true;
-
-        t += 2;
+    static void nonce(unsigned char * nonce, const Time & window) {
         memset(nonce, 0, 16);
-        memcpy(nonce, &t, sizeof(Time) < 16u ? sizeof(Time) : 16u);
-        if(poly.verify(otp, nonce, mi, MI_SIZE))
-            return true;
-
-        return false;
+        memcpy(nonce, &window, sizeof(Time) < 16u ? sizeof(Time) : 16u);
     }
 
     static int key_manager() {
@@ -423,7 +442,7 @@ private:
                 next = el->next();
                 Peer * p = el->object();
                 if(!p->valid_deploy(p->valid().center, TSTP::now())) {
-                    _trusted_peers.remove(el);
+                    remove(_trusted_peers, _trusted_grid, p);
                     delete p;
                     db<TSTP>(INF) << "TSTP::Security::key_manager(): permanently removed trusted peer" << endl;
                 }
@@ -432,7 +451,7 @@ private:
                 next = el->next();
                 Peer * p = el->object();
                 if(!p->valid_deploy(p->valid().center, TSTP::now())) {
-                    _pending_peers.remove(el);
+                    remove(_pending_peers, _pending_grid, p);
                     delete p;
                     db<TSTP>(INF) << "TSTP::Security::key_manager(): permanently removed pending peer" << endl;
                 }
@@ -443,8 +462,7 @@ private:
                 next = el->next();
                 Peer * p = el->object();
                 if(TSTP::now() - p->authentication_time() > KEY_EXPIRY) {
-                    _trusted_peers.remove(el);
-                    _pending_peers.insert(el);
+                    distrust(p);
                     db<TSTP>(INF) << "TSTP::Security::key_manager(): trusted peer's key expired" << endl;
                 }
             }
@@ -488,6 +506,8 @@ private:
     static volatile bool _peers_lock;
     static Peers _pending_peers;
     static Peers _trusted_peers;
+    static Peer_Grid _pending_grid;
+    static Peer_Grid _trusted_grid;
     static unsigned int _dh_requests_open;
 
     static _AES _aes;
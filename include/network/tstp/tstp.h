@@ -192,6 +192,7 @@ public:
 
     static Buffer * alloc(unsigned int size);
     static int send(Buffer * buf);
+    static Buffer * writable(Buffer * buf);
 
     // Local network Space-Time
     static Space here();
@@ -289,6 +290,25 @@ inline int TSTP::send(TSTP::Buffer * buf)
 }
 
 
+// Copy-on-write for observers that must change a received frame: if the Router is also relaying it in place,
+// a private copy is returned instead (and must be deleted by the caller)
+inline TSTP::Buffer * TSTP::writable(TSTP::Buffer * buf)
+{
+    if(buf->references <= 1)
+        return buf;
+
+    db<TSTP>(TRC) << "TSTP::writable(buf=" << buf << ") => copy" << endl;
+
+    Buffer * copy = alloc(buf->size());
+    memcpy(copy->frame(), buf->frame(), buf->size());
+    copy->size(buf->size());
+    *static_cast<Metadata *>(copy) = *buf;
+    copy->references = 0;
+
+    return copy;
+}
+
+
 inline TSTP::Space TSTP::here() { return Locator::here(); }
 
 inline TSTP::Space TSTP::local(TSTP::Global_Space gs) {
@@ -9,7 +9,9 @@
 #include <utility/geometry.h>
 #include <utility/observer.h>
 #include <utility/hash.h>
+#include <utility/string.h>
 #include <utility/predictor.h>
+#include <utility/time_series.h>
 #include <time.h>
 #include <real-time.h>
 
@@ -478,6 +480,7 @@ public:
 
         // Response
         ADVERTISEMENT   = 1,
+        BATCH           = 2,
 
         // Interest
         ANNOUNCEMENT    = 1,
@@ -603,14 +606,19 @@ public:
     class Interest: public Header
     {
     public:
-        Interest(const Region & region, const Unit & unit, const Device_Id & device, const Mode & mode, const Precision & precision, const Time_Offset & expiry, const Time_Offset & period)
-        : Header(unit, device, INTEREST, NONE, mode, precision), _region(region), _expiry(expiry), _period(period) {}
+        Interest(const Region & region, const Unit & unit, const Device_Id & device, const Mode & mode, const Precision & precision, const Time_Offset & expiry, const Time_Offset & period, const unsigned char & batch = 1, const Time_Offset & latency = 0)
+        : Header(unit, device, INTEREST, NONE, mode, precision), _region(region), _expiry(expiry), _period(period), _batch(batch), _latency(latency) {}
 
         Precision precision() const { return static_cast<Precision>(_subtype); }
         const Region & region() const { return _region; }
         Time_Offset expiry() const { return _expiry; }
         Time_Offset period() const { return _period; }
 
+        // Batching of time-triggered responses: up to batch samples per Response (1 disables batching), none of them
+        // held back for longer than latency (0 for no bound other than batch)
+        unsigned char batch() const { return _batch; }
+        Time_Offset latency() const { return _latency; }
+
         template<typename T>
         const T & value() const { return *reinterpret_cast<const T *>(&_data); }
         template<typename T>
@@ -622,7 +630,7 @@ public:
         bool event_driven() { return !time_triggered(); }
 
         friend Debug & operator<<(Debug & db, const Interest & m) {
-            db << "[INT" << ((m._mode == ALL) ? ".A" : ".S") << "]:{h=" << reinterpret_cast<const Header &>(m) << ",r=" << m._region << ",x=" << m._expiry << ",p=" << m._period << "}";
+            db << "[INT" << ((m._mode == ALL) ? ".A" : ".S") << "]:{h=" << reinterpret_cast<const Header &>(m) << ",r=" << m._region << ",x=" << m._expiry << ",p=" << m._period << ",b=" << int(m._batch) << ",l=" << m._latency << "}";
             return db;
         }
 
@@ -630,6 +638,8 @@ public:
         Region _region;
         Time_Offset _expiry;
         Time_Offset _period;
+        unsigned char _batch;
+        Time_Offset _latency;
         char _data[]; // must be manually allocated (adds 0 bytes to sizeof; can overlap)
     } __attribute__((packed));
 
@@ -652,8 +662,15 @@ public:
 
         unsigned int data_size() const { return _unit.value_size(); };
 
+        // Batched responses (subtype BATCH) carry a time series instead of a single value (see Series)
+        unsigned char * series() { return reinterpret_cast<unsigned char *>(&_data); }
+        const unsigned char * series() const { return reinterpret_cast<const unsigned char *>(&_data); }
+
         friend Debug & operator<<(Debug & db, const Response & m) {
-            db << "[RES]:{h=" << reinterpret_cast<const Header &>(m) << ",c=" << int(m._confidence) << ",x=" << m._expiry << "}";
+            db << "[RES" << ((m._subtype == BATCH) ? ".B" : "") << "]:{h=" << reinterpret_cast<const Header &>(m) << ",c=" << int(m._confidence) << ",x=" << m._expiry;
+            if(m._subtype == BATCH)
+                db << ",n=" << int(m.series()[0]);
+            db << "}";
             return db;
         }
 
@@ -663,6 +680,108 @@ public:
         char _data[]; // must be manually allocated (adds 0 bytes to sizeof; can overlap)
     } __attribute__((packed));
 
+    // Time series carried by batched Responses: a sample count followed by the samples, oldest first, each of them its value
+    // preceded by the time elapsed since the previous sample as a LEB128 varint (0 for the first one). The Response's origin is
+    // the time of the newest sample, so periodic samples cost a byte or two of time stamp each instead of a whole Response.
+    template<typename T, unsigned int CAPACITY>
+    class Series
+    {
+    public:
+        static const unsigned int MAX_COUNT = 255;
+
+    private:
+        static const unsigned int MAX_DELTA_SIZE = (sizeof(Time) * 8 + 6) / 7;
+
+    public:
+        // Iterates over a received series
+        class Reader
+        {
+        public:
+            Reader(const unsigned char * series, const Time & last): _data(&series[1]), _count(series[0]), _time(last) {
+                // Walk the deltas back from the newest sample to find when the oldest was taken
+                const unsigned char * data = _data;
+                for(unsigned int i = 0; i < _count; i++) {
+                    Time delta;
+                    data += unpack(data, &delta) + sizeof(T);
+                    _time -= delta;
+                }
+            }
+
+            bool next(Time * t, T * v) {
+                if(!_count)
+                    return false;
+
+                Time delta;
+                _data += unpack(_data, &delta);
+                _time += delta;
+                memcpy(v, _data, sizeof(T));
+                _data += sizeof(T);
+                *t = _time;
+                _count--;
+
+                return true;
+            }
+
+        private:
+            const unsigned char * _data;
+            unsigned int _count;
+            Time _time;
+        };
+
+    public:
+        Series() { clear(); }
+
+        unsigned int count() const { return _data[0]; }
+        bool empty() const { return !_data[0]; }
+        bool full() const { return (_data[0] == MAX_COUNT) || (_size + MAX_DELTA_SIZE + sizeof(T) > CAPACITY); }
+
+        const Time & first() const { return _first; }
+        const Time & last() const { return _last; }
+
+        const unsigned char * data() const { return _data; }
+        unsigned int size() const { return _size; }
+
+        void append(const Time & t, const T & v) {
+            assert(!full());
+            if(empty())
+                _first = _last = t;
+            _size += pack(&_data[_size], t - _last);
+            memcpy(&_data[_size], &v, sizeof(T));
+            _size += sizeof(T);
+            _last = t;
+            _data[0]++;
+        }
+
+        void clear() {
+            _data[0] = 0;
+            _size = 1;
+        }
+
+    private:
+        static unsigned int pack(unsigned char * data, Time v) {
+            unsigned int i = 0;
+            for(; v >= 0x80; v >>= 7)
+                data[i++] = (v & 0x7f) | 0x80;
+            data[i++] = v;
+            return i;
+        }
+
+        static unsigned int unpack(const unsigned char * data, Time * v) {
+            unsigned int i = 0;
+            *v = 0;
+            do
+                *v |= static_cast<Time>(data[i] & 0x7f) << (7 * i);
+            while(data[i++] & 0x80);
+            return i;
+        }
+
+    private:
+        Time _first;
+        Time _last;
+        unsigned int _size;
+        unsigned char _data[CAPACITY];
+    };
+
     // Commands to SmartData (e.g. actuation)
     class Command: public Header
     {
@@ -786,6 +905,180 @@ template<> inline SmartData::_Space<SmartData::CMx25_16>::operator SmartData::_S
 template<> inline SmartData::_Space<SmartData::CM_32>::operator    SmartData::_Space<CM_32>() const { return _Space<CM_32>(Point<Number, 3>::x,      Point<Number, 3>::y,      Point<Number, 3>::z); }
 
 
+// Time-triggered sampling of all local SmartData, multiplexed on a single periodic thread
+// The thread ticks at the greatest common divisor of the jobs' periods and runs each job whenever its own period elapses.
+// Jobs come and go from the network's receive path and from the jobs themselves, so the list is handled with interrupts
+// disabled (also while the thread walks it, only releasing them to run handlers), while changes to the thread itself are left
+// to it: it adopts a new period after its current pass and finishes when it runs out of jobs, to be deleted by whoever next
+// needs a thread or, at the latest, by the next thread to finish.
+template<typename Network>
+class SmartData_Dispatcher
+{
+public:
+    typedef SmartData::Time_Offset Time_Offset;
+
+    class Job
+    {
+        friend class SmartData_Dispatcher;
+
+    private:
+        typedef typename Simple_List<Job>::Element Element;
+
+    public:
+        Job(Handler * handler, const Time_Offset & period): _handler(handler), _period(period), _remaining(period), _link(this) {}
+
+        const Time_Offset & period() const { return _period; }
+
+    private:
+        Handler * _handler;
+        Time_Offset _period;
+        Time_Offset _remaining;
+        Element _link;
+    };
+
+private:
+    typedef Simple_List<Job> Jobs;
+
+public:
+    static void insert(Job * job) {
+        db<SmartData>(TRC) << "SmartData_Dispatcher::insert(job=" << job << ",p=" << job->_period << ")" << endl;
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        _jobs.insert(&job->_link);
+        bool start = reschedule();
+        if(e)
+            CPU::int_enable();
+
+        if(start)
+            launch();
+    }
+
+    static void remove(Job * job) {
+        db<SmartData>(TRC) << "SmartData_Dispatcher::remove(job=" << job << ")" << endl;
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        if(_cursor == &job->_link) // the dispatcher is about to visit it
+            _cursor = _cursor->next();
+        _jobs.remove(&job->_link);
+        reschedule();
+        if(e)
+            CPU::int_enable();
+    }
+
+    static void period(Job * job, const Time_Offset & p) {
+        db<SmartData>(TRC) << "SmartData_Dispatcher::period(job=" << job << ",p=" << p << ")" << endl;
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        job->_period = p;
+        if(job->_remaining > p)
+            job->_remaining = p;
+        reschedule();
+        if(e)
+            CPU::int_enable();
+    }
+
+    static const Time_Offset & period() { return _period; }
+
+private:
+    // Recomputes the period the thread should tick at and tells whether a thread must be launched for it
+    // Called with interrupts disabled
+    static bool reschedule() {
+        Time_Offset period = 0;
+        for(typename Jobs::Iterator i = _jobs.begin(); i != _jobs.end(); i++)
+            period = period ? gcd(period, i->object()->_period) : i->object()->_period;
+
+        db<SmartData>(TRC) << "SmartData_Dispatcher::reschedule() => p=" << period << endl;
+
+        _period = period;
+        if(!period || _thread || _launching)
+            return false;
+        _launching = true;
+        return true;
+    }
+
+    static void launch() {
+        // A previous thread that ran out of jobs is only deleted once it has really finished (otherwise the next one to finish will)
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        Periodic_Thread * finished = 0;
+        if(_finished && (_finished->state() == Thread::FINISHING)) {
+            finished = _finished;
+            _finished = 0;
+        }
+        if(e)
+            CPU::int_enable();
+        if(finished)
+            delete finished;
+
+        // The thread only runs once it is known as the current one, so it can tell whether it is to retire
+        Periodic_Thread * thread = new (SYSTEM) Periodic_Thread(Periodic_Thread::Configuration(_period, Periodic_Thread::INFINITE, Thread::SUSPENDED), &dispatch);
+
+        CPU::int_disable();
+        _thread = thread;
+        _launching = false;
+        if(e)
+            CPU::int_enable();
+
+        thread->resume();
+    }
+
+    static int dispatch() {
+        Periodic_Thread * self = reinterpret_cast<Periodic_Thread *>(Thread::self());
+
+        while(true) {
+            Time_Offset elapsed = self->period();
+
+            // The next job to visit is kept in _cursor, which remove() advances if it takes that job out of the list meanwhile
+            bool e = CPU::int_enabled();
+            CPU::int_disable();
+            for(typename Jobs::Element * el = _jobs.head(); el; el = _cursor) {
+                Job * job = el->object();
+                _cursor = el->next();
+                job->_remaining -= elapsed;
+                if(job->_remaining <= 0) {
+                    job->_remaining += job->_period;
+                    Handler * handler = job->_handler; // the job might be removed (and destroyed) by its own handler
+                    CPU::int_enable();
+                    (*handler)();
+                    CPU::int_disable();
+                }
+            }
+            _cursor = 0;
+
+            // Changes requested during the pass are only applied now, by the thread itself
+            if(!_period) {
+                Periodic_Thread * previous = _finished; // this thread now owns it, and leaves itself to the next
+                _finished = self;
+                _thread = 0;
+                if(e)
+                    CPU::int_enable();
+                if(previous) {
+                    previous->join(); // it has already left this loop, so it is about to finish
+                    delete previous;
+                }
+                break;
+            }
+            if(self->period() != static_cast<typename Periodic_Thread::Microsecond>(_period))
+                self->period(_period);
+            if(e)
+                CPU::int_enable();
+
+            Periodic_Thread::wait_next();
+        }
+
+        return 0;
+    }
+
+private:
+    static Time_Offset _period;
+    static Periodic_Thread * _thread;
+    static Periodic_Thread * _finished;
+    static volatile bool _launching;
+    static Jobs _jobs;
+    static typename Jobs::Element * volatile _cursor;
+};
+
+
 // Local data source, possibly advertised to or commanded through the network
 template<typename Transducer, typename Network>
 class Responsive_SmartData: public SmartData, public Observed, private Network::Observer, private Transducer::Observer
@@ -805,7 +1098,14 @@ private:
     typedef typename Network::Locator Locator;
     typedef typename Network::Timekeeper Timekeeper;
     typedef typename Select_Predictor<Traits<SmartData>::PREDICTOR>::template Predictor<Time, Value> Predictor;
+    typedef SmartData::Series<Value, sizeof(Header) + Network::MTU - sizeof(Response)> Batch;
+    typedef SmartData_Dispatcher<Network> Dispatcher;
+    typedef typename Dispatcher::Job Job;
+
+public:
+    typedef Time_Series<Time, Value> History;
 
+private:
     class Binding;
     typedef Simple_List<Binding> Interesteds;
     typedef Simple_List<SmartData> Responsives;
@@ -817,13 +1117,25 @@ private:
 
     public:
         Binding(const Interest & interest)
-        : _region(interest.region()), _mode(interest.mode()), _precision(interest.precision()), _expiry(interest.expiry()), _period(interest.period()), _link(this) {}
+        : _region(interest.region()), _mode(interest.mode()), _precision(interest.precision()), _expiry(interest.expiry()), _period(interest.period()),
+          _batch(interest.batch()), _latency(interest.latency()), _remaining(interest.period()), _link(this) {}
 
         const Region & region() const { return _region; }
         const Mode & mode() const { return _mode; }
         const Precision & precision() const { return _precision; }
         const Time_Offset & expiry() const { return _expiry; }
         const Time_Offset & period() const { return _period; }
+        unsigned char batch() const { return _batch; }
+        const Time_Offset & latency() const { return _latency; }
+
+        // Whether the binding's period is over, now that another elapsed us went by
+        bool due(const Time_Offset & elapsed) {
+            _remaining -= elapsed;
+            if(_remaining > 0)
+                return false;
+            _remaining += _period;
+            return true;
+        }
 
         Element * link() { return &_link; }
 
@@ -833,6 +1145,9 @@ private:
         Precision _precision;
         Time_Offset _expiry;
         Time_Offset _period;
+        unsigned char _batch;
+        Time_Offset _latency;
+        Time_Offset _remaining;
 
         Element _link;
     };
@@ -841,13 +1156,14 @@ private:
         ADVERTISE,
         CONCEAL,
         RESPOND,
+        FLUSH,
         CONTROL
     };
 
 public:
     Responsive_SmartData(const Device_Id & dev, const Time_Offset & expiry, const Mode & mode = PRIVATE)
     : _mode(mode), _origin(Locator::here(), Timekeeper::now()), _device(dev), _value(0), _error(ERROR), _confidence(0), _expiry(expiry),
-     _transducer(new (SYSTEM) Transducer(dev)), _predictor(predictive ? new (SYSTEM) Predictor(typename Predictor::Configuration(), false) : 0), _thread(0), _link(this) {
+     _transducer(new (SYSTEM) Transducer(dev)), _predictor(predictive ? new (SYSTEM) Predictor(typename Predictor::Configuration(), false) : 0), _handler(&sample, this), _sampler(0), _batch_size(1), _batch_latency(0), _history(0), _history_heap(0), _link(this) {
         db<SmartData>(TRC) << "SmartData[R](d=" << dev << ",x=" << expiry << ",m=" << mode << ")=>" << this << endl;
         if(active)
             _transducer->attach(this);
@@ -869,8 +1185,11 @@ public:
         process(CONCEAL);
         Network::detach(this, UNIT);
         _responsives.remove(&_link);
-        if(_thread)
-            delete _thread;
+        if(_sampler) {
+            Dispatcher::remove(_sampler);
+            delete _sampler;
+        }
+        history(0);
     }
 
     const Unit unit() const { return UNIT; }
@@ -886,6 +1205,20 @@ public:
     Time_Offset expiry() const { return _expiry; }
     bool expired() const { return Timekeeper::now() > (_origin + _expiry); }
 
+    // Compressed history of the values sensed, kept in a heap of its own with room for the given number of blocks (0 drops it)
+    const History * history() const { return _history; }
+    void history(unsigned int blocks) {
+        if(_history) {
+            delete _history;
+            delete [] _history_heap;
+            _history = 0;
+        }
+        if(blocks) {
+            _history_heap = new (SYSTEM) char[History::footprint(blocks)];
+            _history = new (SYSTEM) History(_history_heap, History::footprint(blocks));
+        }
+    }
+
     operator Value() {
         db<SmartData>(TRC) << "SmartData[R]::operator Value(this=" << this << ")" << endl;
 
@@ -896,6 +1229,7 @@ public:
                 if(!active) {
                     _value = _transducer->sense();
                     _origin = Timekeeper::now();
+                    record();
                 } else {
                     // Active transducer should have called update() timely
                     db<SmartData>(WRN) << "SmartData[R]::value(this=" << this << ",t=" <<_origin.t + _expiry << ",v=" << _value << ") => expired!" << endl;
@@ -916,7 +1250,7 @@ public:
         if(Transducer::TYPE & Transducer::ACTUATOR) {
             _transducer->actuate(v);
             _value = _transducer->sense();
-            if(!_thread && !_interesteds.empty())
+            if(!_sampler && !_interesteds.empty())
                 process(RESPOND);
         } else
             db<SmartData>(WRN) << "SmartData[R]::operator= called for sensing-only transducer!" << endl;
@@ -947,7 +1281,7 @@ public:
     static Time now() { return Timekeeper::now(); }
 
     friend Debug & operator<<(Debug & db, const Responsive_SmartData & d) {
-        db << "{R" << ((d._thread) ? ".TT" : ".ED");
+        db << "{R" << ((d._sampler) ? ".TT" : ".ED");
         switch(d._mode) {
         case FIXED:     db << ".ST"; break;
         case MOBILE:     db << ".MB"; break;
@@ -956,17 +1290,17 @@ public:
         case CUMULATIVE: db << ".SM"; break;
         case PREDICTIVE: db << ".PR"; break;
         }
-        if(d._thread)
-            db << "]:p=" << d._thread->period();
+        if(d._sampler)
+            db << "]:p=" << d._sampler->period();
         db << ":u=" << d.unit() << ",d=" << d._device << ",o=" << d._origin << ",v=" << d._value << ",e=" << int(d._error) << ",c=" << d._confidence << ",x=" << d._expiry << "}";
         return db;
     }
 
 private:
     void process(const Operation & op) {
-        db<SmartData>(TRC) << "SmartData[R]::process(op=" << ((op == ADVERTISE) ? "ADV" : (op == CONCEAL) ? "CON" : (op == RESPOND) ? "RES" : "CTL") << ")" << endl;
+        db<SmartData>(TRC) << "SmartData[R]::process(op=" << ((op == ADVERTISE) ? "ADV" : (op == CONCEAL) ? "CON" : (op == RESPOND) ? "RES" : (op == FLUSH) ? "FLU" : "CTL") << ")" << endl;
 
-        Buffer * buffer = Network::alloc(sizeof(Response) + sizeof(Value));
+        Buffer * buffer = Network::alloc(sizeof(Response) + ((op == FLUSH) ? _batch.size() : sizeof(Value)));
         Header * header = buffer->frame()->template data<Header>();
         Response * response = new (header) Response(_origin, UNIT, _device, _mode, _error, _confidence, _expiry);
 
@@ -977,6 +1311,12 @@ private:
         case RESPOND:
             response->value<Value>(_value);
             break;
+        case FLUSH:
+            response->subtype(BATCH);
+            response->origin(_batch.last());
+            memcpy(response->series(), _batch.data(), _batch.size());
+            _batch.clear();
+            break;
         }
 
         db<SmartData>(INF) << "SmartData[R]::process:msg=" << *response << endl;
@@ -1003,6 +1343,7 @@ private:
                     if(!active) {
                         _value = _transducer->sense();
                         _origin = Timekeeper::now();
+                        record();
                     }
                     db<SmartData>(INF) << "SmartData[R]::value:n=" << Timekeeper::now() << ",t=" << _origin.t << ",t+e=" << _origin.t + _expiry << ")" << endl;
                     process(RESPOND);
@@ -1055,8 +1396,9 @@ private:
         _origin = Timekeeper::now();
         _value = _transducer->sense();
         db<SmartData>(TRC) << "SmartData[R]::update(this=" << this << ",x=" << _expiry << ")=>" << _value << endl;
+        record();
         notify();
-        if(!_thread && !_interesteds.empty())
+        if(!_sampler && !_interesteds.empty())
             process(RESPOND);
     }
 
@@ -1072,14 +1414,10 @@ private:
         if(i == _interesteds.end()) {
             Binding * binding = new (SYSTEM) Binding(*interest);
             _interesteds.insert(binding->link());
-            if(interest->period()) {
-                if(!_thread)
-                    _thread = new (SYSTEM) Periodic_Thread(interest->period(), &updater, _device, interest->expiry(), this);
-                else
-                    if(interest->period() != _thread->period())
-                        _thread->period(interest->period()); // FIXME: MDC(_thread->period(), interest->period())
-            }
+            if(interest->period())
+                resample();
             bound = true;
+            rebatch();
         }
 
         return bound;
@@ -1096,33 +1434,99 @@ private:
         if(i != _interesteds.end()) {
             _interesteds.remove(i);
             delete i->object();
+            resample();
             if(_interesteds.empty()) {
-                if(_thread) {
-                    delete _thread;
-                    _thread = 0;
-                }
                 if(_predictor){
                     delete _predictor;
                     _predictor = 0;
                 }
                 bound = false;
             }
+            rebatch();
         }
 
         return bound;
     }
 
+    // Time-triggered bindings share a single sampling job, whose period divides all of theirs
+    void resample() {
+        Time_Offset period = 0;
+        for(typename Interesteds::Iterator i = _interesteds.begin(); i != _interesteds.end(); i++)
+            if(i->object()->period())
+                period = period ? gcd(period, i->object()->period()) : i->object()->period();
 
-    // Time-triggered updater
-    static int updater(unsigned int device, Time_Offset expiry, Responsive_SmartData * sd) {
-        db<SmartData>(TRC) << "SmartData[R]::updater(d=" << device << ",x=" << expiry << ",sd=" << sd << ")" << endl;
-        while(true) {
-            sd->_value = sd->_transducer->sense();
-            sd->_origin = Timekeeper::now();
-            sd->process(RESPOND);
-            Periodic_Thread::wait_next();
+        db<SmartData>(TRC) << "SmartData[R]::resample() => p=" << period << endl;
+
+        if(!period) {
+            if(_sampler) {
+                Dispatcher::remove(_sampler);
+                delete _sampler;
+                _sampler = 0;
+            }
+        } else if(!_sampler) {
+            _sampler = new (SYSTEM) Job(&_handler, period);
+            Dispatcher::insert(_sampler);
+        } else if(period != _sampler->period())
+            Dispatcher::period(_sampler, period);
+    }
+
+    // Time-triggered responses are batched as much as the most demanding binding allows
+    void rebatch() {
+        _batch_size = _interesteds.empty() ? 1 : Batch::MAX_COUNT;
+        _batch_latency = 0;
+        for(typename Interesteds::Iterator i = _interesteds.begin(); i != _interesteds.end(); i++) {
+            Binding * binding = i->object();
+            if(binding->batch() < _batch_size)
+                _batch_size = binding->batch() ? binding->batch() : 1;
+            if(binding->latency() && (!_batch_latency || (binding->latency() < _batch_latency)))
+                _batch_latency = binding->latency();
         }
-        return 0;
+
+        db<SmartData>(TRC) << "SmartData[R]::rebatch() => {b=" << int(_batch_size) << ",l=" << _batch_latency << "}" << endl;
+
+        // Samples held for a batch that no longer is go out right away (or nowhere, if nobody is interested anymore)
+        if(!_batch.empty() && ((_batch.count() >= _batch_size) || _interesteds.empty())) {
+            if(_interesteds.empty())
+                _batch.clear();
+            else
+                process(FLUSH);
+        }
+    }
+
+    void record() {
+        if(_history)
+            _history->insert(_origin.t, _value);
+    }
+
+    // Accumulates a time-triggered sample, sending the batch once it is as big or as old as the interesteds tolerate
+    void accumulate() {
+        _batch.append(_origin.t, _value);
+        if((_batch.count() >= _batch_size) || _batch.full()
+            || (_batch_latency && (_batch.last() + _sampler->period() - _batch.first() > static_cast<Time>(_batch_latency))))
+            process(FLUSH);
+    }
+
+
+    // Time-triggered sampler, run by the Dispatcher at the greatest common divisor of the bindings' periods
+    static void sample(Responsive_SmartData * sd) {
+        db<SmartData>(TRC) << "SmartData[R]::sample(sd=" << sd << ")" << endl;
+
+        sd->_value = sd->_transducer->sense();
+        sd->_origin = Timekeeper::now();
+        sd->record();
+
+        // Only bindings whose own period is over get this sample
+        bool due = false;
+        for(typename Interesteds::Iterator i = sd->_interesteds.begin(); i != sd->_interesteds.end(); i++)
+            if(i->object()->period() && i->object()->due(sd->_sampler->period()))
+                due = true;
+        if(!due)
+            return;
+
+        if(sd->_batch_size > 1)
+            sd->accumulate();
+        else
+            sd->process(RESPOND);
     }
 
 private:
@@ -1136,11 +1540,19 @@ private:
 
     Transducer * _transducer;
     Predictor * _predictor;
-    Periodic_Thread * _thread;
+    Functor_Handler<Responsive_SmartData> _handler;
+    Job * _sampler;
+    Interesteds _interesteds;
+
+    unsigned char _batch_size;
+    Time_Offset _batch_latency;
+    Batch _batch;
+
+    History * _history;
+    char * _history_heap;
 
     typename Simple_List<SmartData>::Element _link;
 
-    static Interesteds _interesteds;
     static Responsives _responsives;
 };
 
@@ -1164,9 +1576,15 @@ private:
     typedef typename Network::Locator Locator;
     typedef typename Network::Timekeeper Timekeeper;
     typedef typename Select_Predictor<Traits<SmartData>::PREDICTOR>::template Predictor<Time, Value> Predictor;
+    typedef SmartData::Series<Value, sizeof(Header) + Network::MTU - sizeof(Response)> Batch;
 
     typedef Simple_List<SmartData> Interests;
 
+public:
+    typedef Time_Series<Time, Value> History;
+
+private:
+
     enum Operation {
         ANNOUNCE,
         SUPPRESS,
@@ -1175,9 +1593,10 @@ private:
     };
 
 public:
-    Interested_SmartData(const Region & region, const Time_Offset & expiry, const Time_Offset & period = 0, const Mode & mode = SINGLE, const Precision & precision = 0, const Device_Id & device = UNIQUE)
-    : _mode(mode), _region(region), _device(device), _precision(precision), _expiry(expiry), _period(period), _value(0), _predictor((predictive && (mode & PREDICTIVE)) ? new (SYSTEM) Predictor : 0), _link(this) {
-        db<SmartData>(TRC) << "SmartData[I](r=" << region << ",d=" << device << ",x=" << expiry << ",m=" << mode << ",e=" << int(precision) << ",p=" << period << ")=>" << this << endl;
+    // Time-triggered interests can accept batches of up to batch samples, none older than latency when sent (see Interest::batch())
+    Interested_SmartData(const Region & region, const Time_Offset & expiry, const Time_Offset & period = 0, const Mode & mode = SINGLE, const Precision & precision = 0, const Device_Id & device = UNIQUE, const unsigned char & batch = 1, const Time_Offset & latency = 0)
+    : _mode(mode), _region(region), _device(device), _precision(precision), _expiry(expiry), _period(period), _batch(batch), _latency(latency), _predictor((predictive && (mode & PREDICTIVE)) ? new (SYSTEM) Predictor : 0), _link(this), _history(0), _history_heap(0), _value(0) {
+        db<SmartData>(TRC) << "SmartData[I](r=" << region << ",d=" << device << ",x=" << expiry << ",m=" << mode << ",e=" << int(precision) << ",p=" << period << ",b=" << int(batch) << ",l=" << latency << ")=>" << this << endl;
         _interests.insert(&_link);
         Network::attach(this, UNIT);
         process(ANNOUNCE);
@@ -1189,6 +1608,7 @@ public:
         process(SUPPRESS);
         Network::detach(this, UNIT);
         _interests.remove(&_link);
+        history(0);
     }
 
     const Unit unit() const { return UNIT; }
@@ -1205,6 +1625,20 @@ public:
     Time_Offset expiry() const { return _response.expiry; }
     bool expired() const { return Timekeeper::now() > (_response.time() + _expiry); }
 
+    // Compressed history of the values received, kept in a heap of its own with room for the given number of blocks (0 drops it)
+    const History * history() const { return _history; }
+    void history(unsigned int blocks) {
+        if(_history) {
+            delete _history;
+            delete [] _history_heap;
+            _history = 0;
+        }
+        if(blocks) {
+            _history_heap = new (SYSTEM) char[History::footprint(blocks)];
+            _history = new (SYSTEM) History(_history_heap, History::footprint(blocks));
+        }
+    }
+
     operator Value & () {
         if(expired()) {
             if(predictive)
@@ -1280,7 +1714,7 @@ private:
 
         Buffer * buffer = Network::alloc(sizeof(Interest) + sizeof(Value));
         Header * header = buffer->frame()->template data<Header>();
-        Interest * interest = new (header) Interest(_region, UNIT, _device, _mode, _precision, _expiry, _period);
+        Interest * interest = new (header) Interest(_region, UNIT, _device, _mode, _precision, _expiry, _period, _batch, _latency);
 
         switch(op) {
         case ANNOUNCE:
@@ -1316,12 +1750,28 @@ private:
             if((response->unit() == UNIT) && _region.contains(response->origin())) {
                 if(response->subtype() == ADVERTISEMENT)
                     process(ANNOUNCE);
-                else {
+                else if(response->subtype() == BATCH) {
+                    // Observers see each sample of the batch as if it had come in a response of its own
+                    typename Batch::Reader reader(response->series(), response->origin().t);
+                    Time t;
+                    Value v;
+                    _response = *response;
+                    while(reader.next(&t, &v)) {
+                        _response.origin(t);
+                        if(_mode & CUMULATIVE)
+                            _value += v;
+                        else
+                            _value = v;
+                        record();
+                        notify();
+                    }
+                } else {
                     _response = *response;
                     if(_mode & CUMULATIVE)
                         _value += response->template value<Value>();
                     else
                         _value = response->template value<Value>();
+                    record();
                     notify();
                 }
             } else
@@ -1357,6 +1807,11 @@ private:
         }
     }
 
+    void record() {
+        if(_history)
+            _history->insert(_response.origin().t, _value);
+    }
+
 private:
     // Interested attributes
     Mode _mode;
@@ -1365,9 +1820,14 @@ private:
     Precision _precision;
     Time_Offset _expiry;
     Time_Offset _period;
+    unsigned char _batch;
+    Time_Offset _latency;
     Predictor * _predictor;
     typename Simple_List<SmartData>::Element _link;
 
+    History * _history;
+    char * _history_heap;
+
     // Last response attributes
     Value _value;
     Response _response;
@@ -1388,8 +1848,19 @@ public:
     virtual ~Controller_SmartData();
 };
 
-template<typename Transducer, typename Network>
-typename Responsive_SmartData<Transducer, Network>::Interesteds Responsive_SmartData<Transducer, Network>::_interesteds;
+template<typename Network>
+typename SmartData_Dispatcher<Network>::Time_Offset SmartData_Dispatcher<Network>::_period;
+template<typename Network>
+Periodic_Thread * SmartData_Dispatcher<Network>::_thread;
+template<typename Network>
+Periodic_Thread * SmartData_Dispatcher<Network>::_finished;
+template<typename Network>
+volatile bool SmartData_Dispatcher<Network>::_launching;
+template<typename Network>
+typename SmartData_Dispatcher<Network>::Jobs SmartData_Dispatcher<Network>::_jobs;
+template<typename Network>
+typename SmartData_Dispatcher<Network>::Jobs::Element * volatile SmartData_Dispatcher<Network>::_cursor;
+
 template<typename Transducer, typename Network>
 typename Responsive_SmartData<Transducer, Network>::Responsives Responsive_SmartData<Transducer, Network>::_responsives;
 
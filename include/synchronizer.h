@@ -5,6 +5,8 @@
 
 #include <architecture.h>
 #include <utility/handler.h>
+#include <utility/buffer.h>
+#include <utility/spin.h>
 #include <process.h>
 
 __BEGIN_SYS
@@ -164,8 +166,8 @@ public:
         for(Element * e = _observers.head(); e; e = e->next()) {
             if(e->rank() == c) {
                 db<Observeds, Semaphore>(INF) << "Observed::notify(this=" << this << ",obs=" << e->object() << ")" << endl;
-                e->object()->update(c, d);
-                notified = true;
+                if(e->object()->update(c, d))
+                    notified = true;
             }
         }
 
@@ -181,6 +183,10 @@ class Concurrent_Observer
 {
     friend class Concurrent_Observed<D, C>;
 
+private:
+    // Enough to hold a whole NIC receive ring
+    static const unsigned int BUFFERS = 256;
+
 public:
     typedef D Observed_Data;
     typedef C Observing_Condition;
@@ -194,19 +200,60 @@ public:
         db<Observers>(TRC) << "~Observer(this=" << this << ")" << endl;
     }
 
-    void update(const C & c, D * d) {
-        _list.insert(d->lext());
-        _semaphore.v();
+    // Producer side (usually in interrupt context): the semaphore is only signaled when the consumer had taken everything else
+    // Null data is queued too, so updated() can return it as a wakeup (e.g. a time out) in order with the data around it
+    // Returns false if the ring is full, in which case the data was not taken and remains owned by the caller
+    // Producers (ISRs of different NICs, possibly nested or on different CPUs) are serialized here, since the ring takes only one
+    bool update(const C & c, D * d) {
+        bool was_empty;
+        bool e = CPU::int_enabled();
+        CPU::int_disable();
+        if(Traits<System>::multicore)
+            _producers.acquire();
+        bool inserted = _ring.insert(d, &was_empty);
+        if(Traits<System>::multicore)
+            _producers.release();
+        if(e)
+            CPU::int_enable();
+
+        if(!inserted) {
+            db<Observers>(WRN) << "Concurrent_Observer::update: ring full!" << endl;
+            return false;
+        }
+        if(was_empty)
+            _semaphore.v();
+        return true;
+    }
+
+    // Consumer side: blocks until data is available and then takes up to max items at once
+    // The semaphore may have been signaled for items already consumed, hence the loop
+    unsigned int updated(D * ds[], unsigned int max) {
+        unsigned int n;
+        while(!(n = _ring.remove(ds, max)))
+            _semaphore.p();
+        return n;
     }
 
     D * updated() {
-        _semaphore.p();
-        return _list.remove()->object();
+        D * d;
+        updated(&d, 1);
+        return d;
+    }
+
+    // Bounded consumer side: gives up, returning 0, once *expired is set (usually by an alarm that then calls wakeup())
+    unsigned int updated(D * ds[], unsigned int max, volatile bool * expired) {
+        unsigned int n;
+        while(!(n = _ring.remove(ds, max)) && !*expired)
+            _semaphore.p();
+        return n;
     }
 
+    void wakeup() { _semaphore.v(); }
+
 private:
     Semaphore _semaphore;
-    Simple_List<D> _list;
+    SPSC_Ring<D *, BUFFERS> _ring;
+    Simple_Spin _producers;
     typename Concurrent_Observed<D, C>::Element _link;
 };
 
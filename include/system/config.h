@@ -96,6 +96,7 @@ namespace EPOS {
 #define __NIC_H                 __HEADER_MACH(nic)
 #define __FPGA_H                __HEADER_MACH(fpga)
 #define __AES_H                 __HEADER_MACH(aes)
+#define __WATCHDOG_H            __HEADER_MACH(watchdog)
 #define __ipv4__
 #define __tstp__
 
@@ -146,6 +146,8 @@ template<typename Family> class NIC;
 class PCNet32;
 class C905;
 class E100;
+class Loopback;
+class Radio_Emulator;
 class CC2538;
 class M95;
 class AT86RF;
@@ -193,6 +195,7 @@ class IP;
 class ICMP;
 class UDP;
 class TCP;
+class DIRP;
 class DHCP;
 class HTTP;
 class IPC;
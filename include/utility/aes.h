@@ -24,9 +24,25 @@ private:
 
 public:
     static const unsigned int KEY_SIZE = 16;
+    static const unsigned int BLOCK_SIZE = 16;
+
+    // Expanded key (i.e. the round keys), so callers that use the same key for many blocks expand it only once
+    class Key_Schedule
+    {
+        friend class _AES<16>;
+
+    public:
+        Key_Schedule() {}
+        Key_Schedule(const unsigned char * key) { expand_key(key, _round_key); }
+
+        void key(const unsigned char * key) { expand_key(key, _round_key); }
+
+    private:
+        unsigned char _round_key[Nb * (Nr + 1) * 4];
+    };
 
 public:
-    _AES(const Mode & m = ECB): _mode(m) {
+    _AES(const Mode & m = ECB): _mode(m), _schedule(_round_key) {
         assert((m == ECB) || (m == CBC));
         for(unsigned int i = 0; i < 23; i++)
             iv[i] = 0;
@@ -37,6 +53,31 @@ public:
     void encrypt(const unsigned char * data, const unsigned char * key, unsigned char * result) { crypt(data, key, result, true); }
     void decrypt(const unsigned char * data, const unsigned char * key, unsigned char * result) { crypt(data, key, result, false); }
 
+    // ECB with an expanded key
+    void encrypt(const unsigned char * data, const Key_Schedule & key, unsigned char * result) {
+        block_copy(result, data);
+        _schedule = key._round_key;
+        encrypt_block(result);
+    }
+    void decrypt(const unsigned char * data, const Key_Schedule & key, unsigned char * result) {
+        block_copy(result, data);
+        _state = reinterpret_cast<State *>(result);
+        _schedule = key._round_key;
+        inv_cipher();
+    }
+
+    // CTR (NIST SP 800-38A): size bytes of data are XORed with the encryption of counter, counter + 1, ...
+    // The counter block is incremented as a 128-bit big-endian number; result may be data
+    void ctr(const unsigned char * data, unsigned int size, const Key_Schedule & key, const unsigned char * counter, unsigned char * result);
+
+    // CCM (NIST SP 800-38C): CBC-MAC over nonce, associated data (aad) and data, followed by CTR
+    // nonce_size must be in [7, 13] and tag_size even and in [4, 16]; result may be data
+    void ccm_encrypt(const unsigned char * data, unsigned int size, const Key_Schedule & key, const unsigned char * nonce, unsigned int nonce_size,
+                     const unsigned char * aad, unsigned int aad_size, unsigned char * result, unsigned char * tag, unsigned int tag_size);
+    // Returns false (and zeroes result) if the tag does not match
+    bool ccm_decrypt(const unsigned char * data, unsigned int size, const Key_Schedule & key, const unsigned char * nonce, unsigned int nonce_size,
+                     const unsigned char * aad, unsigned int aad_size, unsigned char * result, const unsigned char * tag, unsigned int tag_size);
+
 private:
     void mode(const Mode & m) {
         assert((m == ECB) || (m == CBC));
@@ -80,7 +121,7 @@ private:
     void ebc_encrypt(const unsigned char * input, const unsigned char * key, unsigned char *output);
     void ebc_decrypt(const unsigned char * input, const unsigned char * key, unsigned char *output);
 
-    void expand_key();
+    static void expand_key(const unsigned char * key, unsigned char * round_key);
     void add_round_key(int round);
     void sub_bytes();
     void shift_rows();
@@ -92,6 +133,16 @@ private:
     void cipher();
     void inv_cipher();
 
+    void encrypt_block(unsigned char * block) {
+        _state = reinterpret_cast<State *>(block);
+        cipher();
+    }
+
+    void ccm_counter(unsigned char * counter, const unsigned char * nonce, unsigned int nonce_size);
+    void ccm_mac(unsigned char * mac, const unsigned char * data, unsigned int size, const unsigned char * nonce, unsigned int nonce_size,
+                 const unsigned char * aad, unsigned int aad_size, unsigned int tag_size);
+    void cbc_mac(unsigned char * mac, unsigned int offset, const unsigned char * data, unsigned int size);
+
     void block_copy(unsigned char * output, const unsigned char * input) { memcpy(output, input, KEY_SIZE); }
 
     unsigned char xtime(unsigned char x) { return ((x<<1) ^ (((x>>7) & 1) * 0x1b)); }
@@ -109,8 +160,8 @@ private:
     Mode _mode;
 
     State * _state;
-    unsigned char _round_key[176];
-    const unsigned char * _key;
+    unsigned char _round_key[Nb * (Nr + 1) * 4];
+    const unsigned char * _schedule; // round keys in use, either _round_key or a Key_Schedule's
     unsigned char * _iv; // initial Vector used only for CBC mode
     unsigned char iv[23];
 
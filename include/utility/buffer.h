@@ -147,6 +147,67 @@ private:
     unsigned int _tail;
     T _data[N_ELEMENTS];
 };
+
+
+// Lock-free Single-Producer, Single-Consumer Ring
+// The producer (e.g. an ISR) only writes _head and the consumer (e.g. a thread) only writes _tail, so no locking is needed
+// between them; several producers (or several consumers) must however be serialized by the caller
+// N_ELEMENTS must be a power of two, since the free running indexes are wrapped by masking
+template<typename T, unsigned int N_ELEMENTS>
+class SPSC_Ring
+{
+private:
+    static const unsigned int MASK = N_ELEMENTS - 1;
+
+public:
+    typedef T Object_Type;
+
+public:
+    SPSC_Ring(): _head(0), _tail(0) {}
+
+    unsigned int size() const { return _head - _tail; }
+    bool empty() const { return _head == _tail; }
+    bool full() const { return size() == N_ELEMENTS; }
+
+    // Producer side: returns false if the ring is full; was_empty reports that the consumer had taken everything before this element
+    // It is decided after the element is published (and remove() reads _head only after publishing _tail), so a consumer that
+    // found the ring empty and is about to block is never missed
+    bool insert(const Object_Type & o, bool * was_empty = 0) {
+        unsigned int head = _head;
+        if(head - _tail == N_ELEMENTS)
+            return false;
+        _data[head & MASK] = o;
+        __sync_synchronize(); // the element must be visible before the index that publishes it
+        _head = head + 1;
+        __sync_synchronize();
+        if(was_empty)
+            *was_empty = (_tail == head);
+        return true;
+    }
+
+    // Consumer side: moves up to max elements into os, returning how many were moved
+    unsigned int remove(Object_Type * os, unsigned int max) {
+        unsigned int tail = _tail;
+        unsigned int n = _head - tail;
+        if(n > max)
+            n = max;
+        __sync_synchronize(); // elements must be read after the index that published them
+        for(unsigned int i = 0; i < n; i++)
+            os[i] = _data[(tail + i) & MASK];
+        __sync_synchronize();
+        _tail = tail + n;
+        __sync_synchronize(); // see insert()
+        return n;
+    }
+
+    bool remove(Object_Type * o) { return remove(o, 1); }
+
+private:
+    volatile unsigned int _head;
+    volatile unsigned int _tail;
+    Object_Type _data[N_ELEMENTS];
+};
+
 __END_UTIL
 
 #endif
@@ -204,6 +204,214 @@ public:
     Radius radius;
 }__attribute__((packed));
 
+// Uniform grid index of spheres, answering "who is inside/near this sphere" by visiting only the cells the query overlaps
+// Objects embed an Element (much like list elements) and are linked into every cell of side CELL their bounding box
+// overlaps, or into a single oversized chain, which all queries visit, when that would take more than MAX_CELLS links.
+// Cells are hashed into BUCKETS chains, so space needs not be bounded. Insertion and removal are O(MAX_CELLS) and
+// allocation free. Each object is reported by a query only from the first cell it shares with it, so queries keep no state
+// in the grid and can be nested or run concurrently, though not concurrently with updates.
+template<typename T, typename S, unsigned int CELL, unsigned int BUCKETS = 64, unsigned int MAX_CELLS = 8>
+class Spatial_Grid
+{
+public:
+    typedef T Object_Type;
+    typedef typename S::Center Center;
+    typedef typename S::Radius Radius;
+
+    class Element;
+    class Query;
+
+private:
+    struct Link
+    {
+        Element * element;
+        Link * prev;
+        Link * next;
+        unsigned int bucket;
+    };
+
+    struct Cell
+    {
+        Cell() {}
+        Cell(const Center & c, long offset): x(index(c.x + offset)), y(index(c.y + offset)), z(index(c.z + offset)) {}
+
+        // Floor division, so cells do not double in size around the origin
+        static long index(long long v) { return (v >= 0) ? v / CELL : -((-v - 1) / CELL) - 1; }
+
+        unsigned int bucket() const {
+            return (static_cast<unsigned long>(x) * 73856093UL ^ static_cast<unsigned long>(y) * 19349663UL ^ static_cast<unsigned long>(z) * 83492791UL) % BUCKETS;
+        }
+
+        long x, y, z;
+    };
+
+public:
+    class Element
+    {
+        friend class Spatial_Grid;
+        friend class Query;
+
+    public:
+        Element(const T * o): _object(o), _links(0) {}
+
+        T * object() const { return const_cast<T *>(_object); }
+
+        const Center & center() const { return _center; }
+        const Radius & radius() const { return _radius; }
+
+    private:
+        const T * _object;
+        Center _center;
+        Radius _radius;
+        Cell _lo; // first cell of the bounding box
+        unsigned int _links;
+        Link _link[MAX_CELLS];
+    };
+
+    // Iterates over the objects whose spheres intersect the query's one, each of them once
+    class Query
+    {
+    public:
+        Query(Spatial_Grid * grid, const Center & c, const Radius & r = 0): _grid(grid), _center(c), _radius(r) {
+            _lo = Cell(c, -static_cast<long>(r));
+            _hi = Cell(c, r);
+            unsigned long long cells = static_cast<unsigned long long>(_hi.x - _lo.x + 1) * (_hi.y - _lo.y + 1) * (_hi.z - _lo.z + 1);
+            _scan = cells > BUCKETS; // visiting every bucket is cheaper than hashing that many cells
+            _cell = _lo;
+            _bucket = _scan ? 0 : _cell.bucket();
+            _current = _grid->_chain[_bucket];
+        }
+
+        T * next() {
+            while(true) {
+                for(; _current; _current = _current->next) {
+                    Element * e = _current->element;
+                    if((_bucket != BUCKETS) && !first(e))
+                        continue;
+                    if((e->_center - _center) <= static_cast<unsigned long>(e->_radius) + _radius) {
+                        _current = _current->next;
+                        return e->object();
+                    }
+                }
+
+                if(_bucket == BUCKETS) // oversized chain visited last
+                    return 0;
+                else if(_scan)
+                    _bucket++;
+                else if(step())
+                    _bucket = _cell.bucket();
+                else
+                    _bucket = BUCKETS;
+                _current = _grid->_chain[_bucket];
+            }
+        }
+
+    private:
+        // Whether we are at the first cell, in visiting order, shared by the query and the element's bounding boxes
+        bool first(const Element * e) const {
+            Cell c;
+            c.x = (e->_lo.x > _lo.x) ? e->_lo.x : _lo.x;
+            c.y = (e->_lo.y > _lo.y) ? e->_lo.y : _lo.y;
+            c.z = (e->_lo.z > _lo.z) ? e->_lo.z : _lo.z;
+            return _scan ? (c.bucket() == _bucket) : ((c.x == _cell.x) && (c.y == _cell.y) && (c.z == _cell.z));
+        }
+
+        bool step() {
+            if(++_cell.x <= _hi.x)
+                return true;
+            _cell.x = _lo.x;
+            if(++_cell.y <= _hi.y)
+                return true;
+            _cell.y = _lo.y;
+            return ++_cell.z <= _hi.z;
+        }
+
+    private:
+        Spatial_Grid * _grid;
+        Center _center;
+        Radius _radius;
+        Cell _lo;
+        Cell _hi;
+        Cell _cell;
+        bool _scan;
+        unsigned int _bucket;
+        Link * _current;
+    };
+
+public:
+    Spatial_Grid(): _size(0) {
+        for(unsigned int i = 0; i <= BUCKETS; i++)
+            _chain[i] = 0;
+    }
+
+    bool empty() const { return !_size; }
+    unsigned int size() const { return _size; }
+
+    void insert(Element * e, const S & s) { insert(e, s.center, s.radius); }
+    void insert(Element * e, const Center & c, const Radius & r) {
+        e->_center = c;
+        e->_radius = r;
+        e->_links = 0;
+
+        Cell lo(c, -static_cast<long>(r));
+        Cell hi(c, r);
+        e->_lo = lo;
+        if(static_cast<unsigned long long>(hi.x - lo.x + 1) * (hi.y - lo.y + 1) * (hi.z - lo.z + 1) > MAX_CELLS)
+            link(e, BUCKETS);
+        else {
+            Cell i;
+            for(i.z = lo.z; i.z <= hi.z; i.z++)
+                for(i.y = lo.y; i.y <= hi.y; i.y++)
+                    for(i.x = lo.x; i.x <= hi.x; i.x++)
+                        link(e, i.bucket());
+        }
+        _size++;
+    }
+
+    void remove(Element * e) {
+        for(unsigned int i = 0; i < e->_links; i++) {
+            Link * l = &e->_link[i];
+            if(l->prev)
+                l->prev->next = l->next;
+            else
+                _chain[l->bucket] = l->next;
+            if(l->next)
+                l->next->prev = l->prev;
+        }
+        e->_links = 0;
+        _size--;
+    }
+
+    // Moves an object whose sphere has changed
+    void update(Element * e, const S & s) {
+        remove(e);
+        insert(e, s);
+    }
+
+    // First object whose sphere contains the given point
+    T * search(const Center & c) { return Query(this, c).next(); }
+
+private:
+    void link(Element * e, unsigned int bucket) {
+        for(unsigned int i = 0; i < e->_links; i++) // cells sharing a bucket need a single link
+            if(e->_link[i].bucket == bucket)
+                return;
+
+        Link * l = &e->_link[e->_links++];
+        l->element = e;
+        l->bucket = bucket;
+        l->prev = 0;
+        l->next = _chain[bucket];
+        if(l->next)
+            l->next->prev = l;
+        _chain[bucket] = l;
+    }
+
+private:
+    unsigned int _size;
+    Link * _chain[BUCKETS + 1]; // the last one holds oversized objects
+};
+
 __END_UTIL
 
 #endif
@@ -114,6 +114,18 @@ T abs(const T & x)
     return (x > 0) ? x : -x;
 }
 
+// Greatest common divisor (Euclid's)
+template <typename T>
+T gcd(T x, T y)
+{
+    while(y) {
+        T tmp = x % y;
+        x = y;
+        y = tmp;
+    }
+    return x;
+}
+
 template <typename T>
 T largest(const T array[], int size)
 {
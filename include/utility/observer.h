@@ -250,6 +250,9 @@ public:
         return o;
     }
 
+protected:
+    static Element * link(Data_Observer<D, C> * o) { return &o->_link; }
+
 private:
     Simple_Ordered_List<Data_Observer<D, C>, C> _observers;
 };
@@ -281,6 +284,89 @@ private:
 };
 
 
+// (Conditionally) Observed with Data, with observers hashed by condition into a fixed number of buckets
+// Notification costs O(observers in the bucket) instead of O(observers) and never allocates memory
+template<typename D, typename C, unsigned int BUCKETS = 64>
+class Hashed_Data_Observed: public Data_Observed<D, C>
+{
+private:
+    typedef Data_Observed<D, C> Base;
+    typedef Data_Observer<D, C> _Observer;
+    typedef typename Simple_Ordered_List<Data_Observer<D, C>, C>::Element Element;
+    typedef Simple_Ordered_List<Data_Observer<D, C>, C> List;
+
+    using Base::link;
+
+public:
+    Hashed_Data_Observed() {
+        db<Observeds>(TRC) << "Hashed_Data_Observed() => " << this << endl;
+    }
+
+    void attach(Data_Observer<D, C> * o, const C & c) {
+        db<Observeds>(TRC) << "Hashed_Data_Observed::attach(obs=" << o << ",cond=" << c << ")" << endl;
+
+        *link(o) = Element(o, c);
+        _table[bucket(c)].insert(link(o));
+    }
+
+    void detach(Data_Observer<D, C> * o, const C & c) {
+        db<Observeds>(TRC) << "Hashed_Data_Observed::detach(obs=" << o << ",cond=" << c << ")" << endl;
+
+        _table[bucket(c)].remove(link(o));
+    }
+
+    bool notify(const C & c, D * d) {
+        bool notified = false;
+
+        db<Observeds>(TRC) << "Hashed_Data_Observed::notify(this=" << this << ",cond=" << c << ")" << endl;
+
+        for(Element * e = _table[bucket(c)].head(); e; e = e->next()) {
+            if(e->rank() == c) {
+                db<Observeds>(INF) << "Hashed_Data_Observed::notify(this=" << this << ",obs=" << e->object() << ")" << endl;
+                e->object()->update(this, c, d);
+                notified = true;
+            }
+        }
+
+        return notified;
+    }
+
+    D * notified(const C & c) {
+        Element * e = _table[bucket(c)].search_rank(c);
+        if(e) {
+            db<Observeds>(INF) << "Hashed_Data_Observed::notified(this=" << this << ",obs=" << e->object() << ")" << endl;
+            return e->object()->updated();
+        }
+        return nullptr;
+    }
+
+    _Observer * observer(const C & c, unsigned int index = 0) {
+        _Observer * o = 0;
+        for(Element * e = _table[bucket(c)].head(); e; e = e->next()) {
+            if(e->rank() == c) {
+                if(!index)
+                    o =  e->object();
+                else
+                    index--;
+            }
+        }
+        return o;
+    }
+
+private:
+    // Folds wide conditions (e.g. TCP connection ids) so all their bits contribute to the bucket
+    static unsigned int bucket(const C & c) {
+        unsigned long long k = c;
+        k ^= k >> 32;
+        k ^= k >> 16;
+        return static_cast<unsigned int>(k) % BUCKETS;
+    }
+
+private:
+    List _table[BUCKETS];
+};
+
+
 // (Unconditional) Observer x (Unconditionally) Observed with Data
 template<typename D>
 class Data_Observed<D, void>
@@ -13,9 +13,14 @@ template<typename Cipher>
 class Poly1305
 {
     typedef _UTIL::Bignum<17> Bignum;
+    typedef typename Cipher::Key_Schedule Key_Schedule;
 
 public:
-    Poly1305(const unsigned char k[16], const unsigned char r[16]) : _k(k, 16), _r(r, 16) {
+    // k is only used as the cipher's key, so it is kept expanded
+    Poly1305(const unsigned char k[16], const unsigned char r[16]) : _k(k), _r(r, 16) {
+        clamp();
+    }
+    Poly1305(const Key_Schedule & k, const unsigned char r[16]) : _k(k), _r(r, 16) {
         clamp();
     }
     Poly1305() {}
@@ -34,7 +39,7 @@ public:
 
         unsigned char ciphertext[16];
         Cipher cipher;
-        cipher.encrypt(nonce, reinterpret_cast<const unsigned char *>(_k._data), ciphertext);
+        cipher.encrypt(nonce, _k, ciphertext);
 
         // out = (cr + aes(k,n)) % 2^128
         Bignum::simple_add(reinterpret_cast<Bignum::Digit *>(out), reinterpret_cast<const Bignum::Digit *>(ciphertext), cr._data, 4);
@@ -50,7 +55,7 @@ public:
         return true;
     }
 
-    void k(const unsigned char k1[16]) { new (&_k) Bignum(k1,16); }
+    void k(const unsigned char k1[16]) { _k.key(k1); }
     void r(const unsigned char r1[16]) { new (&_r) Bignum(r1,16); clamp(); }
 
 private:
@@ -64,7 +69,7 @@ private:
         reinterpret_cast<unsigned char *>(_r._data)[12] &= 252;
     }
 
-    Bignum _k;
+    Key_Schedule _k;
     Bignum _r;
 };
 
@@ -18,7 +18,9 @@ public:
     enum : unsigned char {
         NONE = Traits<void>::NONE,
         LVP = Traits<void>::LVP,
-        DBP = Traits<void>::DBP
+        DBP = Traits<void>::DBP,
+        LSP = Traits<void>::LSP,
+        KFP = Traits<void>::KFP
     };
 
     // Predictor Model Types
@@ -40,7 +42,7 @@ public:
     public:
         Constant(const Value & v = 0) : _value(v) {}
 
-        Value operator()(const Time & t) { return _value; }
+        Value operator()(const Time & t) const { return _value; }
 
         Value value() const { return _value; }
         void value(const Value & v)  { _value = v; }
@@ -55,7 +57,7 @@ public:
     public:
         Linear(const Value & a = 0, const Value & b = 0, const Time & t0 = 0): _a(a), _b(b), _t0(t0) {}
 
-        Value operator()(const Time & t1) { return (_a * (t1 - _t0) + _b); }
+        Value operator()(const Time & t1) const { return (_a * (t1 - _t0) + _b); }
 
         Value a() const { return _a; }
         void a(const Value & a)  { _a = a; }
@@ -156,9 +158,52 @@ public:
         Value _value;
     };
 
-    // History (circular buffer of Records)
+    // History (sliding window over the last Records, up to SIZE of them)
     template<History_Type TYPE, unsigned int SIZE, typename ... Tn>
-    class History: public Circular_Buffer<Record<TYPE, Tn ...>, SIZE> {};
+    class History
+    {
+    public:
+        typedef Record<TYPE, Tn ...> Object_Type;
+
+    public:
+        History(unsigned int window = SIZE): _window(((window > 0) && (window < SIZE)) ? window : SIZE), _size(0), _head(0) {}
+
+        unsigned int window() const { return _window; }
+        unsigned int size() const { return _size; }
+        bool empty() const { return !_size; }
+        bool full() const { return _size == _window; }
+
+        // Records are indexed from the oldest one
+        const Object_Type & operator[](unsigned int i) const { assert(i < _size); return _data[(_head + i) % SIZE]; }
+        const Object_Type & head() const { return (*this)[0]; }
+        const Object_Type & tail() const { return (*this)[_size - 1]; }
+
+        // Once the window is full, each insertion evicts the oldest Record
+        void insert(const Object_Type & o) {
+            if(full()) {
+                _head = (_head + 1) % SIZE;
+                _size--;
+            }
+            _data[(_head + _size) % SIZE] = o;
+            _size++;
+        }
+
+        void clear() { _size = _head = 0; }
+
+    private:
+        unsigned int _window;
+        unsigned int _size;
+        unsigned int _head;
+        Object_Type _data[SIZE];
+    };
+
+protected:
+    // Whether a prediction is within the configured error bounds for value
+    template<typename Configuration, typename Value>
+    static bool acceptable(const Configuration & c, const Value & value, float predicted) {
+        float max_acceptable_error = max(abs(((float)value * (float)c.relative_error) / 100.0f), (float)c.absolute_error);
+        return abs((float)value - predicted) <= max_acceptable_error;
+    }
 
 
 //protected:
@@ -249,12 +294,12 @@ public:
     } __attribute__((packed));
 
 public:
-    LVP(Value r = 0, Value a = 0, Time t = 0): _config(r, a, t), _miss_predicted(0) {
+    LVP(Value r = 0, Value a = 0, Time t = 0): _config(r, a, t), _model(TYPE), _miss_predicted(0) {
         db<Predictors>(TRC) << "LVP(r=" << r << ",a=" << a << ",t=" << t << ")" << endl;
         db<Predictors>(INF) << "LVP:config=" << _config << ",model=" << _model << ")" << endl;
     }
 
-    LVP(const Configuration & c, bool r = false): _config(c), _miss_predicted(0) {
+    LVP(const Configuration & c, bool r = false): _config(c), _model(TYPE), _miss_predicted(0) {
         db<Predictors>(TRC) << "LVP(c=" << c << ",r=" << r << ")" << endl;
         db<Predictors>(INF) << "LVP:config=" << _config << ",model=" << _model << ")" << endl;
     }
@@ -275,7 +320,7 @@ public:
 
         if(error > max_acceptable_error) {
             if(++_miss_predicted > _config.time_error) {
-                _model->value(value);
+                _model.value(value);
                 _miss_predicted = 0;
                 return false;
             }
@@ -343,53 +388,50 @@ public:
     } __attribute__((packed));
 
 public:
-    DBP(unsigned int w, unsigned int p, Value r = 0, Value a = 0, Time t = 0): _ready(false), _config(w, p, r, a, t), _miss_predicted(0) {
+    DBP(unsigned int w, unsigned int p, Value r = 0, Value a = 0, Time t = 0): _ready(false), _miss_predicted(0), _config(r, a, t, w, p), _model(TYPE), _history(w) {
         db<Predictors>(TRC) << "DBP(r=" << r << ",a=" << a << ",t=" << t << ")" << endl;
         db<Predictors>(INF) << "DBP:config=" << _config << ",model=" << _model << ")" << endl;
     }
 
-    DBP(const Configuration & c, bool r = false): _ready(false), _config(c), _miss_predicted(0) {
+    DBP(const Configuration & c = Configuration(), bool r = false): _ready(false), _miss_predicted(0), _config(c), _model(TYPE), _history(c.window_size) {
         db<Predictors>(TRC) << "DBP(c=" << c << ",r=" << r << ")" << endl;
         db<Predictors>(INF) << "DBP:config=" << _config << ",model=" << _model << ")" << endl;
     }
 
+    // Until the window first fills up, the model is the last value transmitted (as LVP's)
     template<typename ... Tn>
     Value predict(const Time & t, const Tn & ... an) const {
-        if(_ready)
-            return _model(t, an ...);
-        else if(!_history.empty())
-            return _history->tail().value();
-        else
-            return 0;
+        return _model(t, an ...);
     }
 
-    void update(const Time & t, const Value & v) { _history.insert(t, v); }
+    void update(const Time & t, const Value & v) { _history.insert(Record<TEMPORAL, Time, Value>(t, v)); }
 
     bool trickle(const Time & time, const Value & value) {
         update(time, value);
 
-        if(!_model) {
-            if(_history.full()){
-                build_model(time, value);
-                return false;
-            }
-        } else {
-            float predicted = predict(time);
-            OStream cout;
-            float max_acceptable_error = max(abs(((float)value * (float)_config.relative_error)/100.0f), (float)_config.absolute_error);
-            float error = abs((float)value - predicted);
+        if(!_ready && _history.full()) {
+            build_model(time, value);
+            return false;
+        }
 
-            db<Predictors>(TRC) << "LVP::trickle:real=" << value << ",pred=" << predicted << ",err=" << error << ",max=" << max_acceptable_error << ",t_err:" << _config.time_error << ",miss:" << _miss_predicted << ")" << endl;
+        float predicted = predict(time);
+
+        db<Predictors>(TRC) << "DBP::trickle:real=" << value << ",pred=" << predicted << ",t_err:" << _config.time_error << ",miss:" << _miss_predicted << ")" << endl;
 
-            if(error > max_acceptable_error) {
-                if(++_miss_predicted > _config.time_error) {
+        if(!acceptable(_config, value, predicted)) {
+            if(++_miss_predicted > _config.time_error) {
+                if(_ready)
                     build_model(time, value);
-                    _miss_predicted = 0;
-                    return false;
+                else {
+                    _model.a(0);
+                    _model.b(value);
+                    _model.t0(time);
                 }
-            } else {
                 _miss_predicted = 0;
+                return false;
             }
+        } else {
+            _miss_predicted = 0;
         }
 
         return true;
@@ -412,23 +454,26 @@ protected:
     void build_model(const Time & t, const Value & v){
         assert(_history.full());
 
+        // Unconfigured predictors average each half of the window
+        unsigned int points = _config.points ? _config.points : _history.size() / 2;
+
         float avg_oldest = 0;
         float avg_recent = 0;
 
-        _model.t0(_history[0].time());
-
-        for(unsigned int i = 0; i < _config.points; i++)
+        for(unsigned int i = 0; i < points; i++)
             avg_oldest += _history[i].value();
-        avg_oldest /= _config.points;
+        avg_oldest /= points;
 
-        for(unsigned int i = 0; i < _config.point; i++)
+        for(unsigned int i = 0; i < points; i++)
             avg_recent += _history[_history.size() -1 - i].value();
-        avg_recent /= _config.points;
+        avg_recent /= points;
 
-        float t_oldest = (_history[0].time() + _history[_config.points - 1].time()) / 2;
-        float t_recent = (_history[_history.size() - 1].time() + _history[_history.size() -1 - (_config.point - 1)].time()) / 2;
+        // Times are taken relative to the oldest record, since floats cannot hold absolute time stamps precisely
+        Time origin = _history[0].time();
+        Time t_oldest = origin + (_history[points - 1].time() - origin) / 2;
+        Time t_recent = origin + ((_history[_history.size() - 1].time() - origin) + (_history[_history.size() -1 - (points - 1)].time() - origin)) / 2;
 
-        _model.a((avg_recent - avg_oldest) / (t_recent - t_oldest));
+        _model.a((avg_recent - avg_oldest) / static_cast<float>(t_recent - t_oldest));
         _model.b(avg_oldest);
         _model.t0(t_oldest);
 
@@ -447,6 +492,259 @@ private:
     History<TEMPORAL, MAX_WINDOW, Time, Value> _history;
 };
 
+
+// Least-Squares Predictor (LSP)
+// Fits a line to the samples in the history window by linear regression. The sums the fit depends on are kept up to date as
+// samples enter and leave the window, so refitting takes constant time whatever the window size. They are kept in double
+// precision and relative to the oldest sample in the window, so large absolute time stamps do not degrade the fit.
+template<typename Time, typename Value>
+class LSP: public Predictor_Common
+{
+private:
+    static const Predictor_Type TYPE = Predictor_Common::LSP;
+    static const unsigned int MAX_WINDOW = 100;
+
+public:
+    typedef Linear_Model<Time, Value> Model;
+
+    struct Configuration
+    {
+        Configuration(Value r = 0, Value a = 0, Time t = 0, unsigned int w = 0)
+        : relative_error(r), absolute_error(a), time_error(t), window_size(w) {}
+
+        template<typename Config>
+        Configuration(const Config & conf)
+        : relative_error(conf.relative_error), absolute_error(conf.absolute_error), time_error(conf.time_error), window_size(conf.window_size) {}
+
+        friend Debug & operator<<(Debug & db, const Configuration & c) {
+            db << "{r=" << c.relative_error << ",a=" << c.absolute_error << ",t=" << c.time_error << ",w=" << c.window_size << "}";
+            return db;
+        }
+
+        Value relative_error;
+        Value absolute_error;
+        Time time_error;
+        unsigned int window_size;
+    } __attribute__((packed));
+
+public:
+    LSP(const Configuration & c = Configuration(), bool r = false): _config(c), _model(TYPE), _history(c.window_size), _miss_predicted(0) {
+        db<Predictors>(TRC) << "LSP(c=" << c << ",r=" << r << ")" << endl;
+        clear();
+    }
+
+    template<typename ... Tn>
+    Value predict(const Time & t, const Tn & ... an) const {
+        return _model(t, an ...);
+    }
+
+    void update(const Time & t, const Value & v) {
+        if(_history.full()) {
+            // Take the oldest sample out of the sums and move their origin to the one that becomes the oldest
+            const Record<TEMPORAL, Time, Value> & oldest = _history.head();
+            double x = oldest.time() - _origin;
+            _sx -= x;
+            _sxx -= x * x;
+            _sy -= oldest.value();
+            _sxy -= x * oldest.value();
+            _history.insert(Record<TEMPORAL, Time, Value>(t, v));
+            rebase(_history.head().time(), _history.size() - 1);
+        } else {
+            if(_history.empty())
+                _origin = t;
+            _history.insert(Record<TEMPORAL, Time, Value>(t, v));
+        }
+
+        double x = t - _origin;
+        _sx += x;
+        _sxx += x * x;
+        _sy += v;
+        _sxy += x * v;
+    }
+
+    bool trickle(const Time & time, const Value & value) {
+        update(time, value);
+
+        float predicted = predict(time);
+
+        db<Predictors>(TRC) << "LSP::trickle:real=" << value << ",pred=" << predicted << ",t_err:" << _config.time_error << ",miss:" << _miss_predicted << ")" << endl;
+
+        if(!acceptable(_config, value, predicted)) {
+            if(++_miss_predicted > _config.time_error) {
+                build_model(time, value);
+                if(!acceptable(_config, value, predict(time))) {
+                    // The signal changed regime (e.g. a step) and the window no longer fits it: start over from this sample
+                    clear();
+                    update(time, value);
+                    build_model(time, value);
+                }
+                _miss_predicted = 0;
+                return false;
+            }
+        } else
+            _miss_predicted = 0;
+
+        return true;
+    }
+
+    const Model & model() const { return _model; }
+    void model(const Model & m) { _model = m; }
+
+    void update(const Model & m, const bool & from_sink) { _model = m; }
+
+    template<typename Config>
+    void configure(const Config & c) {
+        _config.relative_error = c.relative_error;
+        _config.absolute_error = c.absolute_error;
+        _config.time_error = c.time_error;
+    }
+
+    void clear() {
+        _history.clear();
+        _origin = 0;
+        _sx = _sxx = _sy = _sxy = 0;
+    }
+
+protected:
+    void build_model(const Time & t, const Value & v) {
+        unsigned int n = _history.size();
+        double det = n * _sxx - _sx * _sx;
+
+        // With a single sample (or all of them taken at once), there is no slope to fit
+        double a = ((n > 1) && (det > 0)) ? (n * _sxy - _sx * _sy) / det : 0;
+        double b = (n > 1) ? (_sy - a * _sx) / n : static_cast<double>(v);
+
+        _model.a(a);
+        _model.b(b);
+        _model.t0(_origin);
+    }
+
+    // Moves the origin of the sums over n samples
+    void rebase(const Time & origin, unsigned int n) {
+        double d = origin - _origin;
+        _sxy -= d * _sy;
+        _sxx -= 2 * d * _sx - n * d * d;
+        _sx -= n * d;
+        _origin = origin;
+    }
+
+private:
+    Configuration _config;
+    Model _model;
+    History<TEMPORAL, MAX_WINDOW, Time, Value> _history;
+    unsigned int _miss_predicted;
+
+    Time _origin;
+    double _sx;
+    double _sxx;
+    double _sy;
+    double _sxy;
+};
+
+
+// Kalman Filter Predictor (KFP)
+// Scalar Kalman filter over a random-walk model of the signal: each sample corrects the estimate by a gain that weighs the
+// estimate's variance against the measurement noise. The sink gets the filtered estimate instead of the raw sample, so
+// measurement noise neither triggers transmissions as often nor is propagated by them.
+template<typename Time, typename Value>
+class KFP: public Predictor_Common
+{
+private:
+    static const Predictor_Type TYPE = Predictor_Common::KFP;
+
+public:
+    typedef Constant_Model<Time, Value> Model;
+
+    struct Configuration
+    {
+        Configuration(Value r = 0, Value a = 0, Time t = 0, Value q = 1, Value m = 1)
+        : relative_error(r), absolute_error(a), time_error(t), process_noise(q), measurement_noise(m) {}
+
+        template<typename Config>
+        Configuration(const Config & conf)
+        : relative_error(conf.relative_error), absolute_error(conf.absolute_error), time_error(conf.time_error), process_noise(conf.process_noise), measurement_noise(conf.measurement_noise) {}
+
+        friend Debug & operator<<(Debug & db, const Configuration & c) {
+            db << "{r=" << c.relative_error << ",a=" << c.absolute_error << ",t=" << c.time_error << ",q=" << c.process_noise << ",m=" << c.measurement_noise << "}";
+            return db;
+        }
+
+        Value relative_error;
+        Value absolute_error;
+        Time time_error;
+        Value process_noise;     // variance of the signal's change between samples
+        Value measurement_noise; // variance of the sensor's error
+    } __attribute__((packed));
+
+public:
+    KFP(const Configuration & c = Configuration(), bool r = false): _config(c), _model(TYPE), _miss_predicted(0), _estimate(0), _variance(-1) {
+        db<Predictors>(TRC) << "KFP(c=" << c << ",r=" << r << ")" << endl;
+    }
+
+    template<typename ... Tn>
+    Value predict(const Time & t, const Tn & ... an) const {
+        return _model(t, an ...);
+    }
+
+    void update(const Time & t, const Value & v) {
+        if(_variance < 0) {
+            _estimate = v;
+            _variance = _config.measurement_noise;
+        } else {
+            float p = _variance + _config.process_noise;
+            float k = p / (p + _config.measurement_noise);
+            _estimate += k * (v - _estimate);
+            _variance = (1 - k) * p;
+        }
+    }
+
+    bool trickle(const Time & time, const Value & value) {
+        update(time, value);
+
+        float predicted = predict(time);
+
+        db<Predictors>(TRC) << "KFP::trickle:real=" << value << ",pred=" << predicted << ",est=" << _estimate << ",var=" << _variance << ",miss:" << _miss_predicted << ")" << endl;
+
+        if(!acceptable(_config, value, predicted)) {
+            if(++_miss_predicted > _config.time_error) {
+                if(!acceptable(_config, value, _estimate)) {
+                    // The signal jumped farther than the filter can follow: restart it from this sample
+                    _estimate = value;
+                    _variance = _config.measurement_noise;
+                }
+                _model.value(_estimate);
+                _miss_predicted = 0;
+                return false;
+            }
+        } else
+            _miss_predicted = 0;
+
+        return true;
+    }
+
+    Value estimate() const { return _estimate; }
+
+    const Model & model() const { return _model; }
+    void model(const Model & m) { _model = m; }
+
+    void update(const Model & m, const bool & from_sink) { _model = m; }
+
+    template<typename Config>
+    void configure(const Config & c) {
+        _config.relative_error = c.relative_error;
+        _config.absolute_error = c.absolute_error;
+        _config.time_error = c.time_error;
+    }
+
+private:
+    Configuration _config;
+    Model _model;
+    unsigned int _miss_predicted;
+
+    float _estimate;
+    float _variance; // negative before the first sample
+};
+
 template<Predictor_Common::Predictor_Type TYPE>
 struct Select_Predictor
 {
@@ -468,6 +766,20 @@ struct Select_Predictor<Predictor_Common::DBP>
     using Predictor = DBP<Time, Value>;
 };
 
+template<>
+struct Select_Predictor<Predictor_Common::LSP>
+{
+    template<typename Time, typename Value>
+    using Predictor = LSP<Time, Value>;
+};
+
+template<>
+struct Select_Predictor<Predictor_Common::KFP>
+{
+    template<typename Time, typename Value>
+    using Predictor = KFP<Time, Value>;
+};
+
 __END_UTIL
 
 #endif
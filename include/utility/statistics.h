@@ -0,0 +1,129 @@
+// EPOS Streaming Statistics Utility Declarations
+
+#ifndef __statistics_h
+#define __statistics_h
+
+#include <utility/math.h>
+
+__BEGIN_UTIL
+
+// Running statistics of a stream of samples, in constant memory
+// Mean and variance are updated with Welford's algorithm (Welford, Technometrics 1962), which, unlike keeping sums of
+// samples and of their squares, neither overflows nor loses precision to cancellation on long streams.
+template<typename T>
+class Statistics
+{
+public:
+    typedef T Value;
+
+public:
+    Statistics() { reset(); }
+
+    void insert(const Value & v) {
+        if(!_count)
+            _min = _max = v;
+        else {
+            if(v < _min)
+                _min = v;
+            if(v > _max)
+                _max = v;
+        }
+        _count++;
+
+        double delta = static_cast<double>(v) - _mean;
+        _mean += delta / _count;
+        _m2 += delta * (static_cast<double>(v) - _mean);
+    }
+
+    unsigned long count() const { return _count; }
+    const Value & min() const { return _min; }
+    const Value & max() const { return _max; }
+    double mean() const { return _mean; }
+    double variance() const { return (_count > 1) ? _m2 / (_count - 1) : 0; }
+    double deviation() const { return babylonian_sqrt(variance()); }
+
+    void reset() {
+        _count = 0;
+        _min = _max = 0;
+        _mean = _m2 = 0;
+    }
+
+private:
+    unsigned long _count;
+    Value _min;
+    Value _max;
+    double _mean;
+    double _m2; // sum of the squared differences from the mean
+};
+
+
+// Log-linear histogram, after HdrHistogram (Tene)
+// Values are bucketed by their most significant bit and, within each power of two, by the SUB_BITS bits that follow it, so
+// any value is counted in a bucket whose width is at most 1/2^SUB_BITS of it, whatever its magnitude. Values below 2^SUB_BITS
+// get a bucket each. Negative values are counted as 0.
+template<typename T, unsigned int SUB_BITS = 2>
+class Histogram
+{
+public:
+    typedef T Value;
+
+    static const unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+    static const unsigned int BUCKETS = (sizeof(unsigned long long) * 8 - SUB_BITS + 1) * SUB_BUCKETS;
+
+public:
+    Histogram() { reset(); }
+
+    void insert(const Value & v) {
+        _counts[index(v)]++;
+        _count++;
+    }
+
+    unsigned long count() const { return _count; }
+    unsigned long operator[](unsigned int i) const { return _counts[i]; }
+
+    // Smallest value counted in bucket i
+    static unsigned long long lower(unsigned int i) {
+        if(i < SUB_BUCKETS)
+            return i;
+        unsigned int shift = i / SUB_BUCKETS - 1;
+        return static_cast<unsigned long long>(SUB_BUCKETS | (i % SUB_BUCKETS)) << shift;
+    }
+
+    // Lower bound of the bucket holding the p-th percentile
+    unsigned long long percentile(unsigned int p) const {
+        unsigned long long rank = (static_cast<unsigned long long>(_count) * p + 99) / 100;
+        unsigned long long seen = 0;
+        for(unsigned int i = 0; i < BUCKETS; i++) {
+            seen += _counts[i];
+            if(seen && (seen >= rank))
+                return lower(i);
+        }
+        return 0;
+    }
+
+    void reset() {
+        _count = 0;
+        for(unsigned int i = 0; i < BUCKETS; i++)
+            _counts[i] = 0;
+    }
+
+private:
+    static unsigned int index(const Value & v) {
+        if(!(v > 0))
+            return 0;
+        unsigned long long u = v;
+        if(u < SUB_BUCKETS)
+            return u;
+        unsigned int msb = sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(u);
+        unsigned int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((u >> shift) & (SUB_BUCKETS - 1));
+    }
+
+private:
+    unsigned long _count;
+    unsigned long _counts[BUCKETS];
+};
+
+__END_UTIL
+
+#endif
@@ -0,0 +1,468 @@
+// EPOS Compressed Time Series Utility Declarations
+
+#ifndef __time_series_h
+#define __time_series_h
+
+#include <utility/heap.h>
+#include <utility/string.h>
+
+__BEGIN_UTIL
+
+// Compressed in-memory time series, after Facebook's Gorilla (Pelkonen et al., VLDB 2015)
+// Samples are stored in fixed-size blocks allocated from a heap dedicated to the series. Within a block, time stamps are
+// encoded as the difference between consecutive deltas (a single bit for periodic samples) and values as the XOR with the
+// previous one, of which only the meaningful bits are kept (again a single bit for repeated values). Each block also keeps
+// the count, minimum, maximum and sum of its samples, so queries skip blocks out of range and downsampling can take whole
+// blocks into account without decoding them. Once the heap is exhausted, the oldest block is recycled, so the series always
+// holds the most recent history that fits in it.
+// Samples must be inserted in time order.
+template<typename T, typename V, unsigned int BLOCK_SIZE = 128>
+class Time_Series
+{
+public:
+    typedef T Time;
+    typedef V Value;
+
+    // Summary of the samples in a time window
+    struct Summary
+    {
+        Time t0; // time of the first sample in the window
+        Time t1; // time of the last sample in the window
+        unsigned int count;
+        Value min;
+        Value max;
+        Value avg;
+    };
+
+private:
+    typedef typename IF<(sizeof(Value) > 4), unsigned long long, unsigned int>::Result Bits;
+
+    static const unsigned int BITS = sizeof(Bits) * 8;
+    static const unsigned int WIDTH_BITS = (BITS == 64) ? 6 : 5; // leading zeros and meaningful bits fields
+
+    // What the heap takes beyond the blocks themselves (block size, heap pointer and alignment, and the heap's free list)
+    static const unsigned int HEAP_OVERHEAD = 2 * sizeof(void *) + sizeof(int);
+    static const unsigned int HEAP_SLACK = 8 * sizeof(void *);
+
+    struct Block
+    {
+        Block(const Time & t, const Value & v): next(0), t0(t), t1(t), count(0), bits(0), min(v), max(v), sum(0) {}
+
+        Block * next;
+        Time t0;
+        Time t1;
+        unsigned short count;
+        unsigned short bits;
+        Value min;
+        Value max;
+        double sum;
+        unsigned char data[];
+    };
+
+    static const unsigned int DATA_SIZE = BLOCK_SIZE - sizeof(Block);
+    static const unsigned int DATA_BITS = DATA_SIZE * 8;
+
+    // Decodes the samples of a block, in order
+    class Decoder
+    {
+    public:
+        Decoder(const Block * block): _block(block), _pos(0), _index(0) {}
+
+        bool next(Time * t, Value * v) {
+            if(_index >= _block->count)
+                return false;
+
+            if(!_index) {
+                _time = _block->t0;
+                _delta = 0;
+                _last = get(_block->data, &_pos, BITS);
+                _leading = BITS;
+                _trailing = 0;
+            } else {
+                _delta += unzigzag(get_time(_block->data, &_pos));
+                _time += _delta;
+                _last ^= get_value(_block->data, &_pos, &_leading, &_trailing);
+            }
+            _index++;
+
+            *t = _time;
+            *v = value(_last);
+            return true;
+        }
+
+    private:
+        const Block * _block;
+        unsigned int _pos;
+        unsigned int _index;
+        Time _time;
+        long long _delta;
+        Bits _last;
+        unsigned int _leading;
+        unsigned int _trailing;
+    };
+
+    // Running summary of a downsampling window
+    struct Window
+    {
+        Window(): index(0), count(0), sum(0) {}
+
+        void add(const Time & t, const Value & v) { add(t, t, 1, v, v, v); }
+        void add(const Time & first, const Time & last, unsigned int n, const Value & lo, const Value & hi, double s) {
+            if(!count) {
+                t0 = first;
+                min = lo;
+                max = hi;
+            } else {
+                if(lo < min)
+                    min = lo;
+                if(hi > max)
+                    max = hi;
+            }
+            t1 = last;
+            count += n;
+            sum += s;
+        }
+
+        unsigned long long index;
+        Time t0;
+        Time t1;
+        unsigned int count;
+        Value min;
+        Value max;
+        double sum;
+    };
+
+public:
+    // Iterates over the samples taken within [t0, t1], in order
+    class Query
+    {
+    public:
+        Query(const Time_Series * series, const Time & t0, const Time & t1): _t0(t0), _t1(t1), _block(series->_head), _decoder(0) {
+            for(; _block && (_block->t1 < t0); _block = _block->next);
+            if(_block)
+                _decoder = Decoder(_block);
+        }
+
+        bool next(Time * t, Value * v) {
+            while(_block && (_block->t0 <= _t1)) {
+                while(_decoder.next(t, v)) {
+                    if(*t > _t1) {
+                        _block = 0;
+                        return false;
+                    }
+                    if(*t >= _t0)
+                        return true;
+                }
+                _block = _block->next;
+                if(_block)
+                    _decoder = Decoder(_block);
+            }
+            return false;
+        }
+
+    private:
+        Time _t0;
+        Time _t1;
+        const Block * _block;
+        Decoder _decoder;
+    };
+
+public:
+    // The series takes over bytes of memory at pool as its dedicated heap (see footprint())
+    Time_Series(void * pool, unsigned int bytes): _pool(pool), _bytes(bytes) { clear(); }
+
+    // Bytes of memory needed for a series of the given number of blocks
+    static unsigned int footprint(unsigned int blocks) { return blocks * (BLOCK_SIZE + HEAP_OVERHEAD) + HEAP_SLACK; }
+
+    unsigned int size() const { return _size; }
+    bool empty() const { return !_size; }
+    unsigned int blocks() const { return _blocks; }
+    unsigned int capacity() const { return _blocks + _free; }
+    unsigned int bytes() const { return _blocks * BLOCK_SIZE; }
+
+    const Time & first() const { return _head->t0; }
+    const Time & last() const { return _tail->t1; }
+
+    bool insert(const Time & t, const Value & v) {
+        Bits b = bits(v);
+
+        if(_tail) {
+            if(t < _tail->t1)
+                return false;
+
+            long long delta = t - _tail->t1;
+            unsigned long long dod = zigzag(delta - _delta);
+            Bits x = b ^ _last;
+
+            if((_tail->count < 0xffff) && (_tail->bits + time_size(dod) + value_size(x, _leading, _trailing) <= DATA_BITS)) {
+                unsigned int pos = _tail->bits;
+                put_time(_tail->data, &pos, dod);
+                put_value(_tail->data, &pos, x, &_leading, &_trailing);
+                _tail->bits = pos;
+                _delta = delta;
+                _last = b;
+                account(_tail, t, v);
+                return true;
+            }
+        }
+
+        // The first sample of each block goes in full, so blocks can be decoded on their own
+        Block * block = alloc(t, v);
+        if(!block)
+            return false;
+
+        unsigned int pos = 0;
+        put(block->data, &pos, b, BITS);
+        block->bits = pos;
+        _delta = 0;
+        _last = b;
+        _leading = BITS;
+        _trailing = 0;
+        account(block, t, v);
+
+        return true;
+    }
+
+    // Summarizes the samples taken within [t0, t1] in consecutive windows of the given length, skipping those without samples
+    // Returns the number of summaries written to s (at most n)
+    unsigned int downsample(const Time & t0, const Time & t1, const Time & window, Summary * s, unsigned int n) const {
+        Window w;
+        unsigned int i = 0;
+
+        for(const Block * block = _head; block && (block->t0 <= t1) && (i < n); block = block->next) {
+            if(block->t1 < t0)
+                continue;
+
+            if((block->t0 >= t0) && (block->t1 <= t1) && ((block->t0 - t0) / window == (block->t1 - t0) / window)) {
+                // Whole block within a single window: no need to decode it
+                if(!shift(&w, (block->t0 - t0) / window, s, &i, n))
+                    break;
+                w.add(block->t0, block->t1, block->count, block->min, block->max, block->sum);
+            } else {
+                Decoder decoder(block);
+                Time t;
+                Value v;
+                while(decoder.next(&t, &v) && (t <= t1))
+                    if(t >= t0) {
+                        if(!shift(&w, (t - t0) / window, s, &i, n))
+                            break;
+                        w.add(t, v);
+                    }
+            }
+        }
+        if(w.count && (i < n))
+            summarize(w, &s[i++]);
+
+        return i;
+    }
+
+    // Summarizes all the samples taken within [t0, t1]
+    Summary summary(const Time & t0, const Time & t1) const {
+        Summary s;
+        s.count = 0;
+        downsample(t0, t1, t1 - t0 + 1, &s, 1);
+        return s;
+    }
+
+    void clear() {
+        _heap = new (&_preheap[0]) Heap(_pool, _bytes);
+        _free = (_bytes > HEAP_SLACK) ? (_bytes - HEAP_SLACK) / (BLOCK_SIZE + HEAP_OVERHEAD) : 0;
+        _head = _tail = 0;
+        _blocks = 0;
+        _size = 0;
+    }
+
+private:
+    Block * alloc(const Time & t, const Value & v) {
+        void * addr;
+        if(_free) {
+            addr = _heap->alloc(BLOCK_SIZE);
+            _free--;
+        } else if(_head) {
+            // Out of blocks: recycle the oldest one
+            Block * oldest = _head;
+            _head = oldest->next;
+            if(!_head)
+                _tail = 0;
+            _size -= oldest->count;
+            _blocks--;
+            addr = oldest;
+        } else
+            return 0;
+
+        Block * block = new (addr) Block(t, v);
+        memset(block->data, 0, DATA_SIZE);
+        if(_tail)
+            _tail->next = block;
+        else
+            _head = block;
+        _tail = block;
+        _blocks++;
+
+        return block;
+    }
+
+    void account(Block * block, const Time & t, const Value & v) {
+        if(v < block->min)
+            block->min = v;
+        if(v > block->max)
+            block->max = v;
+        block->sum += v;
+        block->t1 = t;
+        block->count++;
+        _size++;
+    }
+
+    static bool shift(Window * w, unsigned long long index, Summary * s, unsigned int * i, unsigned int n) {
+        if(w->count && (index != w->index)) {
+            summarize(*w, &s[(*i)++]);
+            *w = Window();
+            if(*i >= n)
+                return false;
+        }
+        w->index = index;
+        return true;
+    }
+
+    static void summarize(const Window & w, Summary * s) {
+        s->t0 = w.t0;
+        s->t1 = w.t1;
+        s->count = w.count;
+        s->min = w.min;
+        s->max = w.max;
+        s->avg = w.sum / w.count;
+    }
+
+    static Bits bits(const Value & v) {
+        Bits b = 0;
+        memcpy(&b, &v, sizeof(Value));
+        return b;
+    }
+
+    static Value value(const Bits & b) {
+        Value v;
+        memcpy(&v, &b, sizeof(Value));
+        return v;
+    }
+
+    static unsigned long long zigzag(long long v) { return (static_cast<unsigned long long>(v) << 1) ^ (v >> 63); }
+    static long long unzigzag(unsigned long long v) { return static_cast<long long>(v >> 1) ^ -static_cast<long long>(v & 1); }
+
+    static unsigned int clz(unsigned int x) { return __builtin_clz(x); }
+    static unsigned int clz(unsigned long long x) { return __builtin_clzll(x); }
+    static unsigned int ctz(unsigned int x) { return __builtin_ctz(x); }
+    static unsigned int ctz(unsigned long long x) { return __builtin_ctzll(x); }
+
+    // Bit stream, most significant bit first
+    static void put(unsigned char * data, unsigned int * pos, unsigned long long v, unsigned int n) {
+        for(; n; n--, (*pos)++)
+            if((v >> (n - 1)) & 1)
+                data[*pos / 8] |= 0x80 >> (*pos % 8);
+    }
+
+    static unsigned long long get(const unsigned char * data, unsigned int * pos, unsigned int n) {
+        unsigned long long v = 0;
+        for(; n; n--, (*pos)++)
+            v = (v << 1) | ((data[*pos / 8] >> (7 - *pos % 8)) & 1);
+        return v;
+    }
+
+    // Delta-of-delta time stamps (zigzag encoded): '0', '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits, '11110' + 32 bits or '11111' + 64 bits
+    static unsigned int time_size(unsigned long long dod) {
+        return !dod ? 1 : (dod < (1ULL << 7)) ? 2 + 7 : (dod < (1ULL << 9)) ? 3 + 9 : (dod < (1ULL << 12)) ? 4 + 12 : (dod < (1ULL << 32)) ? 5 + 32 : 5 + 64;
+    }
+
+    static void put_time(unsigned char * data, unsigned int * pos, unsigned long long dod) {
+        if(!dod)
+            put(data, pos, 0, 1);
+        else if(dod < (1ULL << 7)) {
+            put(data, pos, 0x2, 2);
+            put(data, pos, dod, 7);
+        } else if(dod < (1ULL << 9)) {
+            put(data, pos, 0x6, 3);
+            put(data, pos, dod, 9);
+        } else if(dod < (1ULL << 12)) {
+            put(data, pos, 0xe, 4);
+            put(data, pos, dod, 12);
+        } else if(dod < (1ULL << 32)) {
+            put(data, pos, 0x1e, 5);
+            put(data, pos, dod, 32);
+        } else {
+            put(data, pos, 0x1f, 5);
+            put(data, pos, dod, 64);
+        }
+    }
+
+    static unsigned long long get_time(const unsigned char * data, unsigned int * pos) {
+        static const unsigned int WIDTHS[] = { 0, 7, 9, 12, 32, 64 };
+        unsigned int ones = 0;
+        while((ones < 5) && get(data, pos, 1))
+            ones++;
+        return get(data, pos, WIDTHS[ones]);
+    }
+
+    // XOR-ed values: '0' if unchanged, '10' + the meaningful bits if they fit in the previous window, or
+    // '11' + leading zeros + meaningful bits count - 1 + the meaningful bits, which then become the window
+    static unsigned int value_size(const Bits & x, unsigned int leading, unsigned int trailing) {
+        if(!x)
+            return 1;
+        unsigned int l = clz(x);
+        unsigned int t = ctz(x);
+        if((leading < BITS) && (l >= leading) && (t >= trailing))
+            return 2 + BITS - leading - trailing;
+        return 2 + 2 * WIDTH_BITS + BITS - l - t;
+    }
+
+    static void put_value(unsigned char * data, unsigned int * pos, const Bits & x, unsigned int * leading, unsigned int * trailing) {
+        if(!x) {
+            put(data, pos, 0, 1);
+            return;
+        }
+        unsigned int l = clz(x);
+        unsigned int t = ctz(x);
+        if((*leading < BITS) && (l >= *leading) && (t >= *trailing)) {
+            put(data, pos, 0x2, 2);
+            put(data, pos, x >> *trailing, BITS - *leading - *trailing);
+        } else {
+            put(data, pos, 0x3, 2);
+            put(data, pos, l, WIDTH_BITS);
+            put(data, pos, BITS - l - t - 1, WIDTH_BITS);
+            put(data, pos, x >> t, BITS - l - t);
+            *leading = l;
+            *trailing = t;
+        }
+    }
+
+    static Bits get_value(const unsigned char * data, unsigned int * pos, unsigned int * leading, unsigned int * trailing) {
+        if(!get(data, pos, 1))
+            return 0;
+        if(get(data, pos, 1)) {
+            *leading = get(data, pos, WIDTH_BITS);
+            unsigned int meaningful = get(data, pos, WIDTH_BITS) + 1;
+            *trailing = BITS - *leading - meaningful;
+        }
+        return static_cast<Bits>(get(data, pos, BITS - *leading - *trailing)) << *trailing;
+    }
+
+private:
+    void * _pool;
+    unsigned int _bytes;
+    char _preheap[sizeof(Heap)];
+    Heap * _heap;
+    unsigned int _free;
+
+    Block * _head;
+    Block * _tail;
+    unsigned int _blocks;
+    unsigned int _size;
+
+    // Encoder state for the tail block
+    long long _delta;
+    Bits _last;
+    unsigned int _leading;
+    unsigned int _trailing;
+};
+
+__END_UTIL
+
+#endif
@@ -53,7 +53,10 @@ void Alarm::reset()
 
     db<Alarm>(TRC) << "Alarm::reset(this=" << this << ")" << endl;
 
+    // An alarm that has already gone off all its times is rearmed to go off once more
     _request.remove(this);
+    if(!_times)
+        _times = 1;
     _link.rank(_ticks);
     _request.insert(&_link);
 
@@ -8,6 +8,7 @@ __BEGIN_SYS
 #if defined(__PMU_H) && !defined(__common_only__)
 
 bool Clerk<PMU>::_in_use[Traits<Build>::CPUS][CHANNELS];
+Simple_List<Clerk<PMU>> Clerk<PMU>::_clerks[Traits<Build>::CPUS];
 
 #endif
 
@@ -357,6 +357,10 @@ void Thread::time_slicer(const IC::Interrupt_Id & i)
 {
     lock();
 
+#if defined(__PMU_H) && !defined(__common_only__)
+    Clerk<PMU>::rotate(); // multiplex PMU channels among clerks, if they outnumber them
+#endif
+
     reschedule();
 }
 
@@ -43,6 +43,11 @@ void Thread::init()
 
         // Idle thread creation does not cause rescheduling (see Thread::constructor_epilogue)
         new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::IDLE), &Thread::idle);
+
+#ifdef __mach_pc__
+        // Bottom halves of interrupts deferred before threads existed
+        IC::init_workers();
+#endif
     } else {
         if(Traits<System>::multitask)
             while (!task_ready);
@@ -70,6 +70,7 @@ CC2538::Buffer * CC2538::alloc(const Address & dst, const IEEE802_15_4::Type & t
 
     // Initialize the buffer
     Buffer * buf = new (SYSTEM) Buffer(this, once + always + payload + sizeof(IEEE802_15_4::Header));
+    buf->references = 0; // not a receive buffer, so it is deleted when done
     MAC::marshal(buf, address(), dst, type);
 
     return buf;
@@ -95,6 +96,10 @@ void CC2538::free(Buffer * buf)
 {
     db<CC2538>(TRC) << "CC2538::free(buf=" << buf << ")" << endl;
 
+    // Buffers relayed in place by the MAC only go back to the ring when both the receive path and the MAC are done with them
+    if(CPU::fdec(buf->references) > 1)
+        return;
+
     _statistics.rx_packets++;
     _statistics.rx_bytes += buf->size();
 
@@ -155,6 +160,7 @@ void CC2538::handle_int()
                 assert(buf->size() >= 2);
                 buf->rssi = reinterpret_cast<char *>(buf->frame())[buf->size() - 2];
                 buf->sfd_time_stamp = sfd;
+                buf->references = 1;
 
                 if(MAC::pre_notify(buf)) {
                     db<CC2538>(TRC) << "CC2538::handle_int:receive(b=" << buf << ") => " << *buf << endl;
@@ -2,6 +2,9 @@
 
 #include <machine/machine.h>
 #include <machine/pc/e100.h>
+#include <process.h>
+#include <synchronizer.h>
+#include <time.h>
 
 __BEGIN_SYS
 
@@ -73,6 +76,12 @@ E100::E100(unsigned int unit, const Log_Addr & io_mem, const IO_Irq & irq, DMA_B
     _csr = static_cast<CSR_Desc *>(io_mem);
     _dma_buffer = dma_buf;
 
+    // The poller thread is only created by init_poller(), since NICs are initialized before threads (see Network::init())
+    _polling = false;
+    _rx_ts = 0;
+    _poller = 0;
+    _rx_sem = polling ? new (SYSTEM) Semaphore(0) : 0;
+
     // Distribute the DMA_Buffer allocated by init()
     Log_Addr log = dma_buf->log_address();
     Phy_Addr phy = dma_buf->phy_address();
@@ -118,6 +127,8 @@ E100::E100(unsigned int unit, const Log_Addr & io_mem, const IO_Irq & irq, DMA_B
     // Tx_Desc Ring
     _tx_cur = 1;
     _tx_prev = 0;
+    _tx_clean = 0;
+    _tx_free = TX_BUFS - 1; // the TxCB the CU is suspended on is never free
     _tx_ring = log;
     _tx_ring_phy = phy;
 
@@ -128,6 +139,7 @@ E100::E100(unsigned int unit, const Log_Addr & io_mem, const IO_Irq & irq, DMA_B
         phy += align128(sizeof(Tx_Desc));
 
         new (&_tx_ring[i]) Tx_Desc(phy);
+        _tx_ready[i] = false;
     }
     _tx_ring[i-1].link = _tx_ring_phy;
 
@@ -148,12 +160,18 @@ E100::E100(unsigned int unit, const Log_Addr & io_mem, const IO_Irq & irq, DMA_B
         phy += align128(sizeof(Buffer));
     }
 
-    _tx_buffer_prev = _tx_buffer[_tx_prev];
-
     // reset
     reset();
 }
 
+void E100::init_poller()
+{
+    db<E100>(TRC) << "E100::init_poller(unit=" << _unit << ")" << endl;
+
+    if(polling && !_poller)
+        _poller = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::HIGH), &poll, this);
+}
+
 void E100::reset()
 {
     db<E100>(TRC) << "E100::reset (software reset and self-test)" << endl;
@@ -217,48 +235,16 @@ void E100::reset()
 
 int E100::send(const Address & dst, const Protocol & prot, const void * data, unsigned int size)
 {
-    // wait for a free TxCB
-    while(!(_tx_ring[_tx_cur].status & cb_complete)) {
-        if (_tx_cuc_suspended) {
-            //_int_lock.acquire();
-            _tx_cuc_suspended = 0;
-            while(exec_command(cuc_resume, 0));
-            //_int_lock.release();
-        }
-    }
-
-    _tx_ring[_tx_cur].status = Tx_CB_IN_USE;
-    _tx_ring[_tx_cur].tcb_byte_count = (size + HEADER_SIZE);
-
-    // put the ethernet frame into de TxCB
-    // new (_tx_ring[_tx_cur].frame) Frame(_address, dst, htons(prot), data, size); // original
-    /* New implementation, double copy: parameters to buffer and buffer to Tx_Desc.frame.
-     * Making Tx_Desc.frame a pointer does not work (I believe E100 demands for
-     * a contiguous allocated memory for Tx ring descriptors).
-     */
-    Buffer * buf = _tx_buffer[_tx_cur];
-    Frame * frame = buf->frame();
-    new (frame) Frame(_address, dst, htons(prot), data, size);
-    new (_tx_ring[_tx_cur].frame()) Frame(_address, frame->dst(), htons(frame->prot()), frame->data<void>(), size);
-    // ----
-    // TODO: the above doesn't make sense!
-
     db<E100>(TRC) << "E100::send(dst=" << dst << ", prot=" << prot << ", data=" << (char *) data << ", size=" << size << ")";
-    db<E100>(INF) << "E100::send:frame={dst=" << frame->dst() << ", prot=" << frame->prot() << ", data=" << (char *) frame->data<void>() << ", size=" << buf->size() << "}" << endl;
-
-    _tx_ring[_tx_cur].command = cb_s; // suspend bit
-    _tx_ring[_tx_cur].command |= (cb_tx | cb_cid); // transmit command
 
-    _tx_ring[_tx_prev].command &= ~cb_s; // remove suspend bit
-    ++_tx_prev %= TX_BUFS;
+    // Seize the next TxCB in the ring (it will be reclaimed once the CU has sent it)
+    Buffer * buf = _tx_buffer[reserve(1)];
 
-    // we have no guarantee that this command will be accepted by the adapter
-    exec_command(cuc_resume, 0);
+    new (buf->frame()) Frame(_address, dst, prot, data, size);
+    buf->size(size);
 
-    ++_tx_cur %= TX_BUFS;
-
-    _statistics.tx_packets++;
-    _statistics.tx_bytes += size;
+    publish(buf);
+    doorbell();
 
     return size;
 }
@@ -332,38 +318,31 @@ int E100::receive(Address * src, Protocol * prot, void * data, unsigned int size
     return size;
 }
 
-/*! NOTE: this method is not thread-safe as _tx_cur is shared by all threads
- * that use this object and the access to _tx_cur is not atomic. */
-// TODO: solve this!
+// Allocated buffers must all be sent (in any order), since the CU only gets to a TxCB once all the ones reserved before it have been published
 E100::Buffer * E100::alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload)
 {
     db<E100>(TRC) << "E100::alloc(s=" << _address << ",d=" << dst << ",p=" << hex << prot << dec << ",on=" << once << ",al=" << always << ",ld=" << payload << ")" << endl;
 
     int max_data = MTU - always;
 
-    if((payload + once) / max_data > TX_BUFS) {
+    // Calculate how many frames are needed to hold the transport PDU and reserve them all at once
+    unsigned int frames = (once + payload + max_data - 1) / max_data;
+    if(frames > TX_BUFS - 1) {
         db<E100>(WRN) << "E100::alloc: sizeof(Network::Packet::Data) > sizeof(NIC::Frame::Data) * TX_BUFS!" << endl;
         return 0;
     }
 
     Buffer::List pool;
 
-    // Calculate how many frames are needed to hold the transport PDU and allocate enough buffers
-    for(int size = once + payload; size > 0; size -= max_data) {
-        // Wait for the next buffer to become free and seize it
-        for(bool locked = false; !locked; ) {
-            for(; !(_tx_ring[_tx_cur].status & cb_complete); ++_tx_cur %= TX_BUFS);
-            locked = _tx_buffer[_tx_cur]->lock();
-        }
-        Tx_Desc * desc = &_tx_ring[_tx_cur];
-        Buffer * buf = _tx_buffer[_tx_cur];
+    unsigned int i = reserve(frames);
+    for(int size = once + payload; size > 0; size -= max_data, ++i %= TX_BUFS) {
+        Tx_Desc * desc = &_tx_ring[i];
+        Buffer * buf = _tx_buffer[i];
 
         // Initialize the buffer and assemble the Ethernet Frame Header
         new (buf) Buffer(this, (size > max_data) ? MTU : size + always, _address, dst, prot);
 
-        db<E100>(INF) << "E100::alloc:desc[" << _tx_cur << "]=" << desc << " => " << *desc << endl;
-
-        ++_tx_cur %= TX_BUFS;
+        db<E100>(INF) << "E100::alloc:desc[" << i << "]=" << desc << " => " << *desc << endl;
 
         pool.insert(buf->link());
     }
@@ -394,66 +373,150 @@ void E100::free(Buffer * buf)
     }
 }
 
-/*! NOTE: this method is not thread-safe because _tx_buffer_prev is shared by
- * all threads that use this object. */
 int E100::send(Buffer * buf)
 {
-    db<E100>(TRC) << "E100::send new api" << endl;
-    /// assumes: buf->is_locked();
-
     unsigned int size = 0;
 
-    for(Ethernet::Buffer::Element * el = buf->link(); el; el = el->next()) {
+    for(Buffer::Element * el = buf->link(); el; el = el->next()) {
         buf = el->object();
-        Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(buf->back());
-        Ethernet::Frame * frame = buf->frame();
 
         db<E100>(TRC) << "E100::send(buf=" << buf << ")" << endl;
 
-        desc->tcb_byte_count = buf->size() + sizeof(Ethernet::Header);
+        size += publish(buf);
+    }
 
-        db<E100>(TRC) << "E100::send-zc:\n" << "(dst=" << frame->dst() << ", prot=" << frame->prot() << ", data=" << (char *) frame->data<void>() << ", size=" << buf->size() << ")" << endl;
+    // Resume the CU once for the whole pool (buffers are reclaimed by later reservations, once sent)
+    doorbell();
 
-        new (desc->frame()) Ethernet::Frame(_address, frame->dst(), frame->prot(), frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
+    db<E100>(TRC) << "E100::send size=" << size << endl;
 
-        // Status must be set last, since it can trigger a send
-        desc->status = Tx_CB_IN_USE;
+    return size;
+}
 
-        // Trigger an immediate send poll
-        desc->command = cb_s; // suspend bit
-        desc->command |= (cb_tx | cb_cid); // transmit command
-        reinterpret_cast<Tx_Desc *>(_tx_buffer_prev->back())->command &= ~cb_s; // remove suspend bit of the previous frame
+int E100::send(Buffer * pools[], unsigned int n)
+{
+    db<E100>(TRC) << "E100::send(pools=" << pools << ",n=" << n << ")" << endl;
 
-        while(exec_command(cuc_resume, 0));
+    unsigned int size = 0;
 
-        size += buf->size();
+    // Hand all frames over to the CU, in allocation order
+    for(unsigned int i = 0; i < n; i++)
+        for(Buffer::Element * el = pools[i]->link(); el; el = el->next())
+            size += publish(el->object());
 
-        _statistics.tx_packets++;
-        _statistics.tx_bytes += buf->size();
+    // Resume the CU once for the whole batch
+    doorbell();
 
-        db<E100>(INF) << "E100::send:desc=" << desc << " => " << *desc << endl;
+    return size;
+}
 
-        // Wait for packet to be sent and unlock the respective buffer
-        while(! (desc->status & cb_complete)) {
-            if (_tx_cuc_suspended) {
-                _tx_cuc_suspended = 0;
-                exec_command(cuc_resume, 0);
+// Reserves "n" consecutive TxCBs and returns the index of the first one. TxCBs are handed out strictly in ring order,
+// and the ones already sent are reclaimed in bulk only when the free ones run short
+unsigned int E100::reserve(unsigned int n)
+{
+    while(true) {
+        bool was_disabled = CPU::int_disabled();
+        CPU::int_disable();
+
+        if(_tx_free < n)
+            reclaim();
+
+        if(_tx_free >= n) {
+            unsigned int first = _tx_cur;
+            for(unsigned int i = 0, j = first; i < n; i++, ++j %= TX_BUFS) {
+                _tx_buffer[j]->lock();
+                _tx_ring[j].status = Tx_CB_AVAILABLE; // reserved, so reclaim() stops here until it is sent
             }
+            _tx_cur = (first + n) % TX_BUFS;
+            _tx_free -= n;
+
+            if(!was_disabled)
+                CPU::int_enable();
+
+            return first;
+        }
+
+        // We have no guarantee that a resume command was accepted by the adapter, so issue it again while waiting
+        if(_tx_cuc_suspended) {
+            _tx_cuc_suspended = 0;
+            exec_command(cuc_resume, 0);
         }
 
-        db<E100>(TRC) << "E100::send will unlock" << endl;
+        if(!was_disabled)
+            CPU::int_enable();
+    }
+}
 
-        _tx_buffer_prev = buf;
-        buf->unlock();
+// Returns all TxCBs the CU is done with to the host, oldest first, except for the one it is suspended on (must be called with interrupts disabled)
+void E100::reclaim()
+{
+    for(; (_tx_free < TX_BUFS - 1) && (_tx_clean != static_cast<unsigned int>(_tx_prev)); ++_tx_clean %= TX_BUFS, _tx_free++) {
+        Tx_Desc * desc = &_tx_ring[_tx_clean];
+        Reg16 status = desc->status;
+
+        if(!(status & cb_complete)) // still being sent or reserved but not yet published
+            break;
 
-        db<E100>(TRC) << "E100::send unlocked" << endl;
+        if(!(status & cb_ok)) {
+            db<E100>(WRN) << "E100::reclaim:desc[" << _tx_clean << "]=" << desc << " => " << *desc << endl;
+            _statistics.tx_overruns++;
+        }
+
+        _tx_buffer[_tx_clean]->unlock();
     }
+}
 
-    db<E100>(TRC) << "E100::send size=" << size << endl;
+// Marks the TxCB of a reserved buffer as ready and hands the CU, which will only get to them after the next doorbell(), the run of
+// ready TxCBs that starts at the oldest reservation. Unlike PCNet32's descriptors, TxCBs have no ownership bit, so a TxCB published
+// (e.g. by an ISR) while older reservations (e.g. a thread's) are still being assembled waits for them, instead of resuming the CU
+// over them.
+unsigned int E100::publish(Buffer * buf)
+{
+    Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(buf->back());
+    Frame * frame = buf->frame();
+    unsigned int size = buf->size();
+
+    desc->tcb_byte_count = size + sizeof(Header);
+
+    new (desc->frame()) Frame(_address, frame->dst(), frame->prot(), frame->data<void>(), size); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    _tx_ready[desc - _tx_ring] = true;
+    _statistics.tx_packets++;
+    _statistics.tx_bytes += size;
+
+    for(unsigned int next = (_tx_prev + 1) % TX_BUFS; _tx_ready[next]; next = (next + 1) % TX_BUFS) {
+        Tx_Desc * d = &_tx_ring[next];
+        _tx_ready[next] = false;
+
+        // Status must be set before the previous TxCB releases the CU onto this one
+        d->status = Tx_CB_IN_USE;
+        d->command = cb_s | cb_tx | cb_cid; // transmit and suspend afterwards
+
+        _tx_ring[_tx_prev].command &= ~cb_s; // remove suspend bit of the previous frame
+        _tx_prev = next;
+
+        db<E100>(INF) << "E100::publish:desc[" << next << "]=" << d << " => " << *d << endl;
+    }
+
+    if(!was_disabled)
+        CPU::int_enable();
 
     return size;
 }
 
+void E100::doorbell()
+{
+    // SCB commands must not be interleaved with the ISR's
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    while(exec_command(cuc_resume, 0));
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
 unsigned short E100::eeprom_read(unsigned short *addr_len, unsigned short addr) {
 
     unsigned long cmd_addr_data;
@@ -517,6 +580,9 @@ void E100::handle_int() {
     db<E100>(TRC) << "E100::handle_int()" << endl;
     db<E100>(TRC) << ">" << endl;
 
+    // Time stamp taken as early as possible for time-synchronous protocols (e.g. DIRP's PTP)
+    Timer::Time_Stamp ts = Timer::read();
+
     Reg8 stat_ack = read8(&_csr->scb.stat_ack);
     Reg8 status = read8(&_csr->scb.status);
 
@@ -537,66 +603,16 @@ void E100::handle_int() {
             _rx_ruc_no_more_resources++;
         }
 
-        for(int count = RX_BUFS; count && (_rx_ring[_rx_cur].status & cb_complete); count--, ++_rx_cur %= RX_BUFS) {
-            db<E100>(TRC) << "@ count = " << count << ", _rx_cur = " << _rx_cur << endl;
-
-            // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
-            if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
-                Buffer * buf = _rx_buffer[_rx_cur];
-                Rx_Desc * desc = &_rx_ring[_rx_cur];
-                Frame * frame = buf->frame();
-
-                Frame * desc_frame = reinterpret_cast<Frame *>(desc->frame);
-
-                // For the upper layers, size will represent the size of frame->data<T>()
-                unsigned int size = 0;
-                if (_rx_ring[_rx_cur].actual_count & (RFD_EOF_MASK | RFD_F_MASK)) {
-                    size = _rx_ring[_rx_cur].actual_count & RFD_ACTUAL_COUNT_MASK;
-                }
-                else if (_rx_ring[_rx_cur].actual_count & RFD_F_MASK) {
-                    db<E100>(WRN) << "HDS size" << endl;
-                }
-                else if (! (_rx_ring[_rx_cur].actual_count & RFD_F_MASK)) {
-                    db<E100>(WRN) << "Invalid RFD" << endl;
-                    // Workaround if QEMU patch not applied
-                    // http://patchwork.ozlabs.org/patch/662355/
-                    db<E100>(WRN) << "Assuming size to be 1500" << endl;
-                    size = 1500;
-                    // ----
-                }
-                buf->size(size);
-
-                if (! (_rx_ring[_rx_cur].status & RFD_OK_MASK))
-                    db<E100>(WRN) << "Error on frame reception" << endl;
-
-                db<E100>(INF) << "E100::int:receive desc_frame(s=" << desc_frame->src() << ",d=" << desc_frame->dst() << ",p=" << hex << desc_frame->prot() << dec << ",t=" << (char *) desc_frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                new (frame) Frame(desc_frame->src(), desc_frame->dst(), desc_frame->prot(), desc_frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
-
-                db<E100>(INF) << "E100::int:receive(s=" << frame->src() << ",d=" << frame->dst() << ",p=" << hex << frame->header()->prot() << dec << ",t=" << (char *) frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                db<E100>(INF) << "E100::handle_int:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
-
-                _rx_ring[_rx_cur].command = cb_el;
-                _rx_ring[_rx_cur].status = Rx_RFD_NOT_FILLED;
-
-                // try to avoid ruc stop interrupts by "walking" the el bit
-                _rx_ring[_rx_last_el].command &= ~cb_el; // remove previous el bit
-                _rx_last_el = _rx_cur;
-
-                _statistics.rx_packets++;
-                _statistics.rx_bytes += size;
-
-                db<E100>(TRC) << "Will notify!" << endl;
-                if(!notify(frame->header()->prot(), buf)) { // No one was waiting for this frame, so let it free for receive()
-                    free(buf);
-                    db<E100>(TRC) << "Not notified!" << endl;
-                }
-                else {
-                    db<E100>(TRC) << "Notified!" << endl;
-                }
+        if(polling && _poller) {
+            // Mask further interrupts and let the poller drain the ring in thread context
+            if(!_polling && (stat_ack & FR)) {
+                _polling = true;
+                _rx_ts = ts;
+                i82559_disable_irq();
+                _rx_sem->v();
             }
-        }
+        } else
+            drain(RX_BUFS, ts);
     }
 
     db<E100>(TRC) << "<" << endl;
@@ -605,6 +621,122 @@ void E100::handle_int() {
     // IC::enable(IC::irq2int(_irq));
 }
 
+// Hands up to "budget" newly received frames over to the upper layers, returning how many were
+unsigned int E100::drain(unsigned int budget, const Timer::Time_Stamp & ts)
+{
+    unsigned int handled = 0;
+
+    for(int count = RX_BUFS; count && (handled < budget) && (_rx_ring[_rx_cur].status & cb_complete); count--, ++_rx_cur %= RX_BUFS) {
+        db<E100>(TRC) << "@ count = " << count << ", _rx_cur = " << _rx_cur << endl;
+
+        // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
+        if(_rx_buffer[_rx_cur]->lock()) { // if it wasn't, let's handle it
+            Buffer * buf = _rx_buffer[_rx_cur];
+            Rx_Desc * desc = &_rx_ring[_rx_cur];
+            Frame * frame = buf->frame();
+
+            Frame * desc_frame = reinterpret_cast<Frame *>(desc->frame);
+
+            // For the upper layers, size will represent the size of frame->data<T>()
+            unsigned int size = 0;
+            if (_rx_ring[_rx_cur].actual_count & (RFD_EOF_MASK | RFD_F_MASK)) {
+                size = _rx_ring[_rx_cur].actual_count & RFD_ACTUAL_COUNT_MASK;
+            }
+            else if (_rx_ring[_rx_cur].actual_count & RFD_F_MASK) {
+                db<E100>(WRN) << "HDS size" << endl;
+            }
+            else if (! (_rx_ring[_rx_cur].actual_count & RFD_F_MASK)) {
+                db<E100>(WRN) << "Invalid RFD" << endl;
+                // Workaround if QEMU patch not applied
+                // http://patchwork.ozlabs.org/patch/662355/
+                db<E100>(WRN) << "Assuming size to be 1500" << endl;
+                size = 1500;
+                // ----
+            }
+            buf->size(size);
+            buf->sfd_time_stamp = ts;
+
+            if (! (_rx_ring[_rx_cur].status & RFD_OK_MASK))
+                db<E100>(WRN) << "Error on frame reception" << endl;
+
+            db<E100>(INF) << "E100::int:receive desc_frame(s=" << desc_frame->src() << ",d=" << desc_frame->dst() << ",p=" << hex << desc_frame->prot() << dec << ",t=" << (char *) desc_frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            new (frame) Frame(desc_frame->src(), desc_frame->dst(), desc_frame->prot(), desc_frame->data<void>(), buf->size()); // TODO: FIXME. That is creating a copy on a Zero-copy implementation. :P
+
+            db<E100>(INF) << "E100::int:receive(s=" << frame->src() << ",d=" << frame->dst() << ",p=" << hex << frame->header()->prot() << dec << ",t=" << (char *) frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            db<E100>(INF) << "E100::handle_int:desc[" << _rx_cur << "]=" << desc << " => " << *desc << endl;
+
+            _rx_ring[_rx_cur].command = cb_el;
+            _rx_ring[_rx_cur].status = Rx_RFD_NOT_FILLED;
+
+            // try to avoid ruc stop interrupts by "walking" the el bit
+            _rx_ring[_rx_last_el].command &= ~cb_el; // remove previous el bit
+            _rx_last_el = _rx_cur;
+
+            _statistics.rx_packets++;
+            _statistics.rx_bytes += size;
+
+            handled++;
+
+            db<E100>(TRC) << "Will notify!" << endl;
+            if(!notify(frame->header()->prot(), buf)) { // No one was waiting for this frame, so let it free for receive()
+                free(buf);
+                db<E100>(TRC) << "Not notified!" << endl;
+            }
+            else {
+                db<E100>(TRC) << "Notified!" << endl;
+            }
+        }
+    }
+
+    return handled;
+}
+
+void E100::rx_unmask()
+{
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    _polling = false;
+    i82559_enable_irq(); // frames received meanwhile have left FR set, so they interrupt as soon as unmasked
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+// NAPI-like receive thread: drains up to RX_BUDGET frames per pass, yielding between full passes, and unmasks interrupts
+// only when the ring is found empty (after waiting up to MODERATION us for more frames, if moderation is enabled)
+int E100::poll(E100 * dev)
+{
+    db<E100>(TRC) << "E100::poll(dev=" << dev << ")" << endl;
+
+    bool moderated = false;
+
+    dev->_rx_sem->p();
+    while(true) {
+        // Frames keep the time stamp taken by the ISR that woke us up, since ours would include the scheduling latency
+        unsigned int handled = dev->drain(RX_BUDGET, dev->_rx_ts);
+
+        if(handled) {
+            moderated = false;
+            if(handled == RX_BUDGET)
+                Thread::yield();
+            continue;
+        }
+
+        if(MODERATION && !moderated) {
+            moderated = true;
+            Alarm::delay(MODERATION);
+            continue;
+        }
+
+        moderated = false;
+        dev->rx_unmask();
+        dev->_rx_sem->p();
+    }
+
+    return 0;
+}
+
 void E100::i82559_configure(void)
 {
     configCB->command = cb_config;
@@ -8,6 +8,10 @@ __BEGIN_SYS
 // Class attributes
 APIC::Log_Addr APIC::_base;
 IC::Interrupt_Handler IC::_int_vector[IC::INTS];
+unsigned int IC::_deferred[IC::INTS];
+volatile bool IC::_pending[IC::INTS];
+IC::Worker IC::_workers[IC::WORKERS];
+volatile bool IC::_workers_ready;
 
 
 // APIC class methods
@@ -2,6 +2,7 @@
 
 #include <machine/ic.h>
 #include <process.h>
+#include <synchronizer.h>
 
 __BEGIN_SYS
 
@@ -21,6 +22,7 @@ void IC::dispatch(unsigned int i)
 // the ISR, even the reentrant ones, might hold resources (e.g. network buffers) indefinitely.
 // Raising the thread's priority to a ceiling or to a value which allows preemption only by higher priority threads is an old and straightforward
 // solution, but it breaks multicore PCs. This must be investigated deeper!
+// Interrupts deferred with IC::defer() avoid the problem altogether, since their handlers run in threads (see below).
 
 //        Thread::Criterion c = Thread::self()->priority();
 //        if(i != INT_TIMER)
@@ -32,6 +34,25 @@ void IC::dispatch(unsigned int i)
 //        if(i != INT_TIMER)
 //            Thread::self()->priority(c);
 
+        if(_deferred[i]) {
+            // Top half: mask the source (its device may keep the line asserted until serviced) and queue it for the bottom half
+            Engine::disable(i);
+
+            // Already queued (its handler unmasked it while running): the queued run will service the device
+            if(_pending[i])
+                return;
+            _pending[i] = true;
+
+            Worker * worker = &_workers[_deferred[i] - 1];
+            worker->queue[worker->head % INTS] = i;
+            worker->head++;
+
+            // Interrupts taken before threads existed stay queued until init_workers() accounts for them
+            if(worker->semaphore)
+                worker->semaphore->v();
+            return;
+        }
+
         db<Thread>(TRC) << "Thread::priority(this=" << Thread::self() << ",prio=" << Thread::self()->link()->rank() << ")" << endl;
         _int_vector[i](i);
 
@@ -41,4 +62,91 @@ void IC::dispatch(unsigned int i)
     }
 }
 
+bool IC::defer(const Interrupt_Id & i, int priority)
+{
+    db<IC>(TRC) << "IC::defer(int=" << i << ",prio=" << priority << ")" << endl;
+
+    // Only hardware interrupts other than the timer's can be deferred, and only if the engine can mask them individually
+    if((i < INT_FIRST_HARD) || (i > INT_LAST_HARD) || (i == INT_TIMER) || Traits<System>::multicore) {
+        db<IC>(WRN) << "IC::defer: interrupt " << i << " cannot be deferred!" << endl;
+        return false;
+    }
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    unsigned int w;
+    for(w = 0; (w < WORKERS) && _workers[w].used && (_workers[w].priority != priority); w++);
+    if(w == WORKERS) {
+        if(!was_disabled)
+            CPU::int_enable();
+        db<IC>(WRN) << "IC::defer: no worker left for priority " << priority << "!" << endl;
+        return false;
+    }
+    Worker * worker = &_workers[w];
+    bool create = !worker->used && _workers_ready;
+    worker->used = true;
+    worker->priority = priority;
+    if(!was_disabled)
+        CPU::int_enable();
+
+    // Workers are preallocated, so top halves never allocate: if threads already exist, this one is created right away,
+    // before any interrupt is routed to it; otherwise, init_workers() will create it
+    if(create)
+        init_worker(worker);
+
+    CPU::int_disable();
+    _deferred[i] = w + 1;
+    if(!was_disabled)
+        CPU::int_enable();
+
+    return true;
+}
+
+void IC::init_workers()
+{
+    db<Init, IC>(TRC) << "IC::init_workers()" << endl;
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    _workers_ready = true;
+    if(!was_disabled)
+        CPU::int_enable();
+
+    // Workers claimed by defer() before threads existed (defer() creates the others itself, since _workers_ready is now set)
+    for(unsigned int w = 0; w < WORKERS; w++)
+        if(_workers[w].used && !_workers[w].thread)
+            init_worker(&_workers[w]);
+}
+
+void IC::init_worker(Worker * worker)
+{
+    // Interrupts already queued are accounted for in the semaphore's initial value
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    worker->semaphore = new (SYSTEM) Semaphore(worker->head - worker->tail);
+    if(!was_disabled)
+        CPU::int_enable();
+
+    worker->thread = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, worker->priority), &bottom_half, worker);
+}
+
+// Bottom half: runs deferred handlers in FIFO order and unmasks their sources afterwards
+int IC::bottom_half(Worker * worker)
+{
+    while(true) {
+        worker->semaphore->p();
+
+        Interrupt_Id i = worker->queue[worker->tail % INTS];
+        worker->tail++;
+        _pending[i] = false; // from now on, a new interrupt is queued again, so nothing arriving during the handler is lost
+
+        db<IC>(TRC) << "IC::bottom_half(int=" << i << ")" << endl;
+
+        _int_vector[i](i);
+        Engine::enable(i);
+    }
+
+    return 0;
+}
+
 __END_SYS
@@ -0,0 +1,249 @@
+// EPOS PC Loopback Ethernet NIC Mediator Implementation
+
+#include <machine/machine.h>
+#include <machine/pc/loopback.h>
+#include <utility/random.h>
+#include <system.h>
+#include <time.h>
+
+__BEGIN_SYS
+
+// Class attributes
+Loopback * Loopback::_devices[UNITS];
+Alarm * Loopback::_alarm;
+Function_Handler Loopback::_handler(&Loopback::tick);
+
+
+// Methods
+Loopback::~Loopback()
+{
+    db<Loopback>(TRC) << "~Loopback(unit=" << _unit << ")" << endl;
+}
+
+
+int Loopback::send(const Address & dst, const Protocol & prot, const void * data, unsigned int size)
+{
+    db<Loopback>(TRC) << "Loopback::send(s=" << _address << ",d=" << dst << ",p=" << hex << prot << dec << ",d=" << data << ",s=" << size << ")" << endl;
+
+    Buffer * buf = alloc(dst, prot, 0, 0, size);
+    if(!buf)
+        return 0;
+
+    memcpy(buf->frame()->data<void>(), data, size);
+
+    return send(buf);
+}
+
+
+int Loopback::receive(Address * src, Protocol * prot, void * data, unsigned int size)
+{
+    db<Loopback>(TRC) << "Loopback::receive(s=" << *src << ",p=" << hex << *prot << dec << ",d=" << data << ",s=" << size << ") => " << endl;
+
+    // Wait for a frame no one else was interested in
+    Buffer::Element * el;
+    do {
+        bool was_disabled = CPU::int_disabled();
+        CPU::int_disable();
+        el = _received.remove();
+        if(!was_disabled)
+            CPU::int_enable();
+    } while(!el);
+
+    Buffer * buf = el->object();
+
+    // Disassemble the Ethernet frame
+    Frame * frame = buf->frame();
+    *src = frame->src();
+    *prot = frame->prot();
+
+    // Copy the data
+    memcpy(data, frame->data<void>(), (buf->size() > size) ? size : buf->size());
+
+    int tmp = buf->size();
+
+    free(buf);
+
+    return tmp;
+}
+
+
+Loopback::Buffer * Loopback::alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload)
+{
+    db<Loopback>(TRC) << "Loopback::alloc(s=" << _address << ",d=" << dst << ",p=" << hex << prot << dec << ",on=" << once << ",al=" << always << ",pl=" << payload << ")" << endl;
+
+    int max_data = MTU - always;
+
+    if((payload + once) / max_data > TX_BUFS) {
+        db<Loopback>(WRN) << "Loopback::alloc: sizeof(Network::Packet::Data) > sizeof(NIC::Frame::Data) * TX_BUFS!" << endl;
+        return 0;
+    }
+
+    Buffer::List pool;
+
+    // Calculate how many frames are needed to hold the transport PDU and allocate enough buffers
+    for(int size = once + payload; size > 0; size -= max_data) {
+        // Wait for the next buffer to become free and seize it (buffers in flight on shaped links are released by tick())
+        unsigned int i = _tx_cur;
+        for(; !_tx_buffer[i]->lock(); ++i %= TX_BUFS);
+        _tx_cur = (i + 1) % TX_BUFS;
+        Buffer * buf = _tx_buffer[i];
+
+        // Initialize the buffer and assemble the Ethernet Frame Header (re-locking it, since the constructor resets the lock)
+        new (buf) Buffer(this, (size > max_data) ? MTU : size + always, _address, dst, prot);
+        buf->lock();
+
+        db<Loopback>(INF) << "Loopback::alloc:buf=" << buf << " => " << *buf << endl;
+
+        pool.insert(buf->link());
+    }
+
+    return pool.head()->object();
+}
+
+
+int Loopback::send(Buffer * buf)
+{
+    unsigned int size = 0;
+
+    for(Buffer::Element * el = buf->link(), * next; el; el = next) {
+        next = el->next();
+        buf = el->object();
+
+        db<Loopback>(TRC) << "Loopback::send(buf=" << buf << ")" << endl;
+
+        size += buf->size();
+        transmit(buf);
+    }
+
+    return size;
+}
+
+
+void Loopback::free(Buffer * buf)
+{
+    db<Loopback>(TRC) << "Loopback::free(buf=" << buf << ")" << endl;
+
+    for(Buffer::Element * el = buf->link(), * next; el; el = next) {
+        next = el->next();
+
+        // Release the buffer to the NIC
+        el->object()->unlock();
+    }
+}
+
+
+void Loopback::reset()
+{
+    db<Loopback>(TRC) << "Loopback::reset()" << endl;
+
+    // Locally administered MAC address, with the unit in the LSB (so MAC-based IP configuration yields x.x.x.<unit + 1>)
+    _address[0] = 0x02;
+    _address[1] = 0x00;
+    _address[2] = 0x00;
+    _address[3] = 0x00;
+    _address[4] = 0x00;
+    _address[5] = _unit + 1;
+    db<Loopback>(INF) << "Loopback::reset: MAC=" << _address << endl;
+
+    _tx_cur = 0;
+    _rx_cur = 0;
+    _link_free = 0;
+
+    // Reset statistics
+    new (&_statistics) Statistics;
+}
+
+
+void Loopback::transmit(Buffer * buf)
+{
+    _statistics.tx_packets++;
+    _statistics.tx_bytes += buf->size();
+
+    // Frames lost on the emulated link never reach the receive path
+    if(LOSS && ((static_cast<unsigned int>(Random::random()) % 100) < LOSS)) {
+        db<Loopback>(INF) << "Loopback::transmit: frame lost (buf=" << buf << ")" << endl;
+        _statistics.carrier_errors++;
+        buf->unlock();
+        return;
+    }
+
+    Time_Stamp now = Timer::read();
+
+    if(!shaped) {
+        buf->sfd_time_stamp = now;
+        deliver(buf);
+        return;
+    }
+
+    // The frame first waits for the link to serialize the previous ones, then takes BANDWIDTH to be serialized and finally LATENCY to propagate
+    _link_free = ((_link_free > now) ? _link_free : now) + serialization(buf->size() + sizeof(Header));
+    buf->sfd_time_stamp = _link_free + Timer::us2count(LATENCY);
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    _wire.insert(buf->link2());
+    if(!_alarm)
+        _alarm = new (SYSTEM) Alarm(TICK, &_handler, Alarm::INFINITE);
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+
+void Loopback::deliver(Buffer * tx)
+{
+    // Seize a free receive buffer or drop the frame, as a real NIC would do
+    Buffer * buf = 0;
+    for(unsigned int count = RX_BUFS, i = _rx_cur; count; count--, ++i %= RX_BUFS)
+        if(_rx_buffer[i]->lock()) {
+            buf = _rx_buffer[i];
+            _rx_cur = (i + 1) % RX_BUFS;
+            break;
+        }
+
+    if(!buf) {
+        db<Loopback>(WRN) << "Loopback::deliver: no receive buffer available, frame dropped!" << endl;
+        _statistics.rx_overruns++;
+        tx->unlock();
+        return;
+    }
+
+    // "DMA" the frame into the receive buffer and release the transmit one
+    memcpy(buf->frame(), tx->frame(), tx->size() + sizeof(Header));
+    buf->size(tx->size());
+    buf->sfd_time_stamp = tx->sfd_time_stamp;
+    tx->unlock();
+
+    _statistics.rx_packets++;
+    _statistics.rx_bytes += buf->size();
+
+    Frame * frame = buf->frame();
+
+    db<Loopback>(TRC) << "Loopback::deliver:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
+                      << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+    // Observers are notified with interrupts disabled, as they would be by a real NIC's ISR
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so keep it for receive()
+        _received.insert(buf->link2());
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+
+void Loopback::tick()
+{
+    for(unsigned int u = 0; u < UNITS; u++) {
+        Loopback * dev = _devices[u];
+        if(!dev)
+            continue;
+
+        Time_Stamp now = Timer::read();
+        for(Buffer::Element * el = dev->_wire.head(); el && (el->object()->sfd_time_stamp <= now); el = dev->_wire.head()) {
+            dev->_wire.remove(el);
+            dev->deliver(el->object());
+        }
+    }
+}
+
+__END_SYS
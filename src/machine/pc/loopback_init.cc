@@ -0,0 +1,40 @@
+// EPOS PC Loopback Ethernet NIC Mediator Initialization
+
+#include <machine/machine.h>
+#include <machine/pc/loopback.h>
+#include <system.h>
+
+__BEGIN_SYS
+
+Loopback::Loopback(unsigned int unit)
+{
+    db<Loopback>(TRC) << "Loopback(unit=" << unit << ")" << endl;
+
+    _unit = unit;
+
+    // Transmit and receive pools (there is no DMA involved, so the system heap is fine)
+    for(unsigned int i = 0; i < TX_BUFS; i++) {
+        _tx_buffer[i] = new (SYSTEM) Buffer(static_cast<void *>(0));
+        _tx_buffer[i]->nic(this);
+    }
+    for(unsigned int i = 0; i < RX_BUFS; i++) {
+        _rx_buffer[i] = new (SYSTEM) Buffer(static_cast<void *>(0));
+        _rx_buffer[i]->nic(this);
+    }
+
+    reset();
+}
+
+
+void Loopback::init(unsigned int unit)
+{
+    db<Init, Loopback>(TRC) << "Loopback::init(unit=" << unit << ")" << endl;
+
+    // Initialize the device
+    Loopback * dev = new (SYSTEM) Loopback(unit);
+
+    // Register the device
+    _devices[unit] = dev;
+}
+
+__END_SYS
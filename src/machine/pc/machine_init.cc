@@ -1,6 +1,7 @@
 // EPOS PC Mediator Initialization
 
 #include <machine.h>
+#include <network/tstp/tstp.h>
 
 __BEGIN_SYS
 
@@ -35,6 +36,10 @@ void Machine::init()
 #ifdef __NIC_H
     if(Traits<Ethernet>::enabled)
         Initializer<Ethernet>::init();
+
+    // The IEEE 802.15.4 radio is emulated on top of Ethernet and only TSTP runs on it
+    if(Traits<IEEE802_15_4>::enabled && Traits<TSTP>::enabled && EQUAL<Traits<TSTP>::NIC_Family, IEEE802_15_4>::Result)
+        Initializer<IEEE802_15_4>::init();
 #endif
 }
 
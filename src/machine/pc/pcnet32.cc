@@ -4,6 +4,8 @@
 #include <machine/pc/pcnet32.h>
 #include <system.h>
 #include <time.h>
+#include <process.h>
+#include <synchronizer.h>
 
 __BEGIN_SYS
 
@@ -20,14 +22,8 @@ PCNet32::~PCNet32()
 
 int PCNet32::send(const Address & dst, const Protocol & prot, const void * data, unsigned int size)
 {
-    // Wait for a buffer to become free and seize it
-    unsigned int i = _tx_cur;
-    for(bool locked = false; !locked; ) {
-        for(; _tx_ring[i].status & Tx_Desc::OWN; ++i %= TX_BUFS);
-        locked = _tx_buffer[i]->lock();
-    }
-    _tx_cur = (i + 1) % TX_BUFS; // _tx_cur and _rx_cur are simple accelerators to avoid scanning the ring buffer from the beginning.
-                                 // Losing a write in a race condition is assumed to be harmless. The FINC + CAS alternative seems too expensive.
+    // Seize the next descriptor in the ring (the buffer will be reclaimed once the NIC has sent it)
+    unsigned int i = reserve(1);
     Tx_Desc * desc = &_tx_ring[i];
     Buffer * buf = _tx_buffer[i];
 
@@ -35,25 +31,13 @@ int PCNet32::send(const Address & dst, const Protocol & prot, const void * data,
 
     // Assemble the Ethernet frame
     new (buf->frame()) Frame(_address, dst, prot, data, size);
+    buf->size(size);
 
-    desc->size = -(size + sizeof(Header)); // 2's comp.
-
-    // Status must be set last, since it can trigger a send
-    desc->status = Tx_Desc::OWN | Tx_Desc::STP | Tx_Desc::ENP;
-
-    // Trigger an immediate send poll
-    csr(0, csr(0) | CSR0_TDMD);
-
-    _statistics.tx_packets++;
-    _statistics.tx_bytes += size;
-
-    // Wait for packet to be sent
-    // while(desc->status & Tx_Desc::OWN);
+    publish(buf);
+    doorbell();
 
     db<PCNet32>(INF) << "PCNet32::send:desc[" << i << "]=" << desc << " => " << *desc << endl;
 
-    buf->unlock();
-
     return size;
 }
 
@@ -99,29 +83,24 @@ int PCNet32::receive(Address * src, Protocol * prot, void * data, unsigned int s
 }
 
 
-// Allocated buffers must be sent or release IN ORDER as assumed by the PCNet32
+// Allocated buffers must be sent IN ORDER as assumed by the PCNet32
 PCNet32::Buffer * PCNet32::alloc(const Address & dst, const Protocol & prot, unsigned int once, unsigned int always, unsigned int payload)
 {
     db<PCNet32>(TRC) << "PCNet32::alloc(s=" << _address << ",d=" << dst << ",p=" << hex << prot << dec << ",on=" << once << ",al=" << always << ",pl=" << payload << ")" << endl;
 
     int max_data = MTU - always;
 
-    if((payload + once) / max_data > TX_BUFS) {
+    // Calculate how many frames are needed to hold the transport PDU and reserve them all at once
+    unsigned int frames = (once + payload + max_data - 1) / max_data;
+    if(frames > TX_BUFS) {
         db<PCNet32>(WRN) << "PCNet32::alloc: sizeof(Network::Packet::Data) > sizeof(NIC::Frame::Data) * TX_BUFS!" << endl;
         return 0;
     }
 
     Buffer::List pool;
 
-    // Calculate how many frames are needed to hold the transport PDU and allocate enough buffers
-    for(int size = once + payload; size > 0; size -= max_data) {
-        // Wait for the next buffer to become free and seize it
-        unsigned int i = _tx_cur;
-        for(bool locked = false; !locked; ) {
-            for(; _tx_ring[i].status & Tx_Desc::OWN; ++i %= TX_BUFS);
-            locked = _tx_buffer[i]->lock();
-        }
-        _tx_cur = (i + 1) % TX_BUFS;
+    unsigned int i = reserve(frames);
+    for(int size = once + payload; size > 0; size -= max_data, ++i %= TX_BUFS) {
         Tx_Desc * desc = &_tx_ring[i];
         Buffer * buf = _tx_buffer[i];
 
@@ -144,36 +123,130 @@ int PCNet32::send(Buffer * buf)
 
     for(Buffer::Element * el = buf->link(); el; el = el->next()) {
         buf = el->object();
-        Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(buf->back());
 
         db<PCNet32>(TRC) << "PCNet32::send(buf=" << buf << ")" << endl;
 
         db<PCNet32>(INF) << "PCNet32::send:buf=" << buf << " => " << *buf << endl;
 
-        desc->size = -(buf->size() + sizeof(Header)); // 2's comp.
+        size += publish(buf);
+    }
 
-        // Status must be set last, since it can trigger a send
-        desc->status = Tx_Desc::OWN | Tx_Desc::STP | Tx_Desc::ENP;
+    // Trigger a single send poll for the whole pool (buffers are reclaimed by later reservations, once sent)
+    doorbell();
 
-        // Trigger an immediate send poll
-        csr(0, csr(0) | CSR0_TDMD);
+    return size;
+}
 
-        size += buf->size();
 
-        _statistics.tx_packets++;
-        _statistics.tx_bytes += buf->size();
+int PCNet32::send(Buffer * pools[], unsigned int n)
+{
+    db<PCNet32>(TRC) << "PCNet32::send(pools=" << pools << ",n=" << n << ")" << endl;
 
-        db<PCNet32>(INF) << "PCNet32::send:desc=" << desc << " => " << *desc << endl;
+    unsigned int size = 0;
 
-        // Wait for packet to be sent and unlock the respective buffer
-        while(desc->status & Tx_Desc::OWN);
-        buf->unlock();
-    }
+    // Hand all frames over to the NIC, in allocation order
+    for(unsigned int i = 0; i < n; i++)
+        for(Buffer::Element * el = pools[i]->link(); el; el = el->next())
+            size += publish(el->object());
+
+    // Trigger a single send poll for the whole batch
+    doorbell();
 
     return size;
 }
 
 
+// Reserves "n" consecutive transmit descriptors and returns the index of the first one. Since the NIC stops at the first
+// descriptor it doesn't own, descriptors are handed out strictly in ring order and never skipped, and the ones already sent
+// are reclaimed in bulk only when the free ones run short
+unsigned int PCNet32::reserve(unsigned int n)
+{
+    while(true) {
+        bool was_disabled = CPU::int_disabled();
+        CPU::int_disable();
+
+        if(_tx_free < n)
+            reclaim();
+
+        if(_tx_free >= n) {
+            unsigned int first = _tx_cur;
+            for(unsigned int i = 0, j = first; i < n; i++, ++j %= TX_BUFS)
+                _tx_buffer[j]->lock();
+            _tx_cur = (first + n) % TX_BUFS;
+            _tx_free -= n;
+
+            if(!was_disabled)
+                CPU::int_enable();
+
+            return first;
+        }
+
+        if(!was_disabled)
+            CPU::int_enable();
+    }
+}
+
+
+// Returns all descriptors the NIC is done with to the host, oldest first (must be called with interrupts disabled)
+void PCNet32::reclaim()
+{
+    for(; _tx_free < TX_BUFS; ++_tx_clean %= TX_BUFS, _tx_free++) {
+        Tx_Desc * desc = &_tx_ring[_tx_clean];
+        Reg16 status = desc->status;
+
+        if((status & Tx_Desc::OWN) || !(status & Tx_Desc::STP)) // still being sent or reserved but not yet published
+            break;
+
+        if(status & Tx_Desc::ERR) {
+            db<PCNet32>(WRN) << "PCNet32::reclaim:desc[" << _tx_clean << "]=" << desc << " => " << *desc << endl;
+
+            Reg32 misc = desc->misc;
+            if(misc & (Tx_Desc::UFLO | Tx_Desc::BUFF))
+                _statistics.tx_overruns++;
+            if(misc & Tx_Desc::LCAR)
+                _statistics.carrier_errors++;
+            if(misc & (Tx_Desc::LCOL | Tx_Desc::RTRY))
+                _statistics.collisions++;
+        }
+
+        desc->status = 0; // Owned by host
+        desc->misc = 0;
+        _tx_buffer[_tx_clean]->unlock();
+    }
+}
+
+
+// Hands the descriptor of a reserved buffer over to the NIC, which will only send it after the next doorbell()
+unsigned int PCNet32::publish(Buffer * buf)
+{
+    Tx_Desc * desc = reinterpret_cast<Tx_Desc *>(buf->back());
+
+    desc->size = -(buf->size() + sizeof(Header)); // 2's comp.
+
+    // Status must be set last, since it can trigger a send
+    desc->status = Tx_Desc::OWN | Tx_Desc::STP | Tx_Desc::ENP;
+
+    _statistics.tx_packets++;
+    _statistics.tx_bytes += buf->size();
+
+    db<PCNet32>(INF) << "PCNet32::publish:desc=" << desc << " => " << *desc << endl;
+
+    return buf->size();
+}
+
+
+void PCNet32::doorbell()
+{
+    // RAP/RDP accesses must not be interleaved with the ISR's. Writing CSR0 back with its own value would acknowledge pending interrupts,
+    // so only IENA is written along with TDMD
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    csr(0, CSR0_IENA | CSR0_TDMD);
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+
 void PCNet32::free(Buffer * buf)
 {
     db<PCNet32>(TRC) << "PCNet32::free(buf=" << buf << ")" << endl;
@@ -307,33 +380,20 @@ void PCNet32::handle_int()
         }
 
         if(csr0 & CSR0_RINT) { // Frame received (possibly multiple, let's handle a whole round on the ring buffer)
-
-            // Note that ISRs in EPOS are reentrant, that's why locking was carefully made atomic
-            // Therefore, several instances of this code can compete to handle received buffers
-
-            for(unsigned int count = RX_BUFS, i = _rx_cur; count && !(_rx_ring[i].status & Rx_Desc::OWN); count--, ++i %= RX_BUFS, _rx_cur = i) {
-                // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
-                if(_rx_buffer[i]->lock()) { // if it wasn't, let's handle it
-                    Buffer * buf = _rx_buffer[i];
-                    Rx_Desc * desc = &_rx_ring[i];
-                    Frame * frame = buf->frame();
-
-                    // For the upper layers, size will represent the size of frame->data<T>()
-                    buf->size((desc->misc & 0x00000fff) - sizeof(Header) - sizeof(CRC));
-
-                    db<PCNet32>(TRC) << "PCNet32::handle_int:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
-                                     << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
-
-                    db<PCNet32>(INF) << "PCNet32::handle_int:desc[" << i << "]=" << desc << " => " << *desc << endl;
-
-                    IC::disable(IC::irq2int(_irq));
-                    if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so let it free for receive()
-                        free(buf);
-                    // TODO: this serialization is much too restrictive. It was done this way for students to play with
-                    IC::enable(IC::irq2int(_irq));
+            // Time stamp taken as early as possible for time-synchronous protocols (e.g. DIRP's PTP)
+            Timer::Time_Stamp ts = Timer::read();
+
+            if(polling && _poller) {
+                // Mask further receive interrupts and let the poller drain the ring in thread context (RINT is ignored while polling)
+                if(!_polling) {
+                    _polling = true;
+                    _rx_ts = ts;
+                    csr(3, csr(3) | CSR3_RINTM);
+                    _rx_sem->v();
                 }
-            }
- 	}
+            } else
+                drain(RX_BUFS, ts);
+        }
 
         if(csr0 & CSR0_ERR) { // Error
             db<PCNet32>(WRN) << "PCNet32::handle_int:error =>";
@@ -363,6 +423,92 @@ void PCNet32::handle_int()
 }
 
 
+// Hands up to "budget" newly received frames over to the upper layers, returning how many were
+unsigned int PCNet32::drain(unsigned int budget, const Timer::Time_Stamp & ts)
+{
+    unsigned int handled = 0;
+
+    // Note that ISRs in EPOS are reentrant, that's why locking was carefully made atomic
+    // Therefore, several instances of this code can compete to handle received buffers
+    for(unsigned int count = RX_BUFS, i = _rx_cur; count && (handled < budget) && !(_rx_ring[i].status & Rx_Desc::OWN); count--, ++i %= RX_BUFS, _rx_cur = i) {
+        // NIC received a frame in _rx_buffer[_rx_cur], let's check if it has already been handled
+        if(_rx_buffer[i]->lock()) { // if it wasn't, let's handle it
+            Buffer * buf = _rx_buffer[i];
+            Rx_Desc * desc = &_rx_ring[i];
+            Frame * frame = buf->frame();
+
+            // For the upper layers, size will represent the size of frame->data<T>()
+            buf->size((desc->misc & 0x00000fff) - sizeof(Header) - sizeof(CRC));
+            buf->sfd_time_stamp = ts;
+
+            db<PCNet32>(TRC) << "PCNet32::drain:receive(s=" << frame->src() << ",p=" << hex << frame->header()->prot() << dec
+                             << ",d=" << frame->data<void>() << ",s=" << buf->size() << ")" << endl;
+
+            db<PCNet32>(INF) << "PCNet32::drain:desc[" << i << "]=" << desc << " => " << *desc << endl;
+
+            handled++;
+
+            if(!_polling)
+                IC::disable(IC::irq2int(_irq));
+            if(!notify(frame->header()->prot(), buf)) // No one was waiting for this frame, so let it free for receive()
+                free(buf);
+            // TODO: this serialization is much too restrictive. It was done this way for students to play with
+            if(!_polling)
+                IC::enable(IC::irq2int(_irq));
+        }
+    }
+
+    return handled;
+}
+
+
+void PCNet32::rx_unmask()
+{
+    // RAP/RDP accesses must not be interleaved with the ISR's
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    _polling = false;
+    csr(3, csr(3) & ~CSR3_RINTM); // frames received meanwhile have left RINT set, so they interrupt as soon as unmasked
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+
+// NAPI-like receive thread: drains up to RX_BUDGET frames per pass, yielding between full passes, and unmasks receive
+// interrupts only when the ring is found empty (after waiting up to MODERATION us for more frames, if moderation is enabled)
+int PCNet32::poll(PCNet32 * dev)
+{
+    db<PCNet32>(TRC) << "PCNet32::poll(dev=" << dev << ")" << endl;
+
+    bool moderated = false;
+
+    dev->_rx_sem->p();
+    while(true) {
+        // Frames keep the time stamp taken by the ISR that woke us up, since ours would include the scheduling latency
+        unsigned int handled = dev->drain(RX_BUDGET, dev->_rx_ts);
+
+        if(handled) {
+            moderated = false;
+            if(handled == RX_BUDGET)
+                Thread::yield();
+            continue;
+        }
+
+        if(MODERATION && !moderated) {
+            moderated = true;
+            Alarm::delay(MODERATION);
+            continue;
+        }
+
+        moderated = false;
+        dev->rx_unmask();
+        dev->_rx_sem->p();
+    }
+
+    return 0;
+}
+
+
 void PCNet32::int_handler(const IC::Interrupt_Id & interrupt)
 {
     PCNet32 * dev = get_by_interrupt(interrupt);
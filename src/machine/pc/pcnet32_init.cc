@@ -4,6 +4,8 @@
 #include <machine/pci.h>
 #include <machine/pc/pcnet32.h>
 #include <system.h>
+#include <process.h>
+#include <synchronizer.h>
 
 __BEGIN_SYS
 
@@ -16,6 +18,12 @@ PCNet32::PCNet32(unsigned int unit, IO_Port io_port, IO_Irq irq, DMA_Buffer * dm
     _irq = irq;
     _dma_buf = dma_buf;
 
+    // The poller thread is only created by init_poller(), since NICs are initialized before threads (see Network::init())
+    _polling = false;
+    _rx_ts = 0;
+    _poller = 0;
+    _rx_sem = polling ? new (SYSTEM) Semaphore(0) : 0;
+
     // Distribute the DMA_Buffer allocated by init()
     Log_Addr log = _dma_buf->log_address();
     Phy_Addr phy = _dma_buf->phy_address();
@@ -35,6 +43,8 @@ PCNet32::PCNet32(unsigned int unit, IO_Port io_port, IO_Irq irq, DMA_Buffer * dm
 
     // Tx_Desc Ring
     _tx_cur = 0;
+    _tx_clean = 0;
+    _tx_free = TX_BUFS;
     _tx_ring = log;
     _tx_ring_phy = phy;
     log += TX_BUFS * align128(sizeof(Tx_Desc));
@@ -69,6 +79,15 @@ PCNet32::PCNet32(unsigned int unit, IO_Port io_port, IO_Irq irq, DMA_Buffer * dm
 }
 
 
+void PCNet32::init_poller()
+{
+    db<PCNet32>(TRC) << "PCNet32::init_poller(unit=" << _unit << ")" << endl;
+
+    if(polling && !_poller)
+        _poller = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::HIGH), &poll, this);
+}
+
+
 void PCNet32::init(unsigned int unit)
 {
     db<Init, PCNet32>(TRC) << "PCNet32::init(unit=" << unit << ")" << endl;
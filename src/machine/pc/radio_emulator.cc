@@ -0,0 +1,349 @@
+// EPOS PC IEEE 802.15.4 Radio Emulator NIC Mediator Implementation
+
+#include <machine/machine.h>
+#include <network/tstp/tstp.h>
+#include <utility/random.h>
+#include <system.h>
+
+__BEGIN_SYS
+
+// Class attributes
+volatile Radio_Emulator_RF::Timer::Offset Radio_Emulator_RF::Timer::_offset;
+volatile Radio_Emulator_RF::Timer::Time_Stamp Radio_Emulator_RF::Timer::_sfd;
+volatile Radio_Emulator_RF::Timer::Time_Stamp Radio_Emulator_RF::Timer::_int_request_time;
+volatile IC::Interrupt_Handler Radio_Emulator_RF::Timer::_handler;
+
+NIC<Ethernet> * Radio_Emulator_RF::_air;
+Radio_Emulator_RF::Position Radio_Emulator_RF::_position;
+unsigned int Radio_Emulator_RF::_channel;
+Power_Mode Radio_Emulator_RF::_mode = OFF;
+bool Radio_Emulator_RF::_listening;
+Radio_Emulator_RF::Timer::Time_Stamp Radio_Emulator_RF::_rx_ready;
+Radio_Emulator_RF::Timer::Time_Stamp Radio_Emulator_RF::_tx_end;
+Radio_Emulator_RF::Timer::Time_Stamp Radio_Emulator_RF::_air_busy;
+unsigned int Radio_Emulator_RF::_tx_size;
+unsigned char Radio_Emulator_RF::_tx_frame[IEEE802_15_4::MTU];
+volatile Radio_Emulator_RF::RX_State Radio_Emulator_RF::_rx_state;
+Radio_Emulator_RF::Timer::Time_Stamp Radio_Emulator_RF::_rx_end;
+int Radio_Emulator_RF::_rx_rssi;
+unsigned int Radio_Emulator_RF::_rx_size;
+unsigned char Radio_Emulator_RF::_rx_frame[IEEE802_15_4::MTU];
+
+Radio_Emulator * Radio_Emulator::_devices[UNITS];
+User_Timer * Radio_Emulator::_timer;
+volatile bool Radio_Emulator::_handling;
+
+
+// Methods
+void Radio_Emulator_RF::Timer::int_handler(const IC::Interrupt_Id & interrupt)
+{
+    IC::Interrupt_Handler h = _handler;
+    if(h && (_int_request_time <= read())) {
+        int_disable();
+        CPU::int_enable();
+        h(interrupt);
+    }
+}
+
+
+void Radio_Emulator_RF::transmit_no_cca()
+{
+    assert(_tx_size >= sizeof(IEEE802_15_4::CRC));
+
+    Timer::Time_Stamp now = Timer::read();
+    Timer::Time_Stamp start = now + Timer::us2count(((_mode == SLEEP) || (_mode == OFF)) ? SLEEP_TO_TX_DELAY : RX_TO_TX_DELAY);
+    _tx_end = start + airtime(_tx_size);
+    if(!rx_after_tx)
+        _listening = false;
+
+    // Transmitting aborts the reception in progress, if any
+    if((_rx_state == RX_RECEIVING) || (_rx_state == RX_CORRUPTED))
+        _rx_state = RX_IDLE;
+
+    NIC<Ethernet>::Buffer * buf = _air->alloc(_air->broadcast(), PROTO_AIR, 0, 0, sizeof(Air_Header) + _tx_size - sizeof(IEEE802_15_4::CRC));
+    if(!buf)
+        return;
+
+    Air_Header * air = buf->frame()->data<Air_Header>();
+    air->position = _position;
+    air->channel = _channel;
+    air->size = _tx_size;
+    memcpy(air + 1, _tx_frame, _tx_size - sizeof(IEEE802_15_4::CRC));
+
+    _air->send(buf);
+}
+
+
+void Radio_Emulator_RF::power(const Power_Mode & mode)
+{
+    switch(mode) {
+    case ENROLL:
+        break;
+    case DISMISS:
+        break;
+    case SAME:
+        break;
+    case FULL: // Able to receive and transmit
+    case LIGHT: // Able to sense channel and transmit
+        if((_mode == SLEEP) || (_mode == OFF))
+            _rx_ready = Timer::read() + Timer::us2count(SLEEP_TO_RX_DELAY);
+        _mode = mode;
+        break;
+    case SLEEP: // Receiver off
+    case OFF: // Radio unit shut down
+        _mode = mode;
+        _listening = false;
+        if(_rx_state != RX_DONE)
+            _rx_state = RX_IDLE;
+        break;
+    }
+}
+
+
+Radio_Emulator::~Radio_Emulator()
+{
+    db<Radio_Emulator>(TRC) << "~Radio_Emulator(unit=" << _unit << ")" << endl;
+
+    _air->detach(this, PROTO_AIR);
+}
+
+
+int Radio_Emulator::send(const Address & dst, const IEEE802_15_4::Type & type, const void * data, unsigned int size)
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::send(s=" << address() << ",d=" << dst << ",p=" << hex << type << dec << ",d=" << data << ",s=" << size << ")" << endl;
+
+    Buffer * b = alloc(dst, type, 0, 0, size);
+    memcpy(b->frame()->data<void>(), data, size);
+    return send(b);
+}
+
+
+int Radio_Emulator::receive(Address * src, IEEE802_15_4::Type * type, void * data, unsigned int size)
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::receive(s=" << *src << ",p=" << hex << *type << dec << ",d=" << data << ",s=" << size << ") => " << endl;
+
+    Buffer * buf;
+    for(buf = 0; !buf; ++_rx_cur_consume %= RX_BUFS) {
+        unsigned int idx = _rx_cur_consume;
+        if(_rx_bufs[idx]->lock()) {
+            if(_rx_bufs[idx]->size() > 0)
+                buf = _rx_bufs[idx];
+            else
+                _rx_bufs[idx]->unlock();
+        }
+    }
+
+    Address dst;
+    unsigned int ret = MAC::unmarshal(buf, src, &dst, type, data, size);
+    free(buf);
+
+    db<Radio_Emulator>(INF) << "Radio_Emulator::received " << ret << " bytes" << endl;
+
+    return ret;
+}
+
+
+Radio_Emulator::Buffer * Radio_Emulator::alloc(const Address & dst, const IEEE802_15_4::Type & type, unsigned int once, unsigned int always, unsigned int payload)
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::alloc(s=" << address() << ",d=" << dst << ",p=" << hex << type << dec << ",on=" << once << ",al=" << always << ",ld=" << payload << ")" << endl;
+
+    // Initialize the buffer
+    Buffer * buf = new (SYSTEM) Buffer(this, once + always + payload + sizeof(IEEE802_15_4::Header));
+    buf->references = 0; // not a receive buffer, so it is deleted when done
+    MAC::marshal(buf, address(), dst, type);
+
+    return buf;
+}
+
+
+int Radio_Emulator::send(Buffer * buf)
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::send(buf=" << buf << ")" << endl;
+
+    unsigned int size = MAC::send(buf);
+
+    if(size) {
+        _statistics.tx_packets++;
+        _statistics.tx_bytes += size;
+    } else
+        db<Radio_Emulator>(WRN) << "Radio_Emulator::send(buf=" << buf << ")" << " => failed!" << endl;
+
+    return size;
+}
+
+
+void Radio_Emulator::free(Buffer * buf)
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::free(buf=" << buf << ")" << endl;
+
+    // Buffers relayed in place by the MAC only go back to the ring when both the receive path and the MAC are done with them
+    if(CPU::fdec(buf->references) > 1)
+        return;
+
+    _statistics.rx_packets++;
+    _statistics.rx_bytes += buf->size();
+
+    buf->size(0);
+    buf->unlock();
+}
+
+
+void Radio_Emulator::reset()
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::reset()" << endl;
+
+    // Reset statistics
+    new (&_statistics) Statistics;
+}
+
+
+void Radio_Emulator::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & prot, NIC<Ethernet>::Buffer * buf)
+{
+    Timer::Time_Stamp now = Timer::read();
+
+    Air_Header * air = buf->frame()->data<Air_Header>();
+    Position::Distance distance = air->position - _position;
+
+    db<Radio_Emulator>(TRC) << "Radio_Emulator::update(pos=" << air->position << ",ch=" << air->channel << ",s=" << air->size << ",d=" << distance << ")" << endl;
+
+    // Frames out of range or on other channels are not even sensed
+    if((air->channel != _channel) || (RANGE && (distance > RANGE)) || (air->size > IEEE802_15_4::MTU) || (air->size < sizeof(IEEE802_15_4::CRC))) {
+        _air->free(buf);
+        return;
+    }
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    Timer::Time_Stamp end = now + airtime(air->size);
+    if(end > _air_busy)
+        _air_busy = end;
+
+    settle(now);
+
+    if(LOSS && ((static_cast<unsigned int>(Random::random()) % 100) < LOSS)) {
+        db<Radio_Emulator>(INF) << "Radio_Emulator::update: frame lost" << endl;
+        _statistics.carrier_errors++;
+    } else if((_rx_state == RX_RECEIVING) || (_rx_state == RX_CORRUPTED)) {
+        // Overlapping frames corrupt one another and the receiver stays busy until both have left the air
+        db<Radio_Emulator>(INF) << "Radio_Emulator::update: collision" << endl;
+        _statistics.collisions++;
+        _rx_state = RX_CORRUPTED;
+        if(end > _rx_end)
+            _rx_end = end;
+    } else if(_rx_state == RX_DONE) {
+        db<Radio_Emulator>(INF) << "Radio_Emulator::update: RX FIFO full, frame dropped" << endl;
+        _statistics.rx_overruns++;
+    } else if(receiving()) {
+        memcpy(_rx_frame, air + 1, air->size - sizeof(IEEE802_15_4::CRC));
+        _rx_size = air->size;
+        _rx_end = end;
+        _rx_rssi = -40 - (RANGE ? static_cast<int>(50 * distance / RANGE) : 0); // dBm, fading linearly down to the sensitivity at RANGE
+        _rx_state = RX_RECEIVING;
+        Timer::_sfd = now + Timer::us2count(IEEE802_15_4::SHR_SIZE * 1000000ULL / IEEE802_15_4::BYTE_RATE);
+    }
+
+    if(!was_disabled)
+        CPU::int_enable();
+
+    _air->free(buf);
+}
+
+
+void Radio_Emulator::handle_int()
+{
+    settle(Timer::read());
+
+    if(!rx_done())
+        return;
+
+    Buffer * buf = 0;
+    unsigned int idx = _rx_cur_produce;
+    for(unsigned int count = RX_BUFS; count; count--, ++idx %= RX_BUFS) {
+        if(_rx_bufs[idx]->lock()) {
+            buf = _rx_bufs[idx];
+            break;
+        }
+    }
+    _rx_cur_produce = (idx + 1) % RX_BUFS;
+
+    if(buf) {
+        buf->size(Radio_Emulator_RF::copy_from_nic(buf->frame()));
+        buf->rssi = _rx_rssi;
+        buf->sfd_time_stamp = Timer::sfd();
+        buf->references = 1;
+
+        if(MAC::pre_notify(buf)) {
+            db<Radio_Emulator>(TRC) << "Radio_Emulator::handle_int:receive(b=" << buf << ") => " << *buf << endl;
+            bool notified = notify(reinterpret_cast<IEEE802_15_4::Header *>(buf->frame())->type(), buf);
+            if(!MAC::post_notify(buf) && !notified)
+                buf->unlock(); // No one was waiting for this frame, so make it available for receive()
+        } else {
+            db<Radio_Emulator>(TRC) << "Radio_Emulator::handle_int: frame dropped by MAC"  << endl;
+            buf->size(0);
+            buf->unlock();
+        }
+    } else {
+        Radio_Emulator_RF::drop();
+        _statistics.rx_overruns++;
+    }
+}
+
+
+void Radio_Emulator::int_handler(const IC::Interrupt_Id & interrupt)
+{
+    // Radio and MAC timer must not preempt one another and the MAC's handlers busy-wait on the air with interrupts enabled,
+    // so ticks that arrive meanwhile are simply skipped
+    if(_handling)
+        return;
+    _handling = true;
+
+    for(unsigned int u = 0; u < UNITS; u++)
+        if(_devices[u])
+            _devices[u]->handle_int();
+
+    Timer::int_handler(interrupt);
+
+    CPU::int_disable();
+    _handling = false;
+}
+
+
+// TSTP binding
+template<typename Radio>
+void TSTP::MAC<Radio, true>::free(Buffer * b) { Radio::Device::get()->free(b); }
+
+template<typename Radio>
+void TSTP::MAC<Radio, false>::free(Buffer * b) { Radio::Device::get()->free(b); }
+
+template<typename Radio>
+bool TSTP::MAC<Radio, true>::equals(Buffer * b0, Buffer * b1)
+{
+    if(b0->id != b1->id)
+        return false;
+    Header * header = b0->frame()->data<Header>();
+    Header * other_header = b1->frame()->data<Header>();
+    return
+        (other_header->version() == header->version()) &&
+        (other_header->type() == header->type()) &&
+        (other_header->scale() == header->scale()) &&
+        (other_header->time() == header->time()) &&
+        (other_header->origin() == header->origin());
+}
+
+template<typename Radio>
+bool TSTP::MAC<Radio, false>::equals(Buffer * b0, Buffer * b1)
+{
+    if(b0->id != b1->id)
+        return false;
+    Header * header = b0->frame()->data<Header>();
+    Header * other_header = b1->frame()->data<Header>();
+    return
+        (other_header->version() == header->version()) &&
+        (other_header->type() == header->type()) &&
+        (other_header->scale() == header->scale()) &&
+        (other_header->time() == header->time()) &&
+        (other_header->origin() == header->origin());
+}
+
+__END_SYS
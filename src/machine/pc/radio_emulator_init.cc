@@ -0,0 +1,56 @@
+// EPOS PC IEEE 802.15.4 Radio Emulator NIC Mediator Initialization
+
+#include <machine/machine.h>
+#include <network/tstp/tstp.h>
+#include <system.h>
+
+__BEGIN_SYS
+
+Radio_Emulator::Radio_Emulator(unsigned int unit): _unit(unit), _rx_cur_consume(0), _rx_cur_produce(0)
+{
+    db<Radio_Emulator>(TRC) << "Radio_Emulator(unit=" << unit << ") => " << this << endl;
+
+    // Initialize RX buffer pool
+    for(unsigned int i = 0; i < RX_BUFS; i++)
+        _rx_bufs[i] = new (SYSTEM) Buffer(0, 0);
+
+    // The air is the segment of the first Ethernet NIC
+    _air = Traits<Ethernet>::DEVICES::Get<0>::Result::get(0);
+    _air->attach(this, PROTO_AIR);
+
+    // Set Address (derived from the Ethernet one, which is unique on the segment)
+    const NIC<Ethernet>::Address & mac = _air->address();
+    _address[0] = mac[4];
+    _address[1] = mac[5];
+
+    // Set position (nodes without one stay at the origin)
+    System_Info::Boot_Map * bm = &System::info()->bm;
+    if(bm->space_x != -1)
+        position(Position(bm->space_x, bm->space_y, bm->space_z));
+
+    db<Radio_Emulator>(INF) << "Radio_Emulator: address=" << _address << ", position=" << position() << endl;
+
+    channel(Traits<Radio_Emulator>::DEFAULT_CHANNEL);
+
+    reset(); // Reset statistics
+
+    MAC::constructor_epilogue(); // Device is configured, let the MAC use it
+}
+
+
+void Radio_Emulator::init(unsigned int unit)
+{
+    db<Init, Radio_Emulator>(TRC) << "Radio_Emulator::init(unit=" << unit << ")" << endl;
+
+    // Initialize the device
+    Radio_Emulator * dev = new (SYSTEM) Radio_Emulator(unit);
+
+    // Register the device
+    _devices[unit] = dev;
+
+    // Both the end of receptions and the MAC timer are checked on every tick of the system timer, on its user channel
+    if(!_timer)
+        _timer = new (SYSTEM) User_Timer(0, 1000000 / Traits<_SYS::Timer>::FREQUENCY, &int_handler, true);
+}
+
+__END_SYS
@@ -11,8 +11,18 @@
 __BEGIN_SYS
 
 // Class attributes
-DIRP::Observed DIRP::_observed;
+Hashed_Data_Observed<DIRP::Buffer, DIRP::Port> DIRP::_observed;
 DIRP* DIRP::_networks[];
+Function_Handler DIRP::_ptp_handler(&DIRP::ptp_sync);
+DIRP::PTP::Time_Stamp DIRP::PTP::_base;
+DIRP::PTP::Time_Stamp DIRP::PTP::_raw_base;
+DIRP::PTP::Statistics DIRP::PTP::_statistics;
+unsigned short DIRP::PTP::_sequence;
+DIRP::PTP::Time_Stamp DIRP::PTP::_t1;
+DIRP::PTP::Time_Stamp DIRP::PTP::_t2;
+DIRP::PTP::Time_Stamp DIRP::PTP::_t3;
+DIRP::PTP::Time_Stamp DIRP::PTP::_last_t1;
+DIRP::PTP::Time_Stamp DIRP::PTP::_last_t2;
 
 static const int DELAY_SECONDS = 1000000;
 
@@ -64,6 +74,80 @@ int DIRP::send(const Address::Local & from, const Address & to, const void* data
     return size;
 }
 
+int DIRP::send_batch(const Address::Local & from, const Message_Desc * msgs, unsigned int n)
+{
+    db<DIRP>(TRC) << "DIRP::send_batch(f=" << from << ",m=" << msgs << ",n=" << n << ")" << endl;
+
+    // Messages that would not fit in a Packet are refused before anything is sent
+    for(unsigned int i = 0; i < n; i++)
+        if(msgs[i].size > sizeof(Data)) {
+            db<DIRP>(WRN) << "DIRP::send_batch: message " << i << " is larger than the MTU (" << msgs[i].size << " > " << sizeof(Data) << ")!" << endl;
+            return -1;
+        }
+
+    DIRP * dirp = DIRP::get_by_nic(0);
+    NIC<Ethernet> * nic = dirp->nic();
+    int size = 0;
+
+    for(unsigned int i = 0; i < n; i += MAX_BATCH) {
+        unsigned int count = ((n - i) > MAX_BATCH) ? MAX_BATCH : (n - i);
+
+        // Build all packets straight into NIC buffers
+        Buffer * pools[MAX_BATCH];
+        unsigned int built = 0;
+        for(; built < count; built++) {
+            const Message_Desc & msg = msgs[i + built];
+            pools[built] = nic->alloc(msg.to.mac(), dirp->PROTOCOL, 0, 0, sizeof(Packet));
+            if(!pools[built])
+                break;
+            Header header(Address(nic->address(), from), msg.to, msg.size, dirp->_clock->now());
+            new (pools[built]->frame()->data<void>()) Packet(header, msg.data, msg.size);
+        }
+
+        // Notify the NIC only once for the whole batch
+        nic->send(pools, built);
+
+        // Collect the ACKs under a single time out (batched messages are not retransmitted)
+        Batch_Timer timer = {from, false};
+        Functor_Handler<Batch_Timer> handler(&batch_timeout, &timer);
+        Alarm alarm(DELAY_SECONDS * Traits<Network>::TIMEOUT, &handler);
+
+        // DIRP headers carry no sequence numbers, so each ACK is matched to the oldest message of the batch still waiting
+        // for one from the same peer; anything else arriving at the port meanwhile is dropped
+        bool acked[MAX_BATCH] = {false};
+        for(unsigned int pending = built; pending; ) {
+            Buffer * ack = _observed.notified(from);
+            if(!ack || timer.timed_out) {
+                if(ack)
+                    ack->nic()->free(ack);
+                db<DIRP>(WRN) << "DIRP::send_batch() - TIMEOUT!" << endl;
+                return size;
+            }
+
+            Code code = ack->frame()->data<Packet>()->header()->code();
+            Address peer = ack->frame()->data<Packet>()->header()->from();
+            ack->nic()->free(ack);
+
+            unsigned int j = built;
+            if(code == ACK)
+                for(j = 0; (j < built) && (acked[j] || !(peer == msgs[i + j].to)); j++);
+            if(j == built) {
+                db<DIRP>(WRN) << "DIRP::send_batch: unexpected packet (c=" << code << ",f=" << peer << ") dropped!" << endl;
+                continue;
+            }
+
+            acked[j] = true;
+            pending--;
+            size += msgs[i + j].size;
+        }
+
+        if(built < count)
+            break;
+    }
+
+    return size;
+}
+
 int DIRP::receive(Buffer * buf, void * d, unsigned int s)
 {
     DIRP * dirp = DIRP::get_by_nic(0);
@@ -83,7 +167,7 @@ int DIRP::receive(Buffer * buf, void * d, unsigned int s)
     db<DIRP>(WRN) << "Receiving data: " << packet->data<char>() << endl;
     db<DIRP>(WRN) << "Receiving timestamp: " << packet->header()->timestamp() << endl;
 
-    if (dirp->is_master(from)) {
+    if ((SYNC_MODE == SYNC_NTP) && dirp->is_master(from)) {
         dirp->synchronize_time(packet->header()->timestamp());
     }
 
@@ -134,6 +218,15 @@ void DIRP::synchronize_time(Second timestamp)
 
 void DIRP::update(Observed* obs, const Protocol& prot, Buffer* buf)
 {
+    Header * header = buf->frame()->data<Packet>()->header();
+    if(header->code() >= SYNC) {
+        // PTP packets are consumed right here, in the NIC's receive path, to keep their time stamps accurate
+        if(SYNC_MODE == SYNC_PTP)
+            ptp_update(buf->frame()->data<Packet>(), PTP::count2us(buf->sfd_time_stamp));
+        _nic->free(buf);
+        return;
+    }
+
     Packet packet;
     memcpy(&packet, buf->frame()->data<Packet>(), sizeof(Packet));
 
@@ -162,6 +255,97 @@ void DIRP::acknowledged(Packet * pkt)
     dirp->nic()->send(h->from().mac(), dirp->PROTOCOL, reinterpret_cast<void *>(&packet), sizeof(packet));
 }
 
+DIRP::PTP::Time_Stamp DIRP::ptp_send(const Address & to, const Code & code, unsigned short sequence, const PTP::Time_Stamp & time_stamp)
+{
+    PTP::Message msg(sequence, time_stamp);
+    Header header(Address(_address.mac(), PTP_PORT), to, sizeof(PTP::Message), 0, code);
+    Packet packet(header, &msg, sizeof(PTP::Message));
+
+    // The transmission time stamp is taken as close as possible to the NIC
+    PTP::Time_Stamp tx = PTP::local();
+    _nic->send(to.mac(), PROTOCOL, reinterpret_cast<void *>(&packet), sizeof(Header) + sizeof(PTP::Message));
+
+    return tx;
+}
+
+void DIRP::ptp_sync()
+{
+    DIRP * dirp = get_by_nic(0);
+
+    // Two-step: SYNC leaves, then FOLLOW_UP carries the precise time SYNC left at
+    Address all(Ethernet::broadcast(), PTP_PORT);
+    PTP::_sequence++;
+    PTP::Time_Stamp t1 = dirp->ptp_send(all, SYNC, PTP::_sequence, 0);
+    dirp->ptp_send(all, FOLLOW_UP, PTP::_sequence, PTP::disciplined(t1));
+}
+
+void DIRP::ptp_update(Packet * packet, const PTP::Time_Stamp & rx)
+{
+    Header * header = packet->header();
+    PTP::Message * msg = packet->data<PTP::Message>();
+
+    db<DIRP>(TRC) << "DIRP::ptp_update(c=" << header->code() << ",seq=" << msg->sequence() << ",rx=" << rx << ")" << endl;
+
+    if(is_master(_address)) {
+        // The master only answers delay requests, with the time they arrived at it
+        if(header->code() == DELAY_REQ)
+            ptp_send(header->from(), DELAY_RESP, msg->sequence(), PTP::disciplined(rx));
+        return;
+    }
+
+    if(!is_master(header->from()))
+        return;
+
+    switch(header->code()) {
+    case SYNC:
+        PTP::_sequence = msg->sequence();
+        PTP::_t2 = rx;
+        break;
+    case FOLLOW_UP: {
+        if(msg->sequence() != PTP::_sequence)
+            break;
+        PTP::_t1 = msg->time_stamp();
+
+        // Frequency: compare the intervals between consecutive SYNCs as seen by the master and by us
+        if(PTP::_last_t1 && (PTP::_t1 > PTP::_last_t1)) {
+            PTP::Offset master = PTP::_t1 - PTP::_last_t1;
+            PTP::Offset local = PTP::_t2 - PTP::_last_t2;
+            PTP::PPB drift = (local - master) * 1000000000LL / master;
+            PTP::rebase(PTP::_t2);
+            PTP::_statistics.drift = (PTP::_statistics.syncs < 2) ? drift : (PTP::_statistics.drift * 3 + drift) / 4;
+        }
+        PTP::_last_t1 = PTP::_t1;
+        PTP::_last_t2 = PTP::_t2;
+
+        PTP::_t3 = ptp_send(header->from(), DELAY_REQ, PTP::_sequence, 0);
+    } break;
+    case DELAY_RESP: {
+        if(msg->sequence() != PTP::_sequence)
+            break;
+        PTP::Time_Stamp t4 = msg->time_stamp();
+        PTP::Offset ms = PTP::disciplined(PTP::_t2) - PTP::_t1;
+        PTP::Offset sm = t4 - PTP::disciplined(PTP::_t3);
+        PTP::Offset offset = (ms - sm) / 2;
+
+        PTP::rebase(PTP::local(), offset);
+
+        // The first round steps the clock, thereafter offsets are residuals of the disciplined clock
+        if(PTP::_statistics.syncs) {
+            PTP::Offset abs = offset < 0 ? -offset : offset;
+            if(abs > PTP::_statistics.max_offset)
+                PTP::_statistics.max_offset = abs;
+        }
+        PTP::_statistics.offset = offset;
+        PTP::_statistics.delay = (ms + sm) / 2;
+        PTP::_statistics.syncs++;
+
+        db<DIRP>(INF) << "DIRP::ptp_update: now=" << PTP::now() << ",stats=" << PTP::_statistics << endl;
+    } break;
+    default:
+        break;
+    }
+}
+
 int DIRP::get_time() {
     // NOT WORKING
 
@@ -16,6 +16,8 @@ unsigned short IP::Header::_next_id = 0;
 IP * IP::_networks[];
 IP::Router IP::_router;
 IP::Reassembling IP::_reassembling;
+IP::Statistics IP::_statistics;
+unsigned int IP::Fragmented::_next_serial = 0;
 IP::Observed IP::_observed;
 
 // Methods
@@ -52,18 +54,27 @@ IP::Buffer * IP::alloc(const Address & to, const Protocol & prot, unsigned int o
     db<IP>(TRC) << "IP::alloc(to=" << to << ",prot=" << prot << ",on=" << once<< ",pl=" << payload << ")" << endl;
 
     Route * through = _router.search(to);
+    if(!through) {
+        db<IP>(WRN) << "IP::alloc: no route to " << to << "!" << endl;
+        return 0;
+    }
     IP * ip = through->ip();
     NIC<Ethernet> * nic = through->nic();
 
-    MAC_Address mac = through->arp()->resolve((through->gateway() == through->ip()->address()) ? to : through->gateway());
-    if(!mac) {
-         db<IP>(WRN) << "IP::alloc: destination host (" << to << ") unreachable!" << endl;
-         return 0;
+    // Never block waiting for ARP: datagrams to next hops still being resolved are built off the NIC and held by ARP at send()
+    MAC_Address mac = through->arp()->lookup(next_hop(through, to));
+    Buffer * pool;
+    if(mac)
+        pool = nic->alloc(mac, NIC<Ethernet>::PROTO_IP, once, sizeof(IP::Header), payload);
+    else {
+        db<IP>(INF) << "IP::alloc: next hop to " << to << " is being resolved" << endl;
+        pool = through->arp()->alloc(NIC<Ethernet>::PROTO_IP, once, sizeof(IP::Header), payload);
     }
-
-    Buffer * pool = nic->alloc(mac, NIC<Ethernet>::PROTO_IP, once, sizeof(IP::Header), payload);
+    if(!pool)
+        return 0;
 
     Header header(ip->address(), to, prot, 0); // length will be defined latter for each fragment
+    header.sum(); // fragments only differ in length, flags and offset, so their checksums are incrementally updated from this one
 
     unsigned int offset = 0;
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
@@ -74,7 +85,7 @@ IP::Buffer * IP::alloc(const Address & to, const Protocol & prot, unsigned int o
         packet->flags(el->next() ? Header::MF : 0);
         packet->length(el->object()->size());
         packet->offset(offset);
-        packet->header()->sum();
+        packet->header()->sum(header);
         db<IP>(INF) << "IP::alloc:pkt=" << packet << " => " << *packet << endl;
 
         offset += MFS;
@@ -87,9 +98,54 @@ int IP::send(Buffer * buf)
 {
     db<IP>(TRC) << "IP::send(buf=" << buf << ")" << endl;
 
+    if(!buf->frame()->header()->dst())
+        return hold(buf);
+
     return buf->nic()->send(buf); // implicitly releases the pool
 }
 
+int IP::send(Buffer * pools[], unsigned int n)
+{
+    db<IP>(TRC) << "IP::send(pools=" << pools << ",n=" << n << ")" << endl;
+
+    // Pools allocated while their next hops were being resolved go to ARP
+    int size = 0;
+    unsigned int m = 0;
+    for(unsigned int i = 0; i < n; i++) {
+        if(!pools[i]->frame()->header()->dst())
+            size += hold(pools[i]);
+        else
+            pools[m++] = pools[i];
+    }
+    n = m;
+
+    // Hand consecutive pools bound to the same NIC over at once
+    for(unsigned int i = 0, j; i < n; i = j) {
+        NIC<Ethernet> * nic = pools[i]->nic();
+        for(j = i + 1; (j < n) && (pools[j]->nic() == nic); j++);
+        size += nic->send(&pools[i], j - i); // implicitly releases the pools
+    }
+
+    return size;
+}
+
+int IP::hold(Buffer * pool)
+{
+    Packet * packet = pool->frame()->data<Packet>();
+    Route * through = _router.search(packet->to());
+    if(!through) { // the route has been removed since the pool was allocated, so there is no ARP to hold it
+        db<IP>(WRN) << "IP::hold: no route to " << packet->to() << ", dropping the datagram!" << endl;
+        for(Buffer::Element * el = pool->link(); el; ) {
+            Buffer * buf = el->object();
+            el = el->next();
+            delete buf;
+        }
+        return 0;
+    }
+
+    return through->arp()->enqueue(next_hop(through, packet->to()), pool); // ARP sends the pool once the next hop is resolved
+}
+
 void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & prot, Buffer * buf)
 {
     db<IP>(TRC) << "IP::update(obs=" << obs << ",prot=" << hex << prot << dec << ",buf=" << buf << ")" << endl;
@@ -111,6 +167,8 @@ void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & p
         return;
     }
 
+    _arp.refresh(packet->from()); // traffic from a neighbor confirms its ARP mapping
+
     buf->nic(_nic);
 
     // The Ethernet Frame in Buffer might have been padded, so we need to adjust it to the datagram length
@@ -118,23 +176,20 @@ void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & p
 
     if((packet->flags() & Header::MF) || (packet->offset() != 0)) { // Fragmented
         Key key = ((packet->from() & ~_netmask) << 16) | packet->id();
-        Reassembling::Element * el = _reassembling.search_key(key);
+        Fragmented * frag = reassembly(key, packet->from());
 
-        Fragmented * frag;
-        if(el)
-            frag = el->object();
-        else {
-            frag = new (SYSTEM) Fragmented(key); // the Alarm created within Fragmented will re-enable interrupts
-            _reassembling.insert(frag->link());
+        if(!frag->insert(buf)) {
+            _statistics.dropped++;
+            _nic->free(buf);
+            return;
         }
-        frag->insert(buf);
 
         if(frag->reassembled()) {
             db<IP>(INF) << "IP::update: notifying reassembled datagram" << endl;
-            frag->reorder();
             Buffer * pool = frag->pool();
             _reassembling.remove(frag->link());
             delete frag;
+            _statistics.reassembled++;
             if(!notify(packet->protocol(), pool))
                 pool->nic()->free(pool);
         }
@@ -145,44 +200,394 @@ void IP::update(NIC<Ethernet>::Observed * obs, const NIC<Ethernet>::Protocol & p
     }
 }
 
-void IP::Fragmented::reorder() {
-    db<IP>(TRC) << "IP::Fragmented::reorder(this=" << this << ")" << endl;
+IP::Fragmented * IP::reassembly(const Key & key, const Address & from)
+{
+    Reassembling::Element * el = _reassembling.search_key(key);
+    if(el)
+        return el->object();
+
+    // Give up the oldest datagram from this source if it already has too many being reassembled
+    unsigned int count = 0;
+    Fragmented * oldest = 0;
+    for(Reassembling::Iterator it = _reassembling.begin(); it != _reassembling.end(); it++)
+        if(it && (it->object()->from() == from)) {
+            count++;
+            if(!oldest || (int(it->object()->_serial - oldest->_serial) < 0))
+                oldest = it->object();
+        }
+    if(count >= Fragmented::SOURCE_DATAGRAMS) {
+        db<IP>(INF) << "IP::reassembly: too many datagrams from " << from << " being reassembled, evicting the oldest" << endl;
+        _reassembling.remove(oldest->link());
+        oldest->free();
+        delete oldest;
+        _statistics.evicted++;
+    }
+
+    Fragmented * frag = new (SYSTEM) Fragmented(key, from); // the Alarm created within Fragmented will re-enable interrupts
+    _reassembling.insert(frag->link());
+
+    return frag;
+}
 
-    if(_list.size() > 1) {
-        Buffer::List tmp;
-        unsigned int i = 0;
-        while(!_list.empty()) {
-            Buffer * buf = _list.remove()->object();
+bool IP::Fragmented::insert(Buffer * buf)
+{
+    Packet * packet = buf->frame()->data<Packet>();
+    unsigned int offset = packet->offset();
+    unsigned int i = offset / MFS;
 
-            if((buf->frame()->data<Packet>()->offset() / MFS) == i) {
-                tmp.insert(buf->link());
-                i++;
-            } else
-                _list.insert(buf->link());
-        };
+    db<IP>(TRC) << "IP::Fragmented::insert(frags=" << _frags << ",buf=" << buf << ") => " << *packet << endl;
 
-        while(!tmp.empty())
-            _list.insert(tmp.remove()->object()->link());
+    // Fragments must be aligned to MFS (as IP::alloc() produces them), cannot go beyond the last one and must not be duplicates
+    if((offset % MFS) || (i >= _frags) || (!(packet->flags() & Header::MF) && (i + 1 < _top)) || !_bitmap.set(i)) {
+        db<IP>(INF) << "IP::Fragmented::insert: dropping fragment at " << offset << endl;
+        return false;
     }
+
+    _slots[i] = buf;
+    _received++;
+    if(i >= _top)
+        _top = i + 1;
+
+    if(!(packet->flags() & Header::MF))
+        _frags = i + 1;
+
+    return true;
+}
+
+IP::Buffer * IP::Fragmented::pool()
+{
+    Buffer::List list;
+    for(unsigned int i = 0; i < _frags; i++)
+        list.insert(_slots[i]->link());
+
+    return list.head()->object();
+}
+
+void IP::Fragmented::free()
+{
+    for(unsigned int i = 0; i < _frags; i++)
+        if(_slots[i])
+            _slots[i]->nic()->free(_slots[i]);
+}
+
+void IP::Fragmented::timeout(Fragmented * frag)
+{
+    db<IP>(INF) << "IP::Fragmented::timeout: giving up datagram from " << frag->from() << " with " << frag->_received << " fragments" << endl;
+
+    _reassembling.remove(frag->link());
+    frag->free();
+    delete frag;
+    _statistics.timeouts++;
 }
 
 unsigned short IP::checksum(const void * data, unsigned int size)
 {
     db<IP>(TRC) << "IP::checksum(d=" << data << ",s=" << size << ")" << endl;
 
+    return ntohs(~checksum_fold(checksum_add(0, data, size)));
+}
+
+IP::Checksum IP::checksum_add(Checksum sum, const void * data, unsigned int size)
+{
     const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
-    unsigned long sum = 0;
 
-    for(unsigned int i = 0; i < size; i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
+    // Align to 32 bits (frame payloads are usually only 16-bit aligned)
+    if((reinterpret_cast<unsigned long>(ptr) & 2) && (size >= 2)) {
+        sum += *reinterpret_cast<const unsigned short *>(ptr);
+        ptr += 2;
+        size -= 2;
+    }
+
+    const unsigned int * words = reinterpret_cast<const unsigned int *>(ptr);
+    for(; size >= 16; size -= 16, words += 4)
+        sum += Checksum(words[0]) + words[1] + words[2] + words[3];
+    for(; size >= 4; size -= 4)
+        sum += *words++;
+
+    ptr = reinterpret_cast<const unsigned char *>(words);
+    if(size >= 2) {
+        sum += *reinterpret_cast<const unsigned short *>(ptr);
+        ptr += 2;
+        size -= 2;
+    }
+
+    // A trailing odd byte is summed as if padded with a zero byte
+    if(size) {
+        unsigned short last = 0;
+        *reinterpret_cast<unsigned char *>(&last) = *ptr;
+        sum += last;
+    }
+
+    return sum;
+}
+
+IP::Checksum IP::checksum_copy(Checksum sum, void * to, const void * from, unsigned int size)
+{
+    unsigned char * dst = reinterpret_cast<unsigned char *>(to);
+    const unsigned char * src = reinterpret_cast<const unsigned char *>(from);
+
+    // Align the source to 32 bits (x86 handles the eventually unaligned stores in hardware)
+    if((reinterpret_cast<unsigned long>(src) & 2) && (size >= 2)) {
+        unsigned short w = *reinterpret_cast<const unsigned short *>(src);
+        *reinterpret_cast<unsigned short *>(dst) = w;
+        sum += w;
+        src += 2;
+        dst += 2;
+        size -= 2;
+    }
+
+    const unsigned int * s = reinterpret_cast<const unsigned int *>(src);
+    unsigned int * d = reinterpret_cast<unsigned int *>(dst);
+    for(; size >= 16; size -= 16, s += 4, d += 4) {
+        unsigned int w0 = s[0], w1 = s[1], w2 = s[2], w3 = s[3];
+        d[0] = w0;
+        d[1] = w1;
+        d[2] = w2;
+        d[3] = w3;
+        sum += Checksum(w0) + w1 + w2 + w3;
+    }
+    for(; size >= 4; size -= 4) {
+        unsigned int w = *s++;
+        *d++ = w;
+        sum += w;
+    }
+
+    src = reinterpret_cast<const unsigned char *>(s);
+    dst = reinterpret_cast<unsigned char *>(d);
+    if(size >= 2) {
+        unsigned short w = *reinterpret_cast<const unsigned short *>(src);
+        *reinterpret_cast<unsigned short *>(dst) = w;
+        sum += w;
+        src += 2;
+        dst += 2;
+        size -= 2;
+    }
+
+    if(size) {
+        unsigned short last = 0;
+        *reinterpret_cast<unsigned char *>(&last) = *dst = *src;
+        sum += last;
+    }
+
+    return sum;
+}
+
+unsigned int IP::Router::length(const Address & mask)
+{
+    // Masks are assumed to be contiguous, as in any sane routing table
+    unsigned int length = 0;
+    for(Key m = key(mask); m & 0x80000000; m <<= 1)
+        length++;
+    return length;
+}
 
-    if(size & 1)
-        sum += ptr[size - 1];
+void IP::Router::insert(NIC<Ethernet> * nic, IP * ip, ARP<NIC<Ethernet>, IP> * arp, const Address & d, const Address & g, const Address & m, unsigned int t, unsigned int w)
+{
+    Route * route = new (SYSTEM) Route(nic, ip, arp, d, g, m, t, w);
+
+    db<IP>(TRC) << "IP::Router::insert() => " << *route << endl;
+
+    unsigned int len = length(m);
+    Key prefix = key(d) & mask(len);
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    Node ** link = &_root;
+    Node * node;
+    while(true) {
+        node = *link;
+        if(!node) {
+            node = *link = new (SYSTEM) Node(prefix, len);
+            break;
+        }
+
+        // Number of leading bits the node and the new prefix have in common
+        unsigned int common = (node->_length < len) ? node->_length : len;
+        Key diff = (node->_prefix ^ prefix) & mask(common);
+        if(diff)
+            for(common = 0; !(diff & 0x80000000); diff <<= 1)
+                common++;
+
+        if(common == node->_length) {
+            if(len == node->_length)
+                break; // same prefix
+            link = &node->_child[bit(prefix, node->_length)];
+        } else {
+            // Split the node's path at the first differing bit (or where the new prefix ends, if it is shorter)
+            Node * split = new (SYSTEM) Node(prefix & mask(common), common);
+            split->_child[bit(node->_prefix, common)] = node;
+            *link = split;
+            if(common == len)
+                node = split;
+            else
+                node = split->_child[bit(prefix, common)] = new (SYSTEM) Node(prefix, len);
+            break;
+        }
+    }
+
+    // Routes to the same prefix are kept sorted by metric, the best one first (equal metrics keep the insertion order)
+    Route ** r = &node->_routes;
+    for(; *r && ((*r)->_metric <= w); r = &(*r)->_next);
+    route->_next = *r;
+    *r = route;
+    _routes++;
+
+    flush();
+
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+void IP::Router::remove(const Address & to)
+{
+    db<IP>(TRC) << "IP::Router::remove(to=" << to << ")" << endl;
+
+    Key k = key(to);
+
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    // Find the deepest matching node holding routes, along with the links that point to it and to its parent
+    Node ** link = 0;
+    Node ** parent = 0;
+    for(Node ** l = &_root, ** p = 0; *l && matches(k, *l); p = l, l = &(*l)->_child[bit(k, (*l)->_length)]) {
+        if((*l)->_routes) {
+            link = l;
+            parent = p;
+        }
+        if((*l)->_length == 32)
+            break;
+    }
+
+    if(link) {
+        Node * node = *link;
+        Route * route = node->_routes;
+        node->_routes = route->_next;
+        _routes--;
+
+        db<IP>(INF) << "IP::Router::remove: removing and deleting " << *route << endl;
+
+        delete route;
+
+        // A node without routes is only worth keeping while it joins two subtries
+        if(!node->_routes && !(node->_child[0] && node->_child[1])) {
+            *link = node->_child[0] ? node->_child[0] : node->_child[1];
+            delete node;
+
+            if(parent) {
+                Node * p = *parent;
+                if(!p->_routes && !(p->_child[0] && p->_child[1])) {
+                    *parent = p->_child[0] ? p->_child[0] : p->_child[1];
+                    delete p;
+                }
+            }
+        }
+
+        flush();
+    }
+
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+IP::Route * IP::Router::lookup(const Key & to)
+{
+    Route * best = 0;
+    for(Node * n = _root; n && matches(to, n); n = (n->_length < 32) ? n->_child[bit(to, n->_length)] : 0)
+        if(n->_routes)
+            best = n->_routes;
+    return best;
+}
+
+IP::Route * IP::Router::search(const Address & to)
+{
+    db<IP>(TRC) << "IP::Route::search(to=" << to << ")" << endl;
+
+    Key k = key(to);
+    Cached * cached = &_cache[(k ^ (k >> 8)) & (CACHE_SIZE - 1)];
+
+    // IP::alloc() can be reached from interrupt handlers (e.g. TCP timeouts), so cache entries are read and written atomically
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    Route * route = (cached->route && (cached->to == k)) ? cached->route : 0;
+    if(!route) {
+        route = lookup(k);
+        cached->to = k;
+        cached->route = route;
+    }
+
+    if(!was_disabled)
+        CPU::int_enable();
+
+    if(route)
+        db<IP>(INF) << "IP::Route::search: found route to " << to << " => " << *route << endl;
+
+    return route;
+}
+
+unsigned int IP::Gather::size() const
+{
+    unsigned int size = 0;
+    for(const Chunk * c = _chunk; c < _end; c++)
+        size += c->size;
+    return size - _offset;
+}
+
+const unsigned char * IP::Gather::next(unsigned int * piece, unsigned int max)
+{
+    while((_chunk < _end) && (_offset == _chunk->size)) {
+        _chunk++;
+        _offset = 0;
+    }
+    if(_chunk == _end) {
+        *piece = 0;
+        return 0;
+    }
+
+    const unsigned char * data = reinterpret_cast<const unsigned char *>(_chunk->data) + _offset;
+    *piece = (_chunk->size - _offset > max) ? max : _chunk->size - _offset;
+    _offset += *piece;
+
+    return data;
+}
+
+void IP::Gather::skip(unsigned int size)
+{
+    for(unsigned int piece; size && next(&piece, size); size -= piece);
+}
+
+void IP::Gather::copy(void * to, unsigned int size)
+{
+    unsigned char * dst = reinterpret_cast<unsigned char *>(to);
+    unsigned int piece;
+    for(const unsigned char * src; size && (src = next(&piece, size)); size -= piece, dst += piece)
+        memcpy(dst, src, piece);
+}
+
+IP::Checksum IP::Gather::copy(Checksum sum, void * to, unsigned int size)
+{
+    unsigned char * dst = reinterpret_cast<unsigned char *>(to);
+    unsigned char * unsummed = 0;
+    unsigned int piece;
+
+    // Pieces are copied and summed in a single pass while they keep the block 16-bit aligned. After the first odd one
+    // (but the last), the remaining ones are just copied and summed afterwards as the block's tail
+    for(const unsigned char * src; size && (src = next(&piece, size)); size -= piece, dst += piece) {
+        if(!unsummed && (!(piece & 1) || (piece == size)))
+            sum = checksum_copy(sum, dst, src, piece);
+        else {
+            if(!unsummed)
+                unsummed = dst;
+            memcpy(dst, src, piece);
+        }
+    }
 
-    while(sum >> 16)
-        sum = (sum & 0xffff) + (sum >> 16);
+    if(unsummed)
+        sum = checksum_add(sum, unsummed, dst - unsummed);
 
-    return ~sum;
+    return sum;
 }
 
 __END_SYS
@@ -30,9 +30,12 @@ IP::IP(unsigned int unit)
 
     _router.insert(_nic, this, &_arp, _address & _netmask, _address, _netmask);
 
+    if(_address)
+        _arp.announce();
+
     if(_gateway) {
-        _router.insert(_nic, this, &_arp, Address::NULL, _gateway, Address::NULL); // Default route must be the last one in table
-        _arp.resolve(_gateway);
+        _router.insert(_nic, this, &_arp, Address::NULL, _gateway, Address::NULL); // default route
+        _arp.lookup(_gateway); // resolved in background
     }
 }
 
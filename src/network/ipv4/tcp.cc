@@ -7,7 +7,7 @@
 __BEGIN_SYS
 
 // Class attributes
-TCP::Observed TCP::_observed;
+Hashed_Data_Observed<TCP::Buffer, unsigned long long> TCP::_observed;
 
 TCP::Connection::State_Handler TCP::Connection::_handlers[] = {&TCP::Connection::listening,
                                                                &TCP::Connection::syn_sent,
@@ -50,38 +50,27 @@ void TCP::update(IP::Observed * obs, const IP::Protocol & prot, Buffer * pool)
 }
 
 void TCP::Segment::sum(const IP::Address & from, const IP::Address & to, const void * data, unsigned int size)
+{
+    IP::Checksum sum = sum_header(from, to, size);
+    if(data)
+        sum = IP::checksum_add(sum, data, size);
+    sum_trailer(sum);
+}
+
+IP::Checksum TCP::Segment::sum_header(const IP::Address & from, const IP::Address & to, unsigned int size)
 {
     _checksum = 0;
 
     IP::Pseudo_Header pseudo(from, to, IP::TCP, sizeof(Header) + size);
-
-    unsigned long sum = 0;
-    const unsigned char * ptr = reinterpret_cast<const unsigned char *>(&pseudo);
-    for(unsigned int i = 0; i < sizeof(IP::Pseudo_Header); i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
-
-    ptr = reinterpret_cast<const unsigned char *>(header());
-    for(unsigned int i = 0; i < sizeof(Header); i += 2)
-        sum += (ptr[i] << 8) | ptr[i+1];
-
-    if(data) {
-        ptr = reinterpret_cast<const unsigned char *>(data);
-        for(unsigned int i = 0; i < size; i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-        if(size & 1)
-            sum += ptr[size - 1];
-    }
-
-    while(sum >> 16)
-        sum = (sum & 0xffff) + (sum >> 16);
-
-    _checksum = htons(~sum);
+    return IP::checksum_add(IP::checksum_add(0, &pseudo, sizeof(IP::Pseudo_Header)), header(), sizeof(Header));
 }
 
 void TCP::Connection::fsend(const Flags & flags)
 {
     _flags = flags;
     if(!_retransmiting) _sequence = htonl(_next);
+    if(flags & ACK)
+        advertise();
 
     db<TCP>(TRC) << "TCP::Connection::send(flags=" << ((flags & ACK) ? 'A' : '-') << ((flags & RST) ? 'R' : '-') << ((flags & SYN) ? 'S' : '-') << ((flags & FIN) ? 'F' : '-') << "): SND.NXT=" << _next << ",SND.SEQ=" << sequence() << endl;
 
@@ -111,31 +100,72 @@ void TCP::Connection::fsend(const Flags & flags)
 
 int TCP::Connection::send(const void * d, unsigned int size)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
+    db<TCP>(TRC) << "TCP::Connection::send(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << d << ",s=" << size << ")" << endl;
 
-    db<TCP>(TRC) << "TCP::Connection::send(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << data << ",s=" << size << ")" << endl;
+    Chunk chunk = {d, size};
+    return send(&chunk, 1);
+}
+
+int TCP::Connection::send(const Chunk * chunks, unsigned int n)
+{
+    unsigned int size = IP::Gather(chunks, n).size();
+
+    db<TCP>(TRC) << "TCP::Connection::send(f=" << from() << ",t=" << peer() << ":" << to() << ",c=" << chunks << ",n=" << n << ",s=" << size << ")" << endl;
 
-    unsigned int allowed = WINDOW;
-    unsigned int left = size; // bytes that have not been sent at all
+    unsigned int position = 0; // bytes that have been sent at least once (or are to be resent, after a timeout)
     unsigned int acknowledged = 0; // bytes that were sent AND acknowledged
     unsigned int initial_seq = sequence(); // sequence number when stream is started
 
     unsigned int tries = 0;
     for(; (tries < RETRIES) && (acknowledged != size) && (_state == ESTABLISHED || _state == CLOSE_WAIT);
-        acknowledged = _current->header()->acknowledgment() - initial_seq, allowed = _peer_window - (sequence() - _current->header()->acknowledgment())) {
+        acknowledged = _current->header()->acknowledgment() - initial_seq) {
         _streaming = true;
+
+        if(_fast_retransmit) {
+            // Duplicate ACKs (or a partial ACK during fast recovery) point to a lost segment: resend it alone and go on
+            db<TCP>(TRC) << "TCP::Connection::send: fast retransmission" << endl;
+
+            _fast_retransmit = false;
+
+            unsigned int offset = _unacknowledged - initial_seq;
+            unsigned int payload = (size - offset > MSS) ? MSS : size - offset;
+            unsigned int seq = sequence();
+            bool retransmiting = _retransmiting;
+
+            _retransmiting = true;
+            _sequence = htonl(_unacknowledged);
+            if(!dsend(chunks, n, offset, payload))
+                return -1;
+            _sequence = htonl(seq);
+            _retransmiting = retransmiting;
+
+            _statistics.retransmits++;
+            _statistics.fast_retransmits++;
+        }
+
+        unsigned int allowed = usable();
         allowed = (allowed > MSS) ? MSS: allowed;
 
-        if(allowed && left) {
+        if(allowed && (position < size)) {
             db<TCP>(TRC) << "TCP::Connection::send: send" << endl;
 
-            int payload = (allowed > left) ? left : allowed;
+            unsigned int payload = (allowed > size - position) ? size - position : allowed;
 
-            if(!dsend(data, payload)) // FIXME we should wait until there are available buffers
+            if(!_retransmiting && !_timing) {
+                _timing = true;
+                _timed = _next + payload;
+                _rtt.reset();
+                _rtt.start();
+            }
+
+            if(!dsend(chunks, n, position, payload)) // FIXME we should wait until there are available buffers
                 return -1;
 
-            data += payload;
-            left -= payload;
+            _statistics.segments++;
+            if(_retransmiting)
+                _statistics.retransmits++;
+
+            position += payload;
             if(sequence() == _next)
                 _retransmiting = false;
         } else { // Either window's full or we've sent all there was to
@@ -143,23 +173,33 @@ int TCP::Connection::send(const void * d, unsigned int size)
 
             unsigned int old_ack = _current->header()->acknowledgment();
 
-            Condition_Handler h(&_stream);
-            Alarm a(TIMEOUT, &h);
+            _rto_expired = false;
+            Functor_Handler<Connection> h(&retransmission_timeout, this);
+            Alarm a(_rto, &h);
 
             _stream.wait();
 
-            if(_current->header()->acknowledgment() == old_ack) {
-                // Retransmission
+            if(_rto_expired && (_current->header()->acknowledgment() == old_ack)) {
+                // Retransmission timeout: collapse the congestion window, back off the timer and go back to the first unacknowledged byte
                 db<TCP>(TRC) << "TCP::Connection::send: retransmission" << endl;
 
+                unsigned int flight = sequence() - old_ack;
+                _ssthresh = (flight / 2 > 2 * MSS) ? flight / 2 : 2 * MSS;
+                _cwnd = MSS;
+                _duplicates = 0;
+                _recovering = false;
+                _fast_retransmit = false;
+                _timing = false;
+                _rto = (_rto > TIMEOUT / 2) ? TIMEOUT : _rto * 2;
+                _statistics.timeouts++;
+
                 _retransmiting = true;
                 _sequence = htonl(_current->header()->acknowledgment());
                 _unacknowledged = _current->header()->acknowledgment();
-                data = reinterpret_cast<const unsigned char*>(d) + acknowledged;
-                left = size - acknowledged;
+                position = acknowledged;
 
                 tries++;
-            } else
+            } else if(_current->header()->acknowledgment() != old_ack)
                 tries = 0;
         }
     }
@@ -181,15 +221,17 @@ int TCP::Connection::send(const void * d, unsigned int size)
     return size;
 }
 
-int TCP::Connection::dsend(const void * d, unsigned int size)
+int TCP::Connection::dsend(const Chunk * chunks, unsigned int n, unsigned int offset, unsigned int size)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
+    db<TCP>(TRC) << "TCP::dsend(f=" << from() << ",t=" << peer() << ":" << to() << ",c=" << chunks << ",n=" << n << ",o=" << offset << ",s=" << size << ")" << endl;
 
-    db<TCP>(TRC) << "TCP::dsend(f=" << from() << ",t=" << peer() << ":" << to() << ",d=" << data << ",s=" << size << ")" << endl;
+    IP::Gather data(chunks, n);
+    data.skip(offset);
 
     _flags = ACK;
     if(!_retransmiting)
         _sequence = htonl(_next);
+    advertise();
 
     db<TCP>(TRC) << "TCP::Connection::dsend: SND.NXT=" << _next << ",SND.SEQ=" << sequence() << ",payload=" << size << endl;
 
@@ -197,6 +239,8 @@ int TCP::Connection::dsend(const void * d, unsigned int size)
     if(!pool)
         return 0;
 
+    Segment * segment = 0;
+    IP::Checksum sum = 0;
     unsigned int headers = sizeof(Header);
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
         Buffer * buf = el->object();
@@ -205,21 +249,20 @@ int TCP::Connection::dsend(const void * d, unsigned int size)
         db<TCP>(INF) << "TCP::send:buf=" << buf << " => " << *buf<< endl;
 
         if(el == pool->link()) {
-            Segment * segment = packet->data<Segment>();
+            segment = packet->data<Segment>();
             memcpy(segment, header(), sizeof(Header));
-            segment->sum(packet->from(), packet->to(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            memcpy(segment->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            data += buf->size() - sizeof(Header) - sizeof(IP::Header);
-
-            db<TCP>(INF) << "TCP::send:msg=" << segment << " => " << *segment << endl;
-        } else {
-            memcpy(packet->data<void>(), data, buf->size() - sizeof(IP::Header));
-            data += buf->size() - sizeof(IP::Header);
-        }
+            sum = segment->sum_header(packet->from(), packet->to(), size);
+            sum = data.copy(sum, segment->data<void>(), buf->size() - sizeof(Header) - sizeof(IP::Header));
+        } else
+            sum = data.copy(sum, packet->data<void>(), buf->size() - sizeof(IP::Header));
 
         headers += sizeof(IP::Header);
     }
 
+    segment->sum_trailer(sum);
+
+    db<TCP>(INF) << "TCP::send:msg=" << segment << " => " << *segment << endl;
+
     if(!_retransmiting)
         _next += size;
     else
@@ -261,7 +304,9 @@ int TCP::Connection::receive(Buffer * pool, void * d, unsigned int s)
         size += len;
     }
 
+    unsigned int bytes = length(pool);
     pool->nic()->free(pool);
+    consumed(bytes);
 
     return size;
 }
@@ -274,6 +319,7 @@ void TCP::Connection::update(TCP::Observed * obs, const unsigned long long & soc
 
     _current = packet->data<Segment>(); // FIXME should free the previous buffer
     _length = pool->size() - sizeof(IP::Header) - sizeof(TCP::Header);
+    unsigned int window = _peer_window;
     _peer_window = _current->header()->window();
 
     db<TCP>(INF) << "TCP::Connection::update:" <<
@@ -292,8 +338,15 @@ void TCP::Connection::update(TCP::Observed * obs, const unsigned long long & soc
     db<TCP>(INF) << "TCP::Connection::update:conn=" << this << " => " << *this << endl;
 
     if(!((_state == LISTENING) || (_state == SYN_SENT)) && _current->header()->sequence() > acknowledgment()) {
-        // SEG.SEQ musn't be > than RCV.NXT, this forces segments to be accepted in order, except when connecting or listening, then one may receive stuff out of the blue
+        // SEG.SEQ > RCV.NXT, i.e. the segment arrived ahead of a hole (except when connecting or listening, then one may receive stuff out of the blue)
+        // Data within the window is held for reassembly and answered with an immediate duplicate ACK, so the peer can fast retransmit the missing segment
         // If SEG.SEQ < RCV.NXT, i.e. delayed or repeated segment, the treatment happens later
+        if(_length && (_state == ESTABLISHED) && !(_current->header()->flags() & (SYN | FIN | RST))
+            && (_current->header()->sequence() < acknowledgment() + WINDOW) && reorder(pool)) {
+            fsend(ACK);
+            return;
+        }
+
         pool->nic()->free(pool);
         return;
     }
@@ -308,15 +361,23 @@ void TCP::Connection::update(TCP::Observed * obs, const unsigned long long & soc
 
     bool relevant = false; // The segment is relevant to the sliding window
     if(_streaming) {
-        if(_current->header()->acknowledgment() <= sequence()) {
+        unsigned int ack = _current->header()->acknowledgment();
+        if(ack <= sequence()) {
             // Regular ack, i.e. SEG.ACK is <= than the last sequence I sent
-            if(_current->header()->acknowledgment() > _unacknowledged)
+            if(ack > _unacknowledged) {
+                acknowledged(ack);
                 relevant = true; // A segment must ack something in order to be relevant
-
-            _unacknowledged = _current->header()->acknowledgment();
-        } else if(_current->header()->acknowledgment() > sequence()) {
+            } else if((ack == _unacknowledged) && (ack != sequence()) && !_length && (_peer_window == window)
+                && !(_current->header()->flags() & (SYN | FIN | RST)))
+                relevant = duplicated(); // Duplicate ACK as defined by RFC 5681
+            else if((ack == _unacknowledged) && (_peer_window > window))
+                relevant = true; // Window update, which might be all a sender blocked on a closed window is waiting for
+
+            _unacknowledged = ack;
+        } else if(ack > sequence()) {
             // Forward ack, i.e. SEG.ACK > SEG.SEQ, but not > than the SND.NXT. This scenario is only possible in this code and in the FSM during retransmission
-            _sequence = htonl(_current->header()->acknowledgment());
+            acknowledged(ack);
+            _sequence = htonl(ack);
             _unacknowledged = _current->header()->acknowledgment();
             relevant = true;
         }
@@ -335,9 +396,10 @@ void TCP::Connection::update(TCP::Observed * obs, const unsigned long long & soc
         || (state_at_arrival == SYN_RECEIVED)
         || (state_at_arrival == FIN_WAIT1)
         || (state_at_arrival == FIN_WAIT2))
-        if(_length)
-            if(!notify(socket, pool))
-                pool->nic()->free(pool);
+        if(_length) {
+            deliver(socket, pool, _length);
+            acknowledge(_reordered && reassemble(socket));
+        }
 
     if(_streaming && relevant)
         _stream.signal();
@@ -575,7 +637,7 @@ void TCP::Connection::established()
 
             if(_length) {
                 _acknowledgment = htonl(acknowledgment() + _length);
-                fsend(ACK);
+                _delayed++; // acknowledged by update() once the data has been delivered (see acknowledge())
             }
 
             if(_current->header()->flags() & FIN) {
@@ -965,6 +1027,260 @@ void TCP::Connection::timeout(Connection* c)
     }
 }
 
+unsigned int TCP::Connection::usable()
+{
+    unsigned int window = (_cwnd < _peer_window) ? _cwnd : _peer_window;
+    unsigned int flight = sequence() - _current->header()->acknowledgment();
+
+    return (flight < window) ? window - flight : 0;
+}
+
+void TCP::Connection::acknowledged(unsigned int ack)
+{
+    db<TCP>(TRC) << "TCP::Connection::acknowledged(ack=" << ack << ",cwnd=" << _cwnd << ",ssthresh=" << _ssthresh << ")" << endl;
+
+    unsigned int bytes = ack - _unacknowledged;
+
+    if(_timing && (ack >= _timed)) {
+        _rtt.stop();
+        measured(_rtt.read());
+        _timing = false;
+    }
+
+    if(_recovering) {
+        if(ack < _recover) {
+            // Partial ACK (RFC 6582): the next hole is lost too, so retransmit it and deflate the window by the amount acknowledged
+            _cwnd = (_cwnd > bytes + MSS) ? _cwnd - bytes + MSS : MSS;
+            _fast_retransmit = true;
+        } else {
+            // Full ACK: leave fast recovery
+            _cwnd = _ssthresh;
+            _recovering = false;
+        }
+    } else if(_cwnd < _peer_window) { // growing beyond what the receiver allows would only make a later burst bigger
+        if(_cwnd < _ssthresh)
+            _cwnd += (bytes < MSS) ? bytes : MSS; // slow start
+        else
+            _cwnd += (MSS * MSS / _cwnd) ? MSS * MSS / _cwnd : 1; // congestion avoidance
+    }
+
+    _duplicates = 0;
+}
+
+bool TCP::Connection::duplicated()
+{
+    db<TCP>(TRC) << "TCP::Connection::duplicated(dups=" << _duplicates + 1 << ",cwnd=" << _cwnd << ")" << endl;
+
+    _duplicates++;
+
+    if(_recovering) {
+        _cwnd += MSS; // each duplicate ACK means a segment has left the network
+        return true;
+    }
+
+    if(_duplicates == DUPLICATES) {
+        // Fast retransmit, entering fast recovery (RFC 5681 and RFC 6582)
+        unsigned int flight = sequence() - _unacknowledged;
+        _ssthresh = (flight / 2 > 2 * MSS) ? flight / 2 : 2 * MSS;
+        _cwnd = _ssthresh + DUPLICATES * MSS;
+        _recover = _next;
+        _recovering = true;
+        _fast_retransmit = true;
+        _timing = false;
+        return true;
+    }
+
+    return false;
+}
+
+void TCP::Connection::measured(const Alarm::Microsecond & rtt)
+{
+    Alarm::Microsecond r = rtt ? rtt : 1;
+
+    // RFC 6298, with alpha = 1/8 and beta = 1/4
+    if(!_srtt) {
+        _srtt = r;
+        _rttvar = r / 2;
+    } else {
+        Alarm::Microsecond delta = (_srtt > r) ? _srtt - r : r - _srtt;
+        _rttvar = (3 * _rttvar + delta) / 4;
+        _srtt = (7 * _srtt + r) / 8;
+    }
+
+    Alarm::Microsecond granularity = 1000000 / Alarm::frequency();
+    Alarm::Microsecond variation = (4 * _rttvar > granularity) ? 4 * _rttvar : granularity;
+    _rto = _srtt + variation;
+    if(_rto < MIN_RTO)
+        _rto = MIN_RTO;
+    else if(_rto > TIMEOUT)
+        _rto = TIMEOUT;
+
+    db<TCP>(INF) << "TCP::Connection::measured(rtt=" << rtt << "):srtt=" << _srtt << ",rttvar=" << _rttvar << ",rto=" << _rto << endl;
+}
+
+void TCP::Connection::retransmission_timeout(Connection * c)
+{
+    c->_rto_expired = true;
+    c->_stream.signal();
+}
+
+bool TCP::Connection::reorder(Buffer * pool)
+{
+    unsigned int seq = segment(pool)->header()->sequence();
+
+    db<TCP>(TRC) << "TCP::Connection::reorder(seq=" << seq << ",len=" << length(pool) << ",RCV.NXT=" << acknowledgment() << ",held=" << _reordered << ")" << endl;
+
+    unsigned int i = 0;
+    for(; i < _reordered; i++) {
+        unsigned int held = segment(_reorder[i])->header()->sequence();
+        if(held == seq)
+            return false; // already held
+        if(held > seq)
+            break;
+    }
+
+    if(_reordered == REORDER) {
+        if(i == REORDER)
+            return false;
+
+        // Make room by dropping the segment farthest from RCV.NXT, which is the one that would be delivered last
+        _reordered--;
+        _reorder[_reordered]->nic()->free(_reorder[_reordered]);
+    }
+
+    for(unsigned int j = _reordered; j > i; j--)
+        _reorder[j] = _reorder[j - 1];
+    _reorder[i] = pool;
+    _reordered++;
+
+    return true;
+}
+
+bool TCP::Connection::reassemble(const unsigned long long & socket)
+{
+    bool filled = false;
+
+    while(_reordered) {
+        Buffer * pool = _reorder[0];
+        unsigned int seq = segment(pool)->header()->sequence();
+        if(seq > acknowledgment())
+            break; // there is still a hole before it
+
+        _reordered--;
+        for(unsigned int i = 0; i < _reordered; i++)
+            _reorder[i] = _reorder[i + 1];
+
+        if(seq == acknowledgment()) {
+            db<TCP>(TRC) << "TCP::Connection::reassemble: seq=" << seq << ",len=" << length(pool) << endl;
+
+            _acknowledgment = htonl(seq + length(pool));
+            _delayed++;
+            deliver(socket, pool, length(pool));
+            filled = true;
+        } else
+            pool->nic()->free(pool); // overlaps data already received (the peer has resegmented it while retransmitting)
+    }
+
+    return filled;
+}
+
+void TCP::Connection::deliver(const unsigned long long & socket, Buffer * pool, unsigned int length)
+{
+    _unread += length;
+    if(!notify(socket, pool)) {
+        _unread -= length;
+        pool->nic()->free(pool);
+    }
+}
+
+void TCP::Connection::discard(Buffer * pool)
+{
+    unsigned int bytes = length(pool);
+    pool->nic()->free(pool);
+    consumed(bytes);
+}
+
+int TCP::Connection::receive(Buffer * pool, View * view)
+{
+    db<TCP>(TRC) << "TCP::receive(buf=" << pool << ",view=" << view << ")" << endl;
+
+    // The checksum has already been verified by TCP::update()
+    *view = View(pool, sizeof(IP::Header) + sizeof(Header), sizeof(IP::Header));
+
+    return view->size();
+}
+
+void TCP::Connection::release(View * view)
+{
+    db<TCP>(TRC) << "TCP::release(view=" << view << ")" << endl;
+
+    if(view->pool())
+        discard(view->pool());
+    *view = View();
+}
+
+void TCP::Connection::consumed(unsigned int length)
+{
+    // _unread is also updated by update(), which runs in interrupt context
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+    _unread = (_unread > length) ? _unread - length : 0;
+    if(!was_disabled)
+        CPU::int_enable();
+
+    // Receiver-side silly window avoidance (RFC 1122): only announce a window that has opened by a significant amount
+    unsigned int threshold = (WINDOW / 2 < MSS) ? WINDOW / 2 : MSS;
+    if(((_state == ESTABLISHED) || (_state == FIN_WAIT1) || (_state == FIN_WAIT2)) && (acknowledgment() + receive_window() >= _advertised + threshold))
+        fsend(ACK);
+}
+
+void TCP::Connection::acknowledge(bool now)
+{
+    // RFC 1122 and RFC 5681: acknowledge at least every second segment and immediately whenever a hole is being filled or remains
+    if(!_delayed)
+        return;
+
+    if(now || (_delayed >= 2) || _reordered)
+        fsend(ACK);
+    else {
+        bool was_disabled = CPU::int_disabled();
+        CPU::int_disable();
+        bool arm = !_ack_armed;
+        _ack_armed = true;
+        if(!was_disabled)
+            CPU::int_enable();
+        if(arm)
+            _ack_alarm.reset();
+    }
+}
+
+void TCP::Connection::advertise()
+{
+    // Both threads (send) and interrupt handlers (update and the delayed ACK alarm) advertise
+    bool was_disabled = CPU::int_disabled();
+    CPU::int_disable();
+
+    // Every segment we send carries an ACK up to RCV.NXT, so a pending delayed ACK is superseded (its alarm then goes off idly)
+    _delayed = 0;
+
+    unsigned int window = receive_window();
+    _window = htons(window);
+    _advertised = acknowledgment() + window;
+
+    if(!was_disabled)
+        CPU::int_enable();
+}
+
+void TCP::Connection::delayed_ack(Connection * c)
+{
+    db<TCP>(TRC) << "TCP::Connection::delayed_ack(connection=" << c << ",delayed=" << c->_delayed << ")" << endl;
+
+    c->_ack_armed = false;
+
+    if(c->_delayed)
+        c->fsend(ACK);
+}
+
 void TCP::Connection::set_timeout(const Alarm::Microsecond & time)
 {
     db<TCP>(TRC) << "TCP::Connection::set_timeout" << endl;
@@ -7,49 +7,111 @@
 __BEGIN_SYS
 
 // Class attributes
-UDP::Observed UDP::_observed;
+Hashed_Data_Observed<UDP::Buffer, UDP::Port> UDP::_observed;
 
 // Methods
 int UDP::send(const Port & from, const Address & to, const void * d, unsigned int s)
 {
-    const unsigned char * data = reinterpret_cast<const unsigned char *>(d);
-    unsigned int size = (s > sizeof(Data)) ? sizeof(Data) : s;
+    db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",d=" << d << ",s=" << s << ")" << endl;
 
-    db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",d=" << data << ",s=" << size << ")" << endl;
+    Chunk chunk = {d, s};
+    unsigned int headers;
+    Buffer * pool = marshal(from, to, &chunk, 1, &headers);
+    if(!pool)
+        return 0;
+
+    return IP::send(pool) - headers; // implicitly releases the pool
+}
+
+
+int UDP::send(const Port & from, const Address & to, const Chunk * chunks, unsigned int n)
+{
+    db<UDP>(TRC) << "UDP::send(f=" << from << ",t=" << to << ",c=" << chunks << ",n=" << n << ")" << endl;
+
+    unsigned int headers;
+    Buffer * pool = marshal(from, to, chunks, n, &headers);
+    if(!pool)
+        return 0;
+
+    return IP::send(pool) - headers; // implicitly releases the pool
+}
+
+
+int UDP::send_batch(const Port & from, const Message_Desc * msgs, unsigned int n)
+{
+    db<UDP>(TRC) << "UDP::send_batch(f=" << from << ",m=" << msgs << ",n=" << n << ")" << endl;
+
+    Buffer * pools[MAX_BATCH];
+    unsigned int pending = 0;
+    unsigned int frames = 0;
+    unsigned int headers = 0;
+    int size = 0;
+
+    for(unsigned int i = 0; i < n; i++) {
+        unsigned int s = (msgs[i].size > sizeof(Data)) ? sizeof(Data) : msgs[i].size;
+        unsigned int f = (sizeof(Header) + s + IP::MFS - 1) / IP::MFS;
+
+        // Flush before the batch outgrows the NIC's transmit ring
+        if(pending && (frames + f > MAX_BATCH)) {
+            size += IP::send(pools, pending) - headers; // implicitly releases the pools
+            pending = frames = headers = 0;
+        }
+
+        Chunk chunk = {msgs[i].data, s};
+        unsigned int h;
+        Buffer * pool = marshal(from, msgs[i].to, &chunk, 1, &h);
+        if(!pool)
+            break;
+
+        pools[pending++] = pool;
+        frames += f;
+        headers += h;
+    }
+
+    if(pending)
+        size += IP::send(pools, pending) - headers;
+
+    return size;
+}
+
+
+UDP::Buffer * UDP::marshal(const Port & from, const Address & to, const Chunk * chunks, unsigned int n, unsigned int * headers)
+{
+    IP::Gather data(chunks, n);
+    unsigned int size = data.size();
+    if(size > sizeof(Data))
+        size = sizeof(Data);
 
     Buffer * pool = IP::alloc(to.ip(), IP::UDP, sizeof(Header), size);
     if(!pool)
         return 0;
 
     Message * message = 0;
-    unsigned int headers = sizeof(Header);
+    IP::Checksum sum = 0;
+    *headers = sizeof(Header);
     for(Buffer::Element * el = pool->link(); el; el = el->next()) {
         Buffer * buf = el->object();
         Packet * packet = buf->frame()->data<Packet>();
 
-        db<UDP>(INF) << "UDP::send:buf=" << buf << " => " << *buf<< endl;
+        db<UDP>(INF) << "UDP::marshal:buf=" << buf << " => " << *buf<< endl;
 
         if(el == pool->link()) {
             message = packet->data<Message>();
             new(packet->data<void>()) Header(from, to.port(), size);
-            message->sum_header(packet->from(), packet->to());
-            memcpy(message->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            message->sum_data(data, buf->size() - sizeof(Header) - sizeof(IP::Header));
-            data += buf->size() - sizeof(Header) - sizeof(IP::Header);
+            sum = message->sum_header(packet->from(), packet->to());
+            sum = message->sum_data(sum, message->data<void>(), data, buf->size() - sizeof(Header) - sizeof(IP::Header));
 
-            db<UDP>(INF) << "UDP::send:msg=" << message << " => " << *message << endl;
+            db<UDP>(INF) << "UDP::marshal:msg=" << message << " => " << *message << endl;
         } else {
-            memcpy(packet->data<void>(), data, buf->size() - sizeof(IP::Header));
-            message->sum_data(data, buf->size() - sizeof(IP::Header));
-            data += buf->size() - sizeof(IP::Header);
+            sum = message->sum_data(sum, packet->data<void>(), data, buf->size() - sizeof(IP::Header));
         }
 
-        headers += sizeof(IP::Header);
+        *headers += sizeof(IP::Header);
     }
 
-    message->sum_trailer();
+    message->sum_trailer(sum);
 
-    return IP::send(pool) - headers; // implicitly releases the pool
+    return pool;
 }
 
 
@@ -62,9 +124,10 @@ int UDP::receive(Buffer * pool, void * d, unsigned int s)
     Buffer::Element * head = pool->link();
     Packet * packet = head->object()->frame()->data<Packet>();
     Message * message = packet->data<Message>();
+    IP::Checksum sum = message->sum_header(packet->from(), packet->to());
     unsigned int size = 0;
 
-    for(Buffer::Element * el = head; el && (size <= s); el = el->next()) {
+    for(Buffer::Element * el = head; el; el = el->next()) {
         Buffer * buf = el->object();
 
         db<UDP>(INF) << "UDP::receive:buf=" << buf << " => " << *buf << endl;
@@ -72,24 +135,39 @@ int UDP::receive(Buffer * pool, void * d, unsigned int s)
         packet = buf->frame()->data<Packet>();
 
         unsigned int len = buf->size() - sizeof(IP::Header);
+        const void * payload;
         if(el == head) {
             len -= sizeof(Header);
-            memcpy(data, message->data<void>(), len);
+            payload = message->data<void>();
 
             db<UDP>(INF) << "UDP::receive:msg=" << message << " => " << *message << endl;
         } else
-            memcpy(data, packet->data<void>(), len);
+            payload = packet->data<void>();
+
+        // Whatever does not fit in data is still summed, so the message can be checked
+        // Partial sums cannot resume in the middle of a 16-bit word, so an odd byte where the copy stops is summed with the rest
+        unsigned int copy = (size + len > s) ? s - size : len;
+        if(Traits<UDP>::checksum && (copy < len)) {
+            unsigned int even = copy & ~1U;
+            sum = message->sum_data(sum, data, payload, even);
+            if(even < copy)
+                data[even] = reinterpret_cast<const unsigned char *>(payload)[even];
+            sum = IP::checksum_add(sum, reinterpret_cast<const unsigned char *>(payload) + even, len - even);
+        } else
+            sum = message->sum_data(sum, data, payload, copy);
 
         db<UDP>(INF) << "UDP::receive:len=" << len << endl;
 
-        data += len;
-        size += len;
+        data += copy;
+        size += copy;
     }
 
+    bool ok = message->check(sum);
+
     pool->nic()->free(pool);
 
-    if(!message->check()) {
-        db<UDP>(WRN) << "UDP::update: wrong message checksum!" << endl;
+    if(!ok) {
+        db<UDP>(WRN) << "UDP::receive: wrong message checksum!" << endl;
         size = 0;
     }
 
@@ -97,6 +175,46 @@ int UDP::receive(Buffer * pool, void * d, unsigned int s)
 }
 
 
+int UDP::receive(Buffer * pool, View * view)
+{
+    db<UDP>(TRC) << "UDP::receive(buf=" << pool << ",view=" << view << ")" << endl;
+
+    *view = View(pool, sizeof(IP::Header) + sizeof(Header), sizeof(IP::Header));
+
+    Packet * packet = pool->frame()->data<Packet>();
+    Message * message = packet->data<Message>();
+
+    if(Traits<UDP>::checksum) {
+        IP::Checksum sum = message->sum_header(packet->from(), packet->to());
+        for(Buffer::Element * el = pool->link(); el; el = el->next()) {
+            Buffer * buf = el->object();
+            if(el == pool->link())
+                sum = IP::checksum_add(sum, message->data<void>(), buf->size() - sizeof(IP::Header) - sizeof(Header));
+            else
+                sum = IP::checksum_add(sum, buf->frame()->data<Packet>()->data<void>(), buf->size() - sizeof(IP::Header));
+        }
+
+        if(!message->check(sum)) {
+            db<UDP>(WRN) << "UDP::receive: wrong message checksum!" << endl;
+            release(view);
+            return 0;
+        }
+    }
+
+    return view->size();
+}
+
+
+void UDP::release(View * view)
+{
+    db<UDP>(TRC) << "UDP::release(view=" << view << ")" << endl;
+
+    if(view->pool())
+        view->pool()->nic()->free(view->pool());
+    *view = View();
+}
+
+
 void UDP::update(IP::Observed * obs, const IP::Protocol & prot, Buffer * pool)
 {
     db<UDP>(TRC) << "UDP::update(obs=" << obs << ",prot=" << prot << ",buf=" << pool << ")" << endl;
@@ -111,49 +229,40 @@ void UDP::update(IP::Observed * obs, const IP::Protocol & prot, Buffer * pool)
 }
 
 
-void UDP::Message::sum_header(const IP::Address & from, const IP::Address & to)
+IP::Checksum UDP::Message::sum_header(const IP::Address & from, const IP::Address & to)
 {
-    _checksum = 0;
-    if(Traits<UDP>::checksum) {
-        IP::Pseudo_Header pseudo(from, to, IP::UDP, length());
-        unsigned long sum = 0;
-
-        const unsigned char * ptr = reinterpret_cast<const unsigned char *>(&pseudo);
-        for(unsigned int i = 0; i < sizeof(IP::Pseudo_Header); i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-
-        ptr = reinterpret_cast<const unsigned char *>(header());
-        for(unsigned int i = 0; i < sizeof(Header); i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
+    if(!Traits<UDP>::checksum)
+        return 0;
 
-        _checksum = sum;
-    }
+    IP::Pseudo_Header pseudo(from, to, IP::UDP, length());
+    return IP::checksum_add(IP::checksum_add(0, &pseudo, sizeof(IP::Pseudo_Header)), header(), sizeof(Header));
 }
 
-void UDP::Message::sum_data(const void * data, unsigned int size)
+IP::Checksum UDP::Message::sum_data(IP::Checksum sum, void * to, const void * from, unsigned int size)
 {
-    if(Traits<UDP>::checksum) {
-        unsigned long sum = _checksum;
+    if(!Traits<UDP>::checksum) {
+        memcpy(to, from, size);
+        return 0;
+    }
 
-        const unsigned char * ptr = reinterpret_cast<const unsigned char *>(data);
-        for(unsigned int i = 0; i < size; i += 2)
-            sum += (ptr[i] << 8) | ptr[i+1];
-        if(size & 1)
-            sum += ptr[size - 1];
+    return IP::checksum_copy(sum, to, from, size);
+}
 
-        _checksum = sum;
+IP::Checksum UDP::Message::sum_data(IP::Checksum sum, void * to, IP::Gather & from, unsigned int size)
+{
+    if(!Traits<UDP>::checksum) {
+        from.copy(to, size);
+        return 0;
     }
+
+    return from.copy(sum, to, size);
 }
 
-void UDP::Message::sum_trailer()
+void UDP::Message::sum_trailer(IP::Checksum sum)
 {
     if(Traits<UDP>::checksum) {
-        unsigned long sum = _checksum;
-
-        while(sum >> 16)
-            sum = (sum & 0xffff) + (sum >> 16);
-
-        _checksum = htons(~sum);
+        unsigned short chk = ~IP::checksum_fold(sum);
+        _checksum = chk ? chk : 0xffff; // a null checksum would mean "not computed" (RFC 768)
     }
 }
 
@@ -1,5 +1,6 @@
 // EPOS Network Component Initialization
 
+#include <machine.h>
 #include <network.h>
 
 __BEGIN_SYS
@@ -8,6 +9,16 @@ void Network_Common::init()
 {
     db<Init, Network>(TRC) << "Network::init()" << endl;
 
+#if defined(__mach_pc__) && defined(__NIC_H)
+    // NICs are initialized before threads, so their receive pollers can only be created now
+    if(Traits<PCNet32>::enabled && Traits<PCNet32>::polling)
+        for(unsigned int i = 0; i < Traits<PCNet32>::UNITS; i++)
+            PCNet32::get(i)->init_poller();
+    if(Traits<E100>::enabled && Traits<E100>::polling)
+        for(unsigned int i = 0; i < Traits<E100>::UNITS; i++)
+            E100::get(i)->init_poller();
+#endif
+
     Initializer<0>::init();
 
 #ifdef __ipv4__
@@ -34,40 +34,25 @@ void TSTP::Router::update(Data_Observed<Buffer> * obs, Buffer * buf)
             buf->destined_to_me = ((header->origin() != TSTP::here()) && (dst.contains(TSTP::here(), dst.t0)));
 
             if(forward(buf)) {
-
-                // Forward or ACK the message
-
-                Buffer * send_buf = TSTP::alloc(buf->size());
-
-                // Copy frame contents
-                memcpy(send_buf->frame(), buf->frame(), buf->size());
-
-                // Copy Buffer Metainformation
-                send_buf->size(buf->size());
-                send_buf->id = buf->id;
-                send_buf->destined_to_me = buf->destined_to_me;
-                send_buf->downlink = buf->downlink;
-                send_buf->deadline = buf->deadline;
-                send_buf->my_distance = buf->my_distance;
-                send_buf->sender_distance = buf->sender_distance;
-                send_buf->is_new = false;
-                send_buf->is_microframe = false;
-                send_buf->random_backoff_exponent = 0;
+                // Forward or ACK the message by relaying the received buffer itself (its TX Metainformation was already
+                // assembled by the MAC upon reception). The MAC holds a reference to it until it is sent, ACK'ed or dropped,
+                // so only the fields below are rewritten and local observers that must change the frame use TSTP::writable().
+                // The Router is attached after the Locator and the Timekeeper, which have already read the fields as received.
+                CPU::finc(buf->references);
 
                 // Calculate offset
-                offset(send_buf);
+                offset(buf);
 
                 // Adjust Last Hop location
-                Header * header = send_buf->frame()->data<Header>();
                 header->last_hop(TSTP::here());
-                send_buf->sender_distance = send_buf->my_distance;
+                buf->sender_distance = buf->my_distance;
 
                 header->location_confidence(_locator->confidence());
                 header->time_request(TSTP::Timekeeper::sync_required());
 
-                send_buf->hint = send_buf->my_distance;
+                buf->hint = buf->my_distance;
 
-                TSTP::_nic->send(send_buf);
+                TSTP::_nic->send(buf);
             }
         }
     }
@@ -18,6 +18,8 @@ TSTP::Security::_DH TSTP::Security::_dh;
 TSTP::Security::Pending_Keys TSTP::Security::_pending_keys;
 TSTP::Security::Peers TSTP::Security::_pending_peers;
 TSTP::Security::Peers TSTP::Security::_trusted_peers;
+TSTP::Security::Peer_Grid TSTP::Security::_pending_grid;
+TSTP::Security::Peer_Grid TSTP::Security::_trusted_grid;
 volatile bool TSTP::Security::_peers_lock;
 Thread * TSTP::Security::_key_manager;
 unsigned int TSTP::Security::_dh_requests_open;
@@ -29,10 +31,14 @@ TSTP::Security::~Security()
     detach(this);
     if(_key_manager)
         delete _key_manager;
-    while(Peers::Element * el = _trusted_peers.remove_head())
+    while(Peers::Element * el = _trusted_peers.remove_head()) {
+        _trusted_grid.remove(el->object()->spot());
         delete el->object();
-    while(Peers::Element * el = _pending_peers.remove_head())
+    }
+    while(Peers::Element * el = _pending_peers.remove_head()) {
+        _pending_grid.remove(el->object()->spot());
         delete el->object();
+    }
     while(Pending_Keys::Element * el = _pending_keys.remove_head())
         delete el->object();
 }
@@ -56,20 +62,14 @@ void TSTP::Security::update(Data_Observed<Buffer> * obs, Buffer * buf)
 
                             //while(CPU::tsl(_peers_lock));
                             //CPU::int_disable();
-                            bool valid_peer = false;
-                            for(Peers::Element * el = _pending_peers.head(); el; el = el->next())
-                                if(el->object()->valid_deploy(dh_req->origin(), TSTP::now())) {
+                            bool valid_peer = search(_pending_grid, dh_req->origin(), TSTP::now());
+                            if(!valid_peer) {
+                                Peer * peer = search(_trusted_grid, dh_req->origin(), TSTP::now());
+                                if(peer) {
                                     valid_peer = true;
-                                    break;
+                                    distrust(peer);
                                 }
-                            if(!valid_peer)
-                                for(Peers::Element * el = _trusted_peers.head(); el; el = el->next())
-                                    if(el->object()->valid_deploy(dh_req->origin(), TSTP::now())) {
-                                        valid_peer = true;
-                                        _trusted_peers.remove(el);
-                                        _pending_peers.insert(el);
-                                        break;
-                                    }
+                            }
                             //_peers_lock = false;
                             //CPU::int_enable();
 
@@ -107,13 +107,10 @@ void TSTP::Security::update(Data_Observed<Buffer> * obs, Buffer * buf)
                             db<TSTP>(INF) << "TSTP::Security::update(): DH_Response message received: " << *dh_resp << endl;
 
                             //CPU::int_disable();
-                            bool valid_peer = false;
-                            for(Peers::Element * el = _pending_peers.head(); el; el = el->next())
-                                if(el->object()->valid_deploy(dh_resp->origin(), TSTP::now())) {
-                                    valid_peer = true;
-                                    db<TSTP>(TRC) << "Valid peer found: " << *el->object() << endl;
-                                    break;
-                                }
+                            Peer * peer = search(_pending_grid, dh_resp->origin(), TSTP::now());
+                            bool valid_peer = peer;
+                            if(valid_peer)
+                                db<TSTP>(TRC) << "Valid peer found: " << *peer << endl;
 
                             if(valid_peer) {
                                 _dh_requests_open--;
@@ -132,16 +129,14 @@ void TSTP::Security::update(Data_Observed<Buffer> * obs, Buffer * buf)
 
                         //CPU::int_disable();
                         Peer * auth_peer = 0;
-                        for(Peers::Element * el = _pending_peers.head(); el; el = el->next()) {
-                            Peer * peer = el->object();
-
+                        Peer_Grid::Query query(&_pending_grid, auth_req->origin());
+                        for(Peer * peer = query.next(); peer; peer = query.next()) {
                             if(peer->valid_request(auth_req->auth(), auth_req->origin(), TSTP::now())) {
                                 for(Pending_Keys::Element * pk_el = _pending_keys.head(); pk_el; pk_el = pk_el->next()) {
                                     Pending_Key * pk = pk_el->object();
-                                    if(verify_auth_request(pk->master_secret(), peer->id(), auth_req->otp())) {
+                                    if(verify_auth_request(pk->master_secret(), peer, auth_req->otp())) {
                                         peer->master_secret(pk->master_secret());
-                                        _pending_peers.remove(el);
-                                        _trusted_peers.insert(el);
+                                        trust(peer); // the query is not resumed after this
                                         auth_peer = peer;
 
                                         _pending_keys.remove(pk_el);
@@ -181,12 +176,11 @@ void TSTP::Security::update(Data_Observed<Buffer> * obs, Buffer * buf)
                                 for(Pending_Keys::Element * pk_el = _pending_keys.head(); pk_el; pk_el = pk_el->next()) {
                                     Pending_Key * pk = pk_el->object();
                                     Auth decrypted_auth;
-                                    OTP key = otp(pk->master_secret(), peer->id());
+                                    OTP key = otp(pk->master_secret(), peer);
                                     _cipher.decrypt(auth_grant->auth(), key, decrypted_auth);
                                     if(decrypted_auth == _auth) {
                                         peer->master_secret(pk->master_secret());
-                                        _pending_peers.remove(el);
-                                        _trusted_peers.insert(el);
+                                        trust(peer);
                                         auth_peer = true;
 
                                         _pending_keys.remove(pk_el);
@@ -211,19 +205,7 @@ void TSTP::Security::update(Data_Observed<Buffer> * obs, Buffer * buf)
             }
             case RESPONSE: {
                 db<TSTP>(INF) << "TSTP::Security::update(): Response message received from " << buf->frame()->data<Header>()->origin() << endl;
-//                Response * resp = buf->frame()->data<Response>();
-                Time reception_time = _NIC::Timer::count2us(buf->sfd_time_stamp);
-                for(Peers::Element * el = _trusted_peers.head(); el; el = el->next()) {
-                    if(el->object()->valid_deploy(buf->frame()->data<Header>()->origin(), TSTP::now())) {
-                        unsigned char * data = buf->frame()->data<unsigned char>();
-                        if(unpack(el->object(), data, &data[sizeof(Master_Secret)], reception_time)) {
-                            buf->trusted = true;
-                            break;
-                        } else {
-                            db<TSTP>(WRN) << "TSTP::Security: Unpack failed" << endl;
-                        }
-                    }
-                }
+                // Responses are decrypted for the clients by open(), after the Router has relayed them as received
                 buf->trusted = true; // TODO
             } break;
             case INTEREST: {
@@ -237,16 +219,40 @@ void TSTP::Security::update(Data_Observed<Buffer> * obs, Buffer * buf)
     }
 }
 
+TSTP::Buffer * TSTP::Security::open(Buffer * buf)
+{
+    db<TSTP>(TRC) << "TSTP::Security::open(buf=" << buf << ")" << endl;
+
+    if(buf->is_microframe || !buf->destined_to_me || (buf->frame()->data<Header>()->type() != RESPONSE))
+        return buf;
+
+    // unpack() decrypts in place, so a frame the Router is relaying is decrypted on a private copy
+    Buffer * own = buf;
+    Time reception_time = _NIC::Timer::count2us(buf->sfd_time_stamp);
+    const Space origin = buf->frame()->data<Header>()->origin();
+    Peer_Grid::Query query(&_trusted_grid, origin);
+    for(Peer * peer = query.next(); peer; peer = query.next()) {
+        if(peer->valid_deploy(origin, TSTP::now())) {
+            if(own == buf)
+                own = TSTP::writable(buf);
+            unsigned char * data = own->frame()->data<unsigned char>();
+            if(unpack(peer, data, &data[sizeof(Master_Secret)], reception_time)) {
+                own->trusted = true;
+                break;
+            } else {
+                db<TSTP>(WRN) << "TSTP::Security: Unpack failed" << endl;
+            }
+        }
+    }
+
+    return own;
+}
+
 void TSTP::Security::marshal(Buffer * buf)
 {
     db<TSTP>(TRC) << "TSTP::Security::marshal(buf=" << buf << ")" << endl;
     if(buf->frame()->data<Header>()->type() == TSTP::RESPONSE) {
-        Peer * peer = 0;
-        for(Peers::Element * el = _trusted_peers.head(); el; el = el->next())
-            if(el->object()->valid_deploy(Router::destination(buf).center, TSTP::now())) {
-                peer = el->object();
-                break;
-            }
+        Peer * peer = search(_trusted_grid, Router::destination(buf).center, TSTP::now());
         if(!peer)
             return;
 
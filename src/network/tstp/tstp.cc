@@ -37,7 +37,12 @@ void TSTP::update(NIC_Family::Observed * obs, const Protocol & prot, Buffer * bu
     db<TSTP>(TRC) << "TSTP::update:packet=" << *packet << endl;
 
     _parts.notify(buf);
-    _clients.notify(packet->header()->unit(), buf);
+
+    // Clients get Responses decrypted, on a private copy if the Router is relaying the frame in place
+    Buffer * own = Security::open(buf);
+    _clients.notify(packet->header()->unit(), own);
+    if(own != buf)
+        delete own;
 //    if(buf->is_microframe || !buf->trusted)
 //        return;
 //
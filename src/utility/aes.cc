@@ -74,10 +74,10 @@ void _AES<16>::ebc_encrypt(const unsigned char * input, const unsigned char * ke
     block_copy(output, input);
     _state = reinterpret_cast<State *>(output);
 
-    _key = key;
-    expand_key();
+    expand_key(key, _round_key);
+    _schedule = _round_key;
 
-    // The next function call encrypts the PlainText with the _key using AES algorithm.
+    // The next function call encrypts the PlainText with the key using AES algorithm.
     cipher();
 }
 
@@ -88,8 +88,8 @@ void _AES<16>::ebc_decrypt(const unsigned char * input, const unsigned char * ke
     _state = reinterpret_cast<State *>(output);
 
     // The expand_key routine must be called before encryption.
-    _key = key;
-    expand_key();
+    expand_key(key, _round_key);
+    _schedule = _round_key;
 
     inv_cipher();
 }
@@ -103,8 +103,8 @@ void _AES<16>::cbc_encrypt_buffer(unsigned char * output, const unsigned char *
 
     // Skip the key expansion if key is passed as 0
     if(0 != key) {
-        _key = key;
-        expand_key();
+        expand_key(key, _round_key);
+        _schedule = _round_key;
     }
 
     if(iv != 0)
@@ -141,8 +141,8 @@ void _AES<16>::cbc_decrypt_buffer(unsigned char * output, const unsigned char *
 
     // Skip the key expansion if key is passed as 0
     if(0 != key) {
-        _key = key;
-        expand_key();
+        expand_key(key, _round_key);
+        _schedule = _round_key;
     }
 
     // If iv is passed as 0, we continue to encrypt without re-setting the _iv
@@ -167,24 +167,146 @@ void _AES<16>::cbc_decrypt_buffer(unsigned char * output, const unsigned char *
     }
 }
 
+void _AES<16>::ctr(const unsigned char * data, unsigned int size, const Key_Schedule & key, const unsigned char * counter, unsigned char * result)
+{
+    unsigned char block[BLOCK_SIZE];
+    unsigned char stream[BLOCK_SIZE];
+
+    block_copy(block, counter);
+    _schedule = key._round_key;
+
+    for(unsigned int i = 0; i < size; i += BLOCK_SIZE) {
+        block_copy(stream, block);
+        encrypt_block(stream);
+
+        for(unsigned int j = 0; (j < BLOCK_SIZE) && (i + j < size); j++)
+            result[i + j] = data[i + j] ^ stream[j];
+
+        for(int j = BLOCK_SIZE - 1; (j >= 0) && !++block[j]; j--);
+    }
+}
+
+void _AES<16>::ccm_encrypt(const unsigned char * data, unsigned int size, const Key_Schedule & key, const unsigned char * nonce, unsigned int nonce_size,
+                           const unsigned char * aad, unsigned int aad_size, unsigned char * result, unsigned char * tag, unsigned int tag_size)
+{
+    assert((nonce_size >= 7) && (nonce_size <= 13) && (tag_size >= 4) && (tag_size <= 16) && !(tag_size % 2));
+
+    _schedule = key._round_key;
+
+    unsigned char mac[BLOCK_SIZE];
+    ccm_mac(mac, data, size, nonce, nonce_size, aad, aad_size, tag_size);
+
+    // The tag is encrypted with counter block 0 and the data with the following ones
+    unsigned char counter[BLOCK_SIZE];
+    ccm_counter(counter, nonce, nonce_size);
+    unsigned char s0[BLOCK_SIZE];
+    block_copy(s0, counter);
+    encrypt_block(s0);
+    for(unsigned int i = 0; i < tag_size; i++)
+        tag[i] = mac[i] ^ s0[i];
+
+    counter[BLOCK_SIZE - 1] = 1;
+    ctr(data, size, key, counter, result);
+}
+
+bool _AES<16>::ccm_decrypt(const unsigned char * data, unsigned int size, const Key_Schedule & key, const unsigned char * nonce, unsigned int nonce_size,
+                           const unsigned char * aad, unsigned int aad_size, unsigned char * result, const unsigned char * tag, unsigned int tag_size)
+{
+    assert((nonce_size >= 7) && (nonce_size <= 13) && (tag_size >= 4) && (tag_size <= 16) && !(tag_size % 2));
+
+    unsigned char counter[BLOCK_SIZE];
+    ccm_counter(counter, nonce, nonce_size);
+    counter[BLOCK_SIZE - 1] = 1;
+    ctr(data, size, key, counter, result);
+
+    unsigned char mac[BLOCK_SIZE];
+    ccm_mac(mac, result, size, nonce, nonce_size, aad, aad_size, tag_size);
+
+    counter[BLOCK_SIZE - 1] = 0;
+    encrypt_block(counter);
+
+    unsigned char diff = 0;
+    for(unsigned int i = 0; i < tag_size; i++)
+        diff |= mac[i] ^ counter[i] ^ tag[i];
+
+    if(diff)
+        memset(result, 0, size);
+
+    return !diff;
+}
+
+// Counter block 0: flags (the size of the length field, q, minus one), nonce and a zeroed q-byte counter
+void _AES<16>::ccm_counter(unsigned char * counter, const unsigned char * nonce, unsigned int nonce_size)
+{
+    counter[0] = 15 - nonce_size - 1;
+    memcpy(&counter[1], nonce, nonce_size);
+    memset(&counter[1 + nonce_size], 0, BLOCK_SIZE - 1 - nonce_size);
+}
+
+// CBC-MAC over B0 (flags, nonce and data size), the size of aad followed by aad, and data, each zero-padded to the block size
+void _AES<16>::ccm_mac(unsigned char * mac, const unsigned char * data, unsigned int size, const unsigned char * nonce, unsigned int nonce_size,
+                       const unsigned char * aad, unsigned int aad_size, unsigned int tag_size)
+{
+    mac[0] = (aad_size ? 0x40 : 0) | (((tag_size - 2) / 2) << 3) | (15 - nonce_size - 1);
+    memcpy(&mac[1], nonce, nonce_size);
+    unsigned int s = size;
+    for(unsigned int i = BLOCK_SIZE - 1; i > nonce_size; i--, s >>= 8)
+        mac[i] = s;
+    encrypt_block(mac);
+
+    if(aad_size) {
+        unsigned int offset;
+        if(aad_size < 0xff00) {
+            mac[0] ^= aad_size >> 8;
+            mac[1] ^= aad_size;
+            offset = 2;
+        } else {
+            mac[0] ^= 0xff;
+            mac[1] ^= 0xfe;
+            mac[2] ^= aad_size >> 24;
+            mac[3] ^= aad_size >> 16;
+            mac[4] ^= aad_size >> 8;
+            mac[5] ^= aad_size;
+            offset = 6;
+        }
+        cbc_mac(mac, offset, aad, aad_size);
+    }
+
+    cbc_mac(mac, 0, data, size);
+}
+
+// Absorbs size bytes of data into mac, starting at offset of the current block, and closes the last (zero-padded) block
+void _AES<16>::cbc_mac(unsigned char * mac, unsigned int offset, const unsigned char * data, unsigned int size)
+{
+    for(unsigned int i = 0; i < size; i++) {
+        mac[offset++] ^= data[i];
+        if(offset == BLOCK_SIZE) {
+            encrypt_block(mac);
+            offset = 0;
+        }
+    }
+    if(offset)
+        encrypt_block(mac);
+}
+
 // This function produces Nb(Nr+1) round keys. The round keys are used in each round to decrypt the states.
-void _AES<16>::expand_key(void)
+void _AES<16>::expand_key(const unsigned char * key, unsigned char * round_key)
 {
     unsigned int i, j, k;
     unsigned char tempa[4]; // Used for the column/row operations
 
     // The first round key is the key itself.
     for(i = 0; i < Nk; ++i) {
-        _round_key[(i * 4) + 0] = _key[(i * 4) + 0];
-        _round_key[(i * 4) + 1] = _key[(i * 4) + 1];
-        _round_key[(i * 4) + 2] = _key[(i * 4) + 2];
-        _round_key[(i * 4) + 3] = _key[(i * 4) + 3];
+        round_key[(i * 4) + 0] = key[(i * 4) + 0];
+        round_key[(i * 4) + 1] = key[(i * 4) + 1];
+        round_key[(i * 4) + 2] = key[(i * 4) + 2];
+        round_key[(i * 4) + 3] = key[(i * 4) + 3];
     }
 
     // All other round keys are found from the previous round keys.
     for(; (i < (Nb * (Nr + 1))); ++i) {
         for(j = 0; j < 4; ++j)
-            tempa[j]=_round_key[(i-1) * 4 + j];
+            tempa[j]=round_key[(i-1) * 4 + j];
         if (i % Nk == 0) {
             // This function rotates the 4 bytes in a word to the left once.
             // [a0,a1,a2,a3] becomes [a1,a2,a3,a0]
@@ -220,10 +342,10 @@ void _AES<16>::expand_key(void)
                 tempa[3] = sbox[static_cast<int>(tempa[3])];
             }
         }
-        _round_key[i * 4 + 0] = _round_key[(i - Nk) * 4 + 0] ^ tempa[0];
-        _round_key[i * 4 + 1] = _round_key[(i - Nk) * 4 + 1] ^ tempa[1];
-        _round_key[i * 4 + 2] = _round_key[(i - Nk) * 4 + 2] ^ tempa[2];
-        _round_key[i * 4 + 3] = _round_key[(i - Nk) * 4 + 3] ^ tempa[3];
+        round_key[i * 4 + 0] = round_key[(i - Nk) * 4 + 0] ^ tempa[0];
+        round_key[i * 4 + 1] = round_key[(i - Nk) * 4 + 1] ^ tempa[1];
+        round_key[i * 4 + 2] = round_key[(i - Nk) * 4 + 2] ^ tempa[2];
+        round_key[i * 4 + 3] = round_key[(i - Nk) * 4 + 3] ^ tempa[3];
     }
 }
 
@@ -234,7 +356,7 @@ void _AES<16>::add_round_key(int round)
     int i,j;
     for(i=0;i<4;++i) {
         for(j = 0; j < 4; ++j) {
-            (*_state)[i][j] ^= _round_key[round * Nb * 4 + i * Nb + j];
+            (*_state)[i][j] ^= _schedule[round * Nb * 4 + i * Nb + j];
         }
     }
 }
@@ -0,0 +1,72 @@
+// EPOS ARP Test Program
+
+#include <communicator.h>
+
+using namespace EPOS;
+
+typedef ARP<NIC<Ethernet>, IP> _ARP;
+
+const unsigned int PDU = 64;
+
+OStream cout;
+
+int main()
+{
+    cout << "ARP Test" << endl;
+
+    IP * ip = IP::get_by_nic(0);
+
+    cout << "  IP: " << ip->address() << endl;
+    cout << "  MAC: " << ip->nic()->address() << endl;
+
+    char data[PDU];
+    unsigned int errors = 0;
+
+    if(ip->address()[3] % 2) { // sender
+        cout << "Sender:" << endl;
+
+        IP::Address peer_ip = ip->address();
+        peer_ip[3]--;
+
+        // Nothing has been sent to the peer yet, so its mapping must be missing and lookup() must not block
+        IP::MAC_Address mac = ip->arp()->lookup(peer_ip);
+        cout << "  First lookup of " << peer_ip << " => " << mac << (mac ? " (hit?!)" : " (miss, resolving)") << endl;
+        if(mac)
+            errors++;
+
+        // This datagram is built while the peer is being resolved, so ARP holds it and sends it once the reply arrives
+        Link<UDP> * com = new Link<UDP>(8000, Link<UDP>::Address(peer_ip, UDP::Port(8000)));
+        for(unsigned int i = 0; i < PDU - 1; i++)
+            data[i] = 'a' + i % 26;
+        data[PDU - 1] = 0;
+        int sent = com->send(&data, sizeof(data));
+        cout << "  Sent " << sent << " bytes while resolving" << endl;
+
+        for(unsigned int i = 0; !mac && (i <= _ARP::RETRIES); i++) {
+            Alarm::delay(_ARP::TICK);
+            mac = ip->arp()->lookup(peer_ip);
+        }
+        cout << "  Lookup after the miss => " << mac << endl;
+        if(!mac)
+            errors++;
+
+        delete com;
+    } else { // receiver
+        cout << "Receiver:" << endl;
+
+        IP::Address peer_ip = ip->address();
+        peer_ip[3]++;
+
+        Link<UDP> * com = new Link<UDP>(8000, Link<UDP>::Address(peer_ip, UDP::Port(8000)));
+        int received = com->receive(&data, sizeof(data));
+        cout << "  Received " << received << " bytes held during resolution: " << data << endl;
+        if(received != sizeof(data))
+            errors++;
+
+        delete com;
+    }
+
+    cout << "ARP test finished with " << errors << " errors" << endl;
+
+    return errors;
+}
@@ -31,7 +31,7 @@ struct Traits
     enum {STATIC, MAC, INFO, RARP, DHCP};
 
     // SmartData predictors
-    enum :unsigned char {NONE, LVP, DBP};
+    enum :unsigned char {NONE, LVP, DBP, LSP, KFP};
 
     // Default traits
     static const bool enabled = true;
@@ -51,6 +51,7 @@ template<> struct Traits<Build>: public Traits<void>
     static const unsigned int MODEL = eMote3;
     static const unsigned int CPUS = 1;
     static const unsigned int NODES = 1; // (> 1 => NETWORKING)
+    static const bool LOOPBACK = false;  // (true => NETWORKING over a Loopback NIC, even on a single node)
     static const unsigned int EXPECTED_SIMULATION_TIME = 60; // s (0 => not simulated)
 };
 
@@ -184,6 +185,11 @@ template<> struct Traits<Monitor>: public Traits<void>
 {
     static const bool enabled = monitored;
 
+    // STREAMING monitors keep running statistics and only the last RECENT_SNAPSHOTS raw snapshots, in constant memory
+    // Otherwise, all snapshots taken during Traits<Build>::EXPECTED_SIMULATION_TIME are buffered
+    static const bool STREAMING = true;
+    static const unsigned int RECENT_SNAPSHOTS = 64;
+
     // Monitoring frequencies (in Hz, aka samples per second)
     static const unsigned int MONITOR_ELAPSED_TIME      = 0;
     static const unsigned int MONITOR_DEADLINE_MISS     = 0;
@@ -263,6 +269,12 @@ template<> struct Traits<UDP>: public Traits<Network>
     static const bool checksum = true;
 };
 
+template<> struct Traits<DIRP>: public Traits<Network>
+{
+    enum {NTP, PTP};
+    static const unsigned int SYNC_MODE = NTP; // NTP: master time stamps piggybacked on data, PTP: two-step SYNC/DELAY exchanges
+};
+
 template<> struct Traits<TCP>: public Traits<Network>
 {
     static const unsigned int WINDOW = 4096;
@@ -0,0 +1,108 @@
+// EPOS IP Checksum Test Program (throughput of the RFC 1071 primitives)
+
+#include <time.h>
+#include <network/ipv4/ip.h>
+
+using namespace EPOS;
+
+const unsigned int SIZE = 1472; // UDP payload of a full Ethernet frame
+const unsigned int ITERATIONS = 10000;
+
+OStream cout;
+
+unsigned char src[SIZE + 4];
+unsigned char dst[SIZE + 4];
+
+// The 16-bit, byte-shifting loop IP::checksum() used before the 32-bit primitives
+unsigned short reference(const unsigned char * ptr, unsigned int size)
+{
+    unsigned long sum = 0;
+    for(unsigned int i = 0; i + 1 < size; i += 2)
+        sum += (ptr[i] << 8) | ptr[i+1];
+    if(size & 1)
+        sum += ptr[size - 1] << 8;
+    while(sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+void report(const char * what, const Chronometer::Microsecond & time)
+{
+    // bytes per us == MB/s
+    cout << "  " << what << ": " << time << " us => " << static_cast<unsigned long long>(SIZE) * ITERATIONS / (time ? time : 1) << " MB/s" << endl;
+}
+
+int main()
+{
+    cout << "IP Checksum Test" << endl;
+
+    for(unsigned int i = 0; i < sizeof(src); i++)
+        src[i] = i * 7 + 3;
+
+    cout << "\nCorrectness (against the 16-bit reference, all alignments and odd sizes):" << endl;
+    unsigned int errors = 0;
+    for(unsigned int offset = 0; offset < 4; offset++)
+        for(unsigned int size = SIZE - 3; size <= SIZE; size++) {
+            unsigned short ref = reference(src + offset, size);
+            if(IP::checksum(src + offset, size) != ref)
+                errors++;
+            unsigned short copy = ntohs(~IP::checksum_fold(IP::checksum_copy(0, dst + offset, src + offset, size)));
+            if((copy != ref) || memcmp(dst + offset, src + offset, size))
+                errors++;
+        }
+    // Scatter-gather copies (see IP::Gather), with odd chunk sizes in between
+    for(unsigned int split = 1; split < 8; split++) {
+        IP::Chunk chunks[3] = {{src, split}, {src + split, 2 * split + 1}, {src + 3 * split + 1, SIZE - 3 * split - 1}};
+        IP::Gather gather(chunks, 3);
+        memset(dst, 0, SIZE);
+        unsigned short copy = ntohs(~IP::checksum_fold(gather.copy(0, dst, SIZE)));
+        if((copy != reference(src, SIZE)) || memcmp(dst, src, SIZE))
+            errors++;
+    }
+    unsigned short chk = ~IP::checksum_fold(IP::checksum_add(0, src, 20));
+    unsigned short old = reinterpret_cast<unsigned short *>(src)[1];
+    reinterpret_cast<unsigned short *>(src)[1] = 0x1234;
+    if(IP::checksum_update(chk, old, 0x1234) != static_cast<unsigned short>(~IP::checksum_fold(IP::checksum_add(0, src, 20))))
+        errors++;
+    reinterpret_cast<unsigned short *>(src)[1] = old;
+    cout << "  " << errors << " errors" << endl;
+
+    cout << "\nThroughput (" << ITERATIONS << " x " << SIZE << " bytes, 16-bit aligned source like in frames):" << endl;
+    const unsigned char * data = src + 2;
+    Chronometer chrono;
+    volatile unsigned short sink = 0;
+
+    chrono.start();
+    for(unsigned int i = 0; i < ITERATIONS; i++)
+        sink = reference(data, SIZE);
+    chrono.stop();
+    report("checksum (16-bit reference)", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < ITERATIONS; i++)
+        sink = IP::checksum_fold(IP::checksum_add(0, data, SIZE));
+    chrono.stop();
+    report("checksum (32-bit)", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < ITERATIONS; i++) {
+        memcpy(dst + 2, data, SIZE);
+        sink = IP::checksum_fold(IP::checksum_add(0, dst + 2, SIZE));
+    }
+    chrono.stop();
+    report("memcpy + checksum", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < ITERATIONS; i++)
+        sink = IP::checksum_fold(IP::checksum_copy(0, dst + 2, data, SIZE));
+    chrono.stop();
+    report("copy and checksum (fused)", chrono.read());
+    cout << "(last checksum=" << hex << sink << dec << ")" << endl;
+
+    cout << "\nDone!" << endl;
+
+    return 0;
+}
@@ -1,13 +1,32 @@
 // EPOS Cipher Mediator Test Program
 
 #include <utility/random.h>
+#include <utility/poly1305.h>
 #include <machine.h>
+#include <time.h>
 
 using namespace EPOS;
 
 OStream cout;
 
 static const unsigned int ITERATIONS = 100;
+static const unsigned int BENCHMARK_ITERATIONS = 1000;
+static const unsigned int MESSAGE_SIZE = 96; // a typical secured TSTP payload
+
+bool check(bool ok)
+{
+    if(ok)
+        cout << "OK!" << endl;
+    else
+        cout << "ERROR!" << endl;
+    return ok;
+}
+
+void report(const char * what, unsigned int bytes, const Chronometer::Microsecond & time)
+{
+    // bytes per ms == KB/s
+    cout << "  " << what << ": " << time << " us => " << static_cast<unsigned long long>(bytes) * BENCHMARK_ITERATIONS * 1000 / (time ? time : 1) << " KB/s" << endl;
+}
 
 int main()
 {
@@ -62,6 +81,56 @@ int main()
         }
     }
 
+    if(AES<16>::KEY_SIZE == 16) {
+        // Test vectors from NIST SP 800-38A (F.5.1) and SP 800-38C (C.1 to C.3)
+        const unsigned char key[] = {0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c};
+        const unsigned char counter[] = {0xf0,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa,0xfb,0xfc,0xfd,0xfe,0xff};
+        const unsigned char clear_text[] = {0x6b,0xc1,0xbe,0xe2,0x2e,0x40,0x9f,0x96,0xe9,0x3d,0x7e,0x11,0x73,0x93,0x17,0x2a,
+                                            0xae,0x2d,0x8a,0x57,0x1e,0x03,0xac,0x9c,0x9e,0xb7,0x6f,0xac,0x45,0xaf,0x8e,0x51};
+        const unsigned char expected[] = {0x87,0x4d,0x61,0x91,0xb6,0x20,0xe3,0x26,0x1b,0xef,0x68,0x64,0x99,0x0d,0xb6,0xce,
+                                          0x98,0x06,0xf6,0x6b,0x79,0x70,0xfd,0xff,0x86,0x17,0x18,0x7b,0xb9,0xff,0xfd,0xff};
+        AES<16>::Key_Schedule schedule(key);
+        unsigned char result[32];
+
+        cout << endl;
+        cout << "Testing AES-128-CTR with known vectors...";
+        cipher.ctr(clear_text, sizeof(clear_text), schedule, counter, result);
+        tests_failed += !check(!memcmp(result, expected, sizeof(expected)));
+
+        unsigned char ccm_key[16], nonce[13], aad[20], data[24], tag[8];
+        for(unsigned int i = 0; i < sizeof(ccm_key); i++)
+            ccm_key[i] = 0x40 + i;
+        for(unsigned int i = 0; i < sizeof(nonce); i++)
+            nonce[i] = 0x10 + i;
+        for(unsigned int i = 0; i < sizeof(aad); i++)
+            aad[i] = i;
+        for(unsigned int i = 0; i < sizeof(data); i++)
+            data[i] = 0x20 + i;
+        schedule.key(ccm_key);
+
+        const unsigned char expected1[] = {0x71,0x62,0x01,0x5b, 0x4d,0xac,0x25,0x5d};
+        const unsigned char expected2[] = {0xd2,0xa1,0xf0,0xe0,0x51,0xea,0x5f,0x62,0x08,0x1a,0x77,0x92,0x07,0x3d,0x59,0x3d, 0x1f,0xc6,0x4f,0xbf,0xac,0xcd};
+        const unsigned char expected3[] = {0xe3,0xb2,0x01,0xa9,0xf5,0xb7,0x1a,0x7a,0x9b,0x1c,0xea,0xec,0xcd,0x97,0xe7,0x0b,0x61,0x76,0xaa,0xd9,0xa4,0x42,0x8a,0xa5,
+                                           0x48,0x43,0x92,0xfb,0xc1,0xb0,0x99,0x51};
+
+        cout << "Testing AES-128-CCM with known vectors...";
+        bool ok = true;
+        cipher.ccm_encrypt(data, 4, schedule, nonce, 7, aad, 8, result, tag, 4);
+        ok &= !memcmp(result, expected1, 4) && !memcmp(tag, &expected1[4], 4);
+        cipher.ccm_encrypt(data, 16, schedule, nonce, 8, aad, 16, result, tag, 6);
+        ok &= !memcmp(result, expected2, 16) && !memcmp(tag, &expected2[16], 6);
+        cipher.ccm_encrypt(data, 24, schedule, nonce, 12, aad, 20, result, tag, 8);
+        ok &= !memcmp(result, expected3, 24) && !memcmp(tag, &expected3[24], 8);
+        tests_failed += !check(ok);
+
+        cout << "Testing AES-128-CCM decryption and authentication...";
+        unsigned char decrypted[24];
+        ok = cipher.ccm_decrypt(result, 24, schedule, nonce, 12, aad, 20, decrypted, tag, 8) && !memcmp(decrypted, data, 24);
+        tag[Random::random() % 8]++;
+        ok &= !cipher.ccm_decrypt(result, 24, schedule, nonce, 12, aad, 20, decrypted, tag, 8);
+        tests_failed += !check(ok);
+    }
+
     for(unsigned int it = 0; it < ITERATIONS; it++) {
         unsigned char clear_text[AES<16>::KEY_SIZE];
         unsigned char cipher_text[AES<16>::KEY_SIZE];
@@ -156,6 +225,81 @@ int main()
         cout << endl;
     }
 
+    if(AES<16>::KEY_SIZE == 16) {
+        cout << endl;
+        cout << "Throughput (" << BENCHMARK_ITERATIONS << " x " << MESSAGE_SIZE << "-byte messages):" << endl;
+
+        unsigned char key[AES<16>::KEY_SIZE];
+        unsigned char nonce[13];
+        unsigned char message[MESSAGE_SIZE];
+        unsigned char result[MESSAGE_SIZE];
+        unsigned char tag[16];
+        for(unsigned int i = 0; i < sizeof(key); i++)
+            key[i] = Random::random();
+        for(unsigned int i = 0; i < sizeof(nonce); i++)
+            nonce[i] = Random::random();
+        for(unsigned int i = 0; i < sizeof(message); i++)
+            message[i] = Random::random();
+
+        Chronometer chrono;
+
+        // What every secured message paid so far: the key is expanded for each block
+        chrono.start();
+        for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++)
+            for(unsigned int j = 0; j < MESSAGE_SIZE; j += AES<16>::BLOCK_SIZE)
+                cipher.encrypt(&message[j], key, &result[j]);
+        chrono.stop();
+        report("ECB, key expanded per block", MESSAGE_SIZE, chrono.read());
+
+        AES<16>::Key_Schedule schedule(key);
+
+        chrono.reset();
+        chrono.start();
+        for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++)
+            for(unsigned int j = 0; j < MESSAGE_SIZE; j += AES<16>::BLOCK_SIZE)
+                cipher.encrypt(&message[j], schedule, &result[j]);
+        chrono.stop();
+        report("ECB, expanded key", MESSAGE_SIZE, chrono.read());
+
+        unsigned char counter[AES<16>::BLOCK_SIZE];
+        memset(counter, 0, sizeof(counter));
+        chrono.reset();
+        chrono.start();
+        for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+            counter[0] = i;
+            cipher.ctr(message, MESSAGE_SIZE, schedule, counter, result);
+        }
+        chrono.stop();
+        report("CTR, expanded key", MESSAGE_SIZE, chrono.read());
+
+        chrono.reset();
+        chrono.start();
+        for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+            nonce[0] = i;
+            cipher.ccm_encrypt(message, MESSAGE_SIZE, schedule, nonce, sizeof(nonce), key, sizeof(key), result, tag, 8);
+        }
+        chrono.stop();
+        report("CCM (16-byte AAD, 8-byte tag), expanded key", MESSAGE_SIZE, chrono.read());
+
+        // TSTP::Security's MAC: a Poly1305-AES per message (as before) vs one per peer (as now)
+        chrono.reset();
+        chrono.start();
+        for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+            Poly1305<AES<16>> poly(key, nonce);
+            poly.stamp(tag, counter, message, MESSAGE_SIZE);
+        }
+        chrono.stop();
+        report("Poly1305-AES, key expanded per message", MESSAGE_SIZE, chrono.read());
+
+        Poly1305<AES<16>> poly(key, nonce);
+        chrono.reset();
+        chrono.start();
+        for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++)
+            poly.stamp(tag, counter, message, MESSAGE_SIZE);
+        chrono.stop();
+        report("Poly1305-AES, expanded key", MESSAGE_SIZE, chrono.read());
+    }
+
     cout << endl;
     cout << "Tests finished with " << tests_failed << " error" << (tests_failed > 1 ? "s" : "") << " detected." << endl;
     cout << endl;
@@ -0,0 +1,74 @@
+// EPOS Deferred Interrupt Handling Test Program
+
+#include <machine/ic.h>
+#include <machine/rtc.h>
+#include <time.h>
+#include <process.h>
+
+using namespace EPOS;
+
+const unsigned int RTC_IRQ = 8;
+const unsigned int RATE = 13; // RTC periodic interrupt at 32768 >> (RATE - 1) = 8 Hz
+const unsigned int TEST_DURATION = 2; // s
+
+OStream cout;
+
+volatile unsigned int handled;
+volatile unsigned int in_interrupt_context; // runs with interrupts disabled, as an ISR would
+Thread * volatile handler_thread;
+
+unsigned char rtc_read(unsigned char reg)
+{
+    CPU::out8(MC146818::ADDR, reg);
+    return CPU::in8(MC146818::DATA);
+}
+
+void rtc_write(unsigned char reg, unsigned char value)
+{
+    CPU::out8(MC146818::ADDR, reg);
+    CPU::out8(MC146818::DATA, value);
+}
+
+void rtc_handler(const IC::Interrupt_Id & i)
+{
+    rtc_read(MC146818::REG_C); // acknowledges the interrupt, so the RTC can raise the next one
+
+    if(CPU::int_disabled())
+        in_interrupt_context++;
+    handler_thread = Thread::self();
+    handled++;
+}
+
+int main()
+{
+    cout << "Deferred Interrupt Handling Test" << endl;
+
+    IC::Interrupt_Id i = IC::irq2int(RTC_IRQ);
+    IC::int_vector(i, &rtc_handler);
+    if(!IC::defer(i, Thread::HIGH)) {
+        cout << "IC::defer() failed!" << endl;
+        return -1;
+    }
+
+    bool e = CPU::int_enabled();
+    CPU::int_disable();
+    rtc_write(MC146818::REG_A, (rtc_read(MC146818::REG_A) & ~MC146818::INT_FREQ_MASK) | RATE);
+    rtc_write(MC146818::REG_B, rtc_read(MC146818::REG_B) | MC146818::INT_FREQ);
+    rtc_read(MC146818::REG_C);
+    if(e)
+        CPU::int_enable();
+    IC::enable(i);
+
+    Alarm::delay(TEST_DURATION * 1000000);
+
+    IC::disable(i);
+    rtc_write(MC146818::REG_B, rtc_read(MC146818::REG_B) & ~MC146818::INT_FREQ);
+
+    cout << "The RTC handler ran " << handled << " times in " << TEST_DURATION << " s (about "
+         << TEST_DURATION * (32768 >> (RATE - 1)) << " expected), " << in_interrupt_context << " of them in interrupt context" << endl;
+    cout << "It ran on " << ((handler_thread && (handler_thread != Thread::self())) ? "a bottom-half thread" : "the wrong context") << endl;
+
+    cout << "Done!" << endl;
+
+    return 0;
+}
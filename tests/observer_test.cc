@@ -0,0 +1,76 @@
+// EPOS Observer Utility Test Program (port demultiplexing cost)
+
+#include <utility/observer.h>
+#include <time.h>
+
+using namespace EPOS;
+
+typedef unsigned short Port_Number;
+typedef int Data;
+
+const unsigned int MAX_PORTS = 512;
+const unsigned int ITERATIONS = 10000;
+
+class Port_Observer: public Data_Observer<Data, Port_Number>
+{
+public:
+    Port_Observer(): _count(0) {}
+
+    void update(Data_Observed<Data, Port_Number> * o, const Port_Number & p, Data * d) { _count++; }
+
+    unsigned int count() const { return _count; }
+
+private:
+    unsigned int _count;
+};
+
+OStream cout;
+
+Port_Observer observers[MAX_PORTS];
+Data_Observed<Data, Port_Number> linear;
+Hashed_Data_Observed<Data, Port_Number> hashed;
+
+unsigned int dispatch(Data_Observed<Data, Port_Number> * observed, unsigned int ports);
+
+int main()
+{
+    cout << "Observer Utility Test" << endl;
+
+    cout << "\nDispatch cost (ns per notify(), ports chosen round-robin among the bound ones):" << endl;
+    for(unsigned int ports = 1; ports <= MAX_PORTS; ports *= 8) {
+        for(unsigned int i = 0; i < ports; i++)
+            linear.attach(&observers[i], 1024 + i);
+        unsigned int l = dispatch(&linear, ports);
+        for(unsigned int i = 0; i < ports; i++) {
+            linear.detach(&observers[i], 1024 + i);
+            hashed.attach(&observers[i], 1024 + i);
+        }
+        unsigned int h = dispatch(&hashed, ports);
+        for(unsigned int i = 0; i < ports; i++)
+            hashed.detach(&observers[i], 1024 + i);
+
+        cout << "  ports=" << ports << "\tlinear=" << l << "\thashed=" << h << endl;
+    }
+
+    unsigned int total = 0;
+    for(unsigned int i = 0; i < MAX_PORTS; i++)
+        total += observers[i].count();
+    cout << "\nTotal notifications delivered: " << total << " (expected " << 2 * 4 * ITERATIONS << ")" << endl;
+
+    cout << "\nDone!" << endl;
+
+    return 0;
+}
+
+unsigned int dispatch(Data_Observed<Data, Port_Number> * observed, unsigned int ports)
+{
+    Data d = 0;
+    Chronometer chrono;
+
+    chrono.start();
+    for(unsigned int i = 0; i < ITERATIONS; i++)
+        observed->notify(1024 + (i % ports), &d);
+    chrono.stop();
+
+    return chrono.read() * 1000 / ITERATIONS;
+}
@@ -0,0 +1,146 @@
+// EPOS IP Router Test Program (longest prefix match correctness and lookup throughput)
+
+#include <time.h>
+#include <utility/random.h>
+#include <network/ipv4/ip.h>
+
+using namespace EPOS;
+
+const unsigned int MAX_ROUTES = 1000;
+const unsigned int LOOKUPS = 10000;
+
+OStream cout;
+
+typedef IP::Address Address;
+
+// Flat copy of the table, searched linearly as IP::Router::search() used to do (though picking the longest prefix)
+struct Entry
+{
+    unsigned int destination;
+    unsigned int mask;
+    unsigned int metric;
+    bool valid;
+};
+
+Entry table[MAX_ROUTES];
+unsigned int destinations[LOOKUPS];
+
+unsigned int random() { return static_cast<unsigned int>(Random::random()); }
+
+unsigned int mask(unsigned int length) { return length ? ~0U << (32 - length) : 0; }
+
+// Routes are told apart by their gateways, which hold their index in the table
+Address gateway(unsigned int index) { return Address(static_cast<unsigned long>(index + 1)); }
+
+int reference(unsigned int to, unsigned int routes)
+{
+    int best = -1;
+    for(unsigned int i = 0; i < routes; i++)
+        if(table[i].valid && ((to & table[i].mask) == table[i].destination))
+            if((best < 0) || (table[i].mask > table[best].mask) || ((table[i].mask == table[best].mask) && (table[i].metric < table[best].metric)))
+                best = i;
+    return best;
+}
+
+unsigned int check(IP::Router * router, unsigned int routes)
+{
+    unsigned int errors = 0;
+    for(unsigned int i = 0; i < LOOKUPS; i++) {
+        int expected = reference(destinations[i], routes);
+        IP::Route * route = router->search(Address(static_cast<unsigned long>(destinations[i])));
+        if(expected < 0 ? (route != 0) : (!route || (route->gateway() != gateway(expected))))
+            errors++;
+    }
+    return errors;
+}
+
+void report(const char * what, const Chronometer::Microsecond & time)
+{
+    cout << "    " << what << ": " << time << " us => " << static_cast<unsigned long long>(LOOKUPS) * 1000000 / (time ? time : 1) << " lookups/s" << endl;
+}
+
+unsigned int test(unsigned int routes)
+{
+    cout << "\n  " << routes << " routes:" << endl;
+
+    IP::Router * router = new IP::Router;
+
+    // A default route plus random prefixes from /8 to /30, some of them repeated with other metrics
+    table[0].destination = 0;
+    table[0].mask = 0;
+    table[0].metric = 0;
+    table[0].valid = true;
+    for(unsigned int i = 1; i < routes; i++) {
+        if((i > 1) && !(random() % 8))
+            table[i] = table[random() % i];
+        else {
+            unsigned int length = 8 + random() % 23;
+            table[i].mask = mask(length);
+            table[i].destination = random() & table[i].mask;
+        }
+        table[i].metric = random() % 4;
+        table[i].valid = true;
+    }
+    for(unsigned int i = 0; i < routes; i++)
+        router->insert(0, 0, 0, Address(static_cast<unsigned long>(table[i].destination)), gateway(i), Address(static_cast<unsigned long>(table[i].mask)), 0, table[i].metric);
+
+    // Half of the destinations fall within known prefixes, the other half are random
+    for(unsigned int i = 0; i < LOOKUPS; i++) {
+        Entry & e = table[random() % routes];
+        destinations[i] = (i & 1) ? random() : e.destination | (random() & ~e.mask);
+    }
+
+    unsigned int errors = check(router, routes);
+
+    // Remove a third of the routes, picking them the same way in both tables
+    for(unsigned int i = 0; i < routes / 3; i++) {
+        unsigned int to = table[random() % routes].destination;
+        int best = reference(to, routes);
+        if(best >= 0)
+            table[best].valid = false;
+        router->remove(Address(static_cast<unsigned long>(to)));
+    }
+    errors += check(router, routes);
+
+    cout << "    " << router->routes() << " routes left, " << errors << " errors" << endl;
+
+    Chronometer chrono;
+    volatile long sink = 0;
+
+    chrono.start();
+    for(unsigned int i = 0; i < LOOKUPS; i++)
+        sink = reference(destinations[i], routes);
+    chrono.stop();
+    report("linear scan", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < LOOKUPS; i++)
+        sink = reinterpret_cast<long>(router->search(Address(static_cast<unsigned long>(destinations[i]))));
+    chrono.stop();
+    report("trie (mostly cache misses)", chrono.read());
+
+    chrono.reset();
+    chrono.start();
+    for(unsigned int i = 0; i < LOOKUPS; i++)
+        sink = reinterpret_cast<long>(router->search(Address(static_cast<unsigned long>(destinations[i % 4]))));
+    chrono.stop();
+    report("trie (cache hits)", chrono.read());
+    cout << "    (last lookup=" << hex << sink << dec << ")" << endl;
+
+    return errors;
+}
+
+int main()
+{
+    cout << "IP Router Test" << endl;
+
+    Random::seed(1);
+
+    unsigned int errors = test(10) + test(100) + test(1000);
+
+    cout << "\n" << errors << " errors" << endl;
+    cout << "Done!" << endl;
+
+    return 0;
+}
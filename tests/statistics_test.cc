@@ -0,0 +1,55 @@
+// EPOS Streaming Statistics Utility Test Program
+
+#include <utility/ostream.h>
+#include <utility/statistics.h>
+
+using namespace EPOS;
+
+const unsigned int SAMPLES = 100000;
+
+OStream cout;
+
+// Deterministic, roughly uniform samples in [1000, 2000), with a spike every 1000 samples
+unsigned int seed = 1;
+unsigned int sample(unsigned int i)
+{
+    seed = seed * 1103515245 + 12345;
+    return (i % 1000) ? 1000 + (seed >> 16) % 1000 : 100000;
+}
+
+int main()
+{
+    cout << "Streaming Statistics Utility Test" << endl;
+
+    Statistics<unsigned int> statistics;
+    Histogram<unsigned int> histogram;
+    unsigned long long sum = 0;
+
+    for(unsigned int i = 0; i < SAMPLES; i++) {
+        unsigned int v = sample(i);
+        statistics.insert(v);
+        histogram.insert(v);
+        sum += v;
+    }
+
+    cout << "Statistics of " << statistics.count() << " samples in " << sizeof(Statistics<unsigned int>) << " bytes:" << endl;
+    cout << "min=" << statistics.min() << ",max=" << statistics.max() << ",avg=" << statistics.mean() << " (" << sum / SAMPLES
+         << " from the sum),std=" << statistics.deviation() << endl;
+
+    cout << "Histogram in " << sizeof(Histogram<unsigned int>) << " bytes:" << endl;
+    cout << "p1=" << histogram.percentile(1) << ",p50=" << histogram.percentile(50) << ",p99=" << histogram.percentile(99)
+         << ",p100=" << histogram.percentile(100) << endl;
+
+    // Every value must fall in a bucket whose width is at most a quarter of it
+    unsigned int errors = 0;
+    for(unsigned int i = Histogram<unsigned int>::SUB_BUCKETS; i < Histogram<unsigned int>::BUCKETS - 1; i++) {
+        unsigned long long width = Histogram<unsigned int>::lower(i + 1) - Histogram<unsigned int>::lower(i);
+        if(width * Histogram<unsigned int>::SUB_BUCKETS > Histogram<unsigned int>::lower(i))
+            errors++;
+    }
+    cout << "Bucket bounds checked with " << errors << " errors" << endl;
+
+    cout << "Done!" << endl;
+
+    return 0;
+}
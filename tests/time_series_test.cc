@@ -0,0 +1,92 @@
+// EPOS Compressed Time Series Utility Test Program
+
+#include <utility/time_series.h>
+
+using namespace EPOS;
+
+typedef unsigned long long Time_Stamp;
+
+const unsigned int BLOCKS = 16;
+const unsigned int SAMPLES = 2000;
+const Time_Stamp PERIOD = 500000; // us
+const Time_Stamp WINDOW = 60 * 1000000; // us
+
+OStream cout;
+
+// Periodic sampling, with some jitter
+Time_Stamp jitter(unsigned int i) { return (i % 7) ? 0 : 37; }
+
+template<typename Value>
+void test(const char * name, Value (* sample)(unsigned int))
+{
+    typedef Time_Series<Time_Stamp, Value> Series;
+
+    cout << "\nThis is a time series of " << name << " in " << BLOCKS << " blocks:" << endl;
+
+    unsigned int bytes = Series::footprint(BLOCKS);
+    char * pool = new char[bytes];
+    Series series(pool, bytes);
+
+    Time_Stamp t = 0;
+    for(unsigned int i = 0; i < SAMPLES; i++) {
+        t += PERIOD + jitter(i);
+        series.insert(t, sample(i));
+    }
+
+    unsigned int first = SAMPLES - series.size();
+    unsigned int raw = series.size() * (sizeof(Time_Stamp) + sizeof(Value));
+    cout << "Kept the last " << series.size() << " samples in " << series.bytes() << " bytes (" << raw << " bytes raw, "
+         << raw / series.bytes() << "x smaller)" << endl;
+
+    // Replay the samples kept and compare them with the ones inserted
+    t = 0;
+    for(unsigned int i = 0; i < first; i++)
+        t += PERIOD + jitter(i);
+    Time_Stamp st;
+    Value sv;
+    unsigned int i = first, errors = 0;
+    typename Series::Query all(&series, series.first(), series.last());
+    for(; all.next(&st, &sv); i++) {
+        t += PERIOD + jitter(i);
+        if((st != t) || (sv != sample(i)))
+            errors++;
+    }
+    cout << "Read back " << i - first << " samples with " << errors << " errors" << endl;
+
+    // Range query over the last 50 samples
+    unsigned int n = 0;
+    typename Series::Query range(&series, series.last() - 49 * PERIOD - 50, series.last());
+    while(range.next(&st, &sv))
+        n++;
+    cout << "The last " << 49 * PERIOD / 1000000.0f << " s hold " << n << " samples" << endl;
+
+    // Downsampling to one-minute windows
+    typename Series::Summary summaries[8];
+    n = series.downsample(series.first(), series.last(), WINDOW, summaries, 8);
+    for(unsigned int j = 0; j < n; j++)
+        cout << "Window " << j << ": [" << summaries[j].t0 << "," << summaries[j].t1 << "] n=" << summaries[j].count
+             << " min=" << summaries[j].min << " max=" << summaries[j].max << " avg=" << summaries[j].avg << endl;
+
+    typename Series::Summary summary = series.summary(series.first(), series.last());
+    cout << "Overall: n=" << summary.count << " min=" << summary.min << " max=" << summary.max << " avg=" << summary.avg << endl;
+
+    delete [] pool;
+}
+
+// Temperature-like readings: slow drift at 0.1 degree resolution
+float temperatures(unsigned int i) { unsigned int step = (i / 5) % 40; return 20 + ((step < 20) ? step : 40 - step) / 10.0f; }
+long counters(unsigned int i) { return 1000 + (i / 10) % 5; }
+double ramps(unsigned int i) { return i * 0.25; }
+
+int main()
+{
+    cout << "Time Series Utility Test" << endl;
+
+    test<float>("temperatures", &temperatures);
+    test<long>("counters", &counters);
+    test<double>("ramps", &ramps);
+
+    cout << "\nDone!" << endl;
+
+    return 0;
+}